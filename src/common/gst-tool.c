@@ -59,6 +59,13 @@ static void  gst_tool_set_property (GObject      *object,
 
 static void gst_tool_impl_close    (GstTool *tool);
 
+static gboolean configuration_object_committed (GSignalInvocationHint *hint,
+						guint                  n_param_values,
+						const GValue          *param_values,
+						gpointer               data);
+static void     configuration_object_finalized (gpointer               data,
+						GObject               *object);
+
 enum {
 	PROP_0,
 	PROP_NAME,
@@ -171,6 +178,13 @@ gst_tool_init (GstTool *tool)
 		g_object_unref (pixbuf);
 
 	tool->objects = g_ptr_array_new ();
+	tool->registered_objects = g_hash_table_new (g_direct_hash, g_direct_equal);
+	tool->registered_children = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	/* signals are looked up on the class, make sure it exists */
+	g_type_class_unref (g_type_class_ref (OOBS_TYPE_OBJECT));
+	tool->committed_hook_id = g_signal_add_emission_hook (g_signal_lookup ("committed", OOBS_TYPE_OBJECT), 0,
+							      configuration_object_committed, tool, NULL);
 
 	g_object_unref (builder);
 }
@@ -285,6 +299,8 @@ static void
 gst_tool_finalize (GObject *object)
 {
 	GstTool *tool = GST_TOOL (object);
+	GHashTableIter iter;
+	gpointer registered;
 
 	g_free (tool->name);
 	g_free (tool->title);
@@ -300,6 +316,16 @@ gst_tool_finalize (GObject *object)
 	if (tool->report_window)
 		gtk_widget_destroy (tool->report_window);
 
+	g_signal_remove_emission_hook (g_signal_lookup ("committed", OOBS_TYPE_OBJECT),
+				       tool->committed_hook_id);
+
+	g_hash_table_iter_init (&iter, tool->registered_objects);
+
+	while (g_hash_table_iter_next (&iter, &registered, NULL))
+		g_object_weak_unref (G_OBJECT (registered), configuration_object_finalized, tool);
+
+	g_hash_table_destroy (tool->registered_objects);
+	g_hash_table_destroy (tool->registered_children);
 	g_ptr_array_free (tool->objects, FALSE);
 
 	(* G_OBJECT_CLASS (gst_tool_parent_class)->finalize) (object);
@@ -351,6 +377,18 @@ gst_tool_close (GstTool *tool)
 
 void
 gst_init_tool (const gchar *app_name, int argc, char *argv [], GOptionEntry *entries)
+{
+	gst_init_tool_options (app_name, &argc, &argv, entries);
+	gtk_init (&argc, &argv);
+}
+
+/*
+ * Like gst_init_tool(), but without opening the display, for options
+ * that don't need any window. gtk_init() must be called afterwards
+ * before creating the tool.
+ */
+void
+gst_init_tool_options (const gchar *app_name, int *argc, char **argv [], GOptionEntry *entries)
 {
 	GOptionContext *context;
 
@@ -361,12 +399,10 @@ gst_init_tool (const gchar *app_name, int argc, char *argv [], GOptionEntry *ent
 	if (entries) {
 		context = g_option_context_new (NULL);
 		g_option_context_add_main_entries (context, entries, GETTEXT_PACKAGE);
-		g_option_context_add_group (context, gtk_get_option_group (TRUE));
-		g_option_context_parse (context, &argc, &argv, NULL);
+		g_option_context_add_group (context, gtk_get_option_group (FALSE));
+		g_option_context_parse (context, argc, argv, NULL);
 		g_option_context_free (context);
 	}
-
-	gtk_init (&argc, &argv);
 }
 
 void
@@ -650,13 +686,56 @@ configuration_object_changed (OobsObject *object,
 	}
 }
 
+/*
+ * Single emission hook for ::committed on all OobsObjects, so that
+ * registered objects don't need a handler each.
+ */
+static gboolean
+configuration_object_committed (GSignalInvocationHint *hint,
+				guint                  n_param_values,
+				const GValue          *param_values,
+				gpointer               data)
+{
+	GstTool *tool = GST_TOOL (data);
+	GHashTableIter iter;
+	GObject *object;
+	gpointer type, config;
+
+	object = g_value_get_object (&param_values[0]);
+
+	if (g_hash_table_lookup (tool->registered_objects, object)) {
+		tool->last_commit_time = time (NULL);
+		return TRUE;
+	}
+
+	/* children of a registered configuration, see gst_tool_add_configuration_children() */
+	g_hash_table_iter_init (&iter, tool->registered_children);
+
+	while (g_hash_table_iter_next (&iter, &type, &config)) {
+		if (G_TYPE_CHECK_INSTANCE_TYPE (object, GPOINTER_TO_SIZE (type))
+		    && g_hash_table_lookup (tool->registered_objects, config)) {
+			tool->last_commit_time = time (NULL);
+			break;
+		}
+	}
+
+	return TRUE;
+}
+
 static void
-configuration_object_committed (OobsObject *object,
-				GstTool    *tool)
+configuration_object_finalized (gpointer  data,
+				GObject  *object)
 {
-	tool->last_commit_time = time (NULL);
+	GstTool *tool = GST_TOOL (data);
+
+	g_hash_table_remove (tool->registered_objects, object);
 }
 
+/*
+ * Register @object so that its commits are known to come from the tool,
+ * registering an object several times has no effect. Objects are dropped
+ * from the registry when finalized or with gst_tool_remove_configuration_object().
+ */
 void
 gst_tool_add_configuration_object (GstTool    *tool,
                                    OobsObject *object,
@@ -665,8 +744,11 @@ gst_tool_add_configuration_object (GstTool    *tool,
 	g_return_if_fail (GST_IS_TOOL (tool));
 	g_return_if_fail (OOBS_IS_OBJECT (object));
 
-	g_signal_connect (object, "committed",
-			  G_CALLBACK (configuration_object_committed), tool);
+	if (g_hash_table_lookup (tool->registered_objects, object))
+		return;
+
+	g_hash_table_insert (tool->registered_objects, object, GINT_TO_POINTER (watch_updates + 1));
+	g_object_weak_ref (G_OBJECT (object), configuration_object_finalized, tool);
 
 	/* For child objects like OobsUser or OobsService, we don't want
 	 * to get updates directly: instead, we update OobsUsersConfig and OobsServicesConfig,
@@ -680,6 +762,47 @@ gst_tool_add_configuration_object (GstTool    *tool,
 	}
 }
 
+void
+gst_tool_remove_configuration_object (GstTool    *tool,
+                                      OobsObject *object)
+{
+	gboolean watch_updates;
+	gpointer value;
+
+	g_return_if_fail (GST_IS_TOOL (tool));
+	g_return_if_fail (OOBS_IS_OBJECT (object));
+
+	value = g_hash_table_lookup (tool->registered_objects, object);
+
+	if (!value)
+		return;
+
+	watch_updates = GPOINTER_TO_INT (value) - 1;
+	g_hash_table_remove (tool->registered_objects, object);
+	g_object_weak_unref (G_OBJECT (object), configuration_object_finalized, tool);
+
+	if (watch_updates) {
+		g_ptr_array_remove (tool->objects, object);
+		g_signal_handlers_disconnect_by_func (object, configuration_object_changed, tool);
+	}
+}
+
+/*
+ * Count commits of any object of @child_type as coming from the tool while
+ * @config is registered, so that configurations holding many objects, like
+ * users, don't need to register each of them.
+ */
+void
+gst_tool_add_configuration_children (GstTool    *tool,
+                                     OobsObject *config,
+                                     GType       child_type)
+{
+	g_return_if_fail (GST_IS_TOOL (tool));
+	g_return_if_fail (OOBS_IS_OBJECT (config));
+
+	g_hash_table_insert (tool->registered_children, GSIZE_TO_POINTER (child_type), config);
+}
+
 /*
  * Wrapper around oobs_object_authenticate() to show an error dialog if needed.
  */
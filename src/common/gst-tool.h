@@ -52,6 +52,11 @@ struct _GstTool {
 	OobsSession *session;
 	GPtrArray   *objects;
 
+	/* objects whose commits come from the tool, see gst_tool_add_configuration_object() */
+	GHashTable  *registered_objects;
+	GHashTable  *registered_children;   /* child GType -> configuration object */
+	gulong       committed_hook_id;
+
 	char *ui_path;
 	char *common_ui_path;
 
@@ -91,6 +96,10 @@ void         gst_init_tool                (const char   *app_name,
                                            int           argc,
                                            char         *argv [],
                                            GOptionEntry *entries);
+void         gst_init_tool_options        (const char   *app_name,
+                                           int          *argc,
+                                           char        **argv [],
+                                           GOptionEntry *entries);
 
 void         gst_tool_update_gui          (GstTool *tool);
 void         gst_tool_update_config       (GstTool *tool);
@@ -118,6 +127,11 @@ void         gst_tool_update_async    (GstTool             *tool);
 void         gst_tool_add_configuration_object (GstTool    *tool,
                                                 OobsObject *object,
                                                 gboolean    watch_updates);
+void         gst_tool_remove_configuration_object (GstTool    *tool,
+                                                   OobsObject *object);
+void         gst_tool_add_configuration_children  (GstTool    *tool,
+                                                   OobsObject *config,
+                                                   GType       child_type);
 
 gboolean     gst_tool_authenticate    (GstTool *tool,
 				       OobsObject *object);
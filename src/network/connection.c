@@ -261,38 +261,83 @@ ethernet_dialog_check_fields (GstConnectionDialog *dialog)
   return ret;
 }
 
-#ifdef HAVE_LIBIW_H
+#ifdef HAVE_ESSID_LIST
+static gboolean
+find_essid_row (GtkTreeModel *model,
+		const gchar  *essid,
+		GtkTreeIter  *iter)
+{
+  gboolean valid, found = FALSE;
+  gchar *str;
+
+  valid = gtk_tree_model_get_iter_first (model, iter);
+
+  while (valid && !found)
+    {
+      gtk_tree_model_get (model, iter, 1, &str, -1);
+      found = (str && strcmp (str, essid) == 0);
+      g_free (str);
+
+      if (!found)
+	valid = gtk_tree_model_iter_next (model, iter);
+    }
+
+  return found;
+}
+
+static void
+set_essid_row (GtkListStore      *store,
+	       GtkTreeIter       *iter,
+	       GstEssidListEntry *entry,
+	       GdkPixbuf         *locked,
+	       GdkPixbuf         *unlocked)
+{
+  gtk_list_store_set (store, iter,
+		      0, (entry->encrypted) ? locked : unlocked,
+		      1, entry->essid,
+		      2, (gint) (entry->quality * 100),
+		      -1);
+}
+
 /* perhaps there should be a GstEssidListModel class to hide this
  * stuff, but I'll leave that as a code beautification exercise */
 static void
 on_essid_list_changed (GstEssidList        *list,
+		       GstEssidListChanges *changes,
 		       GstConnectionDialog *dialog)
 {
   GList *elem;
   GstEssidListEntry *entry;
   GtkTreeModel *model;
   GtkTreeIter iter;
-  GdkPixbuf *locked, *unlocked, *pixbuf;
+  GdkPixbuf *locked, *unlocked;
 
-  elem = gst_essid_list_get_list (dialog->essid_list);
   model = gtk_combo_box_get_model (GTK_COMBO_BOX (dialog->essid));
-  gtk_list_store_clear (GTK_LIST_STORE (model));
 
   locked = gtk_icon_theme_load_icon (tool->icon_theme, "gnome-dev-wavelan-encrypted", 16, 0, NULL);
   unlocked = gtk_icon_theme_load_icon (tool->icon_theme, "gnome-dev-wavelan", 16, 0, NULL);
 
-  while (elem)
+  /* only touch the rows that changed, so the popup doesn't jump around */
+  for (elem = changes->removed; elem; elem = elem->next)
+    {
+      entry = elem->data;
+
+      if (find_essid_row (model, entry->essid, &iter))
+	gtk_list_store_remove (GTK_LIST_STORE (model), &iter);
+    }
+
+  for (elem = changes->updated; elem; elem = elem->next)
     {
       entry = elem->data;
-      pixbuf = (entry->encrypted) ? locked : unlocked;
 
+      if (find_essid_row (model, entry->essid, &iter))
+	set_essid_row (GTK_LIST_STORE (model), &iter, entry, locked, unlocked);
+    }
+
+  for (elem = changes->added; elem; elem = elem->next)
+    {
       gtk_list_store_append (GTK_LIST_STORE (model), &iter);
-      gtk_list_store_set (GTK_LIST_STORE (model), &iter,
-			  0, pixbuf,
-			  1, entry->essid,
-			  2, (gint) (entry->quality * 100),
-			  -1);
-      elem = elem->next;
+      set_essid_row (GTK_LIST_STORE (model), &iter, elem->data, locked, unlocked);
     }
 
   if (locked)
@@ -307,6 +352,9 @@ static void
 wireless_dialog_prepare (GstConnectionDialog *dialog)
 {
   gchar *essid, *key, *dev, *key_type;
+#ifdef HAVE_ESSID_LIST
+  GstEssidListChanges changes;
+#endif
 
   g_object_get (G_OBJECT (dialog->iface),
 		"device", &dev,
@@ -319,9 +367,14 @@ wireless_dialog_prepare (GstConnectionDialog *dialog)
   gtk_entry_set_text (GTK_ENTRY (gtk_bin_get_child (GTK_BIN (dialog->essid))), (essid) ? essid : "");
   gtk_entry_set_text (GTK_ENTRY (dialog->wep_key), (key) ? key : "");
 
-#ifdef HAVE_LIBIW_H
+#ifdef HAVE_ESSID_LIST
   dialog->essid_list = gst_essid_list_new (dev);
-  on_essid_list_changed (dialog->essid_list, dialog);
+
+  /* start from an empty list, adding everything found so far */
+  changes.added = gst_essid_list_get_list (dialog->essid_list);
+  changes.removed = changes.updated = NULL;
+  gtk_list_store_clear (GTK_LIST_STORE (gtk_combo_box_get_model (GTK_COMBO_BOX (dialog->essid))));
+  on_essid_list_changed (dialog->essid_list, &changes, dialog);
   g_signal_connect (G_OBJECT (dialog->essid_list), "changed",
 		    G_CALLBACK (on_essid_list_changed), dialog);
 #endif
@@ -916,7 +969,7 @@ connection_dialog_hide (GstConnectionDialog *dialog)
 {
   gtk_widget_hide (dialog->dialog);
 
-#ifdef HAVE_LIBIW_H
+#ifdef HAVE_ESSID_LIST
   /* get rid of the essid list, if any */
   if (dialog->essid_list)
     {
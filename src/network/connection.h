@@ -42,7 +42,7 @@ struct _GstConnectionDialog {
   GtkWidget *connection_configured;
   GtkWidget *roaming_configured;
 
-#ifdef HAVE_LIBIW_H
+#ifdef HAVE_ESSID_LIST
   GstEssidList *essid_list;
 #endif
 
@@ -18,24 +18,56 @@
  * Authors: Carlos Garnacho Parro  <carlosg@gnome.org>
  */
 
+#include <config.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <net/if.h>
 #include <glib.h>
 #include <glib-object.h>
-#include <iwlib.h>
 #include "essid-list.h"
 
+#ifdef HAVE_LIBIW_H
+#include <iwlib.h>
+#endif
+
+#ifdef HAVE_NL80211
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <linux/nl80211.h>
+#endif
+
 #define RESCAN_TIMEOUT 2000
 
+/* rows are only updated when the quality changes by a whole percent */
+#define QUALITY_PERCENT(q) ((gint) ((q) * 100))
+
 typedef struct _GstEssidListPrivate GstEssidListPrivate;
 
 struct _GstEssidListPrivate {
   gchar *interface;
-  GList *list;
-  gint fd;
+
+  GList *list;			/* one GstEssidListEntry per ESSID */
+  GHashTable *entries;		/* ESSID -> entry in list */
 
   guint timeout;
 
+#ifdef HAVE_LIBIW_H
+  /* wireless extensions polling */
+  gint fd;
   guint8 *buffer;
   gint buflen;
+#endif
+
+#ifdef HAVE_NL80211
+  gint nl_fd;
+  gint nl_events_fd;
+  guint nl_watch;
+  guint16 family;
+  guint32 ifindex;
+  guint32 seq;
+#endif
 };
 
 #define GST_ESSID_LIST_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), GST_TYPE_ESSID_LIST, GstEssidListPrivate))
@@ -56,7 +88,6 @@ static void gst_essid_list_set_property (GObject         *object,
 					 guint            prop_id,
 					 const GValue    *value,
 					 GParamSpec      *pspec);
-static void schedule_query_essids       (GstEssidList *list);
 
 enum {
   PROP_0,
@@ -96,13 +127,14 @@ gst_essid_list_class_init (GstEssidListClass *class)
 		  G_SIGNAL_RUN_LAST,
 		  G_STRUCT_OFFSET (GstEssidListClass, changed),
 		  NULL, NULL,
-		  g_cclosure_marshal_VOID__VOID,
-		  G_TYPE_NONE, 0);
+		  g_cclosure_marshal_VOID__POINTER,
+		  G_TYPE_NONE, 1, G_TYPE_POINTER);
 
   g_type_class_add_private (object_class,
 			    sizeof (GstEssidListPrivate));
 }
 
+#ifdef HAVE_LIBIW_H
 static void
 allocate_buffer (GstEssidList *list,
 		 gint          size)
@@ -117,6 +149,7 @@ allocate_buffer (GstEssidList *list,
   priv->buflen = size;
   priv->buffer = g_malloc0 (size);
 }
+#endif
 
 static void
 gst_essid_list_init (GstEssidList *list)
@@ -124,9 +157,16 @@ gst_essid_list_init (GstEssidList *list)
   GstEssidListPrivate *priv;
 
   priv = GST_ESSID_LIST_GET_PRIVATE (list);
-  priv->fd = iw_sockets_open ();
+  priv->entries = g_hash_table_new (g_str_hash, g_str_equal);
 
-  allocate_buffer (list, IW_SCAN_MAX_DATA);
+#ifdef HAVE_LIBIW_H
+  priv->fd = -1;
+#endif
+
+#ifdef HAVE_NL80211
+  priv->nl_fd = -1;
+  priv->nl_events_fd = -1;
+#endif
 }
 
 static void
@@ -136,6 +176,17 @@ free_essid_entry (GstEssidListEntry *entry)
   g_free (entry);
 }
 
+static void
+free_scan_results (GList *results)
+{
+  g_list_foreach (results, (GFunc) free_essid_entry, NULL);
+  g_list_free (results);
+}
+
+#ifdef HAVE_NL80211
+static void close_nl80211 (GstEssidList *list);
+#endif
+
 static void
 gst_essid_list_finalize (GObject *object)
 {
@@ -143,11 +194,8 @@ gst_essid_list_finalize (GObject *object)
 
   priv = GST_ESSID_LIST_GET_PRIVATE (object);
 
-  if (priv->list)
-    {
-      g_list_foreach (priv->list, (GFunc) free_essid_entry, NULL);
-      g_list_free (priv->list);
-    }
+  free_scan_results (priv->list);
+  g_hash_table_destroy (priv->entries);
 
   if (priv->timeout)
     {
@@ -155,15 +203,108 @@ gst_essid_list_finalize (GObject *object)
       priv->timeout = 0;
     }
 
+#ifdef HAVE_LIBIW_H
   if (priv->fd >= 0)
     close (priv->fd);
 
-  g_free (priv->interface);
   g_free (priv->buffer);
+#endif
+
+#ifdef HAVE_NL80211
+  close_nl80211 (GST_ESSID_LIST (object));
+#endif
+
+  g_free (priv->interface);
 
   (* G_OBJECT_CLASS (gst_essid_list_parent_class)->finalize) (object);
 }
 
+/* Folds a scan into the list, keeping the strongest BSS of every
+ * ESSID, and tells listeners only about the entries that changed */
+static void
+merge_scan_results (GstEssidList *list,
+		    GList        *results)
+{
+  GstEssidListPrivate *priv;
+  GstEssidListChanges changes = { NULL, NULL, NULL };
+  GstEssidListEntry *entry, *result;
+  GHashTable *best;
+  GList *elem, *next;
+
+  priv = GST_ESSID_LIST_GET_PRIVATE (list);
+  best = g_hash_table_new (g_str_hash, g_str_equal);
+
+  for (elem = results; elem; elem = elem->next)
+    {
+      result = elem->data;
+
+      if (!result->essid)
+	continue;
+
+      entry = g_hash_table_lookup (best, result->essid);
+
+      if (!entry || result->quality > entry->quality)
+	g_hash_table_insert (best, result->essid, result);
+    }
+
+  for (elem = priv->list; elem; elem = next)
+    {
+      next = elem->next;
+      entry = elem->data;
+
+      if (!g_hash_table_lookup (best, entry->essid))
+	{
+	  g_hash_table_remove (priv->entries, entry->essid);
+	  priv->list = g_list_delete_link (priv->list, elem);
+	  changes.removed = g_list_prepend (changes.removed, entry);
+	}
+    }
+
+  /* walk the scan rather than the table, so new entries keep the scan order */
+  for (elem = results; elem; elem = elem->next)
+    {
+      result = elem->data;
+
+      if (!result->essid || g_hash_table_lookup (best, result->essid) != result)
+	continue;
+
+      entry = g_hash_table_lookup (priv->entries, result->essid);
+
+      if (!entry)
+	{
+	  entry = g_new0 (GstEssidListEntry, 1);
+	  entry->essid = g_strdup (result->essid);
+	  entry->encrypted = result->encrypted;
+	  entry->quality = result->quality;
+
+	  g_hash_table_insert (priv->entries, entry->essid, entry);
+	  changes.added = g_list_prepend (changes.added, entry);
+	}
+      else if (entry->encrypted != result->encrypted ||
+	       QUALITY_PERCENT (entry->quality) != QUALITY_PERCENT (result->quality))
+	{
+	  entry->encrypted = result->encrypted;
+	  entry->quality = result->quality;
+	  changes.updated = g_list_prepend (changes.updated, entry);
+	}
+    }
+
+  g_hash_table_destroy (best);
+  free_scan_results (results);
+
+  changes.added = g_list_reverse (changes.added);
+  priv->list = g_list_concat (priv->list, g_list_copy (changes.added));
+
+  if (changes.added || changes.removed || changes.updated)
+    g_signal_emit (list, signals[CHANGED], 0, &changes);
+
+  free_scan_results (changes.removed);
+  g_list_free (changes.added);
+  g_list_free (changes.updated);
+}
+
+#ifdef HAVE_LIBIW_H
+
 static gdouble
 normalize_quality (iwqual          qual,
 		   struct iw_range range,
@@ -239,7 +380,7 @@ get_scan_info (GstEssidList    *list,
   if (entry)
     info = g_list_prepend (info, entry);
 
-  return info;
+  return g_list_reverse (info);
 }
 
 static gboolean
@@ -256,50 +397,491 @@ query_essids (GstEssidList *list)
 
   if (iw_get_ext (priv->fd, priv->interface, SIOCGIWSCAN, &req) < 0)
     {
-      if (errno == E2BIG)
+      /* the length can't go past 16 bits, no use growing further */
+      if (errno == E2BIG && priv->buflen < G_MAXUINT16)
 	{
-	  /* double buffer size */
-	  allocate_buffer (list, priv->buflen * 2);
+	  /* newer drivers tell the size they need, otherwise double it */
+	  allocate_buffer (list, MIN (MAX (req.u.data.length, priv->buflen * 2), G_MAXUINT16));
+	  return query_essids (list);
 	}
 
-      if (errno == E2BIG ||
-	  errno == EAGAIN)
+      /* results aren't ready or the interface is down, try again later */
+      return TRUE;
+    }
+
+  merge_scan_results (list, get_scan_info (list, req));
+
+  return TRUE;
+}
+
+static void
+start_polling (GstEssidList *list)
+{
+  GstEssidListPrivate *priv;
+
+  priv = GST_ESSID_LIST_GET_PRIVATE (list);
+  priv->fd = iw_sockets_open ();
+
+  allocate_buffer (list, IW_SCAN_MAX_DATA);
+
+  query_essids (list);
+  priv->timeout = g_timeout_add (RESCAN_TIMEOUT, (GSourceFunc) query_essids, list);
+}
+
+#endif /* HAVE_LIBIW_H */
+
+#ifdef HAVE_NL80211
+
+#ifndef SOL_NETLINK
+#define SOL_NETLINK 270
+#endif
+
+/* Maps a signal strength to [0, 1], -100dBm being unusable and -50dBm perfect */
+static gdouble
+signal_to_quality (gint dbm)
+{
+  return CLAMP ((gdouble) (dbm + 100) / 50, 0.0, 1.0);
+}
+
+/* a scan dump may hold many large BSS messages */
+#define NL80211_BUFFER_SIZE 65536
+
+#define GENL_ATTRS(h)     ((struct nlattr *) ((guchar *) NLMSG_DATA (h) + GENL_HDRLEN))
+#define GENL_ATTRS_LEN(h) ((gint) (h)->nlmsg_len - (gint) NLMSG_LENGTH (GENL_HDRLEN))
+
+#define NLA_DATA(a)       ((guchar *) (a) + NLA_HDRLEN)
+#define NLA_LEN(a)        ((gint) (a)->nla_len - NLA_HDRLEN)
+#define NLA_OK(a,len)     ((len) >= (gint) NLA_HDRLEN && \
+			   (a)->nla_len >= NLA_HDRLEN && \
+			   (a)->nla_len <= (len))
+#define NLA_NEXT(a,len)   ((len) -= NLA_ALIGN ((a)->nla_len), \
+			   (struct nlattr *) ((guchar *) (a) + NLA_ALIGN ((a)->nla_len)))
+
+/* 802.11 capability bit set by networks requiring any kind of encryption */
+#define WLAN_CAPABILITY_PRIVACY (1 << 4)
+
+typedef void (*GenlFunc) (struct nlmsghdr *header,
+			  gpointer         data);
+
+typedef struct {
+  guint16 id;
+  guint32 scan_group;
+} FamilyInfo;
+
+static void
+parse_attributes (struct nlattr  *attr,
+		  gint            len,
+		  struct nlattr **table,
+		  gint            max)
+{
+  gint type;
+
+  memset (table, 0, sizeof (struct nlattr *) * (max + 1));
+
+  for (; NLA_OK (attr, len); attr = NLA_NEXT (attr, len))
+    {
+      type = attr->nla_type & NLA_TYPE_MASK;
+
+      if (type <= max)
+	table[type] = attr;
+    }
+}
+
+static gint
+open_genl_socket (void)
+{
+  struct sockaddr_nl addr;
+  gint fd;
+
+  fd = socket (AF_NETLINK, SOCK_RAW, NETLINK_GENERIC);
+
+  if (fd < 0)
+    return -1;
+
+  memset (&addr, 0, sizeof (addr));
+  addr.nl_family = AF_NETLINK;
+
+  if (bind (fd, (struct sockaddr *) &addr, sizeof (addr)) < 0)
+    {
+      close (fd);
+      return -1;
+    }
+
+  return fd;
+}
+
+/* Sends a generic netlink request carrying a single attribute */
+static gboolean
+genl_send (gint          fd,
+	   guint16       family,
+	   guint8        cmd,
+	   guint16       flags,
+	   guint32       seq,
+	   guint16       attr_type,
+	   gconstpointer attr_data,
+	   gint          attr_len)
+{
+  struct {
+    struct nlmsghdr header;
+    struct genlmsghdr genl;
+    guchar attrs[NLA_HDRLEN + 32];
+  } request;
+  struct sockaddr_nl kernel;
+  struct nlattr *attr;
+
+  g_return_val_if_fail (attr_len <= 32, FALSE);
+
+  memset (&request, 0, sizeof (request));
+  attr = (struct nlattr *) request.attrs;
+  attr->nla_type = attr_type;
+  attr->nla_len = NLA_HDRLEN + attr_len;
+  memcpy (NLA_DATA (attr), attr_data, attr_len);
+
+  request.header.nlmsg_len = NLMSG_LENGTH (GENL_HDRLEN + NLA_ALIGN (attr->nla_len));
+  request.header.nlmsg_type = family;
+  request.header.nlmsg_flags = NLM_F_REQUEST | flags;
+  request.header.nlmsg_seq = seq;
+  request.genl.cmd = cmd;
+  request.genl.version = 1;
+
+  memset (&kernel, 0, sizeof (kernel));
+  kernel.nl_family = AF_NETLINK;
+
+  return (sendto (fd, &request, request.header.nlmsg_len, 0,
+		  (struct sockaddr *) &kernel, sizeof (kernel)) >= 0);
+}
+
+/* Reads the reply to request @seq, calling @func on every message */
+static gboolean
+genl_receive (gint      fd,
+	      guint32   seq,
+	      GenlFunc  func,
+	      gpointer  data)
+{
+  struct nlmsghdr *header;
+  guchar *buffer;
+  gboolean done = FALSE, success = FALSE;
+  gint len;
+
+  buffer = g_malloc (NL80211_BUFFER_SIZE);
+
+  while (!done)
+    {
+      len = recv (fd, buffer, NL80211_BUFFER_SIZE, 0);
+
+      if (len < 0 && errno == EINTR)
+	continue;
+      else if (len <= 0)
+	break;
+
+      for (header = (struct nlmsghdr *) buffer;
+	   NLMSG_OK (header, len);
+	   header = NLMSG_NEXT (header, len))
 	{
-	  /* reschedule the timeout, so we don't have
-	   * to wait too long to get some data
-	   */
-	  schedule_query_essids (list);
+	  if (header->nlmsg_seq != seq)
+	    continue;
+
+	  if (header->nlmsg_type == NLMSG_ERROR)
+	    {
+	      done = TRUE;
+	      break;
+	    }
+
+	  if (header->nlmsg_type != NLMSG_DONE)
+	    func (header, data);
+
+	  /* dumps end with NLMSG_DONE, plain replies are a single message */
+	  if (header->nlmsg_type == NLMSG_DONE ||
+	      !(header->nlmsg_flags & NLM_F_MULTI))
+	    {
+	      done = success = TRUE;
+	      break;
+	    }
 	}
+    }
+
+  g_free (buffer);
+
+  return success;
+}
+
+static void
+parse_family (struct nlmsghdr *header,
+	      gpointer         data)
+{
+  FamilyInfo *info = data;
+  struct nlattr *attrs[CTRL_ATTR_MAX + 1];
+  struct nlattr *group[CTRL_ATTR_MCAST_GRP_MAX + 1];
+  struct nlattr *attr;
+  gint len;
+
+  parse_attributes (GENL_ATTRS (header), GENL_ATTRS_LEN (header), attrs, CTRL_ATTR_MAX);
+
+  if (attrs[CTRL_ATTR_FAMILY_ID])
+    memcpy (&info->id, NLA_DATA (attrs[CTRL_ATTR_FAMILY_ID]), sizeof (info->id));
+
+  if (!attrs[CTRL_ATTR_MCAST_GROUPS])
+    return;
+
+  attr = (struct nlattr *) NLA_DATA (attrs[CTRL_ATTR_MCAST_GROUPS]);
+  len = NLA_LEN (attrs[CTRL_ATTR_MCAST_GROUPS]);
+
+  for (; NLA_OK (attr, len); attr = NLA_NEXT (attr, len))
+    {
+      parse_attributes ((struct nlattr *) NLA_DATA (attr), NLA_LEN (attr),
+			group, CTRL_ATTR_MCAST_GRP_MAX);
+
+      if (group[CTRL_ATTR_MCAST_GRP_NAME] && group[CTRL_ATTR_MCAST_GRP_ID] &&
+	  strcmp ((gchar *) NLA_DATA (group[CTRL_ATTR_MCAST_GRP_NAME]), "scan") == 0)
+	memcpy (&info->scan_group, NLA_DATA (group[CTRL_ATTR_MCAST_GRP_ID]), sizeof (info->scan_group));
+    }
+}
+
+/* Returns the SSID element of a BSS, NULL for hidden networks */
+static gchar *
+get_ie_essid (const guchar *ies,
+	      gint          len)
+{
+  gint i;
+
+  while (len >= 2 && ies[1] + 2 <= len)
+    {
+      if (ies[0] == 0)
+	{
+	  for (i = 0; i < ies[1]; i++)
+	    if (ies[2 + i] != '\0')
+	      return g_strndup ((const gchar *) ies + 2, ies[1]);
+
+	  return NULL;
+	}
+
+      len -= ies[1] + 2;
+      ies += ies[1] + 2;
+    }
+
+  return NULL;
+}
+
+static void
+parse_scan_result (struct nlmsghdr *header,
+		   gpointer         data)
+{
+  GList **results = data;
+  struct nlattr *attrs[NL80211_ATTR_MAX + 1];
+  struct nlattr *bss[NL80211_BSS_MAX + 1];
+  struct nlattr *ies;
+  GstEssidListEntry *entry;
+  guint16 capability = 0;
+  gint32 mbm;
+  guint8 unspec;
+  gchar *essid;
+
+  parse_attributes (GENL_ATTRS (header), GENL_ATTRS_LEN (header), attrs, NL80211_ATTR_MAX);
+
+  if (!attrs[NL80211_ATTR_BSS])
+    return;
+
+  parse_attributes ((struct nlattr *) NLA_DATA (attrs[NL80211_ATTR_BSS]),
+		    NLA_LEN (attrs[NL80211_ATTR_BSS]),
+		    bss, NL80211_BSS_MAX);
+
+  ies = (bss[NL80211_BSS_INFORMATION_ELEMENTS]) ?
+    bss[NL80211_BSS_INFORMATION_ELEMENTS] : bss[NL80211_BSS_BEACON_IES];
+
+  if (!ies || !(essid = get_ie_essid (NLA_DATA (ies), NLA_LEN (ies))))
+    return;
+
+  entry = g_new0 (GstEssidListEntry, 1);
+  entry->essid = essid;
+
+  if (bss[NL80211_BSS_CAPABILITY])
+    memcpy (&capability, NLA_DATA (bss[NL80211_BSS_CAPABILITY]), sizeof (capability));
+
+  entry->encrypted = ((capability & WLAN_CAPABILITY_PRIVACY) != 0);
+
+  if (bss[NL80211_BSS_SIGNAL_MBM])
+    {
+      memcpy (&mbm, NLA_DATA (bss[NL80211_BSS_SIGNAL_MBM]), sizeof (mbm));
+      entry->quality = signal_to_quality (mbm / 100);
+    }
+  else if (bss[NL80211_BSS_SIGNAL_UNSPEC])
+    {
+      memcpy (&unspec, NLA_DATA (bss[NL80211_BSS_SIGNAL_UNSPEC]), sizeof (unspec));
+      entry->quality = CLAMP ((gdouble) unspec / 100, 0.0, 1.0);
+    }
+  else
+    entry->quality = 0.5;
+
+  *results = g_list_prepend (*results, entry);
+}
+
+/* Reads the results the kernel keeps from the last scans */
+static gboolean
+query_nl80211 (GstEssidList *list)
+{
+  GstEssidListPrivate *priv;
+  GList *results = NULL;
+
+  priv = GST_ESSID_LIST_GET_PRIVATE (list);
+  priv->seq++;
+
+  if (!genl_send (priv->nl_fd, priv->family, NL80211_CMD_GET_SCAN, NLM_F_DUMP, priv->seq,
+		  NL80211_ATTR_IFINDEX, &priv->ifindex, sizeof (priv->ifindex)))
+    return FALSE;
+
+  if (!genl_receive (priv->nl_fd, priv->seq, parse_scan_result, &results))
+    {
+      free_scan_results (results);
+      return FALSE;
+    }
+
+  merge_scan_results (list, g_list_reverse (results));
+
+  return TRUE;
+}
 
+static gboolean
+nl80211_event (GIOChannel   *channel,
+	       GIOCondition  condition,
+	       gpointer      data)
+{
+  GstEssidList *list;
+  GstEssidListPrivate *priv;
+  struct nlmsghdr *header;
+  struct genlmsghdr *genl;
+  struct nlattr *attrs[NL80211_ATTR_MAX + 1];
+  guchar buffer[8192];
+  gboolean query = FALSE;
+  guint32 ifindex;
+  gint len;
+
+  list = GST_ESSID_LIST (data);
+  priv = GST_ESSID_LIST_GET_PRIVATE (list);
+
+  if (condition & (G_IO_ERR | G_IO_HUP))
+    {
+      priv->nl_watch = 0;
       return FALSE;
     }
 
-  /* get info */
-  g_list_foreach (priv->list, (GFunc) free_essid_entry, NULL);
-  g_list_free (priv->list);
-  priv->list = get_scan_info (list, req);
+  while ((len = recv (priv->nl_events_fd, buffer, sizeof (buffer), MSG_DONTWAIT)) > 0)
+    {
+      for (header = (struct nlmsghdr *) buffer;
+	   NLMSG_OK (header, len);
+	   header = NLMSG_NEXT (header, len))
+	{
+	  genl = NLMSG_DATA (header);
+
+	  if (header->nlmsg_type != priv->family ||
+	      genl->cmd != NL80211_CMD_NEW_SCAN_RESULTS)
+	    continue;
 
-  g_signal_emit (list, signals[CHANGED], 0);
+	  parse_attributes (GENL_ATTRS (header), GENL_ATTRS_LEN (header), attrs, NL80211_ATTR_MAX);
+
+	  if (!attrs[NL80211_ATTR_IFINDEX])
+	    continue;
+
+	  memcpy (&ifindex, NLA_DATA (attrs[NL80211_ATTR_IFINDEX]), sizeof (ifindex));
+
+	  if (ifindex == priv->ifindex)
+	    query = TRUE;
+	}
+    }
+
+  /* the queue overflowed, a scan may have been missed */
+  if (len < 0 && errno == ENOBUFS)
+    query = TRUE;
+
+  /* several scans finishing together need a single dump */
+  if (query)
+    query_nl80211 (list);
 
   return TRUE;
 }
 
 static void
-schedule_query_essids (GstEssidList *list)
+close_nl80211 (GstEssidList *list)
 {
   GstEssidListPrivate *priv;
 
   priv = GST_ESSID_LIST_GET_PRIVATE (list);
 
-  if (priv->timeout)
+  if (priv->nl_watch)
     {
-      g_source_remove (priv->timeout);
-      priv->timeout = 0;
+      g_source_remove (priv->nl_watch);
+      priv->nl_watch = 0;
     }
 
-  priv->timeout = g_timeout_add (RESCAN_TIMEOUT, (GSourceFunc) query_essids, list);
+  if (priv->nl_events_fd >= 0)
+    {
+      close (priv->nl_events_fd);
+      priv->nl_events_fd = -1;
+    }
+
+  if (priv->nl_fd >= 0)
+    {
+      close (priv->nl_fd);
+      priv->nl_fd = -1;
+    }
 }
 
+/* Listens to the scans other programs (or the kernel) trigger on the
+ * interface, there are no privileges to request them ourselves */
+static gboolean
+open_nl80211 (GstEssidList *list)
+{
+  GstEssidListPrivate *priv;
+  FamilyInfo info = { 0, 0 };
+  GIOChannel *channel;
+
+  priv = GST_ESSID_LIST_GET_PRIVATE (list);
+  priv->ifindex = if_nametoindex (priv->interface);
+
+  if (!priv->ifindex)
+    return FALSE;
+
+  priv->nl_fd = open_genl_socket ();
+  priv->nl_events_fd = open_genl_socket ();
+
+  if (priv->nl_fd < 0 || priv->nl_events_fd < 0)
+    {
+      close_nl80211 (list);
+      return FALSE;
+    }
+
+  priv->seq++;
+
+  if (!genl_send (priv->nl_fd, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 0, priv->seq,
+		  CTRL_ATTR_FAMILY_NAME, NL80211_GENL_NAME, sizeof (NL80211_GENL_NAME)) ||
+      !genl_receive (priv->nl_fd, priv->seq, parse_family, &info) ||
+      !info.id || !info.scan_group)
+    {
+      close_nl80211 (list);
+      return FALSE;
+    }
+
+  priv->family = info.id;
+
+  /* subscribe before the first dump, so no scan goes unnoticed in between;
+   * the dump fails if the driver doesn't support cfg80211 */
+  if (setsockopt (priv->nl_events_fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP,
+		  &info.scan_group, sizeof (info.scan_group)) < 0 ||
+      !query_nl80211 (list))
+    {
+      close_nl80211 (list);
+      return FALSE;
+    }
+
+  channel = g_io_channel_unix_new (priv->nl_events_fd);
+  priv->nl_watch = g_io_add_watch (channel, G_IO_IN | G_IO_ERR | G_IO_HUP,
+				   nl80211_event, list);
+  g_io_channel_unref (channel);
+
+  return TRUE;
+}
+
+#endif /* HAVE_NL80211 */
+
 static GObject*
 gst_essid_list_constructor (GType                  type,
 			    guint                  n_construct_properties,
@@ -310,8 +892,16 @@ gst_essid_list_constructor (GType                  type,
   object = (* G_OBJECT_CLASS (gst_essid_list_parent_class)->constructor) (type,
 									  n_construct_properties,
 									  construct_params);
-  query_essids (GST_ESSID_LIST (object));
-  schedule_query_essids (GST_ESSID_LIST (object));
+#if defined (HAVE_NL80211) && defined (HAVE_LIBIW_H)
+  /* fall back to polling with drivers not using cfg80211 */
+  if (!open_nl80211 (GST_ESSID_LIST (object)))
+    start_polling (GST_ESSID_LIST (object));
+#elif defined (HAVE_NL80211)
+  /* without wireless extensions, drivers not using cfg80211 find nothing */
+  open_nl80211 (GST_ESSID_LIST (object));
+#else
+  start_polling (GST_ESSID_LIST (object));
+#endif
 
   return object;
 }
@@ -33,9 +33,10 @@ G_BEGIN_DECLS
 #define GST_IS_ESSID_LIST_CLASS(obj)  (G_TYPE_CHECK_CLASS_TYPE ((obj),    GST_TYPE_ESSID_LIST))
 #define GST_ESSID_LIST_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj),  GST_TYPE_ESSID_LIST, GstEssidListClass))
 
-typedef struct _GstEssidList      GstEssidList;
-typedef struct _GstEssidListClass GstEssidListClass;
-typedef struct _GstEssidListEntry GstEssidListEntry;
+typedef struct _GstEssidList        GstEssidList;
+typedef struct _GstEssidListClass   GstEssidListClass;
+typedef struct _GstEssidListEntry   GstEssidListEntry;
+typedef struct _GstEssidListChanges GstEssidListChanges;
 
 struct _GstEssidList
 {
@@ -51,7 +52,8 @@ struct _GstEssidListClass
 {
   GObjectClass parent_class;
 
-  void (*changed) (GstEssidList *list);
+  void (*changed) (GstEssidList        *list,
+		   GstEssidListChanges *changes);
 };
 
 struct _GstEssidListEntry
@@ -61,6 +63,14 @@ struct _GstEssidListEntry
   gchar *essid;
 };
 
+/* entries passed to ::changed, removed ones are freed afterwards */
+struct _GstEssidListChanges
+{
+  GList *added;
+  GList *removed;
+  GList *updated;
+};
+
 GType         gst_essid_list_get_type  (void);
 GstEssidList *gst_essid_list_new       (const gchar *interface);
 GList        *gst_essid_list_get_list  (GstEssidList *list);
@@ -29,6 +29,9 @@
 
 extern GstTool *tool;
 
+/* state flaps are folded into a single row refresh per interface */
+#define IFACE_REFRESH_DELAY 250
+
 GtkActionEntry popup_menu_items [] = {
   { "Properties",  GTK_STOCK_PROPERTIES, N_("_Properties"), NULL, NULL, G_CALLBACK (on_iface_properties_clicked) },
 };
@@ -199,11 +202,16 @@ ifaces_model_search_iface (IfaceSearchTerm search_term, const gchar *term)
   GtkTreeModel *model;
   GtkTreeIter   iter;
   gboolean      valid;
-  gchar        *dev, *item;
   OobsIface    *iface = NULL;
 
   g_return_val_if_fail (term != NULL, NULL);
 
+  if (search_term == SEARCH_DEV)
+    {
+      iface = g_hash_table_lookup (GST_NETWORK_TOOL (tool)->dev_ifaces, term);
+      return (iface) ? g_object_ref (iface) : NULL;
+    }
+
   model = GST_NETWORK_TOOL (tool)->interfaces_model;
   valid = gtk_tree_model_get_iter_first (model, &iter);
 
@@ -211,15 +219,9 @@ ifaces_model_search_iface (IfaceSearchTerm search_term, const gchar *term)
     {
       gtk_tree_model_get (model, &iter,
 			  COL_OBJECT, &iface,
-			  COL_DEV,    &dev,
 			  -1);
 
-      if (search_term == SEARCH_DEV)
-	item = dev;
-      else
-	item = (gchar *) iface_to_type (iface);
-
-      if (strcmp (term, item) == 0)
+      if (strcmp (term, iface_to_type (iface)) == 0)
 	valid = FALSE;
       else
         {
@@ -227,8 +229,6 @@ ifaces_model_search_iface (IfaceSearchTerm search_term, const gchar *term)
 	  g_object_unref (iface);
 	  iface = NULL;
 	}
-
-      g_free (dev);
     }
 
   return iface;
@@ -431,47 +431,92 @@ ifaces_model_set_interface_at_iter (OobsIface *iface, GtkTreeIter *iter, gboolea
   ifaces_model_modify_interface_at_iter (iter);
 }
 
-static void
-iface_state_changed (OobsIface *iface,
-		     gpointer   user_data)
+static gboolean
+get_iface_iter (OobsIface   *iface,
+		GtkTreeIter *iter)
 {
-  GtkTreeModel *model;
+  GtkTreeRowReference *row;
+  GtkTreePath *path;
+  gboolean valid;
+
+  row = g_hash_table_lookup (GST_NETWORK_TOOL (tool)->iface_rows, iface);
+
+  if (!row || !gtk_tree_row_reference_valid (row))
+    return FALSE;
+
+  path = gtk_tree_row_reference_get_path (row);
+  valid = gtk_tree_model_get_iter (gtk_tree_row_reference_get_model (row), iter, path);
+  gtk_tree_path_free (path);
+
+  return valid;
+}
+
+static gboolean
+refresh_pending_ifaces (gpointer data)
+{
+  GstNetworkTool *network_tool;
+  GHashTableIter hash_iter;
   GtkTreeIter iter;
-  OobsIface *model_iface;
-  gboolean valid, found;
+  OobsIface *iface;
 
-  found = FALSE;
-  model = GST_NETWORK_TOOL (tool)->interfaces_model;
-  valid = gtk_tree_model_get_iter_first (model, &iter);
+  network_tool = GST_NETWORK_TOOL (data);
+  g_hash_table_iter_init (&hash_iter, network_tool->pending_ifaces);
 
-  while (valid && !found)
+  while (g_hash_table_iter_next (&hash_iter, (gpointer *) &iface, NULL))
     {
-      gtk_tree_model_get (model, &iter,
-			  COL_OBJECT, &model_iface,
-			  -1);
+      if (get_iface_iter (iface, &iter))
+	ifaces_model_modify_interface_at_iter (&iter);
+    }
 
-      if (iface == model_iface)
-	{
-	  ifaces_model_modify_interface_at_iter (&iter);
-	  found = TRUE;
-	}
+  g_hash_table_remove_all (network_tool->pending_ifaces);
+  network_tool->refresh_timeout = 0;
 
-      g_object_unref (iface);
-      valid = gtk_tree_model_iter_next (model, &iter);
-    }
+  return FALSE;
+}
+
+static void
+iface_state_changed (OobsIface *iface,
+		     gpointer   user_data)
+{
+  GstNetworkTool *network_tool;
+
+  network_tool = GST_NETWORK_TOOL (user_data);
+
+  /* the table holds each interface once, however often it changed */
+  g_hash_table_insert (network_tool->pending_ifaces, g_object_ref (iface), NULL);
+
+  if (!network_tool->refresh_timeout)
+    network_tool->refresh_timeout = g_timeout_add (IFACE_REFRESH_DELAY,
+						   refresh_pending_ifaces,
+						   network_tool);
 }
 
 void
 ifaces_model_add_interface (OobsIface *iface, gboolean show_name)
 {
+  GstNetworkTool *network_tool;
   GtkTreeModel *model;
   GtkTreeIter   it;
+  GtkTreePath  *path;
+  const gchar  *dev;
 
-  model = GST_NETWORK_TOOL (tool)->interfaces_model;
+  network_tool = GST_NETWORK_TOOL (tool);
+  model = network_tool->interfaces_model;
 
   gtk_list_store_append (GTK_LIST_STORE (model), &it);
   ifaces_model_set_interface_at_iter (iface, &it, show_name);
 
+  /* the row may have moved while sorting, the iter is still valid */
+  path = gtk_tree_model_get_path (model, &it);
+  g_hash_table_insert (network_tool->iface_rows, g_object_ref (iface),
+		       gtk_tree_row_reference_new (model, path));
+  gtk_tree_path_free (path);
+
+  dev = oobs_iface_get_device_name (iface);
+
+  if (dev)
+    g_hash_table_insert (network_tool->dev_ifaces, g_strdup (dev), iface);
+
   g_signal_connect (iface, "state-changed",
 		    G_CALLBACK (iface_state_changed), tool);
 }
@@ -479,9 +524,27 @@ ifaces_model_add_interface (OobsIface *iface, gboolean show_name)
 void
 ifaces_model_clear (void)
 {
-  GtkTreeModel *model;
+  GstNetworkTool *network_tool;
+  GHashTableIter iter;
+  OobsIface *iface;
 
-  model = GST_NETWORK_TOOL (tool)->interfaces_model;
-  gtk_list_store_clear (GTK_LIST_STORE (model));
-}
+  network_tool = GST_NETWORK_TOOL (tool);
+
+  if (network_tool->refresh_timeout)
+    {
+      g_source_remove (network_tool->refresh_timeout);
+      network_tool->refresh_timeout = 0;
+    }
+
+  g_hash_table_remove_all (network_tool->pending_ifaces);
+  g_hash_table_iter_init (&iter, network_tool->iface_rows);
 
+  while (g_hash_table_iter_next (&iter, (gpointer *) &iface, NULL))
+    g_signal_handlers_disconnect_by_func (iface, iface_state_changed, tool);
+
+  /* drop the row references first, so they aren't updated on every deleted row */
+  g_hash_table_remove_all (network_tool->dev_ifaces);
+  g_hash_table_remove_all (network_tool->iface_rows);
+
+  gtk_list_store_clear (GTK_LIST_STORE (network_tool->interfaces_model));
+}
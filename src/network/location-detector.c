@@ -0,0 +1,849 @@
+/* -*- Mode: C; c-file-style: "gnu"; tab-width: 8 -*- */
+/* location-detector.c: this file is part of network-admin, a gnome-system-tools
+ * frontend for network administration.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Keeps a fingerprint of the network environment the computer is in: the
+ * hardware address of the default gateway, the visible wireless networks
+ * and the domain handed out by DHCP. It is computed again shortly after
+ * links, routes or neighbours change, or new scan results arrive, and
+ * "changed" is emitted when it differs from the previous one.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "location-detector.h"
+
+#ifdef HAVE_NETLINK
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
+
+#ifdef HAVE_ESSID_LIST
+#include "essid-list.h"
+#endif
+
+/* how long to wait for a burst of link events to settle, in ms */
+#define DETECTION_DELAY 200
+
+#define SYS_CLASS_NET "/sys/class/net"
+
+typedef struct _GstLocationDetectorPrivate GstLocationDetectorPrivate;
+
+struct _GstLocationDetectorPrivate
+{
+  GstNetworkEnvironment *environment;
+  guint detection_timeout;
+
+#ifdef HAVE_NETLINK
+  gint events_fd;
+  guint events_watch;
+  gboolean links_changed;
+  guint32 gateway_address;	/* as seen on the last detection */
+  gint gateway_ifindex;
+#endif
+
+#ifdef HAVE_ESSID_LIST
+  GHashTable *essid_lists;	/* device -> GstEssidList */
+#endif
+};
+
+#define GST_LOCATION_DETECTOR_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), GST_TYPE_LOCATION_DETECTOR, GstLocationDetectorPrivate))
+
+static void gst_location_detector_class_init (GstLocationDetectorClass *class);
+static void gst_location_detector_init       (GstLocationDetector      *detector);
+static void gst_location_detector_finalize   (GObject                  *object);
+
+static void schedule_detection (GstLocationDetector *detector);
+
+enum {
+  CHANGED,
+  LAST_SIGNAL
+};
+
+static guint signals [LAST_SIGNAL] = { 0 };
+
+static const gchar *lease_dirs[] = {
+  "/var/lib/dhcp",
+  "/var/lib/dhcp3",
+  "/var/lib/dhclient",
+  NULL
+};
+
+G_DEFINE_TYPE (GstLocationDetector, gst_location_detector, G_TYPE_OBJECT);
+
+static void
+gst_location_detector_class_init (GstLocationDetectorClass *class)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (class);
+
+  object_class->finalize = gst_location_detector_finalize;
+
+  signals[CHANGED] =
+    g_signal_new ("changed",
+		  G_TYPE_FROM_CLASS (object_class),
+		  G_SIGNAL_RUN_LAST,
+		  G_STRUCT_OFFSET (GstLocationDetectorClass, changed),
+		  NULL, NULL,
+		  g_cclosure_marshal_VOID__VOID,
+		  G_TYPE_NONE, 0);
+
+  g_type_class_add_private (object_class,
+			    sizeof (GstLocationDetectorPrivate));
+}
+
+#ifdef HAVE_NETLINK
+
+typedef void (NetlinkFunc) (struct nlmsghdr *header,
+			    gpointer         data);
+
+typedef struct _DefaultRoute DefaultRoute;
+
+struct _DefaultRoute
+{
+  guint32 gateway;
+  guint32 metric;
+  gint ifindex;
+};
+
+typedef struct _Neighbour Neighbour;
+
+struct _Neighbour
+{
+  guint32 address;
+  gint ifindex;
+  gchar *hw_address;
+};
+
+static gint
+open_netlink_socket (guint32 groups)
+{
+  struct sockaddr_nl addr;
+  gint fd;
+
+  fd = socket (AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+
+  if (fd < 0)
+    return -1;
+
+  memset (&addr, 0, sizeof (addr));
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = groups;
+
+  if (bind (fd, (struct sockaddr *) &addr, sizeof (addr)) < 0)
+    {
+      close (fd);
+      return -1;
+    }
+
+  return fd;
+}
+
+/* Dumps a kernel table, calling @func on every message */
+static gboolean
+netlink_dump (guint16      type,
+	      NetlinkFunc  func,
+	      gpointer     data)
+{
+  struct {
+    struct nlmsghdr header;
+    struct rtmsg message;	/* struct ndmsg is the same size, and also starts with the family */
+  } request;
+  struct sockaddr_nl kernel;
+  struct nlmsghdr *header;
+  guchar buffer[32768];
+  gboolean done = FALSE;
+  gint fd, len;
+
+  fd = open_netlink_socket (0);
+
+  if (fd < 0)
+    return FALSE;
+
+  memset (&request, 0, sizeof (request));
+  request.header.nlmsg_len = NLMSG_LENGTH (sizeof (request.message));
+  request.header.nlmsg_type = type;
+  request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  request.header.nlmsg_seq = 1;
+  request.message.rtm_family = AF_INET;
+
+  memset (&kernel, 0, sizeof (kernel));
+  kernel.nl_family = AF_NETLINK;
+
+  if (sendto (fd, &request, request.header.nlmsg_len, 0,
+	      (struct sockaddr *) &kernel, sizeof (kernel)) < 0)
+    {
+      close (fd);
+      return FALSE;
+    }
+
+  while (!done)
+    {
+      len = recv (fd, buffer, sizeof (buffer), 0);
+
+      if (len < 0 && errno == EINTR)
+	continue;
+      else if (len <= 0)
+	break;
+
+      for (header = (struct nlmsghdr *) buffer;
+	   NLMSG_OK (header, len);
+	   header = NLMSG_NEXT (header, len))
+	{
+	  if (header->nlmsg_type == NLMSG_DONE ||
+	      header->nlmsg_type == NLMSG_ERROR)
+	    {
+	      done = TRUE;
+	      break;
+	    }
+
+	  func (header, data);
+	}
+    }
+
+  close (fd);
+
+  return done;
+}
+
+static void
+parse_route (struct nlmsghdr *header,
+	     gpointer         data)
+{
+  DefaultRoute *route = data;
+  struct rtmsg *message;
+  struct rtattr *attr;
+  guint32 gateway = 0, metric = 0;
+  gint ifindex = 0, len;
+
+  message = NLMSG_DATA (header);
+
+  if (header->nlmsg_type != RTM_NEWROUTE ||
+      message->rtm_family != AF_INET ||
+      message->rtm_table != RT_TABLE_MAIN ||
+      message->rtm_dst_len != 0)
+    return;
+
+  len = RTM_PAYLOAD (header);
+
+  for (attr = RTM_RTA (message); RTA_OK (attr, len); attr = RTA_NEXT (attr, len))
+    {
+      if (attr->rta_type == RTA_GATEWAY)
+	memcpy (&gateway, RTA_DATA (attr), sizeof (gateway));
+      else if (attr->rta_type == RTA_OIF)
+	memcpy (&ifindex, RTA_DATA (attr), sizeof (ifindex));
+      else if (attr->rta_type == RTA_PRIORITY)
+	memcpy (&metric, RTA_DATA (attr), sizeof (metric));
+    }
+
+  /* with several default routes, the one with the lowest metric wins */
+  if (gateway && (!route->gateway || metric < route->metric))
+    {
+      route->gateway = gateway;
+      route->metric = metric;
+      route->ifindex = ifindex;
+    }
+}
+
+static gchar *
+format_hw_address (const guchar *address,
+		   gint          len)
+{
+  GString *str;
+  gint i;
+
+  str = g_string_new (NULL);
+
+  for (i = 0; i < len; i++)
+    g_string_append_printf (str, (i == 0) ? "%02x" : ":%02x", address[i]);
+
+  return g_string_free (str, FALSE);
+}
+
+/* Returns the destination of a neighbour message, and its hardware address if reachable */
+static guint32
+parse_neighbour_message (struct nlmsghdr  *header,
+			 gint             *ifindex,
+			 gchar           **hw_address)
+{
+  struct ndmsg *message;
+  struct rtattr *attr, *lladdr = NULL;
+  guint32 address = 0;
+  gint len;
+
+  message = NLMSG_DATA (header);
+  *ifindex = message->ndm_ifindex;
+  *hw_address = NULL;
+
+  if (message->ndm_family != AF_INET)
+    return 0;
+
+  len = header->nlmsg_len - NLMSG_LENGTH (sizeof (*message));
+
+  for (attr = (struct rtattr *) ((gchar *) message + NLMSG_ALIGN (sizeof (*message)));
+       RTA_OK (attr, len);
+       attr = RTA_NEXT (attr, len))
+    {
+      if (attr->rta_type == NDA_DST)
+	memcpy (&address, RTA_DATA (attr), sizeof (address));
+      else if (attr->rta_type == NDA_LLADDR)
+	lladdr = attr;
+    }
+
+  if (header->nlmsg_type == RTM_NEWNEIGH && lladdr &&
+      !(message->ndm_state & (NUD_INCOMPLETE | NUD_FAILED)))
+    *hw_address = format_hw_address (RTA_DATA (lladdr), RTA_PAYLOAD (lladdr));
+
+  return address;
+}
+
+static void
+parse_neighbour (struct nlmsghdr *header,
+		 gpointer         data)
+{
+  Neighbour *neighbour = data;
+  gchar *hw_address;
+  guint32 address;
+  gint ifindex;
+
+  if (header->nlmsg_type != RTM_NEWNEIGH)
+    return;
+
+  address = parse_neighbour_message (header, &ifindex, &hw_address);
+
+  if (address == neighbour->address && ifindex == neighbour->ifindex &&
+      hw_address && !neighbour->hw_address)
+    neighbour->hw_address = hw_address;
+  else
+    g_free (hw_address);
+}
+
+/*
+ * Returns the hardware address of the default gateway, if it's already
+ * in the neighbour table, along with its IP address and the index of
+ * the interface it's reached by
+ */
+static gchar *
+get_gateway_hw_address (guint32 *gateway,
+			gint    *ifindex)
+{
+  DefaultRoute route = { 0, 0, 0 };
+  Neighbour neighbour;
+
+  *gateway = 0;
+  *ifindex = 0;
+
+  if (!netlink_dump (RTM_GETROUTE, parse_route, &route) || !route.gateway)
+    return NULL;
+
+  *gateway = route.gateway;
+  *ifindex = route.ifindex;
+
+  neighbour.address = route.gateway;
+  neighbour.ifindex = route.ifindex;
+  neighbour.hw_address = NULL;
+
+  netlink_dump (RTM_GETNEIGH, parse_neighbour, &neighbour);
+
+  return neighbour.hw_address;
+}
+
+/*
+ * Whether a neighbour message alters the gateway hardware address
+ * known from the last detection, the rest of the table is just noise
+ */
+static gboolean
+gateway_neighbour_changed (GstLocationDetectorPrivate *priv,
+			   struct nlmsghdr            *header)
+{
+  const gchar *known = NULL;
+  gchar *hw_address;
+  guint32 address;
+  gint ifindex;
+  gboolean changed;
+
+  if (!priv->gateway_address)
+    return FALSE;
+
+  address = parse_neighbour_message (header, &ifindex, &hw_address);
+
+  if (address != priv->gateway_address || ifindex != priv->gateway_ifindex)
+    {
+      g_free (hw_address);
+      return FALSE;
+    }
+
+  if (priv->environment)
+    known = priv->environment->gateway;
+
+  changed = (g_strcmp0 (hw_address, known) != 0);
+  g_free (hw_address);
+
+  return changed;
+}
+
+static gboolean
+netlink_event (GIOChannel   *channel,
+	       GIOCondition  condition,
+	       gpointer      data)
+{
+  GstLocationDetector *detector;
+  GstLocationDetectorPrivate *priv;
+  struct nlmsghdr *header;
+  guchar buffer[8192];
+  gboolean changed = FALSE;
+  gint len;
+
+  detector = GST_LOCATION_DETECTOR (data);
+  priv = detector->_priv;
+
+  if (condition & (G_IO_ERR | G_IO_HUP))
+    {
+      priv->events_watch = 0;
+      return FALSE;
+    }
+
+  /* only the fact something changed matters, drain everything queued */
+  while ((len = recv (priv->events_fd, buffer, sizeof (buffer), MSG_DONTWAIT)) > 0)
+    {
+      for (header = (struct nlmsghdr *) buffer;
+	   NLMSG_OK (header, len);
+	   header = NLMSG_NEXT (header, len))
+	{
+	  switch (header->nlmsg_type)
+	    {
+	    case RTM_NEWLINK:
+	    case RTM_DELLINK:
+	      priv->links_changed = TRUE;
+	      changed = TRUE;
+	      break;
+	    case RTM_NEWNEIGH:
+	    case RTM_DELNEIGH:
+	      /* ARP refreshes for other hosts come in all the time */
+	      if (gateway_neighbour_changed (priv, header))
+		changed = TRUE;
+	      break;
+	    case RTM_NEWADDR:
+	    case RTM_DELADDR:
+	    case RTM_NEWROUTE:
+	    case RTM_DELROUTE:
+	      changed = TRUE;
+	      break;
+	    default:
+	      break;
+	    }
+	}
+    }
+
+  /* the queue overflowed, events were lost */
+  if (len < 0 && errno == ENOBUFS)
+    {
+      priv->links_changed = TRUE;
+      changed = TRUE;
+    }
+
+  if (changed)
+    schedule_detection (detector);
+
+  return TRUE;
+}
+
+static void
+watch_netlink_events (GstLocationDetector *detector)
+{
+  GstLocationDetectorPrivate *priv;
+  GIOChannel *channel;
+
+  priv = detector->_priv;
+  priv->events_fd = open_netlink_socket (RTMGRP_LINK | RTMGRP_NEIGH |
+					 RTMGRP_IPV4_IFADDR | RTMGRP_IPV4_ROUTE);
+  if (priv->events_fd < 0)
+    {
+      g_warning ("Could not listen to network changes: %s", g_strerror (errno));
+      return;
+    }
+
+  channel = g_io_channel_unix_new (priv->events_fd);
+  priv->events_watch = g_io_add_watch (channel, G_IO_IN | G_IO_ERR | G_IO_HUP,
+				       netlink_event, detector);
+  g_io_channel_unref (channel);
+}
+
+#endif /* HAVE_NETLINK */
+
+#ifdef HAVE_ESSID_LIST
+
+static void
+on_essid_list_changed (GstEssidList        *list,
+		       GstEssidListChanges *changes,
+		       GstLocationDetector *detector)
+{
+  /* quality changes don't alter the fingerprint */
+  if (changes->added || changes->removed)
+    schedule_detection (detector);
+}
+
+/* Keeps a scan results list for every wireless device */
+static void
+update_essid_lists (GstLocationDetector *detector)
+{
+  GstLocationDetectorPrivate *priv;
+  GHashTable *present;
+  GHashTableIter iter;
+  GstEssidList *list;
+  const gchar *name;
+  gchar *path;
+  GDir *dir;
+
+  priv = detector->_priv;
+  dir = g_dir_open (SYS_CLASS_NET, 0, NULL);
+
+  if (!dir)
+    return;
+
+  present = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      path = g_build_filename (SYS_CLASS_NET, name, "wireless", NULL);
+
+      if (g_file_test (path, G_FILE_TEST_IS_DIR))
+	{
+	  g_hash_table_insert (present, g_strdup (name), GINT_TO_POINTER (TRUE));
+
+	  if (!g_hash_table_lookup (priv->essid_lists, name))
+	    {
+	      list = gst_essid_list_new (name);
+	      g_signal_connect (list, "changed",
+				G_CALLBACK (on_essid_list_changed), detector);
+	      g_hash_table_insert (priv->essid_lists, g_strdup (name), list);
+	    }
+	}
+
+      g_free (path);
+    }
+
+  g_dir_close (dir);
+
+  g_hash_table_iter_init (&iter, priv->essid_lists);
+
+  while (g_hash_table_iter_next (&iter, (gpointer *) &name, NULL))
+    {
+      if (!g_hash_table_lookup (present, name))
+	g_hash_table_iter_remove (&iter);
+    }
+
+  g_hash_table_destroy (present);
+}
+
+#endif /* HAVE_ESSID_LIST */
+
+static gint
+compare_essids (gconstpointer a,
+		gconstpointer b)
+{
+  return strcmp (* (const gchar **) a, * (const gchar **) b);
+}
+
+/* Sorted, without duplicates nor hidden networks */
+static gchar **
+get_visible_essids (GstLocationDetector *detector)
+{
+  GPtrArray *essids;
+#ifdef HAVE_ESSID_LIST
+  GstLocationDetectorPrivate *priv;
+  GHashTable *seen;
+  GHashTableIter iter;
+  GstEssidList *list;
+  GstEssidListEntry *entry;
+  const gchar *essid;
+  GList *elem;
+
+  priv = detector->_priv;
+  seen = g_hash_table_new (g_str_hash, g_str_equal);
+  g_hash_table_iter_init (&iter, priv->essid_lists);
+
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &list))
+    {
+      for (elem = gst_essid_list_get_list (list); elem; elem = elem->next)
+	{
+	  entry = elem->data;
+
+	  if (entry->essid && *entry->essid && strcmp (entry->essid, "any") != 0)
+	    g_hash_table_insert (seen, entry->essid, NULL);
+	}
+    }
+
+  essids = g_ptr_array_sized_new (g_hash_table_size (seen) + 1);
+  g_hash_table_iter_init (&iter, seen);
+
+  while (g_hash_table_iter_next (&iter, (gpointer *) &essid, NULL))
+    g_ptr_array_add (essids, g_strdup (essid));
+
+  g_hash_table_destroy (seen);
+#else
+  essids = g_ptr_array_new ();
+#endif
+
+  g_ptr_array_sort (essids, compare_essids);
+  g_ptr_array_add (essids, NULL);
+
+  return (gchar **) g_ptr_array_free (essids, FALSE);
+}
+
+/* Last domain in a dhclient leases file, the latest lease is at the end */
+static gchar *
+get_lease_domain (const gchar *path)
+{
+  gchar *contents, **lines, *domain = NULL, *start, *end;
+  gint i;
+
+  if (!g_file_get_contents (path, &contents, NULL, NULL))
+    return NULL;
+
+  lines = g_strsplit (contents, "\n", -1);
+
+  for (i = 0; lines[i]; i++)
+    {
+      start = g_strstrip (lines[i]);
+
+      if (!g_str_has_prefix (start, "option domain-name "))
+	continue;
+
+      start = strchr (start, '"');
+      end = (start) ? strchr (start + 1, '"') : NULL;
+
+      if (end)
+	{
+	  g_free (domain);
+	  domain = g_strndup (start + 1, end - start - 1);
+	}
+    }
+
+  g_strfreev (lines);
+  g_free (contents);
+
+  return domain;
+}
+
+/*
+ * Whether a leases file belongs to @device, distributions name them
+ * "dhclient-eth0.leases", "dhclient.eth0.leases" or "dhclient-<uuid>-eth0.lease",
+ * so the device name must be the whole last component, eth1 isn't eth10
+ */
+static gboolean
+lease_file_matches_device (const gchar *name,
+			   const gchar *device)
+{
+  const gchar *end;
+  gsize len;
+
+  end = strrchr (name, '.');
+  len = strlen (device);
+
+  if (!end || (gsize) (end - name) < len ||
+      strncmp (end - len, device, len) != 0)
+    return FALSE;
+
+  return (end - len == name ||
+	  end[- (gssize) len - 1] == '-' ||
+	  end[- (gssize) len - 1] == '.' ||
+	  end[- (gssize) len - 1] == '_');
+}
+
+/*
+ * Domain from the most recently written dhclient leases file, for the
+ * interface with the default route if known
+ */
+static gchar *
+get_dhcp_domain (gint ifindex)
+{
+  gchar device[IF_NAMESIZE] = { 0, };
+  gchar *path, *latest = NULL, *domain;
+  const gchar *name;
+  time_t latest_time = 0;
+  struct stat st;
+  GDir *dir;
+  gint i;
+
+  if (ifindex > 0)
+    if_indextoname (ifindex, device);
+
+  for (i = 0; lease_dirs[i]; i++)
+    {
+      dir = g_dir_open (lease_dirs[i], 0, NULL);
+
+      if (!dir)
+	continue;
+
+      while ((name = g_dir_read_name (dir)) != NULL)
+	{
+	  if (!g_str_has_suffix (name, ".leases") && !g_str_has_suffix (name, ".lease"))
+	    continue;
+
+	  if (*device && !lease_file_matches_device (name, device))
+	    continue;
+
+	  path = g_build_filename (lease_dirs[i], name, NULL);
+
+	  if (g_stat (path, &st) == 0 && st.st_mtime > latest_time)
+	    {
+	      g_free (latest);
+	      latest = path;
+	      latest_time = st.st_mtime;
+	    }
+	  else
+	    g_free (path);
+	}
+
+      g_dir_close (dir);
+    }
+
+  if (!latest)
+    return NULL;
+
+  domain = get_lease_domain (latest);
+  g_free (latest);
+
+  return domain;
+}
+
+static gboolean
+detect_environment (GstLocationDetector *detector)
+{
+  GstLocationDetectorPrivate *priv;
+  GstNetworkEnvironment *environment;
+  gint ifindex = 0;
+
+  priv = detector->_priv;
+  priv->detection_timeout = 0;
+
+  environment = g_slice_new0 (GstNetworkEnvironment);
+
+#ifdef HAVE_NETLINK
+  environment->gateway = get_gateway_hw_address (&priv->gateway_address, &ifindex);
+  priv->gateway_ifindex = ifindex;
+
+#ifdef HAVE_ESSID_LIST
+  if (priv->links_changed)
+    update_essid_lists (detector);
+#endif
+
+  priv->links_changed = FALSE;
+#endif
+
+  environment->essids = get_visible_essids (detector);
+  environment->domain = get_dhcp_domain (ifindex);
+
+  if (gst_network_environment_equal (environment, priv->environment))
+    {
+      gst_network_environment_free (environment);
+      return FALSE;
+    }
+
+  gst_network_environment_free (priv->environment);
+  priv->environment = environment;
+
+  g_signal_emit (detector, signals[CHANGED], 0);
+
+  return FALSE;
+}
+
+static void
+schedule_detection (GstLocationDetector *detector)
+{
+  GstLocationDetectorPrivate *priv;
+
+  priv = detector->_priv;
+
+  /* don't delay an already scheduled detection any further */
+  if (!priv->detection_timeout)
+    priv->detection_timeout = g_timeout_add (DETECTION_DELAY, (GSourceFunc) detect_environment, detector);
+}
+
+static void
+gst_location_detector_init (GstLocationDetector *detector)
+{
+  GstLocationDetectorPrivate *priv;
+
+  detector->_priv = priv = GST_LOCATION_DETECTOR_GET_PRIVATE (detector);
+
+#ifdef HAVE_ESSID_LIST
+  priv->essid_lists = g_hash_table_new_full (g_str_hash, g_str_equal,
+					     g_free, (GDestroyNotify) g_object_unref);
+  update_essid_lists (detector);
+#endif
+
+#ifdef HAVE_NETLINK
+  watch_netlink_events (detector);
+#endif
+
+  detect_environment (detector);
+}
+
+static void
+gst_location_detector_finalize (GObject *object)
+{
+  GstLocationDetectorPrivate *priv;
+
+  priv = GST_LOCATION_DETECTOR (object)->_priv;
+
+  if (priv->detection_timeout)
+    g_source_remove (priv->detection_timeout);
+
+#ifdef HAVE_NETLINK
+  if (priv->events_watch)
+    g_source_remove (priv->events_watch);
+
+  if (priv->events_fd >= 0)
+    close (priv->events_fd);
+#endif
+
+#ifdef HAVE_ESSID_LIST
+  g_hash_table_destroy (priv->essid_lists);
+#endif
+
+  gst_network_environment_free (priv->environment);
+
+  G_OBJECT_CLASS (gst_location_detector_parent_class)->finalize (object);
+}
+
+GstLocationDetector*
+gst_location_detector_new (void)
+{
+  return g_object_new (GST_TYPE_LOCATION_DETECTOR, NULL);
+}
+
+const GstNetworkEnvironment*
+gst_location_detector_get_environment (GstLocationDetector *detector)
+{
+  GstLocationDetectorPrivate *priv;
+
+  g_return_val_if_fail (GST_IS_LOCATION_DETECTOR (detector), NULL);
+
+  priv = detector->_priv;
+
+  return priv->environment;
+}
@@ -0,0 +1,61 @@
+/* -*- Mode: C; c-file-style: "gnu"; tab-width: 8 -*- */
+/* location-detector.h: this file is part of network-admin, a gnome-system-tools
+ * frontend for network administration.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __LOCATION_DETECTOR_H
+#define __LOCATION_DETECTOR_H
+
+#include <glib.h>
+#include <glib-object.h>
+#include "network-locations.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_LOCATION_DETECTOR           (gst_location_detector_get_type ())
+#define GST_LOCATION_DETECTOR(obj)           (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_LOCATION_DETECTOR, GstLocationDetector))
+#define GST_LOCATION_DETECTOR_CLASS(obj)     (G_TYPE_CHECK_CLASS_CAST ((obj),    GST_TYPE_LOCATION_DETECTOR, GstLocationDetectorClass))
+#define GST_IS_LOCATION_DETECTOR(obj)        (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_LOCATION_DETECTOR))
+#define GST_IS_LOCATION_DETECTOR_CLASS(obj)  (G_TYPE_CHECK_CLASS_TYPE ((obj),    GST_TYPE_LOCATION_DETECTOR))
+#define GST_LOCATION_DETECTOR_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj),  GST_TYPE_LOCATION_DETECTOR, GstLocationDetectorClass))
+
+typedef struct _GstLocationDetector      GstLocationDetector;
+typedef struct _GstLocationDetectorClass GstLocationDetectorClass;
+
+struct _GstLocationDetector
+{
+  GObject parent_instance;
+
+  /*<private>*/
+  gpointer _priv;
+};
+
+struct _GstLocationDetectorClass
+{
+  GObjectClass parent_class;
+
+  void (*changed) (GstLocationDetector *detector);
+};
+
+GType                        gst_location_detector_get_type        (void);
+GstLocationDetector*         gst_location_detector_new             (void);
+
+const GstNetworkEnvironment* gst_location_detector_get_environment (GstLocationDetector *detector);
+
+G_END_DECLS
+
+#endif /* __LOCATION_DETECTOR_H */
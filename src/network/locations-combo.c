@@ -21,6 +21,7 @@
 #include <glib.h>
 #include <glib/gi18n.h>
 #include "locations-combo.h"
+#include "location-detector.h"
 #include "gst.h"
 
 #define GST_LOCATIONS_COMBO_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), GST_TYPE_LOCATIONS_COMBO, GstLocationsComboPrivate))
@@ -37,6 +38,10 @@ struct _GstLocationsComboPrivate
 
   GtkWidget *save_dialog;
   GtkWidget *location_entry;
+
+  GstLocationDetector *detector;
+  GtkWidget *offer_dialog;
+  gchar *offered;
 };
 
 enum {
@@ -139,6 +144,20 @@ gst_locations_combo_finalize (GObject *object)
 
   if (priv->model)
     g_object_unref (priv->model);
+
+  if (priv->detector)
+    {
+      g_signal_handlers_disconnect_matched (priv->detector, G_SIGNAL_MATCH_DATA,
+					    0, 0, NULL, NULL, object);
+      g_object_unref (priv->detector);
+    }
+
+  if (priv->offer_dialog)
+    gtk_widget_destroy (priv->offer_dialog);
+
+  g_free (priv->offered);
+
+  (* G_OBJECT_CLASS (gst_locations_combo_parent_class)->finalize) (object);
 }
 
 static void
@@ -204,6 +223,7 @@ on_combo_changed (GtkWidget *widget, gpointer data)
   GstNetworkLocations *locations;
   GtkTreeModel *model;
   GtkTreeIter iter;
+  GstNetworkLocationChanges changes;
   gchar *str;
 
   locations = GST_NETWORK_LOCATIONS (data);
@@ -213,13 +233,23 @@ on_combo_changed (GtkWidget *widget, gpointer data)
   if (gtk_combo_box_get_active_iter (GTK_COMBO_BOX (widget), &iter))
     {
       gtk_tree_model_get (model, &iter, 0, &str, -1);
-      gst_network_locations_set_location (locations, str);
+      /* the environment isn't recorded here: the location may be picked
+       * ahead of time, somewhere else, see on_offer_dialog_response() */
+      gst_network_locations_set_location (locations, str, &changes);
+      g_free (str);
+
+      /* nothing to reconfigure if the location is already in use */
+      if (changes == GST_NETWORK_LOCATION_CHANGED_NONE)
+	return;
+
       gst_tool_update_gui (priv->tool);
 
-      gst_tool_commit (priv->tool, locations->hosts_config);
-      gst_tool_commit_async (priv->tool, locations->ifaces_config,
-			     _("Changing network location"), NULL, NULL);
-      g_free (str);
+      if (changes & GST_NETWORK_LOCATION_CHANGED_HOSTS)
+	gst_tool_commit (priv->tool, locations->hosts_config);
+
+      if (changes & GST_NETWORK_LOCATION_CHANGED_IFACES)
+	gst_tool_commit_async (priv->tool, locations->ifaces_config,
+			       _("Changing network location"), NULL, NULL);
     }
 }
 
@@ -236,26 +266,12 @@ static gboolean
 check_save_location (GstLocationsCombo *combo, const gchar *name)
 {
   GstLocationsComboPrivate *priv;
-  GList *names, *elem;
-  gboolean found = FALSE;
   GtkWidget *dialog;
   gint response;
 
   priv = (GstLocationsComboPrivate *) combo->_priv;
-  names = elem = gst_network_locations_get_names (GST_NETWORK_LOCATIONS (combo));
-
-  while (elem && !found)
-    {
-      if (strcmp (elem->data, name) == 0)
-	found = TRUE;
-
-      elem = elem->next;
-    }
 
-  g_list_foreach (names, (GFunc) g_free, NULL);
-  g_list_free (names);
-
-  if (!found)
+  if (!gst_network_locations_has_location (GST_NETWORK_LOCATIONS (combo), name))
     return TRUE;
 
   dialog = gtk_message_dialog_new (GTK_WINDOW (priv->tool->main_dialog),
@@ -272,23 +288,22 @@ check_save_location (GstLocationsCombo *combo, const gchar *name)
 }
 
 static void
-select_matching_profile (GstLocationsCombo *combo)
+select_location (GstLocationsCombo *combo,
+		 const gchar       *name)
 {
   GstLocationsComboPrivate *priv;
   GtkTreeIter iter;
-  gchar *current;
   gchar *profile;
   gboolean valid;
 
   priv = combo->_priv;
-  valid = gtk_tree_model_get_iter_first (priv->model, &iter);
-  current = gst_network_locations_get_current (GST_NETWORK_LOCATIONS (combo));
+  valid = (name && gtk_tree_model_get_iter_first (priv->model, &iter));
 
   while (valid)
     {
       gtk_tree_model_get (priv->model, &iter, 0, &profile, -1);
 
-      if (profile && current && strcmp (profile, current) == 0)
+      if (profile && strcmp (profile, name) == 0)
 	{
 	  gtk_combo_box_set_active_iter (GTK_COMBO_BOX (priv->combo), &iter);
 	  valid = FALSE;
@@ -298,7 +313,15 @@ select_matching_profile (GstLocationsCombo *combo)
 
       g_free (profile);
     }
+}
+
+static void
+select_matching_profile (GstLocationsCombo *combo)
+{
+  gchar *current;
 
+  current = gst_network_locations_get_current (GST_NETWORK_LOCATIONS (combo));
+  select_location (combo, current);
   g_free (current);
 }
 
@@ -319,7 +342,8 @@ on_save_dialog_response (GtkWidget *widget, gint response, gpointer data)
 	{
 	  /* save the data and hide the dialog */
 	  gtk_widget_hide (priv->save_dialog);
-	  gst_network_locations_save_current (GST_NETWORK_LOCATIONS (combo), name);
+	  gst_network_locations_save_current (GST_NETWORK_LOCATIONS (combo), name,
+					      gst_location_detector_get_environment (priv->detector));
 	  select_matching_profile (combo);
 	}
       else
@@ -433,23 +457,110 @@ static void
 fill_model (GstLocationsCombo *combo,
 	    GtkTreeModel      *model)
 {
-  GList *names;
+  GList *names, *elem;
   GtkTreeIter iter;
 
   gtk_list_store_clear (GTK_LIST_STORE (model));
-  names = gst_network_locations_get_names (GST_NETWORK_LOCATIONS (combo));
+  names = elem = gst_network_locations_get_names (GST_NETWORK_LOCATIONS (combo));
 
-  while (names)
+  while (elem)
     {
-      gtk_list_store_append (GTK_LIST_STORE (model), &iter);
-      gtk_list_store_set (GTK_LIST_STORE (model), &iter, 0, names->data, -1);
-      names = names->next;
+      gtk_list_store_insert_with_values (GTK_LIST_STORE (model), &iter, -1,
+					 0, elem->data, -1);
+      elem = elem->next;
     }
 
   g_list_foreach (names, (GFunc) g_free, NULL);
   g_list_free (names);
 }
 
+static void
+on_offer_dialog_response (GtkWidget *dialog, gint response, gpointer data)
+{
+  GstLocationsCombo *combo = GST_LOCATIONS_COMBO (data);
+  GstLocationsComboPrivate *priv = combo->_priv;
+
+  /* selecting the row applies the location through on_combo_changed(),
+   * accepting confirms it's used here, refresh where it's used */
+  if (response == GTK_RESPONSE_OK)
+    {
+      select_location (combo, priv->offered);
+      gst_network_locations_set_environment (GST_NETWORK_LOCATIONS (combo), priv->offered,
+					     gst_location_detector_get_environment (priv->detector));
+    }
+
+  gtk_widget_destroy (dialog);
+}
+
+static void
+offer_location (GstLocationsCombo *combo)
+{
+  GstLocationsComboPrivate *priv;
+
+  priv = combo->_priv;
+
+  if (priv->offer_dialog)
+    gtk_widget_destroy (priv->offer_dialog);
+
+  priv->offer_dialog = gtk_message_dialog_new (GTK_WINDOW (priv->tool->main_dialog),
+					       GTK_DIALOG_DESTROY_WITH_PARENT,
+					       GTK_MESSAGE_QUESTION,
+					       GTK_BUTTONS_NONE,
+					       _("Switch to location \"%s\"?"),
+					       priv->offered);
+  gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (priv->offer_dialog),
+					    _("This location was last used on the network "
+					      "the computer is connected to now."));
+  gtk_dialog_add_buttons (GTK_DIALOG (priv->offer_dialog),
+			  _("_Keep Current Location"), GTK_RESPONSE_CANCEL,
+			  _("_Switch Location"), GTK_RESPONSE_OK,
+			  NULL);
+  gtk_dialog_set_default_response (GTK_DIALOG (priv->offer_dialog), GTK_RESPONSE_OK);
+
+  g_signal_connect (G_OBJECT (priv->offer_dialog), "response",
+		    G_CALLBACK (on_offer_dialog_response), combo);
+  g_signal_connect (G_OBJECT (priv->offer_dialog), "destroy",
+		    G_CALLBACK (gtk_widget_destroyed), &priv->offer_dialog);
+
+  gtk_widget_show (priv->offer_dialog);
+}
+
+static void
+on_environment_changed (GstLocationDetector *detector, gpointer data)
+{
+  GstLocationsCombo *combo = GST_LOCATIONS_COMBO (data);
+  GstLocationsComboPrivate *priv = combo->_priv;
+  GtkTreeIter iter;
+  gchar *name, *active = NULL;
+
+  name = gst_network_locations_match_environment (GST_NETWORK_LOCATIONS (combo),
+						  gst_location_detector_get_environment (detector));
+
+  if (!name)
+    {
+      /* left the known network, offer it again when coming back */
+      g_free (priv->offered);
+      priv->offered = NULL;
+      return;
+    }
+
+  if (gtk_combo_box_get_active_iter (GTK_COMBO_BOX (priv->combo), &iter))
+    gtk_tree_model_get (priv->model, &iter, 0, &active, -1);
+
+  /* don't insist on a location that is in use or was already offered */
+  if ((active && strcmp (active, name) == 0) ||
+      (priv->offered && strcmp (priv->offered, name) == 0))
+    g_free (name);
+  else
+    {
+      g_free (priv->offered);
+      priv->offered = name;
+      offer_location (combo);
+    }
+
+  g_free (active);
+}
+
 static GObject*
 gst_locations_combo_constructor (GType                  type,
 				 guint                  n_construct_properties,
@@ -480,6 +591,10 @@ gst_locations_combo_constructor (GType                  type,
   g_signal_connect (G_OBJECT (priv->delete_button), "clicked",
 		    G_CALLBACK (on_delete_button_clicked), object);
 
+  priv->detector = gst_location_detector_new ();
+  g_signal_connect (G_OBJECT (priv->detector), "changed",
+		    G_CALLBACK (on_environment_changed), object);
+
   return object;
 }
 
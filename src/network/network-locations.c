@@ -27,6 +27,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
 
 #define GST_NETWORK_LOCATIONS_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), GST_TYPE_NETWORK_LOCATIONS, GstNetworkLocationsPrivate))
 
@@ -37,8 +39,17 @@ typedef struct _GstNetworkLocationsPrivate GstNetworkLocationsPrivate;
 
 struct _GstNetworkLocationsPrivate
 {
-  GFileMonitor *directory_monitor;
-  gchar *dot_dir;
+  GFileMonitor *store_monitor;
+  gchar *store_path;
+  gchar *legacy_dir;		/* one key file per location, before the store */
+
+  /* see get_location_digest() */
+  GHashTable *entries;		/* name -> LocationEntry, parsed on demand */
+  GHashTable *digests;		/* location digest -> name */
+  gchar *index_layout;		/* interfaces layout digests were computed for */
+
+  /* see gst_network_locations_match_environment() */
+  GHashTable *markers;		/* environment marker -> GSList of LocationEntry */
 };
 
 enum {
@@ -58,17 +69,56 @@ enum {
 typedef struct _PropType PropType;
 
 struct _PropType {
-  gchar *key;
+  const gchar *key;
+  gint type;
+  GCallback getter;		/* typed accessor, or NULL to go through GObject */
+};
+
+typedef G_CONST_RETURN gchar * (* PropStringGetter)   (OobsIface *iface);
+typedef gint                   (* PropIntGetter)      (OobsIface *iface);
+typedef gboolean               (* PropBooleanGetter)  (OobsIface *iface);
+typedef OobsIfaceEthernet *    (* PropEthernetGetter) (OobsIface *iface);
+
+typedef struct _PropAccessor PropAccessor;
+
+struct _PropAccessor {
+  GType (* owner_type) (void);
+  const gchar *key;
   gint type;
+  GCallback getter;
+};
+
+static const OobsIfaceType iface_types[] = {
+  OOBS_IFACE_TYPE_ETHERNET,
+  OOBS_IFACE_TYPE_WIRELESS,
+  OOBS_IFACE_TYPE_IRLAN,
+  OOBS_IFACE_TYPE_PLIP,
+  OOBS_IFACE_TYPE_PPP
+};
+
+/* Properties read through their liboobs accessor instead of g_object_get() */
+static const PropAccessor prop_accessors[] = {
+  { oobs_iface_get_type, "active", TYPE_BOOLEAN, G_CALLBACK (oobs_iface_get_active) },
+  { oobs_iface_get_type, "configured", TYPE_BOOLEAN, G_CALLBACK (oobs_iface_get_configured) },
+  { oobs_iface_ethernet_get_type, "config-method", TYPE_STRING, G_CALLBACK (oobs_iface_ethernet_get_configuration_method) },
+  { oobs_iface_ethernet_get_type, "ip-address", TYPE_STRING, G_CALLBACK (oobs_iface_ethernet_get_ip_address) },
+  { oobs_iface_ethernet_get_type, "ip-mask", TYPE_STRING, G_CALLBACK (oobs_iface_ethernet_get_network_mask) },
+  { oobs_iface_wireless_get_type, "essid", TYPE_STRING, G_CALLBACK (oobs_iface_wireless_get_essid) },
+  { oobs_iface_plip_get_type, "address", TYPE_STRING, G_CALLBACK (oobs_iface_plip_get_address) },
+  { oobs_iface_plip_get_type, "remote-address", TYPE_STRING, G_CALLBACK (oobs_iface_plip_get_remote_address) },
+  { oobs_iface_ppp_get_type, "connection-type", TYPE_STRING, G_CALLBACK (oobs_iface_ppp_get_connection_type) },
+  { oobs_iface_ppp_get_type, "phone-number", TYPE_STRING, G_CALLBACK (oobs_iface_ppp_get_phone_number) },
+  { oobs_iface_ppp_get_type, "apn", TYPE_STRING, G_CALLBACK (oobs_iface_ppp_get_apn) },
+  { oobs_iface_ppp_get_type, "ethernet", TYPE_ETHERNET, G_CALLBACK (oobs_iface_ppp_get_ethernet) }
 };
 
-typedef gboolean (InterfaceForeachFunc) (OobsIface *iface,
-					 GPtrArray *props,
-					 GKeyFile  *key_file);
+/* Property schema of each interface type, built once and never freed */
+static GPtrArray *iface_schemas [G_N_ELEMENTS (iface_types)] = { NULL, };
 
 static void   gst_network_locations_class_init (GstNetworkLocationsClass *class);
 static void   gst_network_locations_init       (GstNetworkLocations *locations);
 static void   gst_network_locations_finalize   (GObject *object);
+static void   invalidate_index                 (GstNetworkLocationsPrivate *priv);
 
 
 G_DEFINE_TYPE (GstNetworkLocations, gst_network_locations, G_TYPE_OBJECT);
@@ -95,28 +145,42 @@ gst_network_locations_class_init (GstNetworkLocationsClass *class)
 
 #define GNOME_DOT_GNOME ".gnome2/"
 
+/* Store format: version, then an array of locations, see location_entry_to_variant() */
+#define STORE_VERSION 2
+#define STORE_ENTRY_TYPE "(ssssasasasa{sa{ss}}(sass))"
+#define STORE_TYPE "(ua" STORE_ENTRY_TYPE ")"
+
+/* version 1 didn't record the environment locations are used in */
+#define STORE_V1_TYPE "(ua(ssssasasasa{sa{ss}}))"
+
+/* Weight of each environment marker when matching, see gst_network_locations_match_environment() */
+#define MATCH_GATEWAY_WEIGHT 4
+#define MATCH_DOMAIN_WEIGHT  2
+#define MATCH_ESSID_WEIGHT   1
+#define MATCH_THRESHOLD      2
+
 static gchar*
-create_dot_dir ()
+get_store_path ()
 {
-  gchar *dir;
+  gchar *dir, *path;
 
-  dir = g_build_filename (g_get_home_dir (),
-			  GNOME_DOT_GNOME,
-			  "network-admin-locations",
-			  NULL);
+  dir = g_build_filename (g_get_home_dir (), GNOME_DOT_GNOME, NULL);
 
   if (!g_file_test (dir, G_FILE_TEST_EXISTS | G_FILE_TEST_IS_DIR))
     g_mkdir_with_parents (dir, 0700);
 
-  return dir;
+  path = g_build_filename (dir, "network-admin-locations.db", NULL);
+  g_free (dir);
+
+  return path;
 }
 
 static void
-directory_monitor_changed (GFileMonitor      *monitor,
-			   GFile             *file,
-			   GFile             *other_file,
-			   GFileMonitorEvent  event,
-			   gpointer           data)
+store_monitor_changed (GFileMonitor      *monitor,
+		       GFile             *file,
+		       GFile             *other_file,
+		       GFileMonitorEvent  event,
+		       gpointer           data)
 {
   GstNetworkLocations *locations;
 
@@ -127,6 +191,7 @@ directory_monitor_changed (GFileMonitor      *monitor,
     case G_FILE_MONITOR_EVENT_CHANGED:
     case G_FILE_MONITOR_EVENT_DELETED:
     case G_FILE_MONITOR_EVENT_CREATED:
+      invalidate_index (locations->_priv);
       g_signal_emit (locations, signals[CHANGED], 0);
       break;
     default:
@@ -146,14 +211,18 @@ gst_network_locations_init (GstNetworkLocations *locations)
   locations->ifaces_config = oobs_ifaces_config_get ();
   locations->hosts_config = oobs_hosts_config_get ();
 
-  priv->dot_dir = create_dot_dir ();
+  priv->store_path = get_store_path ();
+  priv->legacy_dir = g_build_filename (g_get_home_dir (),
+				       GNOME_DOT_GNOME,
+				       "network-admin-locations",
+				       NULL);
 
-  file = g_file_new_for_path (priv->dot_dir);
-  priv->directory_monitor = g_file_monitor_directory (file, G_FILE_MONITOR_NONE, NULL, &error);
+  file = g_file_new_for_path (priv->store_path);
+  priv->store_monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, &error);
 
-  if (priv->directory_monitor)
-    g_signal_connect (priv->directory_monitor, "changed",
-		      G_CALLBACK (directory_monitor_changed), locations);
+  if (priv->store_monitor)
+    g_signal_connect (priv->store_monitor, "changed",
+		      G_CALLBACK (store_monitor_changed), locations);
   else if (error)
     {
       g_warning ("%s", error->message);
@@ -170,10 +239,12 @@ gst_network_locations_finalize (GObject *object)
 
   priv = GST_NETWORK_LOCATIONS (object)->_priv;
 
-  g_free (priv->dot_dir);
+  invalidate_index (priv);
+  g_free (priv->store_path);
+  g_free (priv->legacy_dir);
 
-  if (priv->directory_monitor)
-    g_object_unref (priv->directory_monitor);
+  if (priv->store_monitor)
+    g_object_unref (priv->store_monitor);
 
   G_OBJECT_CLASS (gst_network_locations_parent_class)->finalize (object);
 }
@@ -210,18 +281,15 @@ replace_string (const gchar *str,
   return new_str;
 }
 
-GList*
-gst_network_locations_get_names (GstNetworkLocations *locations)
+/* Location names in the legacy directory, only read for migrating it */
+static GList*
+get_legacy_names (GstNetworkLocationsPrivate *priv)
 {
-  GstNetworkLocationsPrivate *priv;
   const gchar *name;
   GList *list = NULL;
   GDir *dir;
 
-  g_return_val_if_fail (GST_IS_NETWORK_LOCATIONS (locations), NULL);
-
-  priv = GST_NETWORK_LOCATIONS_GET_PRIVATE (locations);
-  dir = g_dir_open (priv->dot_dir, 0, NULL);
+  dir = g_dir_open (priv->legacy_dir, 0, NULL);
 
   if (!dir)
     return NULL;
@@ -256,7 +324,7 @@ get_location_key_file (GstNetworkLocations *locations,
 
   filename = g_filename_from_utf8 (name, -1, NULL, NULL, NULL);
   str = replace_string (filename, "/", SLASH);
-  path = g_build_filename (priv->dot_dir, str, NULL);
+  path = g_build_filename (priv->legacy_dir, str, NULL);
 
   if (!g_key_file_load_from_file (key_file, path, 0, NULL))
     {
@@ -296,155 +364,6 @@ compare_string (const gchar *str1,
   return (strcmp (str1, str2) == 0);
 }
 
-static gboolean
-compare_list (GList *list1,
-	      GList *list2)
-{
-  GList *elem1, *elem2;
-
-  elem1 = list1;
-  elem2 = list2;
-
-  while (elem1 && elem2)
-    {
-      if (!compare_string (elem1->data, elem2->data))
-	return FALSE;
-
-      elem1 = elem1->next;
-      elem2 = elem2->next;
-    }
-
-  if (!elem1 && !elem2)
-    return TRUE;
-
-  return FALSE;
-}
-
-static gboolean
-compare_string_list (GKeyFile    *key_file,
-		     const gchar *key,
-		     GList       *list)
-{
-  GList *list1;
-  gchar **str_list;
-  gboolean result;
-  
-  str_list = g_key_file_get_string_list (key_file, "general", key, NULL, NULL);
-  list1 = array_to_list ((const gchar**) str_list);
-  g_strfreev (str_list);
-
-  result = compare_list (list1, list);
-
-  g_list_foreach (list1, (GFunc) g_free, NULL);
-  g_list_free (list1);
-
-  return result;
-}
-
-static gboolean
-compare_static_host (const gchar    *str,
-		     OobsStaticHost *static_host)
-{
-  gchar **split;
-  const gchar *ip_address;
-  GList *list1, *list2 = NULL;
-  gboolean equal = TRUE;
-
-  split = g_strsplit (str, ";", -1);
-  ip_address = split[0];
-  list1 = array_to_list ((const gchar**) &split[1]);
-
-  equal = compare_string (ip_address, oobs_static_host_get_ip_address (static_host));
-
-  if (equal)
-    {
-      list2 = oobs_static_host_get_aliases (static_host);
-      equal = compare_list (list1, list2);
-    }
-
-  g_strfreev (split);
-  g_list_foreach (list1, (GFunc) g_free, NULL);
-  g_list_free (list1);
-  g_list_free (list2);
-
-  return equal;
-}
-
-static gboolean
-compare_static_hosts (OobsHostsConfig *hosts_config,
-		      GKeyFile        *key_file)
-{
-  gchar **str_list;
-  OobsList *static_hosts;
-  OobsListIter iter;
-  OobsStaticHost *static_host;
-  gboolean valid, equal = TRUE;
-  gint i = 0;
-
-  str_list = g_key_file_get_string_list (key_file, "general", "static-hosts", NULL, NULL);
-  static_hosts = oobs_hosts_config_get_static_hosts (hosts_config);
-  valid = oobs_list_get_iter_first (static_hosts, &iter);
-
-  while (str_list[i] && valid && equal)
-    {
-      static_host = OOBS_STATIC_HOST (oobs_list_get (static_hosts, &iter));
-      equal = compare_static_host (str_list[i], static_host);
-      g_object_unref (static_host);
-
-      valid = oobs_list_iter_next (static_hosts, &iter);
-      i++;
-    }
-
-  if (str_list[i] || valid)
-    equal = FALSE;
-
-  g_strfreev (str_list);
-
-  return equal;
-}
-
-static gboolean
-compare_hosts_config (OobsHostsConfig *hosts_config,
-		      GKeyFile        *key_file)
-{
-  GList *list;
-  gboolean result;
-  gchar *str;
-
-  str = g_key_file_get_string (key_file, "general", "hostname", NULL);
-  result = compare_string (str, oobs_hosts_config_get_hostname (hosts_config));
-  g_free (str);
-
-  if (!result)
-    return FALSE;
-
-  str = g_key_file_get_string (key_file, "general", "domainname", NULL);
-  result = compare_string (str, oobs_hosts_config_get_domainname (hosts_config));
-  g_free (str);
-
-  if (!result)
-    return FALSE;
-
-  list = oobs_hosts_config_get_dns_servers (hosts_config);
-  result = compare_string_list (key_file, "dns-servers", list);
-  g_list_free (list);
-
-  if (!result)
-    return FALSE;
-
-  list = oobs_hosts_config_get_search_domains (hosts_config);
-  result = compare_string_list (key_file, "search-domains", list);
-  g_list_free (list);
-
-  if (!result)
-    return FALSE;
-
-  if (!compare_static_hosts (hosts_config, key_file))
-    return FALSE;
-
-  return TRUE;
-}
-
 /* code to support/migrate legacy parameters */
 static void
 migrate_old_parameters (GKeyFile    *key_file,
@@ -483,6 +402,23 @@ migrate_old_parameters (GKeyFile    *key_file,
   g_key_file_set_string (key_file, section, key, values[value]);
 }
 
+static GCallback
+lookup_prop_accessor (GParamSpec *param,
+		      gint        type)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (prop_accessors); i++)
+    {
+      if (prop_accessors[i].type == type &&
+	  param->owner_type == prop_accessors[i].owner_type () &&
+	  strcmp (param->name, prop_accessors[i].key) == 0)
+	return prop_accessors[i].getter;
+    }
+
+  return NULL;
+}
+
 static GPtrArray *
 get_interface_properties (OobsIface *iface)
 {
@@ -522,8 +458,9 @@ get_interface_properties (OobsIface *iface)
 	}
 
       prop = g_slice_new (PropType);
-      prop->key = g_strdup (params[i]->name);
+      prop->key = g_intern_string (params[i]->name);
       prop->type = type;
+      prop->getter = lookup_prop_accessor (params[i], type);
 
       g_ptr_array_add (array, prop);
     }
@@ -533,362 +470,1162 @@ get_interface_properties (OobsIface *iface)
   return array;
 }
 
-static void
-free_prop (PropType *prop)
-{
-  g_free (prop->key);
-  g_slice_free (PropType, prop);
-}
-
-static gboolean
-compare_interface (OobsIface *iface,
-		   GPtrArray *props,
-		   GKeyFile  *key_file)
+/* Schema for the interface type at @type_index, introspected from @iface the first time */
+static GPtrArray *
+get_iface_schema (guint      type_index,
+		  OobsIface *iface)
 {
-  gboolean equal = FALSE;
-  gchar *name;
-  guint i;
-
-  g_object_get (iface, "device", &name, NULL);
-
-  for (i = 0; i < props->len; i++)
-    {
-      PropType *prop;
-
-      prop = g_ptr_array_index (props, i);
-      migrate_old_parameters (key_file, name, prop->key);
+  if (!iface_schemas[type_index])
+    iface_schemas[type_index] = get_interface_properties (iface);
 
-      if (prop->type == TYPE_STRING)
-	{
-	  gchar *value1, *value2;
-
-	  value1 = g_key_file_get_string (key_file, name, prop->key, NULL);
-	  g_object_get (iface, prop->key, &value2, NULL);
-
-	  equal = compare_string (value1, value2);
-	  g_free (value1);
-	  g_free (value2);
-	}
-      else if (prop->type == TYPE_INT)
-	{
-	  gint value1, value2;
+  return iface_schemas[type_index];
+}
 
-	  value1 = g_key_file_get_integer (key_file, name, prop->key, NULL);
-	  g_object_get (iface, prop->key, &value2, NULL);
-	  equal = (value1 == value2);
-	}
-      else if (prop->type == TYPE_BOOLEAN)
-	{
-	  gboolean value1, value2;
+/* Location fingerprints
+ *
+ * All locations live in a single GVariant store, along with the digest
+ * of their hosts settings. It is mapped and parsed once into LocationEntry
+ * structures, kept until the store changes, so that looking up a location
+ * by name is a hash lookup. Finding the current location compares digests:
+ * interface sections are only compared for the interfaces present in the
+ * live configuration, so location digests are computed for a given
+ * interfaces layout, and computed again when it changes.
+ */
 
-	  value1 = g_key_file_get_boolean (key_file, name, prop->key, NULL);
-	  g_object_get (iface, prop->key, &value2, NULL);
-	  equal = ((value1 == TRUE) == (value2 == TRUE));
-	}
-      else if (prop->type == TYPE_ETHERNET)
-	{
-	  OobsIfaceEthernet *ethernet;
-	  gchar *value1, *value2;
+typedef struct _LocationEntry LocationEntry;
 
-	  value1 = g_key_file_get_string (key_file, name, prop->key, NULL);
-	  value2 = NULL;
+struct _LocationEntry
+{
+  gchar      *name;
+  gchar      *hostname;
+  gchar      *domainname;
+  gchar     **dns_servers;
+  gchar     **search_domains;
+  gchar     **static_hosts;	/* "address;alias;alias" */
+  gchar      *hosts_digest;
+  GHashTable *sections;		/* device -> (key -> value) */
+
+  GstNetworkEnvironment environment;	/* where it was last used, if known */
+};
 
-	  g_object_get (iface, prop->key, &ethernet, NULL);
+typedef struct _Layout Layout;
 
-	  if (ethernet)
-	    {
-	      g_object_get (ethernet, "device", &value2, NULL);
-	      g_object_unref (ethernet);
-	    }
+struct _Layout
+{
+  GPtrArray *ifaces;		/* OobsIface */
+  GPtrArray *props;		/* schema of each interface */
+  gchar     *key;
+};
 
-	  equal = compare_string (value1, value2);
+static void
+free_location_entry (LocationEntry *entry)
+{
+  g_free (entry->name);
+  g_free (entry->hostname);
+  g_free (entry->domainname);
+  g_strfreev (entry->dns_servers);
+  g_strfreev (entry->search_domains);
+  g_strfreev (entry->static_hosts);
+  g_free (entry->hosts_digest);
+  g_hash_table_destroy (entry->sections);
+  g_free (entry->environment.gateway);
+  g_strfreev (entry->environment.essids);
+  g_free (entry->environment.domain);
+  g_slice_free (LocationEntry, entry);
+}
 
-	  g_free (value1);
-	  g_free (value2);
-	}
-      else
-	g_assert_not_reached ();
+static void
+free_layout (Layout *layout)
+{
+  g_ptr_array_foreach (layout->ifaces, (GFunc) g_object_unref, NULL);
+  g_ptr_array_free (layout->ifaces, TRUE);
+  g_ptr_array_free (layout->props, TRUE);
+  g_free (layout->key);
+  g_slice_free (Layout, layout);
+}
 
-      if (!equal)
-	break;
+/* Drops everything computed out of the entries */
+static void
+invalidate_lookups (GstNetworkLocationsPrivate *priv)
+{
+  if (priv->digests)
+    {
+      g_hash_table_destroy (priv->digests);
+      priv->digests = NULL;
     }
 
-  g_free (name);
+  if (priv->markers)
+    {
+      g_hash_table_destroy (priv->markers);
+      priv->markers = NULL;
+    }
 
-  return equal;
+  g_free (priv->index_layout);
+  priv->index_layout = NULL;
 }
 
-static gboolean
-interfaces_list_foreach (OobsIfacesConfig     *config,
-			 OobsIfaceType         iface_type,
-			 InterfaceForeachFunc  func,
-			 GKeyFile             *key_file)
+static void
+invalidate_index (GstNetworkLocationsPrivate *priv)
 {
-  OobsList *list;
-  OobsListIter iter;
-  gboolean valid, cont = TRUE;
-  GObject *iface;
-  GPtrArray *props = NULL;
-
-  list = oobs_ifaces_config_get_ifaces (config, iface_type);
-  valid = oobs_list_get_iter_first (list, &iter);
-
-  while (valid && cont)
+  if (priv->entries)
     {
-      iface = oobs_list_get (list, &iter);
-
-      if (!props)
-	props = get_interface_properties (OOBS_IFACE (iface));
-
-      cont = func (OOBS_IFACE (iface), props, key_file);
-      g_object_unref (iface);
-
-      valid = oobs_list_iter_next (list, &iter);
+      g_hash_table_destroy (priv->entries);
+      priv->entries = NULL;
     }
 
-  if (props)
-    {
-      g_ptr_array_foreach (props, (GFunc) free_prop, NULL);
-      g_ptr_array_free (props, FALSE);
-    }
+  invalidate_lookups (priv);
+}
+
+/* Strings are added with their terminating nul, so that they can't run into each other */
+static void
+checksum_add (GChecksum   *checksum,
+	      const gchar *str)
+{
+  if (!str)
+    str = "";
 
-  return cont;
+  g_checksum_update (checksum, (const guchar *) str, strlen (str) + 1);
 }
 
-static gboolean
-compare_interfaces (OobsIfacesConfig *config,
-		    GKeyFile         *key_file)
-{
-  if (!interfaces_list_foreach (config, OOBS_IFACE_TYPE_ETHERNET, compare_interface, key_file) ||
-      !interfaces_list_foreach (config, OOBS_IFACE_TYPE_WIRELESS, compare_interface, key_file) ||
-      !interfaces_list_foreach (config, OOBS_IFACE_TYPE_IRLAN, compare_interface, key_file) ||
-      !interfaces_list_foreach (config, OOBS_IFACE_TYPE_PLIP, compare_interface, key_file) ||
-      !interfaces_list_foreach (config, OOBS_IFACE_TYPE_PPP, compare_interface, key_file))
-    return FALSE;
+static void
+checksum_add_list (GChecksum   *checksum,
+		   const gchar *key,
+		   GList       *list)
+{
+  gchar count[16];
 
-  return TRUE;
+  checksum_add (checksum, key);
+  g_snprintf (count, sizeof (count), "%u", g_list_length (list));
+  checksum_add (checksum, count);
+
+  for (; list; list = list->next)
+    checksum_add (checksum, list->data);
 }
 
-static gboolean
-compare_location (GstNetworkLocations *locations,
-		  const gchar         *name)
+static void
+checksum_add_strv (GChecksum    *checksum,
+		   const gchar  *key,
+		   gchar       **strv)
 {
-  GstNetworkLocationsPrivate *priv;
-  GKeyFile *key_file;
-  gboolean equal;
+  GList *list;
 
-  priv = (GstNetworkLocationsPrivate *) locations->_priv;
-  key_file = get_location_key_file (locations, name);
+  list = (strv) ? array_to_list ((const gchar **) strv) : NULL;
+  checksum_add_list (checksum, key, list);
 
-  if (!key_file)
-    return FALSE;
+  g_list_foreach (list, (GFunc) g_free, NULL);
+  g_list_free (list);
+}
+
+static gchar *
+checksum_free_to_string (GChecksum *checksum)
+{
+  gchar *digest;
 
-  equal = (compare_hosts_config (OOBS_HOSTS_CONFIG (locations->hosts_config), key_file) &&
-	   compare_interfaces (OOBS_IFACES_CONFIG (locations->ifaces_config), key_file));
+  digest = g_strdup (g_checksum_get_string (checksum));
+  g_checksum_free (checksum);
 
-  g_key_file_free (key_file);
-  return equal;
+  return digest;
 }
 
-gchar*
-gst_network_locations_get_current (GstNetworkLocations *locations)
+/* Static hosts are stored as "address;alias;alias" */
+static gchar *
+get_static_host_string (OobsStaticHost *static_host)
 {
-  GList *names, *elem;
-  gchar *location = NULL;
+  GList *list, *elem;
+  GString *str;
 
-  names = elem = gst_network_locations_get_names (locations);
+  str = g_string_new (oobs_static_host_get_ip_address (static_host));
+  list = elem = oobs_static_host_get_aliases (static_host);
 
-  while (elem && !location)
+  while (elem)
     {
-      if (compare_location (locations, elem->data))
-	location = g_strdup (elem->data);
-
+      g_string_append_printf (str, ";%s", (gchar *) elem->data);
       elem = elem->next;
     }
 
-  g_list_foreach (names, (GFunc) g_free, NULL);
-  g_list_free (names);
+  g_list_free (list);
 
-  return location;
+  return g_string_free (str, FALSE);
 }
 
-static void
-set_static_hosts (OobsHostsConfig *hosts_config,
-		  GKeyFile        *key_file)
+static gchar *
+get_hosts_config_digest (OobsHostsConfig *hosts_config)
 {
-  gchar **str_list, **elem, **split, *ip_address;
+  GChecksum *checksum;
   OobsList *static_hosts;
   OobsListIter iter;
-  OobsStaticHost *static_host;
-  GList *list;
+  GObject *static_host;
+  GList *list, *hosts = NULL;
+  gboolean valid;
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA1);
+
+  checksum_add (checksum, oobs_hosts_config_get_hostname (hosts_config));
+  checksum_add (checksum, oobs_hosts_config_get_domainname (hosts_config));
+
+  list = oobs_hosts_config_get_dns_servers (hosts_config);
+  checksum_add_list (checksum, "dns-servers", list);
+  g_list_free (list);
+
+  list = oobs_hosts_config_get_search_domains (hosts_config);
+  checksum_add_list (checksum, "search-domains", list);
+  g_list_free (list);
 
-  elem = str_list = g_key_file_get_string_list (key_file, "general", "static-hosts", NULL, NULL);
   static_hosts = oobs_hosts_config_get_static_hosts (hosts_config);
-  oobs_list_clear (static_hosts);
+  valid = oobs_list_get_iter_first (static_hosts, &iter);
 
-  while (*elem)
+  while (valid)
     {
-      split = g_strsplit (*elem, ";", -1);
-      ip_address = split[0];
-      list = array_to_list ((const gchar**) &split[1]);
-
-      static_host = oobs_static_host_new (ip_address, list);
-      oobs_list_append (static_hosts, &iter);
-      oobs_list_set (static_hosts, &iter, static_host);
+      static_host = oobs_list_get (static_hosts, &iter);
+      hosts = g_list_prepend (hosts, get_static_host_string (OOBS_STATIC_HOST (static_host)));
       g_object_unref (static_host);
-      g_strfreev (split);
 
-      elem++;
+      valid = oobs_list_iter_next (static_hosts, &iter);
     }
 
-  g_strfreev (str_list);
+  hosts = g_list_reverse (hosts);
+  checksum_add_list (checksum, "static-hosts", hosts);
+
+  g_list_foreach (hosts, (GFunc) g_free, NULL);
+  g_list_free (hosts);
+
+  return checksum_free_to_string (checksum);
 }
 
-static void
-set_hosts_config (OobsHostsConfig *hosts_config,
-		  GKeyFile        *key_file)
+static gchar *
+get_entry_hosts_digest (LocationEntry *entry)
 {
-  GList *list;
-  gchar **str_list;
-  gchar *str;
+  GChecksum *checksum;
 
-  str = g_key_file_get_string (key_file, "general", "hostname", NULL);
-  oobs_hosts_config_set_hostname (hosts_config, str);
-  g_free (str);
+  checksum = g_checksum_new (G_CHECKSUM_SHA1);
 
-  str = g_key_file_get_string (key_file, "general", "domainname", NULL);
-  oobs_hosts_config_set_domainname (hosts_config, str);
-  g_free (str);
+  checksum_add (checksum, entry->hostname);
+  checksum_add (checksum, entry->domainname);
+  checksum_add_strv (checksum, "dns-servers", entry->dns_servers);
+  checksum_add_strv (checksum, "search-domains", entry->search_domains);
+  checksum_add_strv (checksum, "static-hosts", entry->static_hosts);
 
-  str_list = g_key_file_get_string_list (key_file, "general", "dns-servers", NULL, NULL);
-  list = array_to_list ((const gchar**) str_list);
-  oobs_hosts_config_set_dns_servers (hosts_config, list);
-  g_strfreev (str_list);
+  return checksum_free_to_string (checksum);
+}
+
+/* Missing lists read as empty ones */
+static gchar **
+get_general_string_list (GKeyFile    *key_file,
+			 const gchar *key)
+{
+  gchar **strv;
 
-  str_list = g_key_file_get_string_list (key_file, "general", "search-domains", NULL, NULL);
-  list = array_to_list ((const gchar**) str_list);
-  oobs_hosts_config_set_search_domains (hosts_config, list);
-  g_strfreev (str_list);
+  strv = g_key_file_get_string_list (key_file, "general", key, NULL, NULL);
 
-  set_static_hosts (hosts_config, key_file);
+  return (strv) ? strv : g_new0 (gchar *, 1);
 }
 
-static OobsIface *
-get_ethernet_iface_by_name (const gchar *name)
+/* Same rules as g_key_file_get_integer(), missing or invalid values read as 0 */
+static gint
+parse_integer (const gchar *str)
 {
-  OobsIfacesConfig *config;
-  OobsList *list;
-  OobsListIter iter;
-  OobsIface *iface;
-  gboolean valid;
-
-  config = OOBS_IFACES_CONFIG (oobs_ifaces_config_get ());
-  list = oobs_ifaces_config_get_ifaces (config, OOBS_IFACE_TYPE_ETHERNET);
-  valid = oobs_list_get_iter_first (list, &iter);
+  gchar *end;
+  glong value;
 
-  while (valid)
-    {
-      iface = OOBS_IFACE (oobs_list_get (list, &iter));
+  if (!str || !*str)
+    return 0;
 
-      if (compare_string (name, oobs_iface_get_device_name (iface)))
-	return iface;
+  errno = 0;
+  value = strtol (str, &end, 10);
 
-      g_object_unref (iface);
-      valid = oobs_list_iter_next (list, &iter);
-    }
+  if (*end || errno || value > G_MAXINT || value < G_MININT)
+    return 0;
 
-  return NULL;
+  return (gint) value;
 }
 
 static gboolean
-set_interface (OobsIface *iface,
-	       GPtrArray *props,
-	       GKeyFile  *key_file)
+parse_boolean (const gchar *str)
 {
-  gchar *name;
-  guint i;
+  return (str && (strcmp (str, "true") == 0 || strcmp (str, "1") == 0));
+}
 
-  g_object_get (iface, "device", &name, NULL);
+/* Canonical string for a property value, read from the interface */
+static gchar *
+get_iface_value (OobsIface *iface,
+		 PropType  *prop)
+{
+  if (prop->type == TYPE_STRING)
+    {
+      gchar *value;
 
-  for (i = 0; i < props->len; i++)
+      if (prop->getter)
+	{
+	  const gchar *str;
+
+	  str = ((PropStringGetter) prop->getter) (iface);
+	  return g_strdup ((str) ? str : "");
+	}
+
+      g_object_get (iface, prop->key, &value, NULL);
+      return (value) ? value : g_strdup ("");
+    }
+  else if (prop->type == TYPE_INT)
+    {
+      gint value;
+
+      if (prop->getter)
+	value = ((PropIntGetter) prop->getter) (iface);
+      else
+	g_object_get (iface, prop->key, &value, NULL);
+
+      return g_strdup_printf ("%d", value);
+    }
+  else if (prop->type == TYPE_BOOLEAN)
+    {
+      gboolean value;
+
+      if (prop->getter)
+	value = ((PropBooleanGetter) prop->getter) (iface);
+      else
+	g_object_get (iface, prop->key, &value, NULL);
+
+      return g_strdup ((value) ? "true" : "false");
+    }
+  else if (prop->type == TYPE_ETHERNET)
+    {
+      OobsIfaceEthernet *ethernet;
+      gchar *value = NULL;
+
+      if (prop->getter)
+	{
+	  ethernet = ((PropEthernetGetter) prop->getter) (iface);
+	  return g_strdup ((ethernet) ? oobs_iface_get_device_name (OOBS_IFACE (ethernet)) : "");
+	}
+
+      g_object_get (iface, prop->key, &ethernet, NULL);
+
+      if (ethernet)
+	{
+	  value = g_strdup (oobs_iface_get_device_name (OOBS_IFACE (ethernet)));
+	  g_object_unref (ethernet);
+	}
+
+      return (value) ? value : g_strdup ("");
+    }
+
+  g_assert_not_reached ();
+  return NULL;
+}
+
+/* Canonical string for a property value, read from a location section */
+static gchar *
+get_section_value (GHashTable *section,
+		   PropType   *prop)
+{
+  const gchar *str = NULL;
+
+  if (section)
+    str = g_hash_table_lookup (section, prop->key);
+
+  if (prop->type == TYPE_STRING || prop->type == TYPE_ETHERNET)
+    return g_strdup ((str) ? str : "");
+  else if (prop->type == TYPE_INT)
+    return g_strdup_printf ("%d", parse_integer (str));
+  else if (prop->type == TYPE_BOOLEAN)
+    return g_strdup ((parse_boolean (str)) ? "true" : "false");
+
+  g_assert_not_reached ();
+  return NULL;
+}
+
+/*
+ * Digest of a whole location for @layout, with interface values read
+ * from @sections if given, else from the live interfaces.
+ */
+static gchar *
+get_location_digest (const gchar *hosts_digest,
+		     Layout      *layout,
+		     GHashTable  *sections)
+{
+  GChecksum *checksum;
+  OobsIface *iface;
+  GPtrArray *props;
+  GHashTable *section = NULL;
+  const gchar *device;
+  gchar *value;
+  guint i, j;
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA1);
+  checksum_add (checksum, hosts_digest);
+
+  for (i = 0; i < layout->ifaces->len; i++)
+    {
+      iface = g_ptr_array_index (layout->ifaces, i);
+      props = g_ptr_array_index (layout->props, i);
+      device = oobs_iface_get_device_name (iface);
+
+      if (sections)
+	section = g_hash_table_lookup (sections, (device) ? device : "");
+
+      checksum_add (checksum, device);
+
+      for (j = 0; j < props->len; j++)
+	{
+	  PropType *prop = g_ptr_array_index (props, j);
+
+	  value = (sections) ? get_section_value (section, prop) : get_iface_value (iface, prop);
+	  checksum_add (checksum, prop->key);
+	  checksum_add (checksum, value);
+	  g_free (value);
+	}
+    }
+
+  return checksum_free_to_string (checksum);
+}
+
+/* Live interfaces and their properties, in the order locations are compared */
+static Layout *
+get_layout (GstNetworkLocations *locations)
+{
+  Layout *layout;
+  OobsList *list;
+  OobsListIter iter;
+  GPtrArray *props;
+  GString *key;
+  GObject *iface;
+  gboolean valid;
+  guint i;
+
+  layout = g_slice_new (Layout);
+  layout->ifaces = g_ptr_array_new ();
+  layout->props = g_ptr_array_new ();
+  key = g_string_new (NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (iface_types); i++)
+    {
+      list = oobs_ifaces_config_get_ifaces (OOBS_IFACES_CONFIG (locations->ifaces_config), iface_types[i]);
+      valid = oobs_list_get_iter_first (list, &iter);
+
+      while (valid)
+	{
+	  iface = oobs_list_get (list, &iter);
+
+	  g_ptr_array_add (layout->ifaces, iface);
+	  g_ptr_array_add (layout->props, get_iface_schema (i, OOBS_IFACE (iface)));
+	  g_string_append_printf (key, "%d:%s\n", iface_types[i],
+				  oobs_iface_get_device_name (OOBS_IFACE (iface)));
+
+	  valid = oobs_list_iter_next (list, &iter);
+	}
+    }
+
+  layout->key = g_string_free (key, FALSE);
+
+  return layout;
+}
+
+static gchar *
+dup_nonempty (const gchar *str)
+{
+  return (str && *str) ? g_strdup (str) : NULL;
+}
+
+static void
+set_entry_environment (LocationEntry               *entry,
+		       const GstNetworkEnvironment *environment)
+{
+  entry->environment.gateway = (environment) ? dup_nonempty (environment->gateway) : NULL;
+  entry->environment.domain = (environment) ? dup_nonempty (environment->domain) : NULL;
+  entry->environment.essids = (environment && environment->essids) ?
+    g_strdupv (environment->essids) : g_new0 (gchar *, 1);
+}
+
+/* Parses a location from the legacy directory, migrating old parameters */
+static LocationEntry *
+load_legacy_location_entry (GstNetworkLocations *locations,
+			    const gchar         *name)
+{
+  LocationEntry *entry;
+  GKeyFile *key_file;
+  GHashTable *section;
+  gchar **groups, **keys, *value;
+  gint i, j;
+
+  key_file = get_location_key_file (locations, name);
+
+  if (!key_file)
+    return NULL;
+
+  entry = g_slice_new (LocationEntry);
+  entry->name = g_strdup (name);
+  entry->hostname = g_key_file_get_string (key_file, "general", "hostname", NULL);
+  entry->domainname = g_key_file_get_string (key_file, "general", "domainname", NULL);
+  entry->dns_servers = get_general_string_list (key_file, "dns-servers");
+  entry->search_domains = get_general_string_list (key_file, "search-domains");
+  entry->static_hosts = get_general_string_list (key_file, "static-hosts");
+  entry->hosts_digest = get_entry_hosts_digest (entry);
+  entry->sections = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+					   (GDestroyNotify) g_hash_table_destroy);
+  set_entry_environment (entry, NULL);
+
+  groups = g_key_file_get_groups (key_file, NULL);
+
+  for (i = 0; groups[i]; i++)
+    {
+      if (strcmp (groups[i], "general") == 0)
+	continue;
+
+      section = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+      keys = g_key_file_get_keys (key_file, groups[i], NULL, NULL);
+
+      for (j = 0; keys && keys[j]; j++)
+	{
+	  migrate_old_parameters (key_file, groups[i], keys[j]);
+	  value = g_key_file_get_string (key_file, groups[i], keys[j], NULL);
+
+	  if (value)
+	    g_hash_table_insert (section, g_strdup (keys[j]), value);
+	}
+
+      g_strfreev (keys);
+      g_hash_table_insert (entry->sections, g_strdup (groups[i]), section);
+    }
+
+  g_strfreev (groups);
+  g_key_file_free (key_file);
+
+  return entry;
+}
+
+static GVariant *
+location_entry_to_variant (LocationEntry *entry)
+{
+  GVariantBuilder sections, section;
+  GHashTableIter iter, section_iter;
+  const gchar *device, *key, *value;
+  GHashTable *props;
+
+  g_variant_builder_init (&sections, G_VARIANT_TYPE ("a{sa{ss}}"));
+  g_hash_table_iter_init (&iter, entry->sections);
+
+  while (g_hash_table_iter_next (&iter, (gpointer *) &device, (gpointer *) &props))
+    {
+      g_variant_builder_init (&section, G_VARIANT_TYPE ("a{ss}"));
+      g_hash_table_iter_init (&section_iter, props);
+
+      while (g_hash_table_iter_next (&section_iter, (gpointer *) &key, (gpointer *) &value))
+	g_variant_builder_add (&section, "{ss}", key, value);
+
+      g_variant_builder_add (&sections, "{s@a{ss}}", device,
+			     g_variant_builder_end (&section));
+    }
+
+  return g_variant_new ("(ssss@as@as@as@a{sa{ss}}(s@ass))",
+			entry->name,
+			(entry->hostname) ? entry->hostname : "",
+			(entry->domainname) ? entry->domainname : "",
+			entry->hosts_digest,
+			g_variant_new_strv ((const gchar * const *) entry->dns_servers, -1),
+			g_variant_new_strv ((const gchar * const *) entry->search_domains, -1),
+			g_variant_new_strv ((const gchar * const *) entry->static_hosts, -1),
+			g_variant_builder_end (&sections),
+			(entry->environment.gateway) ? entry->environment.gateway : "",
+			g_variant_new_strv ((const gchar * const *) entry->environment.essids, -1),
+			(entry->environment.domain) ? entry->environment.domain : "");
+}
+
+/* Reads both current and version 1 entries, the latter lack the environment */
+static LocationEntry *
+location_entry_from_variant (GVariant *value)
+{
+  LocationEntry *entry;
+  GstNetworkEnvironment environment;
+  GVariantIter fields, *sections, *props;
+  GHashTable *section;
+  const gchar *name, *hostname, *domainname, *hosts_digest;
+  const gchar *device, *key, *str;
+
+  g_variant_iter_init (&fields, value);
+  g_variant_iter_next (&fields, "&s", &name);
+  g_variant_iter_next (&fields, "&s", &hostname);
+  g_variant_iter_next (&fields, "&s", &domainname);
+  g_variant_iter_next (&fields, "&s", &hosts_digest);
+
+  entry = g_slice_new (LocationEntry);
+  entry->name = g_strdup (name);
+  entry->hostname = g_strdup (hostname);
+  entry->domainname = g_strdup (domainname);
+  entry->hosts_digest = g_strdup (hosts_digest);
+
+  g_variant_iter_next (&fields, "^as", &entry->dns_servers);
+  g_variant_iter_next (&fields, "^as", &entry->search_domains);
+  g_variant_iter_next (&fields, "^as", &entry->static_hosts);
+
+  entry->sections = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+					   (GDestroyNotify) g_hash_table_destroy);
+  g_variant_iter_next (&fields, "a{sa{ss}}", &sections);
+
+  while (g_variant_iter_loop (sections, "{&sa{ss}}", &device, &props))
+    {
+      section = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+      while (g_variant_iter_next (props, "{&s&s}", &key, &str))
+	g_hash_table_insert (section, g_strdup (key), g_strdup (str));
+
+      g_hash_table_insert (entry->sections, g_strdup (device), section);
+    }
+
+  g_variant_iter_free (sections);
+
+  if (g_variant_iter_next (&fields, "(&s^a&s&s)",
+			   &environment.gateway, &environment.essids, &environment.domain))
+    {
+      set_entry_environment (entry, &environment);
+      g_free (environment.essids);
+    }
+  else
+    set_entry_environment (entry, NULL);
+
+  return entry;
+}
+
+/*
+ * Reads the store into priv->entries, the file is mapped and every
+ * location is parsed in a single pass. Returns FALSE if there's no
+ * store yet.
+ */
+static gboolean
+load_store (GstNetworkLocations *locations)
+{
+  GstNetworkLocationsPrivate *priv;
+  GMappedFile *file;
+  GVariant *store, *entries, *value;
+  GVariantIter iter;
+  LocationEntry *entry;
+  GError *error = NULL;
+  gboolean byteswap;
+  guint32 version;
+
+  priv = (GstNetworkLocationsPrivate *) locations->_priv;
+  file = g_mapped_file_new (priv->store_path, FALSE, &error);
+
+  if (!file)
+    {
+      gboolean exists;
+
+      exists = !g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+
+      if (exists)
+	g_warning ("%s", error->message);
+
+      g_error_free (error);
+      return exists;
+    }
+
+  /* the version is the first member, at the start of the data */
+  version = 0;
+
+  if (g_mapped_file_get_length (file) >= sizeof (version))
+    memcpy (&version, g_mapped_file_get_contents (file), sizeof (version));
+
+  /* written on a machine with a different endianness */
+  byteswap = (version > STORE_VERSION &&
+	      GUINT32_SWAP_LE_BE (version) <= STORE_VERSION);
+
+  if (byteswap)
+    version = GUINT32_SWAP_LE_BE (version);
+
+  if (version < 1 || version > STORE_VERSION)
+    {
+      g_warning ("Unknown network locations store version %u, ignoring it", version);
+      g_mapped_file_unref (file);
+      return TRUE;
+    }
+
+  store = g_variant_new_from_data (G_VARIANT_TYPE ((version == 1) ? STORE_V1_TYPE : STORE_TYPE),
+				   g_mapped_file_get_contents (file),
+				   g_mapped_file_get_length (file),
+				   FALSE,
+				   (GDestroyNotify) g_mapped_file_unref,
+				   file);
+  g_variant_ref_sink (store);
+
+  if (byteswap)
+    {
+      GVariant *swapped;
+
+      swapped = g_variant_byteswap (store);
+      g_variant_unref (store);
+      store = g_variant_ref_sink (swapped);
+    }
+
+  entries = g_variant_get_child_value (store, 1);
+  g_variant_iter_init (&iter, entries);
+
+  while ((value = g_variant_iter_next_value (&iter)) != NULL)
+    {
+      entry = location_entry_from_variant (value);
+      g_hash_table_replace (priv->entries, entry->name, entry);
+      g_variant_unref (value);
+    }
+
+  g_variant_unref (entries);
+  g_variant_unref (store);
+
+  return TRUE;
+}
+
+/* Atomically replaces the store with the contents of priv->entries */
+static gboolean
+write_store (GstNetworkLocations *locations)
+{
+  GstNetworkLocationsPrivate *priv;
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  LocationEntry *entry;
+  GVariant *store;
+  GError *error = NULL;
+  gboolean retval;
+
+  priv = (GstNetworkLocationsPrivate *) locations->_priv;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a" STORE_ENTRY_TYPE));
+  g_hash_table_iter_init (&iter, priv->entries);
+
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+    g_variant_builder_add_value (&builder, location_entry_to_variant (entry));
+
+  store = g_variant_new ("(u@a" STORE_ENTRY_TYPE ")", STORE_VERSION,
+			 g_variant_builder_end (&builder));
+  g_variant_ref_sink (store);
+
+  retval = g_file_set_contents (priv->store_path,
+				g_variant_get_data (store),
+				g_variant_get_size (store),
+				&error);
+  if (!retval)
+    {
+      g_warning ("%s", error->message);
+      g_error_free (error);
+    }
+
+  g_variant_unref (store);
+
+  return retval;
+}
+
+/*
+ * Imports the locations saved one per file by previous versions, the
+ * legacy directory is left untouched so those can still read it.
+ */
+static void
+migrate_legacy_locations (GstNetworkLocations *locations)
+{
+  GstNetworkLocationsPrivate *priv;
+  LocationEntry *entry;
+  GList *names, *elem;
+
+  priv = (GstNetworkLocationsPrivate *) locations->_priv;
+  names = get_legacy_names (priv);
+
+  if (!names)
+    return;
+
+  for (elem = names; elem; elem = elem->next)
+    {
+      entry = load_legacy_location_entry (locations, elem->data);
+
+      if (entry)
+	g_hash_table_replace (priv->entries, entry->name, entry);
+    }
+
+  g_list_foreach (names, (GFunc) g_free, NULL);
+  g_list_free (names);
+
+  write_store (locations);
+}
+
+static void
+ensure_entries (GstNetworkLocations *locations)
+{
+  GstNetworkLocationsPrivate *priv;
+
+  priv = (GstNetworkLocationsPrivate *) locations->_priv;
+
+  if (priv->entries)
+    return;
+
+  priv->entries = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+					 (GDestroyNotify) free_location_entry);
+
+  if (!load_store (locations))
+    migrate_legacy_locations (locations);
+}
+
+GList*
+gst_network_locations_get_names (GstNetworkLocations *locations)
+{
+  GstNetworkLocationsPrivate *priv;
+  GHashTableIter iter;
+  const gchar *name;
+  GList *list = NULL;
+
+  g_return_val_if_fail (GST_IS_NETWORK_LOCATIONS (locations), NULL);
+
+  priv = (GstNetworkLocationsPrivate *) locations->_priv;
+
+  ensure_entries (locations);
+  g_hash_table_iter_init (&iter, priv->entries);
+
+  while (g_hash_table_iter_next (&iter, (gpointer *) &name, NULL))
+    list = g_list_prepend (list, g_strdup (name));
+
+  return g_list_sort (list, (GCompareFunc) g_utf8_collate);
+}
+
+gboolean
+gst_network_locations_has_location (GstNetworkLocations *locations,
+				    const gchar         *name)
+{
+  GstNetworkLocationsPrivate *priv;
+
+  g_return_val_if_fail (GST_IS_NETWORK_LOCATIONS (locations), FALSE);
+
+  priv = (GstNetworkLocationsPrivate *) locations->_priv;
+
+  ensure_entries (locations);
+
+  return (g_hash_table_lookup (priv->entries, name) != NULL);
+}
+
+/* Digest -> location name, for the live interfaces layout */
+static void
+build_digest_index (GstNetworkLocations *locations,
+		    Layout              *layout)
+{
+  GstNetworkLocationsPrivate *priv;
+  GHashTableIter iter;
+  LocationEntry *entry;
+
+  priv = (GstNetworkLocationsPrivate *) locations->_priv;
+
+  if (priv->digests)
+    g_hash_table_destroy (priv->digests);
+
+  priv->digests = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  g_free (priv->index_layout);
+  priv->index_layout = g_strdup (layout->key);
+
+  g_hash_table_iter_init (&iter, priv->entries);
+
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+    g_hash_table_insert (priv->digests,
+			 get_location_digest (entry->hosts_digest, layout, entry->sections),
+			 g_strdup (entry->name));
+}
+
+gchar*
+gst_network_locations_get_current (GstNetworkLocations *locations)
+{
+  GstNetworkLocationsPrivate *priv;
+  Layout *layout;
+  gchar *hosts_digest, *digest, *location;
+
+  g_return_val_if_fail (GST_IS_NETWORK_LOCATIONS (locations), NULL);
+
+  priv = (GstNetworkLocationsPrivate *) locations->_priv;
+
+  ensure_entries (locations);
+  layout = get_layout (locations);
+
+  if (!priv->digests || !compare_string (priv->index_layout, layout->key))
+    build_digest_index (locations, layout);
+
+  hosts_digest = get_hosts_config_digest (OOBS_HOSTS_CONFIG (locations->hosts_config));
+  digest = get_location_digest (hosts_digest, layout, NULL);
+  location = g_strdup (g_hash_table_lookup (priv->digests, digest));
+
+  g_free (hosts_digest);
+  g_free (digest);
+  free_layout (layout);
+
+  return location;
+}
+
+/* Location switching
+ *
+ * Only settings differing from the live configuration are changed, and
+ * the caller is told which configurations need to be committed, so that
+ * the backends aren't asked to reconfigure anything when nothing changed.
+ */
+
+static gboolean
+compare_string_list (GList  *list,
+		     gchar **strv)
+{
+  guint i = 0;
+
+  for (; list && strv[i]; list = list->next, i++)
+    {
+      if (!compare_string (list->data, strv[i]))
+	return FALSE;
+    }
+
+  return (!list && !strv[i]);
+}
+
+/*
+ * Compare static hosts position by position, replacing those that
+ * differ, and adding or removing trailing ones.
+ */
+static gboolean
+apply_static_hosts (OobsHostsConfig *hosts_config,
+		    gchar          **static_hosts)
+{
+  OobsList *list;
+  OobsListIter iter;
+  GObject *static_host;
+  gchar **split, *str;
+  GList *aliases;
+  gboolean valid, changed = FALSE;
+  guint i = 0;
+
+  list = oobs_hosts_config_get_static_hosts (hosts_config);
+  valid = oobs_list_get_iter_first (list, &iter);
+
+  while (valid || static_hosts[i])
+    {
+      if (valid && !static_hosts[i])
+	{
+	  valid = oobs_list_remove (list, &iter);
+	  changed = TRUE;
+	  continue;
+	}
+
+      if (valid)
+	{
+	  static_host = oobs_list_get (list, &iter);
+	  str = get_static_host_string (OOBS_STATIC_HOST (static_host));
+	  g_object_unref (static_host);
+
+	  if (strcmp (str, static_hosts[i]) == 0)
+	    {
+	      g_free (str);
+	      valid = oobs_list_iter_next (list, &iter);
+	      i++;
+	      continue;
+	    }
+
+	  g_free (str);
+	}
+      else
+	oobs_list_append (list, &iter);
+
+      split = g_strsplit (static_hosts[i], ";", -1);
+      aliases = array_to_list ((const gchar **) &split[1]);
+
+      static_host = G_OBJECT (oobs_static_host_new (split[0], aliases));
+      oobs_list_set (list, &iter, static_host);
+      g_object_unref (static_host);
+      g_strfreev (split);
+      changed = TRUE;
+
+      valid = oobs_list_iter_next (list, &iter);
+      i++;
+    }
+
+  return changed;
+}
+
+static gboolean
+apply_hosts_config (OobsHostsConfig *hosts_config,
+		    LocationEntry   *entry)
+{
+  GList *list;
+  gboolean equal, changed = FALSE;
+
+  if (!compare_string (entry->hostname, oobs_hosts_config_get_hostname (hosts_config)))
+    {
+      oobs_hosts_config_set_hostname (hosts_config, entry->hostname);
+      changed = TRUE;
+    }
+
+  if (!compare_string (entry->domainname, oobs_hosts_config_get_domainname (hosts_config)))
+    {
+      oobs_hosts_config_set_domainname (hosts_config, entry->domainname);
+      changed = TRUE;
+    }
+
+  list = oobs_hosts_config_get_dns_servers (hosts_config);
+  equal = compare_string_list (list, entry->dns_servers);
+  g_list_free (list);
+
+  if (!equal)
     {
-      PropType *prop;
+      oobs_hosts_config_set_dns_servers (hosts_config,
+					 array_to_list ((const gchar **) entry->dns_servers));
+      changed = TRUE;
+    }
 
-      prop = g_ptr_array_index (props, i);
-      migrate_old_parameters (key_file, name, prop->key);
+  list = oobs_hosts_config_get_search_domains (hosts_config);
+  equal = compare_string_list (list, entry->search_domains);
+  g_list_free (list);
 
-      if (prop->type == TYPE_STRING)
-	{
-	  gchar *value;
+  if (!equal)
+    {
+      oobs_hosts_config_set_search_domains (hosts_config,
+					    array_to_list ((const gchar **) entry->search_domains));
+      changed = TRUE;
+    }
 
-	  value = g_key_file_get_string (key_file, name, prop->key, NULL);
-	  g_object_set (iface, prop->key, value, NULL);
-	  g_free (value);
-	}
-      else if (prop->type == TYPE_INT)
-	{
-	  gint value;
+  if (apply_static_hosts (hosts_config, entry->static_hosts))
+    changed = TRUE;
 
-	  value = g_key_file_get_integer (key_file, name, prop->key, NULL);
-	  g_object_set (iface, prop->key, value, NULL);
-	}
-      else if (prop->type == TYPE_BOOLEAN)
-	{
-	  gboolean value;
+  return changed;
+}
 
-	  value = g_key_file_get_boolean (key_file, name, prop->key, NULL);
-	  g_object_set (iface, prop->key, value, NULL);
-	}
-      else if (prop->type == TYPE_ETHERNET)
-	{
-	  gchar *value;
-	  OobsIface *ethernet;
+static OobsIface *
+get_ethernet_iface_by_name (const gchar *name)
+{
+  OobsIfacesConfig *config;
+  OobsList *list;
+  OobsListIter iter;
+  OobsIface *iface;
+  gboolean valid;
 
-	  value = g_key_file_get_string (key_file, name, prop->key, NULL);
-	  ethernet = get_ethernet_iface_by_name (value);
+  config = OOBS_IFACES_CONFIG (oobs_ifaces_config_get ());
+  list = oobs_ifaces_config_get_ifaces (config, OOBS_IFACE_TYPE_ETHERNET);
+  valid = oobs_list_get_iter_first (list, &iter);
 
-	  if (ethernet)
-	    {
-	      g_object_set (iface, prop->key, ethernet, NULL);
-	      g_object_unref (ethernet);
-	    }
+  while (valid)
+    {
+      iface = OOBS_IFACE (oobs_list_get (list, &iter));
 
-	  g_free (value);
+      if (compare_string (name, oobs_iface_get_device_name (iface)))
+	return iface;
+
+      g_object_unref (iface);
+      valid = oobs_list_iter_next (list, &iter);
+    }
+
+  return NULL;
+}
+
+static void
+set_iface_value (OobsIface   *iface,
+		 PropType    *prop,
+		 const gchar *value)
+{
+  if (prop->type == TYPE_STRING)
+    g_object_set (iface, prop->key, value, NULL);
+  else if (prop->type == TYPE_INT)
+    g_object_set (iface, prop->key, parse_integer (value), NULL);
+  else if (prop->type == TYPE_BOOLEAN)
+    g_object_set (iface, prop->key, parse_boolean (value), NULL);
+  else if (prop->type == TYPE_ETHERNET)
+    {
+      OobsIface *ethernet;
+
+      ethernet = get_ethernet_iface_by_name (value);
+
+      if (ethernet)
+	{
+	  g_object_set (iface, prop->key, ethernet, NULL);
+	  g_object_unref (ethernet);
 	}
     }
+}
+
+/* Only set the properties that differ, returns whether any did */
+static gboolean
+apply_interface (OobsIface  *iface,
+		 GPtrArray  *props,
+		 GHashTable *section)
+{
+  gchar *value, *live_value;
+  gboolean changed = FALSE;
+  guint i;
+
+  for (i = 0; i < props->len; i++)
+    {
+      PropType *prop = g_ptr_array_index (props, i);
 
-  g_free (name);
+      value = get_section_value (section, prop);
+      live_value = get_iface_value (iface, prop);
 
-  return TRUE;
+      if (strcmp (value, live_value) != 0)
+	{
+	  set_iface_value (iface, prop,
+			   (section) ? g_hash_table_lookup (section, prop->key) : NULL);
+	  changed = TRUE;
+	}
+
+      g_free (value);
+      g_free (live_value);
+    }
+
+  return changed;
 }
 
-static void
-set_interfaces_config (OobsIfacesConfig *config,
-		       GKeyFile         *key_file)
+static gboolean
+apply_interfaces (GstNetworkLocations *locations,
+		  LocationEntry       *entry)
 {
-  interfaces_list_foreach (config, OOBS_IFACE_TYPE_ETHERNET, set_interface, key_file);
-  interfaces_list_foreach (config, OOBS_IFACE_TYPE_WIRELESS, set_interface, key_file);
-  interfaces_list_foreach (config, OOBS_IFACE_TYPE_IRLAN, set_interface, key_file);
-  interfaces_list_foreach (config, OOBS_IFACE_TYPE_PLIP, set_interface, key_file);
-  interfaces_list_foreach (config, OOBS_IFACE_TYPE_PPP, set_interface, key_file);
+  Layout *layout;
+  OobsIface *iface;
+  const gchar *device;
+  gboolean changed = FALSE;
+  guint i;
+
+  layout = get_layout (locations);
+
+  for (i = 0; i < layout->ifaces->len; i++)
+    {
+      iface = g_ptr_array_index (layout->ifaces, i);
+      device = oobs_iface_get_device_name (iface);
+
+      if (apply_interface (iface, g_ptr_array_index (layout->props, i),
+			   g_hash_table_lookup (entry->sections, (device) ? device : "")))
+	changed = TRUE;
+    }
+
+  free_layout (layout);
+
+  return changed;
 }
 
+/*
+ * Make the live configuration match the location @name. If given,
+ * @changes is set to the configurations which have been modified, and
+ * which should be committed.
+ */
 gboolean
-gst_network_locations_set_location (GstNetworkLocations *locations,
-				    const gchar         *name)
+gst_network_locations_set_location (GstNetworkLocations       *locations,
+				    const gchar               *name,
+				    GstNetworkLocationChanges *changes)
 {
   GstNetworkLocationsPrivate *priv;
-  GKeyFile *key_file;
+  GstNetworkLocationChanges applied = GST_NETWORK_LOCATION_CHANGED_NONE;
+  LocationEntry *entry;
+
+  g_return_val_if_fail (GST_IS_NETWORK_LOCATIONS (locations), FALSE);
 
   priv = (GstNetworkLocationsPrivate *) locations->_priv;
-  key_file = get_location_key_file (locations, name);
 
-  if (!key_file)
+  ensure_entries (locations);
+  entry = g_hash_table_lookup (priv->entries, name);
+
+  if (changes)
+    *changes = applied;
+
+  if (!entry)
     return FALSE;
 
-  set_hosts_config (OOBS_HOSTS_CONFIG (locations->hosts_config), key_file);
-  set_interfaces_config (OOBS_IFACES_CONFIG (locations->ifaces_config), key_file);
-  g_key_file_free (key_file);
+  if (apply_hosts_config (OOBS_HOSTS_CONFIG (locations->hosts_config), entry))
+    applied |= GST_NETWORK_LOCATION_CHANGED_HOSTS;
+
+  if (apply_interfaces (locations, entry))
+    applied |= GST_NETWORK_LOCATION_CHANGED_IFACES;
+
+  if (changes)
+    *changes = applied;
 
   return TRUE;
 }
@@ -911,39 +1648,14 @@ list_to_array (GList *list)
   return arr;
 }
 
-static gchar*
-concatenate_aliases (OobsStaticHost *static_host)
-{
-  GList *list, *elem;
-  GString *str;
-  gchar *s;
-
-  str = g_string_new ("");
-  list = elem = oobs_static_host_get_aliases (OOBS_STATIC_HOST (static_host));
-
-  while (elem)
-    {
-      g_string_append_printf (str, ";%s", (gchar *)elem->data);
-      elem = elem->next;
-    }
-
-  s = str->str;
-  g_string_free (str, FALSE);
-  g_list_free (list);
-
-  return s;
-}
-
-static void
-save_static_hosts (OobsHostsConfig *config,
-		   GKeyFile        *key_file)
+static gchar**
+get_static_hosts_array (OobsHostsConfig *config)
 {
   OobsList *list;
   OobsListIter iter;
   gboolean valid;
   GObject *static_host;
-  GString *str;
-  gchar **arr, *aliases;
+  gchar **arr;
   gint i = 0;
 
   list = oobs_hosts_config_get_static_hosts (config);
@@ -953,200 +1665,361 @@ save_static_hosts (OobsHostsConfig *config,
   while (valid)
     {
       static_host = oobs_list_get (list, &iter);
+      arr[i] = get_static_host_string (OOBS_STATIC_HOST (static_host));
 
-      str = g_string_new (oobs_static_host_get_ip_address (OOBS_STATIC_HOST (static_host)));
-      aliases = concatenate_aliases (OOBS_STATIC_HOST (static_host));
-      g_string_append (str, aliases);
-      arr[i] = str->str;
-
-      g_string_free (str, FALSE);
       g_object_unref (static_host);
-      g_free (aliases);
       valid = oobs_list_iter_next (list, &iter);
       i++;
     }
 
-  g_key_file_set_string_list (key_file, "general", "static-hosts",
-			      (const gchar**) arr, g_strv_length (arr));
-  g_strfreev (arr);
+  return arr;
 }
 
-static void
-save_hosts_config (OobsHostsConfig *config,
-		   GKeyFile        *key_file)
+/* Builds a location entry out of the live configuration */
+static LocationEntry *
+get_current_entry (GstNetworkLocations         *locations,
+		   const gchar                 *name,
+		   const GstNetworkEnvironment *environment)
 {
+  OobsHostsConfig *config;
+  LocationEntry *entry;
+  Layout *layout;
+  OobsIface *iface;
+  GPtrArray *props;
+  GHashTable *section;
+  const gchar *device;
   GList *list;
-  gchar **arr;
-  const gchar *str;
+  guint i, j;
 
-  str = oobs_hosts_config_get_hostname (config);
-  g_key_file_set_string (key_file, "general", "hostname", (str) ? str : "");
+  config = OOBS_HOSTS_CONFIG (locations->hosts_config);
 
-  str = oobs_hosts_config_get_domainname (config);
-  g_key_file_set_string (key_file, "general", "domainname", (str) ? str : "");
+  entry = g_slice_new (LocationEntry);
+  entry->name = g_strdup (name);
+  entry->hostname = g_strdup (oobs_hosts_config_get_hostname (config));
+  entry->domainname = g_strdup (oobs_hosts_config_get_domainname (config));
 
   list = oobs_hosts_config_get_dns_servers (config);
-  arr = list_to_array (list);
-  g_key_file_set_string_list (key_file, "general", "dns-servers",
-			      (const gchar**) arr, g_strv_length (arr));
+  entry->dns_servers = list_to_array (list);
   g_list_free (list);
-  g_strfreev (arr);
 
   list = oobs_hosts_config_get_search_domains (config);
-  arr = list_to_array (list);
-  g_key_file_set_string_list (key_file, "general", "search-domains",
-			      (const gchar**) arr, g_strv_length (arr));
+  entry->search_domains = list_to_array (list);
   g_list_free (list);
-  g_strfreev (arr);
 
-  save_static_hosts (config, key_file);
+  entry->static_hosts = get_static_hosts_array (config);
+  entry->hosts_digest = get_entry_hosts_digest (entry);
+  entry->sections = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+					   (GDestroyNotify) g_hash_table_destroy);
+  set_entry_environment (entry, environment);
+
+  layout = get_layout (locations);
+
+  for (i = 0; i < layout->ifaces->len; i++)
+    {
+      iface = g_ptr_array_index (layout->ifaces, i);
+      props = g_ptr_array_index (layout->props, i);
+      device = oobs_iface_get_device_name (iface);
+      section = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+      for (j = 0; j < props->len; j++)
+	{
+	  PropType *prop = g_ptr_array_index (props, j);
+
+	  g_hash_table_insert (section, g_strdup (prop->key),
+			       get_iface_value (iface, prop));
+	}
+
+      g_hash_table_insert (entry->sections, g_strdup ((device) ? device : ""), section);
+    }
+
+  free_layout (layout);
+
+  return entry;
 }
 
+/* Nothing detected yet, or offline */
 static gboolean
-save_interface (OobsIface *iface,
-		GPtrArray *props,
-		GKeyFile  *key_file)
+environment_is_empty (const GstNetworkEnvironment *environment)
 {
-  gchar *name;
-  guint i;
+  return (!environment ||
+	  ((!environment->gateway || !*environment->gateway) &&
+	   (!environment->domain || !*environment->domain) &&
+	   (!environment->essids || !environment->essids[0])));
+}
+
+/*
+ * Saves the live configuration as @name, replacing any location with the
+ * same name. @environment is the one the configuration is used in, if known,
+ * an empty one keeps the environment of the location being replaced.
+ */
+gboolean
+gst_network_locations_save_current (GstNetworkLocations         *locations,
+				    const gchar                 *name,
+				    const GstNetworkEnvironment *environment)
+{
+  GstNetworkLocationsPrivate *priv;
+  LocationEntry *entry, *old_entry;
 
-  g_object_get (iface, "device", &name, NULL);
+  g_return_val_if_fail (GST_IS_NETWORK_LOCATIONS (locations), FALSE);
+  g_return_val_if_fail (name && *name, FALSE);
 
-  for (i = 0; i < props->len; i++)
-    {
-      PropType *prop;
+  priv = (GstNetworkLocationsPrivate *) locations->_priv;
 
-      prop = g_ptr_array_index (props, i);
+  ensure_entries (locations);
+  old_entry = g_hash_table_lookup (priv->entries, name);
 
-      if (prop->type == TYPE_STRING)
-	{
-	  gchar *value;
+  if (old_entry && environment_is_empty (environment))
+    environment = &old_entry->environment;
 
-	  g_object_get (iface, prop->key, &value, NULL);
-	  g_key_file_set_string (key_file, name, prop->key, (value) ? value : "");
-	  g_free (value);
-	}
-      else if (prop->type == TYPE_INT)
-	{
-	  gint value;
+  entry = get_current_entry (locations, name, environment);
+  g_hash_table_replace (priv->entries, entry->name, entry);
+  invalidate_lookups (priv);
 
-	  g_object_get (iface, prop->key, &value, NULL);
-	  g_key_file_set_integer (key_file, name, prop->key, value);
-	}
-      else if (prop->type == TYPE_BOOLEAN)
-	{
-	  gboolean value;
+  return write_store (locations);
+}
 
-	  g_object_get (iface, prop->key, &value, NULL);
-	  g_key_file_set_boolean (key_file, name, prop->key, value);
-	}
-      else if (prop->type == TYPE_ETHERNET)
-	{
-	  OobsIface *ethernet;
-	  gchar *value = NULL;
+void
+gst_network_locations_delete_location (GstNetworkLocations *locations,
+				       const gchar         *name)
+{
+  GstNetworkLocationsPrivate *priv;
 
-	  g_object_get (iface, prop->key, &ethernet, NULL);
+  g_return_if_fail (GST_IS_NETWORK_LOCATIONS (locations));
 
-	  if (ethernet)
-	    {
-	      g_object_get (ethernet, "device", &value, NULL);
-	      g_object_unref (ethernet);
-	    }
+  priv = (GstNetworkLocationsPrivate *) locations->_priv;
 
-	  g_key_file_set_string (key_file, name, prop->key, (value) ? value : "");
-	  g_free (value);
-	}
+  ensure_entries (locations);
+
+  if (g_hash_table_remove (priv->entries, name))
+    {
+      invalidate_lookups (priv);
+      write_store (locations);
+    }
+}
+
+/* Environment matching
+ *
+ * Each location remembers the environment it was last used in. Gateway,
+ * domain and ESSIDs are indexed as markers, and the environment being
+ * matched scores each location sharing a marker with it, so matching
+ * costs a lookup per marker instead of a pass over every location.
+ */
+
+static gboolean
+compare_strv (gchar **strv1,
+	      gchar **strv2)
+{
+  guint i;
+
+  if (!strv1 || !strv2)
+    return (strv1 == strv2);
+
+  for (i = 0; strv1[i] && strv2[i]; i++)
+    {
+      if (strcmp (strv1[i], strv2[i]) != 0)
+	return FALSE;
     }
 
-  g_free (name);
+  return (!strv1[i] && !strv2[i]);
+}
 
-  return TRUE;
+GstNetworkEnvironment*
+gst_network_environment_copy (const GstNetworkEnvironment *environment)
+{
+  GstNetworkEnvironment *copy;
+
+  g_return_val_if_fail (environment != NULL, NULL);
+
+  copy = g_slice_new (GstNetworkEnvironment);
+  copy->gateway = g_strdup (environment->gateway);
+  copy->essids = g_strdupv (environment->essids);
+  copy->domain = g_strdup (environment->domain);
+
+  return copy;
+}
+
+gboolean
+gst_network_environment_equal (const GstNetworkEnvironment *environment1,
+			       const GstNetworkEnvironment *environment2)
+{
+  if (!environment1 || !environment2)
+    return (environment1 == environment2);
+
+  return (compare_string (environment1->gateway, environment2->gateway) &&
+	  compare_string (environment1->domain, environment2->domain) &&
+	  compare_strv (environment1->essids, environment2->essids));
+}
+
+void
+gst_network_environment_free (GstNetworkEnvironment *environment)
+{
+  if (!environment)
+    return;
+
+  g_free (environment->gateway);
+  g_strfreev (environment->essids);
+  g_free (environment->domain);
+  g_slice_free (GstNetworkEnvironment, environment);
 }
 
 static void
-save_interfaces (OobsIfacesConfig *config,
-		 GKeyFile         *key_file)
+add_marker (GHashTable    *markers,
+	    gchar         *marker,
+	    LocationEntry *entry)
 {
-  interfaces_list_foreach (config, OOBS_IFACE_TYPE_ETHERNET, save_interface, key_file);
-  interfaces_list_foreach (config, OOBS_IFACE_TYPE_WIRELESS, save_interface, key_file);
-  interfaces_list_foreach (config, OOBS_IFACE_TYPE_IRLAN, save_interface, key_file);
-  interfaces_list_foreach (config, OOBS_IFACE_TYPE_PLIP, save_interface, key_file);
-  interfaces_list_foreach (config, OOBS_IFACE_TYPE_PPP, save_interface, key_file);
+  GSList *list;
+
+  list = g_hash_table_lookup (markers, marker);
+
+  if (list)
+    {
+      /* keep the head, the table owns it */
+      list->next = g_slist_prepend (list->next, entry);
+      g_free (marker);
+    }
+  else
+    g_hash_table_insert (markers, marker, g_slist_prepend (NULL, entry));
 }
 
-static gboolean
-save_current (GstNetworkLocations *locations,
-	      const gchar         *name)
+static void
+ensure_markers (GstNetworkLocations *locations)
 {
-  GKeyFile *key_file;
   GstNetworkLocationsPrivate *priv;
-  gchar *contents, *filename, *path;
-  gboolean retval;
+  GHashTableIter iter;
+  LocationEntry *entry;
+  guint i;
 
-  priv = GST_NETWORK_LOCATIONS_GET_PRIVATE (locations);
+  priv = (GstNetworkLocationsPrivate *) locations->_priv;
 
-  key_file = g_key_file_new ();
-  g_key_file_set_list_separator (key_file, ',');
-  save_hosts_config (OOBS_HOSTS_CONFIG (locations->hosts_config), key_file);
-  save_interfaces (OOBS_IFACES_CONFIG (locations->ifaces_config), key_file);
+  if (priv->markers)
+    return;
 
-  contents = g_key_file_to_data (key_file, NULL, NULL);
-  g_key_file_free (key_file);
+  priv->markers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+					 (GDestroyNotify) g_slist_free);
+  g_hash_table_iter_init (&iter, priv->entries);
 
-  if (!contents)
-    return FALSE;
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+    {
+      if (entry->environment.gateway)
+	add_marker (priv->markers, g_strconcat ("g:", entry->environment.gateway, NULL), entry);
 
-  filename = g_filename_from_utf8 (name, -1, NULL, NULL, NULL);
-  path = g_build_filename (priv->dot_dir, filename, NULL);
-  retval = g_file_set_contents (path, contents, -1, NULL);
+      if (entry->environment.domain)
+	add_marker (priv->markers, g_strconcat ("d:", entry->environment.domain, NULL), entry);
 
-  g_free (contents);
-  g_free (filename);
-  g_free (path);
+      for (i = 0; entry->environment.essids[i]; i++)
+	add_marker (priv->markers, g_strconcat ("e:", entry->environment.essids[i], NULL), entry);
+    }
+}
 
-  return retval;
+static void
+score_marker (GHashTable  *markers,
+	      GHashTable  *scores,
+	      const gchar *prefix,
+	      const gchar *value,
+	      gint         weight)
+{
+  GSList *list;
+  gchar *marker;
+  gint score;
+
+  marker = g_strconcat (prefix, value, NULL);
+  list = g_hash_table_lookup (markers, marker);
+  g_free (marker);
+
+  for (; list; list = list->next)
+    {
+      score = GPOINTER_TO_INT (g_hash_table_lookup (scores, list->data));
+      g_hash_table_insert (scores, list->data, GINT_TO_POINTER (score + weight));
+    }
 }
 
-gboolean
-gst_network_locations_save_current (GstNetworkLocations *locations,
-				    const gchar         *name)
+/*
+ * Remembers @environment as the one the location @name is used in. An empty
+ * environment would never match again, so it doesn't replace a stored one.
+ */
+void
+gst_network_locations_set_environment (GstNetworkLocations         *locations,
+				       const gchar                 *name,
+				       const GstNetworkEnvironment *environment)
 {
-  gchar *filename, *str;
-  gboolean result;
+  GstNetworkLocationsPrivate *priv;
+  LocationEntry *entry;
 
-  g_return_val_if_fail (GST_IS_NETWORK_LOCATIONS (locations), FALSE);
-  g_return_val_if_fail (name && *name, FALSE);
+  g_return_if_fail (GST_IS_NETWORK_LOCATIONS (locations));
+  g_return_if_fail (environment != NULL);
 
-  /* Unset the previous configuration with the same name, if any */
-  gst_network_locations_delete_location (locations, name);
+  priv = (GstNetworkLocationsPrivate *) locations->_priv;
 
-  filename = g_filename_from_utf8 (name, -1, NULL, NULL, NULL);
-  str = replace_string (filename, "/", SLASH);
+  ensure_entries (locations);
+  entry = g_hash_table_lookup (priv->entries, name);
 
-  result = save_current (locations, str);
+  if (!entry || environment_is_empty (environment) ||
+      gst_network_environment_equal (&entry->environment, environment))
+    return;
 
-  g_free (filename);
-  g_free (str);
+  g_free (entry->environment.gateway);
+  g_strfreev (entry->environment.essids);
+  g_free (entry->environment.domain);
+  set_entry_environment (entry, environment);
 
-  return result;
+  invalidate_lookups (priv);
+  write_store (locations);
 }
 
-void
-gst_network_locations_delete_location (GstNetworkLocations *locations,
-				       const gchar         *name)
+/*
+ * Returns the location whose environment best matches @environment, or
+ * NULL if none matches well enough or several match equally well.
+ */
+gchar*
+gst_network_locations_match_environment (GstNetworkLocations         *locations,
+					 const GstNetworkEnvironment *environment)
 {
   GstNetworkLocationsPrivate *priv;
-  gchar *filename, *str, *location_path;
+  GHashTable *scores;
+  GHashTableIter iter;
+  LocationEntry *entry, *best = NULL;
+  gpointer score;
+  gint best_score = 0;
+  gboolean tie = FALSE;
+  guint i;
 
-  g_return_val_if_fail (GST_IS_NETWORK_LOCATIONS (locations), FALSE);
+  g_return_val_if_fail (GST_IS_NETWORK_LOCATIONS (locations), NULL);
+  g_return_val_if_fail (environment != NULL, NULL);
+
+  priv = (GstNetworkLocationsPrivate *) locations->_priv;
 
-  priv = GST_NETWORK_LOCATIONS_GET_PRIVATE (locations);
+  ensure_entries (locations);
+  ensure_markers (locations);
 
-  filename = g_filename_from_utf8 (name, -1, NULL, NULL, NULL);
-  str = replace_string (filename, "/", SLASH);
-  location_path = g_build_filename (priv->dot_dir, str, NULL);
+  scores = g_hash_table_new (NULL, NULL);
 
-  g_unlink (location_path);
-  g_free (location_path);
-  g_free (filename);
+  if (environment->gateway)
+    score_marker (priv->markers, scores, "g:", environment->gateway, MATCH_GATEWAY_WEIGHT);
+
+  if (environment->domain)
+    score_marker (priv->markers, scores, "d:", environment->domain, MATCH_DOMAIN_WEIGHT);
+
+  for (i = 0; environment->essids && environment->essids[i]; i++)
+    score_marker (priv->markers, scores, "e:", environment->essids[i], MATCH_ESSID_WEIGHT);
+
+  g_hash_table_iter_init (&iter, scores);
+
+  while (g_hash_table_iter_next (&iter, (gpointer *) &entry, &score))
+    {
+      if (GPOINTER_TO_INT (score) > best_score)
+	{
+	  best = entry;
+	  best_score = GPOINTER_TO_INT (score);
+	  tie = FALSE;
+	}
+      else if (GPOINTER_TO_INT (score) == best_score)
+	tie = TRUE;
+    }
+
+  g_hash_table_destroy (scores);
+
+  if (!best || tie || best_score < MATCH_THRESHOLD)
+    return NULL;
+
+  return g_strdup (best->name);
 }
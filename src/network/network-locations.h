@@ -37,6 +37,21 @@ G_BEGIN_DECLS
 typedef struct _GstNetworkLocations      GstNetworkLocations;
 typedef struct _GstNetworkLocationsClass GstNetworkLocationsClass;
 
+typedef enum {
+  GST_NETWORK_LOCATION_CHANGED_NONE   = 0,
+  GST_NETWORK_LOCATION_CHANGED_HOSTS  = 1 << 0,
+  GST_NETWORK_LOCATION_CHANGED_IFACES = 1 << 1
+} GstNetworkLocationChanges;
+
+typedef struct _GstNetworkEnvironment GstNetworkEnvironment;
+
+struct _GstNetworkEnvironment
+{
+  gchar  *gateway;		/* hardware address of the default gateway */
+  gchar **essids;		/* visible wireless networks, sorted */
+  gchar  *domain;		/* domain handed out by DHCP */
+};
+
 struct _GstNetworkLocations
 {
   GObject parent_instance;
@@ -57,14 +72,29 @@ GType                  gst_network_locations_get_type        (void);
 GstNetworkLocations*   gst_network_locations_get             (void);
 
 GList*                 gst_network_locations_get_names       (GstNetworkLocations *locations);
-gchar*                 gst_network_locations_get_current     (GstNetworkLocations *locations);
-gboolean               gst_network_locations_set_location    (GstNetworkLocations *locations,
-							      const gchar         *name);
-gboolean               gst_network_locations_save_current    (GstNetworkLocations *locations,
+gboolean               gst_network_locations_has_location    (GstNetworkLocations *locations,
 							      const gchar         *name);
+gchar*                 gst_network_locations_get_current     (GstNetworkLocations *locations);
+gboolean               gst_network_locations_set_location    (GstNetworkLocations       *locations,
+							      const gchar               *name,
+							      GstNetworkLocationChanges *changes);
+gboolean               gst_network_locations_save_current    (GstNetworkLocations         *locations,
+							      const gchar                 *name,
+							      const GstNetworkEnvironment *environment);
 void                   gst_network_locations_delete_location (GstNetworkLocations *locations,
 							      const gchar         *name);
 
+void                   gst_network_locations_set_environment   (GstNetworkLocations         *locations,
+								const gchar                 *name,
+								const GstNetworkEnvironment *environment);
+gchar*                 gst_network_locations_match_environment (GstNetworkLocations         *locations,
+								const GstNetworkEnvironment *environment);
+
+GstNetworkEnvironment* gst_network_environment_copy  (const GstNetworkEnvironment *environment);
+gboolean               gst_network_environment_equal (const GstNetworkEnvironment *environment1,
+						      const GstNetworkEnvironment *environment2);
+void                   gst_network_environment_free  (GstNetworkEnvironment       *environment);
+
 G_END_DECLS
 
 #endif /* __NETWORK_LOCATIONS_H */
@@ -77,6 +77,11 @@ gst_network_tool_finalize (GObject *object)
 
   g_object_unref (tool->dns);
   g_object_unref (tool->search);
+
+  ifaces_model_clear ();
+  g_hash_table_destroy (tool->iface_rows);
+  g_hash_table_destroy (tool->dev_ifaces);
+  g_hash_table_destroy (tool->pending_ifaces);
   g_object_unref (tool->interfaces_model);
   g_object_unref (tool->location);
   g_free (tool->dialog);
@@ -141,6 +146,10 @@ gst_network_tool_constructor (GType                  type,
   tool->domain = GTK_ENTRY (widget);
 
   tool->interfaces_model = ifaces_model_create ();
+  tool->iface_rows = g_hash_table_new_full (NULL, NULL, g_object_unref,
+					    (GDestroyNotify) gtk_tree_row_reference_free);
+  tool->dev_ifaces = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  tool->pending_ifaces = g_hash_table_new_full (NULL, NULL, g_object_unref, NULL);
   tool->interfaces_list = ifaces_list_create (GST_TOOL (tool));
   tool->host_aliases_list = host_aliases_list_create (GST_TOOL (tool));
 
@@ -266,7 +275,7 @@ gst_network_tool_update_gui (GstTool *tool)
 		  oobs_hosts_config_get_domainname (network_tool->hosts_config));
   g_signal_handlers_unblock_by_func (network_tool->domain, on_entry_changed, tool->main_dialog);
 
-  gtk_list_store_clear (GTK_LIST_STORE (network_tool->interfaces_model));
+  ifaces_model_clear ();
   add_all_interfaces (network_tool);
 
   connection_dialog_update (network_tool->dialog);
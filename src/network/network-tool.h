@@ -57,6 +57,14 @@ struct _GstNetworkTool
   GtkTreeModel *interfaces_model;
   GtkTreeView  *interfaces_list;
 
+  /* OobsIface -> GtkTreeRowReference, device name -> OobsIface */
+  GHashTable *iface_rows;
+  GHashTable *dev_ifaces;
+
+  /* interfaces whose state changed since the last refresh */
+  GHashTable *pending_ifaces;
+  guint refresh_timeout;
+
   GtkTreeView *host_aliases_list;
   GstLocationsCombo *location;
 
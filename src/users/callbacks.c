@@ -33,6 +33,7 @@
 #include "users-tool.h"
 #include "group-settings.h"
 #include "groups-table.h"
+#include "membership-index.h"
 
 extern GstTool *tool;
 
@@ -216,8 +217,10 @@ on_group_new_clicked (GtkButton *button, gpointer user_data)
 
 		result = oobs_groups_config_add_group (config, group);
 
-		if (result == OOBS_RESULT_OK)
+		if (result == OOBS_RESULT_OK) {
+			membership_index_add_group (group);
 			groups_table_add_group (group);
+		}
 		else
 			gst_tool_commit_error (tool, result);
 	}
@@ -272,22 +275,22 @@ on_group_delete_clicked (GtkButton *button, gpointer user_data)
 {
 	GtkTreeModel *model;
 	GtkTreePath *path;
-	GList *list, *elem;
+	GList *list;
 
-	list = elem = groups_table_get_row_references ();
+	list = groups_table_get_row_references ();
 	model = groups_table_get_model ();
 
 	/* Before going further, check for authorizations, authenticating if needed */
 	if (!gst_tool_authenticate (tool, GST_USERS_TOOL (tool)->groups_config))
 		return;
 
-	while (elem) {
-		path = gtk_tree_row_reference_get_path (elem->data);
+	if (list && !list->next) {
+		path = gtk_tree_row_reference_get_path (list->data);
 		group_delete (model, path);
-
 		gtk_tree_path_free (path);
-		elem = elem->next;
 	}
+	else if (list)
+		groups_delete_batch (model, list);
 
 	g_list_foreach (list, (GFunc) gtk_tree_row_reference_free, NULL);
 	g_list_free (list);
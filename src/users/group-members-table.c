@@ -19,162 +19,395 @@
  * Authors: Carlos Garnacho Parro <carlosg@gnome.org>
  */
 
+/*
+ * Group members editor: members and other users are shown in two filtered
+ * views of the users list store, each with its own search. Only memberships
+ * changed in the dialog are kept, in a delta set applied on save, so that
+ * opening and saving don't depend on the number of users.
+ */
+
+#include <string.h>
 #include "gst.h"
 #include "users-table.h"
 #include "table.h"
 #include "group-members-table.h"
+#include "membership-index.h"
+#include "users-model.h"
 
 extern GstTool *tool;
 
-static GtkTreeModel*
-get_model (void)
+typedef struct {
+	gboolean       members;
+	GtkWidget     *view;
+	GtkWidget     *search;
+	GtkWidget     *move_button;  /* moves selected users to the other pane */
+	GstUsersModel *model;
+	gchar         *query;        /* casefolded, NULL when empty */
+} MembersPane;
+
+enum {
+	PANE_MEMBERS,
+	PANE_OTHERS,
+	N_PANES
+};
+
+static MembersPane panes[N_PANES];
+
+/* Group being edited, memberships are read from the index */
+static OobsGroup *edited_group = NULL;
+
+/*
+ * Login -> GINT_TO_POINTER (member), only for changed memberships. Users are
+ * replaced when their configuration is reloaded while the dialog is open,
+ * which logins survive, so they're only looked up again on save.
+ */
+static GHashTable *delta = NULL;
+
+
+static gboolean
+get_member (OobsUser *user)
 {
-	GtkWidget *users_table;
-	GtkTreeModel *model;
+	gpointer member;
 
-	users_table = gst_dialog_get_widget (GST_TOOL (tool)->main_dialog, "users_table");
-	model = gtk_tree_view_get_model (GTK_TREE_VIEW (users_table));
+	if (g_hash_table_lookup_extended (delta, oobs_user_get_login_name (user), NULL, &member))
+		return GPOINTER_TO_INT (member);
 
-	return model;
+	return membership_index_is_member (edited_group, user);
 }
 
 static void
-on_group_member_toggled (GtkCellRendererToggle *cell, gchar *path_str, gpointer data)
-{
-	GtkTreeModel *model, *sort_model, *filter_model;
-	GtkTreePath *sort_path, *filter_path, *path;
-	GtkTreeIter iter;
-	gboolean value;
-
-	sort_model = (GtkTreeModel*) data;
-	filter_model = gtk_tree_model_sort_get_model (GTK_TREE_MODEL_SORT (sort_model));
-	model = gtk_tree_model_filter_get_model (GTK_TREE_MODEL_FILTER (filter_model));
-
-	sort_path = gtk_tree_path_new_from_string (path_str);
-	filter_path = gtk_tree_model_sort_convert_path_to_child_path (GTK_TREE_MODEL_SORT (sort_model),
-	                                                              sort_path);
-	path = gtk_tree_model_filter_convert_path_to_child_path (GTK_TREE_MODEL_FILTER (filter_model),
-	                                                         filter_path);
-
-	if (gtk_tree_model_get_iter (GTK_TREE_MODEL (model), &iter, path)) {
-		gtk_tree_model_get (model, &iter, COL_USER_MEMBER, &value, -1);
-		gtk_list_store_set (GTK_LIST_STORE (model), &iter,
-				    COL_USER_MEMBER, !value,
-				    -1);
+set_member (OobsUser *user,
+            gboolean  member)
+{
+	const gchar *login;
+
+	login = oobs_user_get_login_name (user);
+
+	if (member == membership_index_is_member (edited_group, user))
+		g_hash_table_remove (delta, login);
+	else
+		g_hash_table_insert (delta, g_strdup (login), GINT_TO_POINTER (member));
+}
+
+static gboolean
+user_matches_query (OobsUser    *user,
+                    const gchar *query)
+{
+	const gchar *name;
+	gchar *folded;
+	gboolean match;
+
+	name = oobs_user_get_login_name (user);
+	folded = g_utf8_casefold ((name) ? name : "", -1);
+	match = (strstr (folded, query) != NULL);
+	g_free (folded);
+
+	if (match)
+		return TRUE;
+
+	name = oobs_user_get_full_name (user);
+	folded = g_utf8_casefold ((name) ? name : "", -1);
+	match = (strstr (folded, query) != NULL);
+	g_free (folded);
+
+	return match;
+}
+
+static gboolean
+members_pane_visible (GtkTreeModel *model,
+                      GtkTreeIter  *iter,
+                      gpointer      data)
+{
+	MembersPane *pane = data;
+	GstUsersTool *users_tool = GST_USERS_TOOL (tool);
+	OobsUser *user;
+	gint uid;
+	gboolean visible;
+
+	gtk_tree_model_get (model, iter,
+			    COL_USER_OBJECT, &user,
+			    -1);
+
+	if (!user)
+		return FALSE;
+
+	visible = (get_member (user) == pane->members);
+
+	/* system accounts are always listed when members, else like in the users table */
+	if (visible && !pane->members && !users_tool->showall) {
+		uid = oobs_user_get_uid (user);
+		visible = (uid >= users_tool->minimum_uid && uid <= users_tool->maximum_uid);
 	}
 
-	gtk_tree_path_free (sort_path);
-	gtk_tree_path_free (filter_path);
-	gtk_tree_path_free (path);
+	if (visible && pane->query)
+		visible = user_matches_query (user, pane->query);
+
+	g_object_unref (user);
+
+	return visible;
 }
 
 static void
-user_name_cell_data_func (GtkCellLayout   *layout,
-			  GtkCellRenderer *renderer,
-			  GtkTreeModel    *model,
-			  GtkTreeIter     *iter,
-			  gpointer         data)
+user_name_cell_data_func (GtkTreeViewColumn *column,
+			  GtkCellRenderer   *renderer,
+			  GtkTreeModel      *model,
+			  GtkTreeIter       *iter,
+			  gpointer           data)
 {
 	OobsUser *user;
-	const gchar *name;
+	gchar *markup;
 
 	gtk_tree_model_get (model, iter,
 			    COL_USER_OBJECT, &user,
 			    -1);
 
-	name = oobs_user_get_full_name_fallback (user);
+	if (!user) {
+		g_object_set (renderer, "markup", NULL, NULL);
+		return;
+	}
+
+	markup = g_markup_printf_escaped ("%s <span color='dark grey'>%s</span>",
+	                                  oobs_user_get_full_name_fallback (user),
+	                                  oobs_user_get_login_name (user));
+	g_object_set (renderer, "markup", markup, NULL);
 
-	g_object_set (renderer, "text", name, NULL);
+	g_free (markup);
 	g_object_unref (user);
 }
 
-void
-create_group_members_table (void)
+/*
+ * Move the selected users of @pane to the other one. Changing the rows in
+ * the users store makes both views only update the rows concerned.
+ */
+static void
+members_pane_move_selected (MembersPane *pane)
+{
+	GtkTreeSelection *selection;
+	GtkTreeModel *child_model;
+	GtkTreePath *path;
+	GtkTreeIter iter, child_iter;
+	GList *paths, *l, *iters = NULL;
+	OobsUser *user;
+
+	selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (pane->view));
+	paths = gtk_tree_selection_get_selected_rows (selection, NULL);
+	child_model = gst_users_model_get_model (pane->model);
+
+	/* rows leave the view as they change, get iters in the store first */
+	for (l = paths; l; l = l->next) {
+		if (!gtk_tree_model_get_iter (GTK_TREE_MODEL (pane->model), &iter, l->data))
+			continue;
+
+		gst_users_model_convert_iter_to_child_iter (pane->model, &child_iter, &iter);
+		iters = g_list_prepend (iters, gtk_tree_iter_copy (&child_iter));
+	}
+
+	for (l = iters; l; l = l->next) {
+		gtk_tree_model_get (child_model, l->data,
+				    COL_USER_OBJECT, &user,
+				    -1);
+		set_member (user, !pane->members);
+		g_object_unref (user);
+
+		path = gtk_tree_model_get_path (child_model, l->data);
+		gtk_tree_model_row_changed (child_model, path, l->data);
+		gtk_tree_path_free (path);
+	}
+
+	g_list_foreach (iters, (GFunc) gtk_tree_iter_free, NULL);
+	g_list_free (iters);
+	g_list_foreach (paths, (GFunc) gtk_tree_path_free, NULL);
+	g_list_free (paths);
+}
+
+static void
+on_move_button_clicked (GtkButton *button,
+                        gpointer   data)
+{
+	members_pane_move_selected (data);
+}
+
+static void
+on_members_pane_row_activated (GtkTreeView       *view,
+                               GtkTreePath       *path,
+                               GtkTreeViewColumn *column,
+                               gpointer           data)
+{
+	members_pane_move_selected (data);
+}
+
+static void
+on_members_pane_selection_changed (GtkTreeSelection *selection,
+                                   gpointer          data)
+{
+	MembersPane *pane = data;
+
+	gtk_widget_set_sensitive (pane->move_button,
+	                          gtk_tree_selection_count_selected_rows (selection) > 0);
+}
+
+static void
+on_members_search_changed (GtkEntry *entry,
+                           gpointer  data)
+{
+	MembersPane *pane = data;
+	const gchar *text;
+
+	text = gtk_entry_get_text (entry);
+
+	g_free (pane->query);
+	pane->query = (*text) ? g_utf8_casefold (text, -1) : NULL;
+
+	gst_users_model_refilter (pane->model);
+}
+
+static void
+on_members_search_icon_press (GtkEntry             *entry,
+                              GtkEntryIconPosition  icon_pos,
+                              GdkEvent             *event,
+                              gpointer              data)
+{
+	gtk_entry_set_text (entry, "");
+}
+
+/*
+ * Views are only attached to the users store while the dialog is shown,
+ * so that they don't need to follow changes to the users list meanwhile.
+ */
+static void
+on_group_settings_dialog_hide (GtkWidget *dialog,
+                               gpointer   data)
+{
+	gint i;
+
+	for (i = 0; i < N_PANES; i++) {
+		gtk_tree_view_set_model (GTK_TREE_VIEW (panes[i].view), NULL);
+		gst_users_model_set_model (panes[i].model, NULL);
+	}
+}
+
+static void
+setup_members_pane (MembersPane *pane,
+                    gboolean     members,
+                    const gchar *view_name,
+                    const gchar *search_name,
+                    const gchar *button_name)
 {
-	GtkWidget *list;
-	GtkCellRenderer *renderer;
 	GtkTreeViewColumn *column;
-	GtkTreeModel *model;
+	GtkCellRenderer *renderer;
+	GtkTreeSelection *selection;
 
-	list = gst_dialog_get_widget (GST_TOOL (tool)->main_dialog, "group_settings_members");
-	model = get_model ();
+	pane->members = members;
+	pane->view = gst_dialog_get_widget (GST_TOOL (tool)->main_dialog, view_name);
+	pane->search = gst_dialog_get_widget (GST_TOOL (tool)->main_dialog, search_name);
+	pane->move_button = gst_dialog_get_widget (GST_TOOL (tool)->main_dialog, button_name);
 
-	gtk_tree_view_set_model (GTK_TREE_VIEW (list), model);
-	column = gtk_tree_view_column_new ();
+	pane->model = GST_USERS_MODEL (gst_users_model_new (NULL, COL_USER_OBJECT));
+	gst_users_model_set_search_ranked (pane->model, FALSE);
+	gst_users_model_set_visible_func (pane->model, members_pane_visible, pane);
 
-	renderer = gtk_cell_renderer_toggle_new ();
-	gtk_tree_view_column_pack_start (column, renderer, FALSE);
-	gtk_tree_view_column_set_attributes (column,
-					     renderer,
-					     "active", COL_USER_MEMBER,
-					     NULL);
-	g_signal_connect (G_OBJECT (renderer), "toggled", G_CALLBACK (on_group_member_toggled), model);
+	/* all rows have the same height, so that only visible ones are rendered */
+	column = gtk_tree_view_column_new ();
+	gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
 
 	renderer = gtk_cell_renderer_text_new ();
-	gtk_tree_view_column_pack_end (column, renderer, TRUE);
-	gtk_cell_layout_set_cell_data_func (GTK_CELL_LAYOUT (column), renderer,
-					    user_name_cell_data_func,
-					    NULL, NULL);
+	gtk_tree_view_column_pack_start (column, renderer, TRUE);
+	gtk_tree_view_column_set_cell_data_func (column, renderer,
+						 user_name_cell_data_func,
+						 NULL, NULL);
+	g_object_set (G_OBJECT (renderer),
+	              "ellipsize", PANGO_ELLIPSIZE_END,
+	              "ellipsize-set", TRUE,
+		      NULL);
+
+	gtk_tree_view_insert_column (GTK_TREE_VIEW (pane->view), column, 0);
+	gtk_tree_view_set_fixed_height_mode (GTK_TREE_VIEW (pane->view), TRUE);
 
-	gtk_tree_view_insert_column (GTK_TREE_VIEW (list), column, 0);
+	selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (pane->view));
+	gtk_tree_selection_set_mode (selection, GTK_SELECTION_MULTIPLE);
+
+	g_signal_connect (G_OBJECT (selection), "changed",
+			  G_CALLBACK (on_members_pane_selection_changed), pane);
+	g_signal_connect (G_OBJECT (pane->view), "row-activated",
+			  G_CALLBACK (on_members_pane_row_activated), pane);
+	g_signal_connect (G_OBJECT (pane->move_button), "clicked",
+			  G_CALLBACK (on_move_button_clicked), pane);
+	g_signal_connect (G_OBJECT (pane->search), "changed",
+			  G_CALLBACK (on_members_search_changed), pane);
+	g_signal_connect (G_OBJECT (pane->search), "icon-press",
+			  G_CALLBACK (on_members_search_icon_press), NULL);
+}
+
+void
+create_group_members_table (void)
+{
+	GtkWidget *dialog;
+
+	delta = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	setup_members_pane (&panes[PANE_MEMBERS], TRUE,
+	                    "group_settings_members",
+	                    "group_settings_members_search",
+	                    "group_settings_remove_member");
+	setup_members_pane (&panes[PANE_OTHERS], FALSE,
+	                    "group_settings_nonmembers",
+	                    "group_settings_nonmembers_search",
+	                    "group_settings_add_member");
+
+	dialog = gst_dialog_get_widget (GST_TOOL (tool)->main_dialog, "group_settings_dialog");
+	g_signal_connect (G_OBJECT (dialog), "hide",
+			  G_CALLBACK (on_group_settings_dialog_hide), NULL);
 }
 
 void
 group_members_table_set_from_group (OobsGroup *group)
 {
-	GtkWidget *table;
-	GtkTreeModel *sort_model, *filter_model, *model;
-	GtkTreeIter iter;
-	GList *users;
-	gboolean valid;
-	OobsUser *user;
+	GtkTreeModel *users_model;
+	gint i;
 
-	table = gst_dialog_get_widget (GST_TOOL (tool)->main_dialog, "group_settings_members");
-	sort_model = gtk_tree_view_get_model (GTK_TREE_VIEW (table));
-	filter_model = gtk_tree_model_sort_get_model (GTK_TREE_MODEL_SORT (sort_model));
-	model = gtk_tree_model_filter_get_model (GTK_TREE_MODEL_FILTER (filter_model));
-	users = oobs_group_get_users (group);
+	if (edited_group)
+		g_object_unref (edited_group);
 
-	valid = gtk_tree_model_get_iter_first (model, &iter);
+	edited_group = g_object_ref (group);
+	g_hash_table_remove_all (delta);
 
-	while (valid) {
-		gtk_tree_model_get (model, &iter,
-				    COL_USER_OBJECT, &user,
-				    -1);
+	users_model = users_table_get_model ();
 
-		gtk_list_store_set (GTK_LIST_STORE (model), &iter,
-				    COL_USER_MEMBER, (g_list_find (users, user) != NULL),
-				    -1);
+	for (i = 0; i < N_PANES; i++) {
+		/* no model attached yet, so refiltering is free */
+		gtk_entry_set_text (GTK_ENTRY (panes[i].search), "");
 
-		valid = gtk_tree_model_iter_next (model, &iter);
+		gst_users_model_set_model (panes[i].model, users_model);
+		gtk_tree_view_set_model (GTK_TREE_VIEW (panes[i].view),
+		                         GTK_TREE_MODEL (panes[i].model));
 	}
-	
-	g_list_free (users);
 }
 
+/*
+ * Apply the memberships changed in the dialog to @group, which is either
+ * the edited group or a new group created from the dialog. Users removed
+ * meanwhile are skipped.
+ */
 void
 group_members_table_save (OobsGroup *group)
 {
-	GtkWidget *table;
-	GtkTreeModel *model;
-	GtkTreeIter iter;
+	OobsUsersConfig *config;
 	OobsUser *user;
-	gboolean valid, member;
+	GHashTableIter iter;
+	gpointer login, member;
 
-	table = gst_dialog_get_widget (GST_TOOL (tool)->main_dialog, "group_settings_members");
-	model = gtk_tree_view_get_model (GTK_TREE_VIEW (table));
-	valid = gtk_tree_model_get_iter_first (model, &iter);
+	config = OOBS_USERS_CONFIG (GST_USERS_TOOL (tool)->users_config);
+	g_hash_table_iter_init (&iter, delta);
 
-	while (valid) {
-		gtk_tree_model_get (model, &iter,
-				    COL_USER_OBJECT, &user,
-				    COL_USER_MEMBER, &member,
-				    -1);
-		if (member)
-			oobs_group_add_user (group, user);
-		else
-			oobs_group_remove_user (group, user);
+	while (g_hash_table_iter_next (&iter, &login, &member)) {
+		user = oobs_users_config_get_from_login (config, login);
+
+		if (!user)
+			continue;
 
-		valid = gtk_tree_model_iter_next (model, &iter);
+		membership_index_set_member (group, user, GPOINTER_TO_INT (member));
+		g_object_unref (user);
 	}
+
+	g_hash_table_remove_all (delta);
 }
@@ -35,6 +35,8 @@
 #include "callbacks.h"
 #include "group-settings.h"
 #include "test-battery.h"
+#include "membership-index.h"
+#include "privileges-table.h"
 
 extern GstTool *tool;
 
@@ -106,6 +108,7 @@ group_delete (GtkTreeModel *model, GtkTreePath *path)
 		config = OOBS_GROUPS_CONFIG (GST_USERS_TOOL (tool)->groups_config);
 		result = oobs_groups_config_delete_group (config, group);
 		if (result == OOBS_RESULT_OK) {
+			membership_index_remove_group (group);
 			gtk_list_store_remove (GTK_LIST_STORE (model), &iter);
 			retval = TRUE;
 		}
@@ -121,6 +124,136 @@ group_delete (GtkTreeModel *model, GtkTreePath *path)
 
 }
 
+/*
+ * Delete all groups pointed by @references after one confirmation,
+ * removing them from the groups list and committing it only once.
+ */
+void
+groups_delete_batch (GtkTreeModel *model, GList *references)
+{
+	OobsGroupsConfig *config;
+	OobsList *list;
+	OobsListIter list_iter;
+	OobsResult result;
+	GtkWidget *parent, *dialog;
+	GtkTreePath *path;
+	GtkTreeIter iter;
+	GHashTable *deleted;
+	GList *groups = NULL, *rows = NULL, *l;
+	OobsGroup *group;
+	GObject *object;
+	gboolean valid, kept_root = FALSE;
+	guint n_groups;
+	gint reply;
+
+	for (l = references; l; l = l->next) {
+		path = gtk_tree_row_reference_get_path (l->data);
+
+		if (gtk_tree_model_get_iter (model, &iter, path)) {
+			gtk_tree_model_get (model, &iter, COL_GROUP_OBJECT, &group, -1);
+
+			/* administrator group is never deleted */
+			if (oobs_group_get_gid (group) == 0) {
+				kept_root = TRUE;
+				g_object_unref (group);
+			}
+			else {
+				groups = g_list_prepend (groups, group);
+				rows = g_list_prepend (rows, l->data);
+			}
+		}
+
+		gtk_tree_path_free (path);
+	}
+
+	if (!groups) {
+		g_list_free (rows);
+		return;
+	}
+
+	n_groups = g_list_length (groups);
+	parent = gst_dialog_get_widget (tool->main_dialog, "group_settings_dialog");
+
+	dialog = gtk_message_dialog_new (GTK_WINDOW (parent),
+					 GTK_DIALOG_MODAL,
+					 GTK_MESSAGE_WARNING,
+					 GTK_BUTTONS_NONE,
+					 ngettext ("Are you sure you want to delete %u group?",
+					           "Are you sure you want to delete %u groups?", n_groups),
+					 n_groups);
+	gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog),
+						  "%s%s%s",
+						  _("This may leave files with invalid group ID in the filesystem."),
+						  kept_root ? " " : "",
+						  kept_root ? _("The administrator group will be kept.") : "");
+	gtk_dialog_add_buttons (GTK_DIALOG (dialog),
+				GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+				GTK_STOCK_DELETE, GTK_RESPONSE_ACCEPT,
+				NULL);
+
+	gst_dialog_add_edit_dialog (tool->main_dialog, dialog);
+	reply = gtk_dialog_run (GTK_DIALOG (dialog));
+	gst_dialog_remove_edit_dialog (tool->main_dialog, dialog);
+
+	gtk_widget_destroy (dialog);
+
+	if (reply != GTK_RESPONSE_ACCEPT)
+		goto out;
+
+	deleted = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	for (l = groups; l; l = l->next)
+		g_hash_table_insert (deleted, l->data, l->data);
+
+	/* remove all groups in one pass over the list, then commit once */
+	config = OOBS_GROUPS_CONFIG (GST_USERS_TOOL (tool)->groups_config);
+	list = oobs_groups_config_get_groups (config);
+	valid = oobs_list_get_iter_first (list, &list_iter);
+
+	while (valid) {
+		object = oobs_list_get (list, &list_iter);
+
+		if (g_hash_table_lookup (deleted, object))
+			valid = oobs_list_remove (list, &list_iter);
+		else
+			valid = oobs_list_iter_next (list, &list_iter);
+
+		g_object_unref (object);
+	}
+
+	g_hash_table_destroy (deleted);
+
+	result = gst_tool_commit (tool, OOBS_OBJECT (config));
+
+	if (result != OOBS_RESULT_OK) {
+		gst_tool_update_async (tool);
+		goto out;
+	}
+
+	for (l = groups; l; l = l->next) {
+		gst_tool_remove_configuration_object (tool, OOBS_OBJECT (l->data));
+		membership_index_remove_group (OOBS_GROUP (l->data));
+		privileges_table_remove_group (OOBS_GROUP (l->data));
+	}
+
+	for (l = rows; l; l = l->next) {
+		path = gtk_tree_row_reference_get_path (l->data);
+
+		if (path && gtk_tree_model_get_iter (model, &iter, path))
+			gtk_list_store_remove (GTK_LIST_STORE (model), &iter);
+
+		gtk_tree_path_free (path);
+	}
+
+	/* catch any other change the commit made to the groups list, only once */
+	g_idle_add (gst_users_tool_sync_groups_async, tool);
+
+ out:
+	g_list_foreach (groups, (GFunc) g_object_unref, NULL);
+	g_list_free (groups);
+	g_list_free (rows);
+}
+
 GtkWidget*
 group_settings_dialog_new (OobsGroup *group)
 {
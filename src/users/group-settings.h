@@ -28,6 +28,8 @@
 
 gboolean     group_delete                       (GtkTreeModel *model,
 						 GtkTreePath  *path);
+void         groups_delete_batch                (GtkTreeModel *model,
+						 GList        *references);
 
 GtkWidget*   group_settings_dialog_new          (OobsGroup    *group);
 gboolean     group_settings_dialog_group_is_new (void);
@@ -34,21 +34,72 @@ extern GstTool *tool;
 static GtkListStore *groups_model = NULL;
 static GtkTreeModelSort *groups_sort_model = NULL;
 
+/*
+ * Render the group name, used for the groups table and the main group combo.
+ */
+void
+groups_table_name_cell_data_func (GtkCellLayout   *layout,
+				  GtkCellRenderer *renderer,
+				  GtkTreeModel    *model,
+				  GtkTreeIter     *iter,
+				  gpointer         data)
+{
+	OobsGroup *group;
+
+	gtk_tree_model_get (model, iter,
+			    COL_GROUP_OBJECT, &group,
+			    -1);
+
+	g_object_set (renderer, "text", (group) ? oobs_group_get_name (group) : NULL, NULL);
+
+	if (group)
+		g_object_unref (group);
+}
+
+static gint
+groups_model_sort (GtkTreeModel *model,
+                   GtkTreeIter  *a,
+                   GtkTreeIter  *b,
+                   gpointer      data)
+{
+	OobsGroup *group_a, *group_b;
+	const gchar *name_a = NULL, *name_b = NULL;
+	gint retval;
+
+	gtk_tree_model_get (model, a, COL_GROUP_OBJECT, &group_a, -1);
+	gtk_tree_model_get (model, b, COL_GROUP_OBJECT, &group_b, -1);
+
+	if (group_a)
+		name_a = oobs_group_get_name (group_a);
+	if (group_b)
+		name_b = oobs_group_get_name (group_b);
+
+	retval = g_utf8_collate ((name_a) ? name_a : "", (name_b) ? name_b : "");
+
+	if (group_a)
+		g_object_unref (group_a);
+	if (group_b)
+		g_object_unref (group_b);
+
+	return retval;
+}
+
 static void
 add_group_columns (GtkTreeView *treeview)
 {
 	GtkTreeViewColumn *column;
 	GtkCellRenderer *renderer;
 
-	column = gtk_tree_view_column_new ();
-
 	/* Group name */
 	renderer = gtk_cell_renderer_text_new ();
-	column = gtk_tree_view_column_new_with_attributes (_("Group name"),
-							   renderer,
-							   "text", COL_GROUP_NAME, NULL);
+	column = gtk_tree_view_column_new ();
+	gtk_tree_view_column_set_title (column, _("Group name"));
+	gtk_tree_view_column_pack_start (column, renderer, TRUE);
+	gtk_cell_layout_set_cell_data_func (GTK_CELL_LAYOUT (column), renderer,
+					    groups_table_name_cell_data_func,
+					    NULL, NULL);
 	gtk_tree_view_column_set_resizable (column, TRUE);
-	gtk_tree_view_column_set_sort_column_id (column, 0);
+	gtk_tree_view_column_set_sort_column_id (column, COL_GROUP_OBJECT);
 	gtk_tree_view_column_set_expand (column, TRUE);
 
 	gtk_tree_view_insert_column (treeview, column, -1);
@@ -64,14 +115,14 @@ create_groups_table (void)
 	groups_table = gst_dialog_get_widget (tool->main_dialog, "groups_table");
 
 	groups_model = gtk_list_store_new (COL_GROUP_LAST,
-	                                   G_TYPE_STRING,
-	                                   G_TYPE_INT,
 				           G_TYPE_OBJECT);
 
 	/* Sort model */
 	groups_sort_model = GTK_TREE_MODEL_SORT (gtk_tree_model_sort_new_with_model (GTK_TREE_MODEL (groups_model)));
+	gtk_tree_sortable_set_sort_func (GTK_TREE_SORTABLE (groups_sort_model), COL_GROUP_OBJECT,
+	                                 groups_model_sort, NULL, NULL);
 	gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (groups_sort_model),
-	                                      COL_GROUP_NAME, GTK_SORT_ASCENDING);
+	                                      COL_GROUP_OBJECT, GTK_SORT_ASCENDING);
 	gtk_tree_view_set_model (GTK_TREE_VIEW (groups_table), GTK_TREE_MODEL (groups_sort_model));
 	g_object_unref (groups_model);
 	g_object_unref (groups_sort_model);
@@ -106,8 +157,6 @@ void
 groups_table_set_group (OobsGroup *group, GtkTreeIter *iter)
 {
 	gtk_list_store_set (groups_model, iter,
-			    COL_GROUP_NAME, oobs_group_get_name (group),
-			    COL_GROUP_ID, oobs_group_get_gid (group),
 			    COL_GROUP_OBJECT, group,
 			    -1);
 }
@@ -116,8 +165,6 @@ void
 groups_table_add_group (OobsGroup *group)
 {
 	gtk_list_store_insert_with_values (groups_model, NULL, G_MAXINT,
-	                                   COL_GROUP_NAME, oobs_group_get_name (group),
-	                                   COL_GROUP_ID, oobs_group_get_gid (group),
 	                                   COL_GROUP_OBJECT, group,
 	                                   -1);
 }
@@ -128,6 +175,70 @@ groups_table_clear (void)
 	gtk_list_store_clear (groups_model);
 }
 
+/*
+ * Make the table match @list without rebuilding it: rows of groups no longer
+ * in the list are removed, and missing groups are appended. Removed and added
+ * groups are returned in @removed and @added, which must be freed by the caller
+ * after unreffing their elements.
+ */
+void
+groups_table_sync (OobsList  *list,
+                   GList    **added,
+                   GList    **removed)
+{
+	GHashTable *current, *shown;
+	OobsListIter list_iter;
+	GtkTreeIter iter;
+	OobsGroup *group;
+	gboolean valid;
+
+	current = g_hash_table_new_full (g_direct_hash, g_direct_equal, g_object_unref, NULL);
+	shown = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	valid = oobs_list_get_iter_first (list, &list_iter);
+
+	while (valid) {
+		group = OOBS_GROUP (oobs_list_get (list, &list_iter));
+		g_hash_table_insert (current, group, GINT_TO_POINTER (TRUE));
+		valid = oobs_list_iter_next (list, &list_iter);
+	}
+
+	valid = gtk_tree_model_get_iter_first (GTK_TREE_MODEL (groups_model), &iter);
+
+	while (valid) {
+		gtk_tree_model_get (GTK_TREE_MODEL (groups_model), &iter,
+		                    COL_GROUP_OBJECT, &group,
+		                    -1);
+
+		if (g_hash_table_lookup (current, group)) {
+			g_hash_table_insert (shown, group, group);
+			g_object_unref (group);
+			valid = gtk_tree_model_iter_next (GTK_TREE_MODEL (groups_model), &iter);
+		}
+		else {
+			*removed = g_list_prepend (*removed, group);
+			valid = gtk_list_store_remove (groups_model, &iter);
+		}
+	}
+
+	valid = oobs_list_get_iter_first (list, &list_iter);
+
+	while (valid) {
+		group = OOBS_GROUP (oobs_list_get (list, &list_iter));
+
+		if (!g_hash_table_lookup (shown, group)) {
+			groups_table_add_group (group);
+			*added = g_list_prepend (*added, g_object_ref (group));
+		}
+
+		g_object_unref (group);
+		valid = oobs_list_iter_next (list, &list_iter);
+	}
+
+	g_hash_table_destroy (shown);
+	g_hash_table_destroy (current);
+}
+
 /*
  * Detach the model from the tree view before massive insert,
  * for performance reasons.
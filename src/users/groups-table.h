@@ -24,9 +24,8 @@
 #ifndef _GROUPS_TABLE_H
 #define _GROUPS_TABLE_H
 
+/* The name is read from the OobsGroup when rendering */
 enum {
-	COL_GROUP_NAME,
-	COL_GROUP_ID,
 	COL_GROUP_OBJECT,
 	COL_GROUP_LAST
 };
@@ -57,9 +56,18 @@ GtkTreeModel *groups_table_get_model           ();
 void          groups_table_set_group           (OobsGroup    *group,
                                                 GtkTreeIter  *iter);
 void          groups_table_add_group           (OobsGroup    *group);
+void          groups_table_sync                (OobsList     *list,
+                                                GList       **added,
+                                                GList       **removed);
 void          groups_table_begin_insertions    (void);
 void          groups_table_end_insertions      (void);
 
 GList        *groups_table_get_row_references  ();
 
+void          groups_table_name_cell_data_func (GtkCellLayout   *layout,
+                                                GtkCellRenderer *renderer,
+                                                GtkTreeModel    *model,
+                                                GtkTreeIter     *iter,
+                                                gpointer         data);
+
 #endif /* _GROUPS_TABLE_H */
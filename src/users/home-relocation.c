@@ -0,0 +1,946 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* home-relocation.c: this file is part of users-admin, a gnome-system-tools frontend
+ * for user administration.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Copy of a home directory to its new location, with progress.
+ *
+ * Directories are handed to a pool of threads, first to count files and
+ * bytes, then to copy them. File contents are shared with a reflink when
+ * the filesystem supports it, copied by the kernel with copy_file_range()
+ * otherwise, and read and written as a last resort. Ownership, modes,
+ * extended attributes (which include ACLs) and times are preserved, or
+ * files are given to the user in the same pass. Files already copied with
+ * the same size and modification time are skipped, so that running again
+ * after a cancellation resumes where it stopped. Hard links are copied as
+ * separate files.
+ *
+ * This runs as root over a tree the user can modify meanwhile, so nothing
+ * is resolved by path: entries are opened relative to the descriptor of
+ * their directory without following symbolic links, and checked with
+ * fstat() once opened. Directories are only kept open while their entries
+ * are read, and reopened from the top one component at a time, so the
+ * number of descriptors doesn't grow with the size of the tree.
+ */
+
+#include <config.h>
+#include <glib/gi18n.h>
+#include <gio/gio.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/xattr.h>
+
+#include "home-relocation.h"
+
+/* Threads copying directories in parallel */
+#define N_THREADS 4
+
+/* Bytes copied between two checks for cancellation */
+#define COPY_CHUNK (8 * 1024 * 1024)
+
+/* Buffer used when the kernel can't copy for us */
+#define COPY_BUFFER (1024 * 1024)
+
+/* Milliseconds between two progress reports */
+#define PROGRESS_INTERVAL 100
+
+#ifndef FICLONE
+#define FICLONE _IOW (0x94, 9, int)
+#endif
+
+enum {
+	PHASE_SCAN,
+	PHASE_COPY
+};
+
+/*
+ * A directory of the tree. Subdirectories hold a reference, so that the
+ * mode and times of the copy are set once the whole subtree has been
+ * copied. Descriptors are only open while the directory is processed.
+ */
+typedef struct _DirNode DirNode;
+
+struct _DirNode {
+	volatile gint  ref_count;
+	DirNode       *parent;
+	gchar         *name;       /* NULL for the top directory */
+	gchar         *relative;   /* path from the top */
+	int            src_fd;
+	int            dst_fd;     /* only opened when copying */
+	gboolean       created;    /* the copy has been filled, or is being */
+	struct stat    st;         /* of the source directory */
+};
+
+struct _HomeRelocation {
+	gchar        *source;
+	gchar        *dest;
+	gboolean      chown;
+	uid_t         uid;
+	gid_t         gid;
+
+	GCancellable *cancellable;
+	GThreadPool  *pool;
+	gint          phase;
+	int           src_root;     /* top directories, open during a phase */
+	int           dst_root;
+
+	/* protected by lock */
+	GMutex       *lock;
+	GCond        *cond;
+	guint         pending;      /* directories queued or being processed */
+	guint64       bytes_total;
+	guint64       bytes_done;
+	guint         files_total;
+	guint         files_done;
+	GError       *error;
+
+	gboolean      running;
+	guint         progress_id;
+	HomeRelocationProgressFunc progress_func;
+	HomeRelocationDoneFunc     done_func;
+	gpointer      data;
+};
+
+static gboolean
+is_dot_entry (const gchar *name)
+{
+	return (strcmp (name, ".") == 0 || strcmp (name, "..") == 0);
+}
+
+/* Keep the first error, and stop other threads */
+static void
+set_error (HomeRelocation *relocation,
+           gint            errsv,
+           const gchar    *path)
+{
+	if (g_cancellable_is_cancelled (relocation->cancellable))
+		return;
+
+	g_mutex_lock (relocation->lock);
+
+	if (!relocation->error)
+		relocation->error = g_error_new (G_FILE_ERROR, g_file_error_from_errno (errsv),
+		                                 _("Could not copy %s: %s"),
+		                                 path, g_strerror (errsv));
+
+	g_mutex_unlock (relocation->lock);
+
+	g_cancellable_cancel (relocation->cancellable);
+}
+
+static void
+add_progress (HomeRelocation *relocation,
+              guint64         bytes,
+              guint           files)
+{
+	g_mutex_lock (relocation->lock);
+	relocation->bytes_done += bytes;
+	relocation->files_done += files;
+	g_mutex_unlock (relocation->lock);
+}
+
+static gchar *
+build_path (const gchar *root,
+            DirNode     *node,
+            const gchar *name)
+{
+	return g_build_filename (root, node->relative, name, NULL);
+}
+
+/*
+ * Open the directory at @relative below @root_fd, one component at a
+ * time and without following symbolic links. The top directory is
+ * opened again too, so that it doesn't share its offset with @root_fd.
+ */
+static int
+open_relative (int          root_fd,
+               const gchar *relative)
+{
+	gchar **names;
+	int fd, next, errsv, i;
+
+	fd = openat (root_fd, ".", O_RDONLY | O_DIRECTORY);
+	names = g_strsplit (relative, G_DIR_SEPARATOR_S, -1);
+
+	for (i = 0; fd >= 0 && names[i]; i++) {
+		if (*names[i] == '\0')
+			continue;
+
+		next = openat (fd, names[i], O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+		errsv = errno;
+		close (fd);
+		errno = errsv;
+		fd = next;
+	}
+
+	g_strfreev (names);
+
+	return fd;
+}
+
+/* @st is the one seen when reading the parent, NULL for the top directory */
+static DirNode *
+dir_node_new (DirNode           *parent,
+              const gchar       *name,
+              const struct stat *st)
+{
+	DirNode *node;
+
+	node = g_slice_new0 (DirNode);
+	node->ref_count = 1;
+	node->src_fd = -1;
+	node->dst_fd = -1;
+
+	if (parent) {
+		g_atomic_int_inc (&parent->ref_count);
+		node->parent = parent;
+		node->name = g_strdup (name);
+		node->relative = g_build_filename (parent->relative, name, NULL);
+		node->st = *st;
+	}
+	else
+		node->relative = g_strdup ("");
+
+	return node;
+}
+
+static void
+dir_node_close (DirNode *node)
+{
+	if (node->src_fd >= 0)
+		close (node->src_fd);
+
+	if (node->dst_fd >= 0)
+		close (node->dst_fd);
+
+	node->src_fd = -1;
+	node->dst_fd = -1;
+}
+
+static void
+dir_node_unref (HomeRelocation *relocation,
+                DirNode        *node)
+{
+	struct timespec times[2];
+	gchar *path;
+	int fd, errsv;
+
+	if (!g_atomic_int_dec_and_test (&node->ref_count))
+		return;
+
+	dir_node_close (node);
+
+	/* the copy is only accessible by root until it has been filled */
+	if (node->created && !g_cancellable_is_cancelled (relocation->cancellable)) {
+		times[0] = node->st.st_atim;
+		times[1] = node->st.st_mtim;
+
+		fd = open_relative (relocation->dst_root, node->relative);
+
+		if (fd < 0 ||
+		    fchmod (fd, node->st.st_mode & 07777) != 0 ||
+		    futimens (fd, times) != 0) {
+			errsv = errno;
+			path = build_path (relocation->dest, node, NULL);
+			set_error (relocation, errsv, path);
+			g_free (path);
+		}
+
+		if (fd >= 0)
+			close (fd);
+	}
+
+	if (node->parent)
+		dir_node_unref (relocation, node->parent);
+
+	g_free (node->name);
+	g_free (node->relative);
+	g_slice_free (DirNode, node);
+}
+
+static void
+queue_directory (HomeRelocation *relocation,
+                 DirNode        *node)
+{
+	g_mutex_lock (relocation->lock);
+	relocation->pending++;
+	g_mutex_unlock (relocation->lock);
+
+	g_thread_pool_push (relocation->pool, node, NULL);
+}
+
+/* Files */
+
+/* Extended attributes, ACLs are stored as system.posix_acl_* ones */
+static gboolean
+copy_xattrs (int in,
+             int out)
+{
+	gchar *names, *name, *value = NULL;
+	gssize size, len;
+	gboolean retval = TRUE;
+
+	size = flistxattr (in, NULL, 0);
+
+	if (size <= 0)
+		return TRUE;
+
+	names = g_malloc (size);
+	size = flistxattr (in, names, size);
+
+	for (name = names; size > 0 && name < names + size; name += strlen (name) + 1) {
+		len = fgetxattr (in, name, NULL, 0);
+
+		if (len < 0)
+			continue;
+
+		value = g_realloc (value, MAX (len, 1));
+		len = fgetxattr (in, name, value, len);
+
+		if (len < 0)
+			continue;
+
+		/* the new location may not support them */
+		if (fsetxattr (out, name, value, len, 0) != 0 && errno != ENOTSUP) {
+			retval = FALSE;
+			break;
+		}
+	}
+
+	g_free (names);
+	g_free (value);
+
+	return retval;
+}
+
+/*
+ * Ownership before extended attributes and mode, since changing
+ * it clears capabilities and setuid bits.
+ */
+static gboolean
+copy_owner_and_xattrs (HomeRelocation    *relocation,
+                       int                in,
+                       int                out,
+                       const struct stat *st)
+{
+	uid_t uid = (relocation->chown) ? relocation->uid : st->st_uid;
+	gid_t gid = (relocation->chown) ? relocation->gid : st->st_gid;
+
+	if (fchown (out, uid, gid) != 0)
+		return FALSE;
+
+	return copy_xattrs (in, out);
+}
+
+static gboolean
+copy_data (HomeRelocation *relocation,
+           int             in,
+           int             out,
+           off_t           size)
+{
+	gchar *buffer;
+	gssize n, written, w;
+	guint64 copied = 0;
+
+	if (size > 0 && ioctl (out, FICLONE, in) == 0) {
+		add_progress (relocation, size, 0);
+		return TRUE;
+	}
+
+#ifdef SYS_copy_file_range
+	while (TRUE) {
+		n = syscall (SYS_copy_file_range, in, NULL, out, NULL, COPY_CHUNK, 0);
+
+		if (n < 0) {
+			/* not supported, or across filesystems before Linux 5.3 */
+			if (copied == 0 && (errno == ENOSYS || errno == EXDEV ||
+			                    errno == EINVAL || errno == EOPNOTSUPP))
+				break;
+
+			return FALSE;
+		}
+
+		if (n == 0)
+			return TRUE;
+
+		copied += n;
+		add_progress (relocation, n, 0);
+
+		if (g_cancellable_is_cancelled (relocation->cancellable)) {
+			errno = ECANCELED;
+			return FALSE;
+		}
+	}
+#endif
+
+	buffer = g_malloc (COPY_BUFFER);
+
+	while ((n = read (in, buffer, COPY_BUFFER)) != 0) {
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+
+			g_free (buffer);
+			return FALSE;
+		}
+
+		for (written = 0; written < n; written += w) {
+			w = write (out, buffer + written, n - written);
+
+			if (w < 0 && errno == EINTR)
+				w = 0;
+			else if (w < 0) {
+				g_free (buffer);
+				return FALSE;
+			}
+		}
+
+		add_progress (relocation, n, 0);
+
+		if (g_cancellable_is_cancelled (relocation->cancellable)) {
+			g_free (buffer);
+			errno = ECANCELED;
+			return FALSE;
+		}
+	}
+
+	g_free (buffer);
+
+	return TRUE;
+}
+
+static gboolean
+copy_file (HomeRelocation *relocation,
+           DirNode        *node,
+           const gchar    *name)
+{
+	struct stat st, dst_st;
+	struct timespec times[2];
+	gboolean retval;
+	int in, out, errsv;
+
+	/* O_NONBLOCK, so that a fifo put in place of the file doesn't block us */
+	in = openat (node->src_fd, name, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_NOCTTY);
+
+	if (in < 0)
+		return FALSE;
+
+	if (fstat (in, &st) != 0) {
+		errsv = errno;
+		close (in);
+		errno = errsv;
+		return FALSE;
+	}
+
+	/* replaced since the directory was read, running again copies it */
+	if (!S_ISREG (st.st_mode)) {
+		close (in);
+		errno = EAGAIN;
+		return FALSE;
+	}
+
+	if (fstatat (node->dst_fd, name, &dst_st, AT_SYMLINK_NOFOLLOW) == 0) {
+		/* copied before a cancellation, times are set last */
+		if (S_ISREG (dst_st.st_mode) &&
+		    dst_st.st_size == st.st_size &&
+		    dst_st.st_mtim.tv_sec == st.st_mtim.tv_sec &&
+		    dst_st.st_mtim.tv_nsec == st.st_mtim.tv_nsec) {
+			add_progress (relocation, st.st_size, 0);
+			close (in);
+			return TRUE;
+		}
+
+		if (!S_ISREG (dst_st.st_mode) && unlinkat (node->dst_fd, name, 0) != 0) {
+			errsv = errno;
+			close (in);
+			errno = errsv;
+			return FALSE;
+		}
+	}
+
+	/* only readable by the owner until the mode is set */
+	out = openat (node->dst_fd, name, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0600);
+
+	if (out < 0) {
+		errsv = errno;
+		close (in);
+		errno = errsv;
+		return FALSE;
+	}
+
+	times[0] = st.st_atim;
+	times[1] = st.st_mtim;
+
+	retval = (copy_data (relocation, in, out, st.st_size) &&
+	          copy_owner_and_xattrs (relocation, in, out, &st) &&
+	          fchmod (out, st.st_mode & 07777) == 0 &&
+	          futimens (out, times) == 0);
+
+	errsv = errno;
+	close (in);
+	close (out);
+	errno = errsv;
+
+	return retval;
+}
+
+/* Symbolic links, fifos, sockets and devices, which are never opened */
+static gboolean
+copy_special (HomeRelocation    *relocation,
+              DirNode           *node,
+              const gchar       *name,
+              const struct stat *st)
+{
+	struct timespec times[2];
+	gchar target[PATH_MAX];
+	gssize len;
+	uid_t uid = (relocation->chown) ? relocation->uid : st->st_uid;
+	gid_t gid = (relocation->chown) ? relocation->gid : st->st_gid;
+
+	if (unlinkat (node->dst_fd, name, 0) != 0 && errno != ENOENT)
+		return FALSE;
+
+	if (S_ISLNK (st->st_mode)) {
+		len = readlinkat (node->src_fd, name, target, sizeof (target) - 1);
+
+		if (len < 0)
+			return FALSE;
+
+		target[len] = '\0';
+
+		if (symlinkat (target, node->dst_fd, name) != 0)
+			return FALSE;
+	}
+	else if (mknodat (node->dst_fd, name, st->st_mode & (S_IFMT | 07777), st->st_rdev) != 0)
+		return FALSE;
+
+	if (fchownat (node->dst_fd, name, uid, gid, AT_SYMLINK_NOFOLLOW) != 0)
+		return FALSE;
+
+	if (!S_ISLNK (st->st_mode) && fchmodat (node->dst_fd, name, st->st_mode & 07777, 0) != 0)
+		return FALSE;
+
+	times[0] = st->st_atim;
+	times[1] = st->st_mtim;
+
+	return (utimensat (node->dst_fd, name, times, AT_SYMLINK_NOFOLLOW) == 0);
+}
+
+/* Directories */
+
+/*
+ * Open @node and, when copying, its copy, which its parent has created.
+ * The source must still be the directory that was seen in the parent.
+ */
+static gboolean
+open_directory (HomeRelocation *relocation,
+                DirNode        *node)
+{
+	struct stat st;
+	gchar *path;
+	int errsv;
+
+	node->src_fd = open_relative (relocation->src_root, node->relative);
+
+	if (node->src_fd >= 0 && fstat (node->src_fd, &st) != 0) {
+		errsv = errno;
+		close (node->src_fd);
+		node->src_fd = -1;
+		errno = errsv;
+	}
+	else if (node->src_fd >= 0 && node->parent &&
+	         (st.st_dev != node->st.st_dev || st.st_ino != node->st.st_ino)) {
+		/* replaced since the parent was read, running again copies it */
+		close (node->src_fd);
+		node->src_fd = -1;
+		errno = EAGAIN;
+	}
+
+	if (node->src_fd < 0) {
+		errsv = errno;
+		path = build_path (relocation->source, node, NULL);
+		set_error (relocation, errsv, path);
+		g_free (path);
+		return FALSE;
+	}
+
+	node->st = st;
+
+	if (relocation->phase == PHASE_SCAN)
+		return TRUE;
+
+	/* mode and times are set by dir_node_unref() once it has been filled */
+	node->dst_fd = open_relative (relocation->dst_root, node->relative);
+	node->created = (node->dst_fd >= 0);
+
+	if (node->dst_fd < 0 ||
+	    !copy_owner_and_xattrs (relocation, node->src_fd, node->dst_fd, &node->st)) {
+		errsv = errno;
+		path = build_path (relocation->dest, node, NULL);
+		set_error (relocation, errsv, path);
+		g_free (path);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* The stream has its own descriptor, since closedir() closes it */
+static DIR *
+read_directory (HomeRelocation *relocation,
+                DirNode        *node)
+{
+	DIR *dir = NULL;
+	gchar *path;
+	int fd, errsv;
+
+	fd = dup (node->src_fd);
+
+	if (fd >= 0 && (dir = fdopendir (fd)) == NULL)
+		close (fd);
+
+	if (!dir) {
+		errsv = errno;
+		path = build_path (relocation->source, node, NULL);
+		set_error (relocation, errsv, path);
+		g_free (path);
+	}
+
+	return dir;
+}
+
+static void
+scan_directory (HomeRelocation *relocation,
+                DirNode        *node)
+{
+	struct dirent *entry;
+	struct stat st;
+	guint64 bytes = 0;
+	guint files = 0;
+	DIR *dir;
+
+	dir = read_directory (relocation, node);
+
+	if (!dir)
+		return;
+
+	while ((entry = readdir (dir)) != NULL) {
+		if (is_dot_entry (entry->d_name))
+			continue;
+
+		if (fstatat (node->src_fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+			continue;
+
+		if (S_ISDIR (st.st_mode))
+			queue_directory (relocation, dir_node_new (node, entry->d_name, &st));
+		else {
+			files++;
+
+			if (S_ISREG (st.st_mode))
+				bytes += st.st_size;
+		}
+	}
+
+	closedir (dir);
+
+	g_mutex_lock (relocation->lock);
+	relocation->bytes_total += bytes;
+	relocation->files_total += files;
+	g_mutex_unlock (relocation->lock);
+}
+
+static void
+copy_directory (HomeRelocation *relocation,
+                DirNode        *node)
+{
+	struct dirent *entry;
+	struct stat st;
+	gboolean copied;
+	gchar *path;
+	DIR *dir;
+
+	dir = read_directory (relocation, node);
+
+	if (!dir)
+		return;
+
+	while ((entry = readdir (dir)) != NULL &&
+	       !g_cancellable_is_cancelled (relocation->cancellable)) {
+		if (is_dot_entry (entry->d_name))
+			continue;
+
+		if (fstatat (node->src_fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+			copied = FALSE;
+		else if (S_ISDIR (st.st_mode)) {
+			/* created here, where the parent copy is still open */
+			copied = (mkdirat (node->dst_fd, entry->d_name, 0700) == 0 || errno == EEXIST);
+
+			if (copied) {
+				queue_directory (relocation, dir_node_new (node, entry->d_name, &st));
+				continue;
+			}
+		}
+		else if (S_ISREG (st.st_mode))
+			copied = copy_file (relocation, node, entry->d_name);
+		else
+			copied = copy_special (relocation, node, entry->d_name, &st);
+
+		if (copied)
+			add_progress (relocation, 0, 1);
+		else {
+			path = build_path (relocation->source, node, entry->d_name);
+			set_error (relocation, errno, path);
+			g_free (path);
+		}
+	}
+
+	closedir (dir);
+}
+
+/* Threads */
+
+static void
+process_directory (gpointer data,
+                   gpointer user_data)
+{
+	HomeRelocation *relocation = user_data;
+	DirNode *node = data;
+
+	if (!g_cancellable_is_cancelled (relocation->cancellable) &&
+	    open_directory (relocation, node)) {
+		if (relocation->phase == PHASE_SCAN)
+			scan_directory (relocation, node);
+		else
+			copy_directory (relocation, node);
+	}
+
+	/* entries have been queued, children open their own descriptors */
+	dir_node_close (node);
+	dir_node_unref (relocation, node);
+
+	/* subdirectories have been queued already */
+	g_mutex_lock (relocation->lock);
+
+	if (--relocation->pending == 0)
+		g_cond_signal (relocation->cond);
+
+	g_mutex_unlock (relocation->lock);
+}
+
+/* The only directories opened by path */
+static gboolean
+open_roots (HomeRelocation *relocation)
+{
+	relocation->src_root = open (relocation->source, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+
+	if (relocation->src_root < 0) {
+		set_error (relocation, errno, relocation->source);
+		return FALSE;
+	}
+
+	if (relocation->phase == PHASE_SCAN)
+		return TRUE;
+
+	if (mkdir (relocation->dest, 0700) == 0 || errno == EEXIST)
+		relocation->dst_root = open (relocation->dest, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+
+	if (relocation->dst_root < 0) {
+		set_error (relocation, errno, relocation->dest);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+run_phase (HomeRelocation *relocation,
+           gint            phase)
+{
+	relocation->phase = phase;
+	relocation->src_root = -1;
+	relocation->dst_root = -1;
+
+	if (!g_cancellable_is_cancelled (relocation->cancellable) &&
+	    open_roots (relocation)) {
+		queue_directory (relocation, dir_node_new (NULL, NULL, NULL));
+
+		g_mutex_lock (relocation->lock);
+
+		while (relocation->pending > 0)
+			g_cond_wait (relocation->cond, relocation->lock);
+
+		g_mutex_unlock (relocation->lock);
+	}
+
+	if (relocation->src_root >= 0)
+		close (relocation->src_root);
+
+	if (relocation->dst_root >= 0)
+		close (relocation->dst_root);
+}
+
+static gboolean
+report_progress (gpointer data)
+{
+	HomeRelocation *relocation = data;
+	guint64 bytes_done, bytes_total;
+	guint files_done, files_total;
+
+	g_mutex_lock (relocation->lock);
+	bytes_done = relocation->bytes_done;
+	bytes_total = relocation->bytes_total;
+	files_done = relocation->files_done;
+	files_total = relocation->files_total;
+	g_mutex_unlock (relocation->lock);
+
+	if (relocation->progress_func)
+		(* relocation->progress_func) (relocation, bytes_done, bytes_total,
+		                               files_done, files_total, relocation->data);
+
+	return TRUE;
+}
+
+static gboolean
+relocation_done (gpointer data)
+{
+	HomeRelocation *relocation = data;
+	GError *error = NULL;
+
+	g_source_remove (relocation->progress_id);
+	relocation->progress_id = 0;
+	relocation->running = FALSE;
+
+	report_progress (relocation);
+
+	if (relocation->error)
+		error = g_error_copy (relocation->error);
+	else if (g_cancellable_is_cancelled (relocation->cancellable))
+		error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CANCELLED,
+		                             _("The copy has been cancelled."));
+
+	if (relocation->done_func)
+		(* relocation->done_func) (relocation, error, relocation->data);
+
+	if (error)
+		g_error_free (error);
+
+	return FALSE;
+}
+
+static gpointer
+relocation_thread (gpointer data)
+{
+	HomeRelocation *relocation = data;
+
+	run_phase (relocation, PHASE_SCAN);
+	run_phase (relocation, PHASE_COPY);
+
+	g_idle_add (relocation_done, relocation);
+
+	return NULL;
+}
+
+/*
+ * Prepare the copy of @source to @dest, files are given to
+ * @uid and @gid if @chown is TRUE, and keep their owner otherwise.
+ */
+HomeRelocation *
+home_relocation_new (const gchar *source,
+                     const gchar *dest,
+                     gboolean     chown,
+                     uid_t        uid,
+                     gid_t        gid)
+{
+	HomeRelocation *relocation;
+
+	relocation = g_slice_new0 (HomeRelocation);
+	relocation->source = g_strdup (source);
+	relocation->dest = g_strdup (dest);
+	relocation->chown = chown;
+	relocation->uid = uid;
+	relocation->gid = gid;
+
+	relocation->cancellable = g_cancellable_new ();
+	relocation->lock = g_mutex_new ();
+	relocation->cond = g_cond_new ();
+
+	return relocation;
+}
+
+/* Must not be called while the copy is running */
+void
+home_relocation_free (HomeRelocation *relocation)
+{
+	g_return_if_fail (!relocation->running);
+
+	if (relocation->pool)
+		g_thread_pool_free (relocation->pool, TRUE, TRUE);
+
+	if (relocation->error)
+		g_error_free (relocation->error);
+
+	g_cond_free (relocation->cond);
+	g_mutex_free (relocation->lock);
+	g_object_unref (relocation->cancellable);
+	g_free (relocation->source);
+	g_free (relocation->dest);
+
+	g_slice_free (HomeRelocation, relocation);
+}
+
+/*
+ * Start copying in the background. @progress_func is called regularly
+ * and @done_func once, from the main loop, with an error if the copy
+ * failed or has been cancelled.
+ */
+void
+home_relocation_start (HomeRelocation             *relocation,
+                       HomeRelocationProgressFunc  progress_func,
+                       HomeRelocationDoneFunc      done_func,
+                       gpointer                    data)
+{
+	g_return_if_fail (!relocation->running && !relocation->pool);
+
+	relocation->progress_func = progress_func;
+	relocation->done_func = done_func;
+	relocation->data = data;
+	relocation->running = TRUE;
+	relocation->progress_id = g_timeout_add (PROGRESS_INTERVAL, report_progress, relocation);
+
+	relocation->pool = g_thread_pool_new (process_directory, relocation,
+	                                      N_THREADS, FALSE, &relocation->error);
+
+	if (!relocation->pool ||
+	    !g_thread_create (relocation_thread, relocation, FALSE, &relocation->error))
+		g_idle_add (relocation_done, relocation);
+}
+
+void
+home_relocation_cancel (HomeRelocation *relocation)
+{
+	g_cancellable_cancel (relocation->cancellable);
+}
@@ -0,0 +1,51 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* home-relocation.h: this file is part of users-admin, a gnome-system-tools frontend
+ * for user administration.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __HOME_RELOCATION_H
+#define __HOME_RELOCATION_H
+
+#include <sys/types.h>
+#include <glib.h>
+
+typedef struct _HomeRelocation HomeRelocation;
+
+typedef void (* HomeRelocationProgressFunc) (HomeRelocation *relocation,
+                                             guint64         bytes_done,
+                                             guint64         bytes_total,
+                                             guint           files_done,
+                                             guint           files_total,
+                                             gpointer        data);
+typedef void (* HomeRelocationDoneFunc)     (HomeRelocation *relocation,
+                                             const GError   *error,
+                                             gpointer        data);
+
+HomeRelocation *home_relocation_new    (const gchar    *source,
+                                        const gchar    *dest,
+                                        gboolean        chown,
+                                        uid_t           uid,
+                                        gid_t           gid);
+void            home_relocation_free   (HomeRelocation *relocation);
+
+void            home_relocation_start  (HomeRelocation             *relocation,
+                                        HomeRelocationProgressFunc  progress_func,
+                                        HomeRelocationDoneFunc      done_func,
+                                        gpointer                    data);
+void            home_relocation_cancel (HomeRelocation *relocation);
+
+#endif /* __HOME_RELOCATION_H */
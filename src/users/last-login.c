@@ -0,0 +1,455 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* last-login.c: this file is part of users-admin, a gnome-system-tools frontend
+ * for user administration.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Time of the last login of users, read from a background thread.
+ *
+ * lastlog is a sparse file indexed by UID, so it is mapped and only the
+ * records of known users are read: refreshing costs O(users), whatever
+ * the highest UID on the system. When it can't be used, wtmp is scanned
+ * into a login -> time map, and later refreshes only read the records
+ * appended since. Both files are monitored, so that the cache follows
+ * logins as they happen.
+ */
+
+#include <config.h>
+#include "gst.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <utmp.h>
+#include <paths.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "last-login.h"
+
+#ifndef _PATH_LASTLOG
+#define _PATH_LASTLOG "/var/log/lastlog"
+#endif
+
+#ifndef _PATH_WTMP
+#define _PATH_WTMP "/var/log/wtmp"
+#endif
+
+/* wtmp records read at once */
+#define WTMP_CHUNK 256
+
+/* Milliseconds to wait after a change, a login touches both files */
+#define REFRESH_DELAY 2000
+
+typedef struct {
+	uid_t  uid;
+	gchar *login;
+} LoginRequest;
+
+typedef struct {
+	guint       generation;
+	GArray     *requests;   /* LoginRequest, copied from the main thread */
+	GHashTable *times;      /* uid -> gint64, filled by the thread */
+	gboolean    available;
+} LoginJob;
+
+static OobsUsersConfig *users_config = NULL;
+static LastLoginChangedFunc changed_func = NULL;
+static gpointer changed_data = NULL;
+
+static GHashTable *login_cache = NULL;   /* uid -> gint64, 0 if never logged in */
+static gboolean login_available = FALSE;
+
+static GFileMonitor *lastlog_monitor = NULL;
+static GFileMonitor *wtmp_monitor = NULL;
+static guint refresh_id = 0;
+
+static guint generation = 0;
+static gboolean job_running = FALSE;
+static gboolean job_pending = FALSE;
+
+/* wtmp scan state, only used from the thread and kept between refreshes */
+static GHashTable *wtmp_logins = NULL;   /* login -> gint64 */
+static off_t wtmp_offset = 0;
+static ino_t wtmp_ino = 0;
+
+static void
+set_time (GHashTable *times,
+          uid_t       uid,
+          gint64      value)
+{
+	gint64 *time;
+
+	time = g_new (gint64, 1);
+	*time = value;
+	g_hash_table_insert (times, GUINT_TO_POINTER (uid), time);
+}
+
+static gboolean
+read_lastlog (LoginJob *job)
+{
+	struct lastlog *records = NULL;
+	struct stat st;
+	LoginRequest *request;
+	gsize n_records;
+	guint i;
+	int fd;
+
+	fd = open (_PATH_LASTLOG, O_RDONLY);
+
+	if (fd < 0)
+		return FALSE;
+
+	if (fstat (fd, &st) != 0) {
+		close (fd);
+		return FALSE;
+	}
+
+	/* the mapping may fail for huge files on 32 bits systems, use wtmp then */
+	n_records = st.st_size / sizeof (struct lastlog);
+
+	if (n_records > 0)
+		records = mmap (NULL, n_records * sizeof (struct lastlog),
+		                PROT_READ, MAP_SHARED, fd, 0);
+
+	close (fd);
+
+	if (records == MAP_FAILED)
+		return FALSE;
+
+	/* holes and users past the end of the file never logged in */
+	for (i = 0; i < job->requests->len; i++) {
+		request = &g_array_index (job->requests, LoginRequest, i);
+		set_time (job->times, request->uid,
+		          (request->uid < n_records) ? records[request->uid].ll_time : 0);
+	}
+
+	if (records)
+		munmap (records, n_records * sizeof (struct lastlog));
+
+	return TRUE;
+}
+
+/* Read records appended since the last scan, stopping at a partial one */
+static void
+read_wtmp_records (int fd)
+{
+	struct utmp *records;
+	gint64 *time;
+	gchar *login;
+	gssize len;
+	guint i, n;
+
+	records = g_new (struct utmp, WTMP_CHUNK);
+
+	while ((len = pread (fd, records, WTMP_CHUNK * sizeof (struct utmp), wtmp_offset)) > 0) {
+		n = len / sizeof (struct utmp);
+
+		if (n == 0)
+			break;
+
+		for (i = 0; i < n; i++) {
+			if (records[i].ut_type != USER_PROCESS)
+				continue;
+
+			login = g_strndup (records[i].ut_user, sizeof (records[i].ut_user));
+			time = g_hash_table_lookup (wtmp_logins, login);
+
+			if (!time) {
+				time = g_new0 (gint64, 1);
+				g_hash_table_insert (wtmp_logins, login, time);
+			}
+			else
+				g_free (login);
+
+			*time = MAX (*time, (gint64) records[i].ut_tv.tv_sec);
+		}
+
+		wtmp_offset += n * sizeof (struct utmp);
+	}
+
+	g_free (records);
+}
+
+static gboolean
+read_wtmp (LoginJob *job)
+{
+	LoginRequest *request;
+	struct stat st;
+	gint64 *time;
+	guint i;
+	int fd;
+
+	fd = open (_PATH_WTMP, O_RDONLY);
+
+	if (fd < 0)
+		return FALSE;
+
+	if (fstat (fd, &st) != 0) {
+		close (fd);
+		return FALSE;
+	}
+
+	/* rotated or truncated, start over */
+	if (!wtmp_logins || st.st_ino != wtmp_ino || st.st_size < wtmp_offset) {
+		if (wtmp_logins)
+			g_hash_table_destroy (wtmp_logins);
+
+		wtmp_logins = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+		wtmp_offset = 0;
+		wtmp_ino = st.st_ino;
+	}
+
+	read_wtmp_records (fd);
+	close (fd);
+
+	for (i = 0; i < job->requests->len; i++) {
+		request = &g_array_index (job->requests, LoginRequest, i);
+		time = g_hash_table_lookup (wtmp_logins, request->login);
+		set_time (job->times, request->uid, (time) ? *time : 0);
+	}
+
+	return TRUE;
+}
+
+static void
+free_job (LoginJob *job)
+{
+	guint i;
+
+	for (i = 0; i < job->requests->len; i++)
+		g_free (g_array_index (job->requests, LoginRequest, i).login);
+
+	g_array_free (job->requests, TRUE);
+
+	if (job->times)
+		g_hash_table_destroy (job->times);
+
+	g_slice_free (LoginJob, job);
+}
+
+static gboolean
+refresh_done (gpointer data)
+{
+	LoginJob *job = data;
+
+	job_running = FALSE;
+
+	/* discard results arriving after last_login_shutdown() */
+	if (job->generation == generation) {
+		if (login_cache)
+			g_hash_table_destroy (login_cache);
+
+		login_cache = job->times;
+		job->times = NULL;
+		login_available = job->available;
+
+		if (changed_func)
+			changed_func (changed_data);
+
+		if (job_pending) {
+			job_pending = FALSE;
+			last_login_refresh ();
+		}
+	}
+
+	free_job (job);
+
+	return FALSE;
+}
+
+static gpointer
+refresh_thread (gpointer data)
+{
+	LoginJob *job = data;
+
+	job->available = read_lastlog (job) || read_wtmp (job);
+	g_idle_add (refresh_done, job);
+
+	return NULL;
+}
+
+static gboolean
+refresh_timeout (gpointer data)
+{
+	refresh_id = 0;
+	last_login_refresh ();
+
+	return FALSE;
+}
+
+static void
+on_log_changed (GFileMonitor      *monitor,
+                GFile             *file,
+                GFile             *other_file,
+                GFileMonitorEvent  event,
+                gpointer           data)
+{
+	if (!refresh_id)
+		refresh_id = g_timeout_add (REFRESH_DELAY, refresh_timeout, NULL);
+}
+
+static GFileMonitor *
+monitor_log (const gchar *path)
+{
+	GFileMonitor *monitor;
+	GFile *file;
+
+	file = g_file_new_for_path (path);
+	monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, NULL);
+	g_object_unref (file);
+
+	if (monitor)
+		g_signal_connect (monitor, "changed",
+		                  G_CALLBACK (on_log_changed), NULL);
+
+	return monitor;
+}
+
+/*
+ * Start following logins of the users of @config, @func is called
+ * from the main loop each time the cache has been refreshed.
+ */
+void
+last_login_init (OobsUsersConfig      *config,
+                 LastLoginChangedFunc  func,
+                 gpointer              data)
+{
+	users_config = config;
+	changed_func = func;
+	changed_data = data;
+
+	if (!lastlog_monitor)
+		lastlog_monitor = monitor_log (_PATH_LASTLOG);
+
+	if (!wtmp_monitor)
+		wtmp_monitor = monitor_log (_PATH_WTMP);
+}
+
+void
+last_login_shutdown (void)
+{
+	if (refresh_id) {
+		g_source_remove (refresh_id);
+		refresh_id = 0;
+	}
+
+	if (lastlog_monitor) {
+		g_object_unref (lastlog_monitor);
+		lastlog_monitor = NULL;
+	}
+
+	if (wtmp_monitor) {
+		g_object_unref (wtmp_monitor);
+		wtmp_monitor = NULL;
+	}
+
+	/* a running thread is left to finish, its results are dropped */
+	generation++;
+	job_pending = FALSE;
+
+	users_config = NULL;
+	changed_func = NULL;
+	changed_data = NULL;
+
+	if (login_cache) {
+		g_hash_table_destroy (login_cache);
+		login_cache = NULL;
+	}
+
+	login_available = FALSE;
+}
+
+/*
+ * Read last logins again in the background. Logins are copied from
+ * the configuration here, since OobsUsers can't be used from the thread.
+ */
+void
+last_login_refresh (void)
+{
+	OobsList *list;
+	OobsListIter iter;
+	OobsUser *user;
+	LoginJob *job;
+	LoginRequest request;
+	gboolean valid;
+
+	if (!users_config)
+		return;
+
+	if (job_running) {
+		job_pending = TRUE;
+		return;
+	}
+
+	job = g_slice_new0 (LoginJob);
+	job->generation = generation;
+	job->requests = g_array_new (FALSE, FALSE, sizeof (LoginRequest));
+	job->times = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+
+	list = oobs_users_config_get_users (users_config);
+	valid = oobs_list_get_iter_first (list, &iter);
+
+	while (valid) {
+		user = OOBS_USER (oobs_list_get (list, &iter));
+
+		request.uid = oobs_user_get_uid (user);
+		request.login = g_strdup (oobs_user_get_login_name (user));
+		g_array_append_val (job->requests, request);
+
+		g_object_unref (user);
+		valid = oobs_list_iter_next (list, &iter);
+	}
+
+	if (!g_thread_create (refresh_thread, job, FALSE, NULL)) {
+		free_job (job);
+		return;
+	}
+
+	job_running = TRUE;
+}
+
+/* Whether lastlog or wtmp could be read */
+gboolean
+last_login_is_available (void)
+{
+	return login_available;
+}
+
+/*
+ * Get the time of the last login of @user, 0 if the user never logged in.
+ * Returns FALSE if it isn't known yet.
+ */
+gboolean
+last_login_lookup (OobsUser *user,
+                   gint64   *time)
+{
+	gint64 *cached;
+
+	if (!login_cache)
+		return FALSE;
+
+	cached = g_hash_table_lookup (login_cache, GUINT_TO_POINTER (oobs_user_get_uid (user)));
+
+	if (!cached)
+		return FALSE;
+
+	*time = *cached;
+
+	return TRUE;
+}
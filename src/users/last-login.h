@@ -0,0 +1,38 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* last-login.h: this file is part of users-admin, a gnome-system-tools frontend
+ * for user administration.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __LAST_LOGIN_H
+#define __LAST_LOGIN_H
+
+#include "gst.h"
+
+typedef void (* LastLoginChangedFunc) (gpointer data);
+
+void      last_login_init          (OobsUsersConfig      *config,
+                                    LastLoginChangedFunc  func,
+                                    gpointer              data);
+void      last_login_shutdown      (void);
+
+void      last_login_refresh       (void);
+
+gboolean  last_login_is_available  (void);
+gboolean  last_login_lookup        (OobsUser *user,
+                                    gint64   *time);
+
+#endif /* __LAST_LOGIN_H */
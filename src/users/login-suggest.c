@@ -0,0 +1,694 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* login-suggest.c: this file is part of users-admin, a gnome-system-tools frontend
+ * for user administration.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <config.h>
+#include "gst.h"
+
+#include <string.h>
+
+#include "login-suggest.h"
+
+/* Largest numeric suffix offered for a taken login */
+#define MAX_SUFFIX 9999
+
+/* Used by g_convert_with_fallback() for characters it can't transliterate */
+#define UNICODE_FALLBACK "?"
+
+typedef struct {
+	const gchar *utf8;
+	const gchar *ascii;
+} Transliteration;
+
+/* Alternative spellings that iconv's //TRANSLIT won't give us,
+ * since it usually turns "ü" into "u" rather than "ue". */
+static const Transliteration alt_transliterations[] = {
+	{ "\xc3\xa4", "ae" }, { "\xc3\x84", "ae" },	/* ä Ä */
+	{ "\xc3\xb6", "oe" }, { "\xc3\x96", "oe" },	/* ö Ö */
+	{ "\xc3\xbc", "ue" }, { "\xc3\x9c", "ue" },	/* ü Ü */
+	{ "\xc3\x9f", "ss" },				/* ß */
+	{ "\xc3\xa5", "aa" }, { "\xc3\x85", "aa" },	/* å Å */
+	{ "\xc3\xa6", "ae" }, { "\xc3\x86", "ae" },	/* æ Æ */
+	{ "\xc3\xb8", "oe" }, { "\xc3\x98", "oe" },	/* ø Ø */
+	{ "\xc5\x93", "oe" }, { "\xc5\x92", "oe" },	/* œ Œ */
+	{ "\xc3\xbe", "th" }, { "\xc3\x9e", "th" },	/* þ Þ */
+};
+
+typedef struct {
+	gchar  *word;      /* toplevel word, after normalization */
+	gchar  *joined;    /* its dash-separated parts, concatenated */
+	gchar  *initials;  /* first letter of each of these parts */
+} NameWord;
+
+/* Set of logins already in use, so that checking a candidate is O(1)
+ * instead of a walk over the whole users list */
+static GHashTable *used_logins = NULL;
+
+/* Used logins grouped by their prefix before a numeric suffix: for each
+ * base login, the sorted array of suffixes in use (john2, john3...), so
+ * that the first free one is found without trying them one by one */
+static GHashTable *suffix_index = NULL;
+
+/* State kept from the previous keystroke */
+static gchar     *last_normalized = NULL;
+static gchar     *last_alt_normalized = NULL;
+static guint      last_max_len = 0;
+static guint      last_generation = 0;
+static GPtrArray *last_words = NULL;
+static GPtrArray *last_alt_words = NULL;
+static GPtrArray *candidates = NULL;
+
+/* Bumped on every change to used_logins, to know when cached candidates are stale */
+static guint generation = 1;
+
+
+static void
+free_suffixes (GArray *suffixes)
+{
+	g_array_free (suffixes, TRUE);
+}
+
+/*
+ * Split @login into a base and the numeric suffix suggestions may use,
+ * i.e. from 2 to MAX_SUFFIX without leading zeros. Returns the base,
+ * or NULL if @login has no such suffix.
+ */
+static gchar *
+split_suffix (const gchar *login,
+              guint       *suffix)
+{
+	const gchar *digits;
+	guint64 value;
+
+	digits = login + strlen (login);
+	while (digits > login && g_ascii_isdigit (digits[-1]))
+		digits--;
+
+	if (digits == login || *digits == '\0' || *digits == '0')
+		return NULL;
+
+	value = g_ascii_strtoull (digits, NULL, 10);
+
+	if (value < 2 || value > MAX_SUFFIX)
+		return NULL;
+
+	*suffix = (guint) value;
+
+	return g_strndup (login, digits - login);
+}
+
+/*
+ * Binary search of @suffix in sorted @suffixes. Returns whether it
+ * was found, and sets @pos to its position or to where it belongs.
+ */
+static gboolean
+find_suffix (GArray *suffixes,
+             guint   suffix,
+             guint  *pos)
+{
+	guint low = 0, high = suffixes->len, mid, value;
+
+	while (low < high) {
+		mid = (low + high) / 2;
+		value = g_array_index (suffixes, guint, mid);
+
+		if (value == suffix) {
+			*pos = mid;
+			return TRUE;
+		}
+		else if (value < suffix)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	*pos = low;
+	return FALSE;
+}
+
+static void
+index_suffix (const gchar *login)
+{
+	GArray *suffixes;
+	gchar *base;
+	guint suffix, pos;
+
+	base = split_suffix (login, &suffix);
+	if (!base)
+		return;
+
+	suffixes = g_hash_table_lookup (suffix_index, base);
+
+	if (!suffixes) {
+		suffixes = g_array_new (FALSE, FALSE, sizeof (guint));
+		g_hash_table_insert (suffix_index, base, suffixes);
+	}
+	else
+		g_free (base);
+
+	if (!find_suffix (suffixes, suffix, &pos))
+		g_array_insert_val (suffixes, pos, suffix);
+}
+
+static void
+unindex_suffix (const gchar *login)
+{
+	GArray *suffixes;
+	gchar *base;
+	guint suffix, pos;
+
+	base = split_suffix (login, &suffix);
+	if (!base)
+		return;
+
+	suffixes = g_hash_table_lookup (suffix_index, base);
+
+	if (suffixes && find_suffix (suffixes, suffix, &pos)) {
+		g_array_remove_index (suffixes, pos);
+
+		if (suffixes->len == 0)
+			g_hash_table_remove (suffix_index, base);
+	}
+
+	g_free (base);
+}
+
+static void
+ensure_tables (void)
+{
+	if (used_logins)
+		return;
+
+	used_logins = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	suffix_index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+	                                      (GDestroyNotify) free_suffixes);
+}
+
+/*
+ * Fill the set of used logins from the users configuration.
+ * Must be called each time the users list is reloaded.
+ */
+void
+login_suggest_reset (OobsUsersConfig *config)
+{
+	OobsList *list;
+	OobsListIter iter;
+	OobsUser *user;
+	gboolean valid;
+
+	login_suggest_clear ();
+
+	list = oobs_users_config_get_users (config);
+	valid = oobs_list_get_iter_first (list, &iter);
+
+	while (valid) {
+		user = OOBS_USER (oobs_list_get (list, &iter));
+		login_suggest_add_login (oobs_user_get_login_name (user));
+		g_object_unref (user);
+
+		valid = oobs_list_iter_next (list, &iter);
+	}
+}
+
+void
+login_suggest_clear (void)
+{
+	ensure_tables ();
+
+	g_hash_table_remove_all (used_logins);
+	g_hash_table_remove_all (suffix_index);
+	generation++;
+}
+
+void
+login_suggest_add_login (const gchar *login)
+{
+	gchar *key;
+
+	if (!login)
+		return;
+
+	ensure_tables ();
+
+	if (g_hash_table_lookup (used_logins, login))
+		return;
+
+	key = g_strdup (login);
+	g_hash_table_insert (used_logins, key, key);
+	index_suffix (login);
+	generation++;
+}
+
+void
+login_suggest_remove_login (const gchar *login)
+{
+	if (!login)
+		return;
+
+	ensure_tables ();
+
+	if (!g_hash_table_remove (used_logins, login))
+		return;
+
+	unindex_suffix (login);
+	generation++;
+}
+
+gboolean
+login_suggest_is_used (const gchar *login)
+{
+	ensure_tables ();
+
+	return (g_hash_table_lookup (used_logins, login) != NULL);
+}
+
+/*
+ * Returns a newly allocated string where letters with a common
+ * two-letter spelling have been expanded, or NULL if there were none.
+ */
+static gchar *
+expand_transliterations (const gchar *name)
+{
+	GString *str;
+	const gchar *p;
+	gboolean changed = FALSE;
+	guint i;
+
+	str = g_string_sized_new (strlen (name) + 8);
+
+	for (p = name; *p; p = g_utf8_next_char (p)) {
+		for (i = 0; i < G_N_ELEMENTS (alt_transliterations); i++) {
+			if (strncmp (p, alt_transliterations[i].utf8,
+			             strlen (alt_transliterations[i].utf8)) == 0)
+				break;
+		}
+
+		if (i < G_N_ELEMENTS (alt_transliterations)) {
+			g_string_append (str, alt_transliterations[i].ascii);
+			changed = TRUE;
+		}
+		else
+			g_string_append_len (str, p, g_utf8_next_char (p) - p);
+	}
+
+	if (!changed) {
+		g_string_free (str, TRUE);
+		return NULL;
+	}
+
+	return g_string_free (str, FALSE);
+}
+
+/*
+ * Turn a full name into lower case ASCII, only keeping the characters
+ * allowed in logins, spaces, and the fallback character marking words
+ * that could not be transliterated. If @alternative is TRUE, use the
+ * expanded spellings, returning NULL if it would not make any difference.
+ */
+static gchar *
+normalize_name (const gchar *name,
+                gboolean     alternative)
+{
+	gchar *expanded = NULL;
+	gchar *ascii, *lc_name, *stripped;
+	gchar *c;
+	int i;
+
+	if (alternative) {
+		expanded = expand_transliterations (name);
+
+		if (!expanded)
+			return NULL;
+	}
+
+	ascii = g_convert_with_fallback (expanded ? expanded : name, -1,
+	                                 "ASCII//TRANSLIT", "UTF-8",
+	                                 UNICODE_FALLBACK, NULL, NULL, NULL);
+	g_free (expanded);
+
+	if (!ascii)
+		return NULL;
+
+	lc_name = g_ascii_strdown (ascii, -1);
+	g_free (ascii);
+
+	stripped = g_strnfill (strlen (lc_name) + 1, '\0');
+	i = 0;
+
+	for (c = lc_name; *c; c++) {
+		if ( !(g_ascii_isdigit (*c) || g_ascii_islower (*c)
+		       || *c == ' ' || *c == '-' || *c == '.' || *c == '_'
+		       || *c == UNICODE_FALLBACK[0]) )
+			continue;
+
+		stripped[i] = *c;
+		i++;
+	}
+
+	g_free (lc_name);
+
+	return stripped;
+}
+
+static void
+name_word_free (NameWord *word)
+{
+	if (!word)
+		return;
+
+	g_free (word->word);
+	g_free (word->joined);
+	g_free (word->initials);
+	g_slice_free (NameWord, word);
+}
+
+static NameWord *
+name_word_new (const gchar *toplevel)
+{
+	NameWord *word;
+	GString *joined, *initials;
+	gchar **parts, **part;
+
+	joined = g_string_sized_new (strlen (toplevel));
+	initials = g_string_sized_new (4);
+
+	/* words linked with dashes are treated the same way, i.e.
+	 * both fully shown, or both abbreviated */
+	parts = g_strsplit (toplevel, "-", -1);
+
+	for (part = parts; *part; part++) {
+		if (**part == '\0')
+			continue;
+
+		g_string_append (joined, *part);
+		g_string_append_c (initials, **part);
+	}
+
+	g_strfreev (parts);
+
+	if (joined->len == 0) {
+		g_string_free (joined, TRUE);
+		g_string_free (initials, TRUE);
+		return NULL;
+	}
+
+	word = g_slice_new (NameWord);
+	word->word = g_strdup (toplevel);
+	word->joined = g_string_free (joined, FALSE);
+	word->initials = g_string_free (initials, FALSE);
+
+	return word;
+}
+
+/*
+ * Split a normalized name into words. Words that did not change since
+ * the previous keystroke are taken from @previous instead of being parsed
+ * again: when typing, only the last word changes.
+ */
+static GPtrArray *
+split_words (const gchar *normalized,
+             GPtrArray   *previous)
+{
+	GPtrArray *words;
+	NameWord *word;
+	gchar **toplevel, **w;
+	guint pos;
+
+	words = g_ptr_array_new_with_free_func ((GDestroyNotify) name_word_free);
+	toplevel = g_strsplit (normalized, " ", -1);
+
+	for (w = toplevel; *w; w++) {
+		/* skip words with the fallback character, most likely
+		 * resulting from failed transliteration to ASCII */
+		if (**w == '\0' || strstr (*w, UNICODE_FALLBACK) != NULL)
+			continue;
+
+		word = NULL;
+		pos = words->len;
+
+		if (previous && pos < previous->len) {
+			word = g_ptr_array_index (previous, pos);
+
+			if (word && strcmp (word->word, *w) == 0)
+				previous->pdata[pos] = NULL;
+			else
+				word = NULL;
+		}
+
+		if (!word)
+			word = name_word_new (*w);
+
+		if (word)
+			g_ptr_array_add (words, word);
+	}
+
+	g_strfreev (toplevel);
+
+	return words;
+}
+
+/*
+ * Append @login to the candidates if it is valid and unused.
+ * Returns whether the login is taken.
+ */
+static gboolean
+add_candidate (GHashTable  *seen,
+               const gchar *login,
+               guint        max_len)
+{
+	gchar *copy;
+
+	if (!login || *login == '\0' || g_ascii_isdigit (*login))
+		return FALSE;
+
+	if (g_hash_table_lookup (used_logins, login))
+		return TRUE;
+
+	if ((max_len > 0 && strlen (login) > max_len)
+	    || g_hash_table_lookup (seen, login))
+		return FALSE;
+
+	copy = g_strdup (login);
+	g_ptr_array_add (candidates, copy);
+	g_hash_table_insert (seen, copy, copy);
+
+	return FALSE;
+}
+
+/*
+ * Returns the first free login made of @base and a numeric suffix.
+ * Suffixes in use for @base are sorted and start at 2, so the first
+ * free one is right after the longest run where the suffix at position
+ * i is i + 2, which a binary search finds.
+ */
+static gchar *
+find_free_suffixed (const gchar *base,
+                    guint        max_len)
+{
+	GArray *suffixes;
+	gchar *login;
+	guint low, high, mid;
+
+	suffixes = g_hash_table_lookup (suffix_index, base);
+	low = 0;
+	high = suffixes ? suffixes->len : 0;
+
+	while (low < high) {
+		mid = (low + high) / 2;
+
+		if (g_array_index (suffixes, guint, mid) == mid + 2)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if (low + 2 > MAX_SUFFIX)
+		return NULL;
+
+	login = g_strdup_printf ("%s%u", base, low + 2);
+
+	if (max_len > 0 && strlen (login) > max_len) {
+		g_free (login);
+		return NULL;
+	}
+
+	return login;
+}
+
+static gboolean
+equal_or_both_null (const gchar *str1,
+                    const gchar *str2)
+{
+	if (!str1 || !str2)
+		return (str1 == str2);
+
+	return (strcmp (str1, str2) == 0);
+}
+
+static void
+add_candidates_for_words (GPtrArray  *words,
+                          GHashTable *seen,
+                          GPtrArray  *taken_bases,
+                          guint       max_len)
+{
+	NameWord *first, *last;
+	GString *but_first, *but_last;
+	gchar *item;
+	gboolean taken;
+	guint i;
+
+	if (words->len == 0)
+		return;
+
+	first = g_ptr_array_index (words, 0);
+	last = g_ptr_array_index (words, words->len - 1);
+
+	/* initials of all words but the first one, and but the last one */
+	but_first = g_string_new (NULL);
+	but_last = g_string_new (NULL);
+
+	for (i = 0; i < words->len; i++) {
+		NameWord *word = g_ptr_array_index (words, i);
+
+		if (i > 0)
+			g_string_append (but_first, word->initials);
+		if (i < words->len - 1)
+			g_string_append (but_last, word->initials);
+	}
+
+	/* whole first word with the initials of the others (johnfs) */
+	item = g_strconcat (first->joined, but_first->str, NULL);
+	taken = add_candidate (seen, item, max_len);
+	if (taken)
+		g_ptr_array_add (taken_bases, item);
+	else
+		g_free (item);
+
+	if (words->len > 1 || strlen (first->initials) > 1) {
+		/* initials followed by the last word (jfsmith) */
+		item = g_strconcat (but_last->str, last->joined, NULL);
+		taken = add_candidate (seen, item, max_len);
+		if (taken)
+			g_ptr_array_add (taken_bases, item);
+		else
+			g_free (item);
+
+		/* symmetrical variants (fsjohn, smithjf) */
+		item = g_strconcat (but_first->str, first->joined, NULL);
+		add_candidate (seen, item, max_len);
+		g_free (item);
+
+		item = g_strconcat (last->joined, but_last->str, NULL);
+		add_candidate (seen, item, max_len);
+		g_free (item);
+
+		/* first and last names, with the usual separator (john.smith) */
+		if (words->len > 1) {
+			item = g_strconcat (first->joined, ".", last->joined, NULL);
+			add_candidate (seen, item, max_len);
+			g_free (item);
+		}
+
+		/* the last word alone, and the first one */
+		add_candidate (seen, last->joined, max_len);
+		add_candidate (seen, first->joined, max_len);
+	}
+
+	g_string_free (but_first, TRUE);
+	g_string_free (but_last, TRUE);
+}
+
+/*
+ * Get a list of unused logins that could be derived from full name @name.
+ * The array and its contents are owned by the suggestion engine, and are
+ * only valid until the next call.
+ */
+const GPtrArray *
+login_suggest_get_candidates (const gchar *name,
+                              guint        max_len)
+{
+	GHashTable *seen;
+	GPtrArray *taken_bases;
+	GPtrArray *words, *alt_words;
+	gchar *normalized, *alt_normalized;
+	gchar *login;
+	guint i;
+
+	ensure_tables ();
+
+	normalized = normalize_name (name, FALSE);
+	alt_normalized = normalize_name (name, TRUE);
+
+	/* the previous set is still right if the keystroke didn't change the
+	 * normalized name, e.g. a space or a comma was typed */
+	if (candidates && max_len == last_max_len && last_generation == generation
+	    && equal_or_both_null (normalized, last_normalized)
+	    && equal_or_both_null (alt_normalized, last_alt_normalized)) {
+		g_free (normalized);
+		g_free (alt_normalized);
+		return candidates;
+	}
+
+	if (candidates)
+		g_ptr_array_free (candidates, TRUE);
+
+	candidates = g_ptr_array_new_with_free_func (g_free);
+	seen = g_hash_table_new (g_str_hash, g_str_equal);
+	taken_bases = g_ptr_array_new_with_free_func (g_free);
+
+	words = split_words (normalized ? normalized : "", last_words);
+	add_candidates_for_words (words, seen, taken_bases, max_len);
+
+	if (alt_normalized) {
+		alt_words = split_words (alt_normalized, last_alt_words);
+		add_candidates_for_words (alt_words, seen, taken_bases, max_len);
+	}
+	else
+		alt_words = NULL;
+
+	/* when the preferred logins are taken, offer numbered ones instead */
+	for (i = 0; i < taken_bases->len; i++) {
+		login = find_free_suffixed (g_ptr_array_index (taken_bases, i), max_len);
+
+		if (login) {
+			add_candidate (seen, login, max_len);
+			g_free (login);
+		}
+	}
+
+	/* keep state for the next keystroke */
+	if (last_words)
+		g_ptr_array_free (last_words, TRUE);
+	if (last_alt_words)
+		g_ptr_array_free (last_alt_words, TRUE);
+
+	last_words = words;
+	last_alt_words = alt_words;
+
+	g_free (last_normalized);
+	g_free (last_alt_normalized);
+	last_normalized = normalized;
+	last_alt_normalized = alt_normalized;
+	last_max_len = max_len;
+	last_generation = generation;
+
+	g_hash_table_destroy (seen);
+	g_ptr_array_free (taken_bases, TRUE);
+
+	return candidates;
+}
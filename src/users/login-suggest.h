@@ -0,0 +1,35 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* login-suggest.h: this file is part of users-admin, a gnome-system-tools frontend
+ * for user administration.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __LOGIN_SUGGEST_H
+#define __LOGIN_SUGGEST_H
+
+#include "gst.h"
+
+void              login_suggest_reset            (OobsUsersConfig *config);
+void              login_suggest_clear            (void);
+
+void              login_suggest_add_login        (const gchar *login);
+void              login_suggest_remove_login     (const gchar *login);
+gboolean          login_suggest_is_used          (const gchar *login);
+
+const GPtrArray * login_suggest_get_candidates   (const gchar *name,
+                                                  guint        max_len);
+
+#endif /* __LOGIN_SUGGEST_H */
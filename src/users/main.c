@@ -35,6 +35,9 @@
 #include "table.h"
 #include "callbacks.h"
 #include "users-tool.h"
+#include "user-import.h"
+#include "passwd-hash.h"
+#include "passwd-quality.h"
 
 GstTool *tool;
 
@@ -44,6 +47,7 @@ static GstDialogSignal signals[] = {
 	/* Main dialog callbacks, users tab */
 	{ "user_delete",                	"clicked",       	G_CALLBACK (on_user_delete_clicked) },
 	{ "manage_groups",                      "clicked",              G_CALLBACK (on_manage_groups_clicked) },
+	{ "user_import",                        "clicked",              G_CALLBACK (on_user_import_clicked) },
 	
 	/* Main dialog callbacks, groups tab */
 	{ "group_new",				"clicked",		G_CALLBACK (on_group_new_clicked) },
@@ -81,13 +85,41 @@ main_window_prepare (GstUsersTool *tool)
 int
 main (int argc, char *argv[])
 {
-	gst_init_tool ("users-admin", argc, argv, NULL);
+	gchar *import_file = NULL;
+	gchar *import_profile = NULL;
+	gint calibrate_msecs = 0;
+	gchar *wordlist = NULL;
+
+	GOptionEntry entries[] = {
+		{ "import", 'i', 0, G_OPTION_ARG_FILENAME, &import_file, N_("Create users listed in a CSV or newusers file"), N_("FILE") },
+		{ "profile", 'p', 0, G_OPTION_ARG_STRING, &import_profile, N_("Profile applied to imported users"), N_("PROFILE") },
+		{ "calibrate-hash", 0, 0, G_OPTION_ARG_INT, &calibrate_msecs, N_("Tune password hashing to take MSECS milliseconds, and save it in user profiles"), N_("MSECS") },
+		{ "build-dictionary", 0, 0, G_OPTION_ARG_FILENAME, &wordlist, N_("Reject passwords listed in FILE, one per line"), N_("FILE") },
+		{ NULL }
+	};
+
+	g_thread_init (NULL);
+	gst_init_tool_options ("users-admin", &argc, &argv, entries);
+
+	/* these run before GTK+ is initialized, so they work without display */
+	if (import_file)
+		return user_import_run_headless (import_file, import_profile) ? 0 : 1;
+
+	if (calibrate_msecs > 0)
+		return passwd_hash_run_calibration (calibrate_msecs) ? 0 : 1;
+
+	if (wordlist)
+		return passwd_quality_run_build_dictionary (wordlist) ? 0 : 1;
+
+	gtk_init (&argc, &argv);
+
 	tool = GST_TOOL (gst_users_tool_new ());
 
 	gst_dialog_connect_signals (tool->main_dialog, signals);
 	main_window_prepare (GST_USERS_TOOL (tool));
 
 	gtk_widget_show (GTK_WIDGET (tool->main_dialog));
+
 	gtk_main ();
 	
 	return 0;
@@ -0,0 +1,302 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* membership-index.c: this file is part of users-admin, a gnome-system-tools frontend
+ * for user administration.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Two-way index of group memberships: for each user the set of groups
+ * it belongs to, and for each group the set of its members. Both are
+ * hash sets keyed on the objects themselves, so that membership checks
+ * don't need to walk the member list of a group. The index holds a
+ * reference on every object it knows about, and is rebuilt each time the
+ * users or groups lists are reloaded, since those replace the objects.
+ */
+
+#include <config.h>
+#include "gst.h"
+
+#include "membership-index.h"
+
+/* OobsUser -> set of OobsGroup */
+static GHashTable *user_groups = NULL;
+
+/* OobsGroup -> set of OobsUser */
+static GHashTable *group_users = NULL;
+
+/* Bumped on every change, so that callers can cache results */
+static guint generation = 1;
+
+/* Only bumped when groups are added or removed */
+static guint groups_generation = 1;
+
+
+static void
+ensure_tables (void)
+{
+	if (user_groups)
+		return;
+
+	user_groups = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+	                                     g_object_unref, (GDestroyNotify) g_hash_table_destroy);
+	group_users = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+	                                     g_object_unref, (GDestroyNotify) g_hash_table_destroy);
+}
+
+static GHashTable *
+lookup_set (GHashTable *index,
+            gpointer    key,
+            gboolean    create)
+{
+	GHashTable *set;
+
+	set = g_hash_table_lookup (index, key);
+
+	/* sets don't reference their members, which are always keys of the
+	 * other table too */
+	if (!set && create) {
+		set = g_hash_table_new (g_direct_hash, g_direct_equal);
+		g_hash_table_insert (index, g_object_ref (key), set);
+	}
+
+	return set;
+}
+
+static void
+index_add (OobsGroup *group,
+           OobsUser  *user)
+{
+	g_hash_table_insert (lookup_set (group_users, group, TRUE), user, user);
+	g_hash_table_insert (lookup_set (user_groups, user, TRUE), group, group);
+}
+
+static void
+index_remove (OobsGroup *group,
+              OobsUser  *user)
+{
+	GHashTable *set;
+
+	set = lookup_set (group_users, group, FALSE);
+	if (set)
+		g_hash_table_remove (set, user);
+
+	set = lookup_set (user_groups, user, FALSE);
+	if (set)
+		g_hash_table_remove (set, group);
+}
+
+void
+membership_index_clear (void)
+{
+	ensure_tables ();
+
+	g_hash_table_remove_all (user_groups);
+	g_hash_table_remove_all (group_users);
+	generation++;
+	groups_generation++;
+}
+
+/*
+ * Add @group and its current members to the index.
+ */
+void
+membership_index_add_group (OobsGroup *group)
+{
+	GList *users, *l;
+
+	ensure_tables ();
+
+	/* make sure empty groups are known too */
+	lookup_set (group_users, group, TRUE);
+
+	users = oobs_group_get_users (group);
+
+	for (l = users; l; l = l->next)
+		index_add (group, OOBS_USER (l->data));
+
+	g_list_free (users);
+	generation++;
+	groups_generation++;
+}
+
+void
+membership_index_remove_group (OobsGroup *group)
+{
+	GHashTableIter iter;
+	gpointer user;
+	GHashTable *set;
+
+	ensure_tables ();
+
+	set = lookup_set (group_users, group, FALSE);
+	if (!set)
+		return;
+
+	g_hash_table_iter_init (&iter, set);
+	while (g_hash_table_iter_next (&iter, &user, NULL)) {
+		GHashTable *groups = lookup_set (user_groups, user, FALSE);
+
+		if (groups)
+			g_hash_table_remove (groups, group);
+	}
+
+	g_hash_table_remove (group_users, group);
+	generation++;
+	groups_generation++;
+}
+
+void
+membership_index_remove_user (OobsUser *user)
+{
+	GHashTableIter iter;
+	gpointer group;
+	GHashTable *set;
+
+	ensure_tables ();
+
+	set = lookup_set (user_groups, user, FALSE);
+	if (!set)
+		return;
+
+	g_hash_table_iter_init (&iter, set);
+	while (g_hash_table_iter_next (&iter, &group, NULL)) {
+		GHashTable *users = lookup_set (group_users, group, FALSE);
+
+		if (users)
+			g_hash_table_remove (users, user);
+	}
+
+	g_hash_table_remove (user_groups, user);
+	generation++;
+}
+
+/*
+ * Rebuild the whole index from the groups configuration.
+ */
+void
+membership_index_build (OobsGroupsConfig *config)
+{
+	OobsList *list;
+	OobsListIter iter;
+	GObject *group;
+	gboolean valid;
+
+	membership_index_clear ();
+
+	list = oobs_groups_config_get_groups (config);
+	valid = oobs_list_get_iter_first (list, &iter);
+
+	while (valid) {
+		group = oobs_list_get (list, &iter);
+		membership_index_add_group (OOBS_GROUP (group));
+		g_object_unref (group);
+
+		valid = oobs_list_iter_next (list, &iter);
+	}
+}
+
+gboolean
+membership_index_is_member (OobsGroup *group,
+                            OobsUser  *user)
+{
+	GHashTable *set;
+
+	if (!group || !user)
+		return FALSE;
+
+	ensure_tables ();
+
+	set = lookup_set (group_users, group, FALSE);
+
+	return (set && g_hash_table_lookup (set, user) != NULL);
+}
+
+guint
+membership_index_count_members (OobsGroup *group)
+{
+	GHashTable *set;
+
+	if (!group)
+		return 0;
+
+	ensure_tables ();
+
+	set = lookup_set (group_users, group, FALSE);
+
+	return (set) ? g_hash_table_size (set) : 0;
+}
+
+/*
+ * Returns the set of members of @group, owned by the index,
+ * or NULL if the group is unknown.
+ */
+GHashTable *
+membership_index_get_members (OobsGroup *group)
+{
+	ensure_tables ();
+
+	return lookup_set (group_users, group, FALSE);
+}
+
+/*
+ * Returns the set of groups @user belongs to, owned by the index,
+ * or NULL if the user is not a member of any group.
+ */
+GHashTable *
+membership_index_get_groups (OobsUser *user)
+{
+	ensure_tables ();
+
+	return lookup_set (user_groups, user, FALSE);
+}
+
+/*
+ * Add or remove @user from @group, keeping the index up to date.
+ * All membership edits should go through this function.
+ */
+void
+membership_index_set_member (OobsGroup *group,
+                             OobsUser  *user,
+                             gboolean   member)
+{
+	g_return_if_fail (OOBS_IS_GROUP (group));
+	g_return_if_fail (OOBS_IS_USER (user));
+
+	ensure_tables ();
+
+	if (member) {
+		oobs_group_add_user (group, user);
+		index_add (group, user);
+	}
+	else {
+		oobs_group_remove_user (group, user);
+		index_remove (group, user);
+	}
+
+	generation++;
+}
+
+guint
+membership_index_get_generation (void)
+{
+	return generation;
+}
+
+guint
+membership_index_get_groups_generation (void)
+{
+	return groups_generation;
+}
@@ -0,0 +1,45 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* membership-index.h: this file is part of users-admin, a gnome-system-tools frontend
+ * for user administration.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __MEMBERSHIP_INDEX_H
+#define __MEMBERSHIP_INDEX_H
+
+#include "gst.h"
+
+void         membership_index_build          (OobsGroupsConfig *config);
+void         membership_index_clear          (void);
+
+void         membership_index_add_group      (OobsGroup *group);
+void         membership_index_remove_group   (OobsGroup *group);
+void         membership_index_remove_user    (OobsUser  *user);
+
+gboolean     membership_index_is_member      (OobsGroup *group,
+                                              OobsUser  *user);
+guint        membership_index_count_members  (OobsGroup *group);
+GHashTable * membership_index_get_members    (OobsGroup *group);
+GHashTable * membership_index_get_groups     (OobsUser  *user);
+
+void         membership_index_set_member     (OobsGroup *group,
+                                              OobsUser  *user,
+                                              gboolean   member);
+
+guint        membership_index_get_generation (void);
+guint        membership_index_get_groups_generation (void);
+
+#endif /* __MEMBERSHIP_INDEX_H */
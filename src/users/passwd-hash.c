@@ -0,0 +1,458 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* passwd-hash.c: this file is part of users-admin, a gnome-system-tools frontend
+ * for user administration.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Password hashing with a method and cost chosen for the machine. Slow
+ * hashes are what makes a stolen shadow file expensive to crack, so
+ * --calibrate-hash measures how long hashing takes here and stores the
+ * cost that makes a login take the requested time in user-profiles.conf,
+ * as the CryptPrefix and CryptCost keys of each profile.
+ */
+
+#include <config.h>
+#include <glib/gi18n.h>
+#include "gst.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#ifdef HAVE_CRYPT_H
+#include <crypt.h>
+#endif
+
+#include "passwd-hash.h"
+
+typedef struct {
+	const gchar *prefix;
+	const gchar *name;
+	gboolean     linear;		/* cost is a number of rounds, else a logarithmic factor */
+	gulong       min_cost;
+	gulong       max_cost;
+} HashMethod;
+
+/* In order of preference */
+static const HashMethod methods[] = {
+#ifdef HAVE_CRYPT_GENSALT_RN
+	{ "$y$", "yescrypt", FALSE, 1, 11 },
+#endif
+	{ "$6$", "SHA-512", TRUE, 1000, 999999999 },
+	{ "$5$", "SHA-256", TRUE, 1000, 999999999 },
+	{ NULL }
+};
+
+/* Rounds linear methods are first measured with, the SHA-crypt default */
+#define MEASURE_ROUNDS 5000
+
+/* Keep the fastest of a few runs, the others were disturbed */
+#define MEASURE_RUNS 3
+
+#define SALT_LEN 16
+
+typedef struct {
+	const HashMethod *method;
+	gulong            cost;
+	const gchar     **passwords;
+	gchar           **hashes;
+} HashBatch;
+
+
+static const HashMethod *
+find_method (const gchar *prefix)
+{
+	const HashMethod *method;
+
+	for (method = methods; prefix && method->prefix; method++) {
+		if (strcmp (method->prefix, prefix) == 0)
+			return method;
+	}
+
+	return NULL;
+}
+
+#ifdef HAVE_CRYPT_R
+
+#ifndef HAVE_CRYPT_GENSALT_RN
+static void
+read_random (guchar *bytes,
+             gsize   len)
+{
+	gssize n_read = -1;
+	gsize i;
+	int fd;
+
+	fd = open ("/dev/urandom", O_RDONLY);
+
+	if (fd >= 0) {
+		n_read = read (fd, bytes, len);
+		close (fd);
+	}
+
+	if (n_read != (gssize) len) {
+		for (i = 0; i < len; i++)
+			bytes[i] = g_random_int_range (0, 256);
+	}
+}
+#endif
+
+/*
+ * Build the setting passed to crypt_r(): method prefix, cost and a new
+ * random salt. A cost of 0 means the default cost of the method.
+ */
+static gchar *
+make_setting (const HashMethod *method,
+              gulong            cost)
+{
+#ifdef HAVE_CRYPT_GENSALT_RN
+	gchar setting[CRYPT_GENSALT_OUTPUT_SIZE];
+
+	/* libcrypt gets the random bytes itself when passed none */
+	if (crypt_gensalt_rn (method->prefix, cost, NULL, 0,
+	                      setting, sizeof (setting)) == NULL)
+		return NULL;
+
+	return g_strdup (setting);
+#else
+	static const gchar alphabet[] =
+		"./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+	guchar bytes[SALT_LEN];
+	gchar salt[SALT_LEN + 1];
+	gint i;
+
+	read_random (bytes, SALT_LEN);
+
+	for (i = 0; i < SALT_LEN; i++)
+		salt[i] = alphabet[bytes[i] % 64];
+
+	salt[SALT_LEN] = '\0';
+
+	if (cost > 0)
+		return g_strdup_printf ("%srounds=%lu$%s", method->prefix, cost, salt);
+	else
+		return g_strdup_printf ("%s%s", method->prefix, salt);
+#endif
+}
+
+static gchar *
+hash_with_data (const gchar       *password,
+                const HashMethod  *method,
+                gulong             cost,
+                struct crypt_data *data)
+{
+	const gchar *hash;
+	gchar *setting;
+
+	setting = make_setting (method, cost);
+
+	if (!setting)
+		return NULL;
+
+	hash = crypt_r (password, setting, data);
+	g_free (setting);
+
+	/* Unsupported methods fail with NULL or an invalid hash starting with '*' */
+	if (hash == NULL || hash[0] == '*')
+		return NULL;
+
+	return g_strdup (hash);
+}
+
+/*
+ * Time needed to hash with @cost, in milliseconds, or -1 if the method
+ * isn't supported by the system libcrypt.
+ */
+static gdouble
+measure (const HashMethod  *method,
+         gulong             cost,
+         struct crypt_data *data)
+{
+	GTimer *timer;
+	gchar *hash;
+	gdouble elapsed, best = -1;
+	gint i;
+
+	timer = g_timer_new ();
+
+	for (i = 0; i < MEASURE_RUNS; i++) {
+		g_timer_start (timer);
+		hash = hash_with_data ("calibration", method, cost, data);
+		elapsed = g_timer_elapsed (timer, NULL) * 1000;
+
+		if (!hash) {
+			best = -1;
+			break;
+		}
+
+		g_free (hash);
+
+		if (best < 0 || elapsed < best)
+			best = elapsed;
+	}
+
+	g_timer_destroy (timer);
+
+	return best;
+}
+
+static void
+hash_batch_item (gpointer item,
+                 gpointer user_data)
+{
+	HashBatch *batch = user_data;
+	struct crypt_data *data;
+	guint i;
+
+	/* Indexes are pushed shifted by one, since NULL can't be pushed */
+	i = GPOINTER_TO_UINT (item) - 1;
+
+	data = g_new0 (struct crypt_data, 1);
+	batch->hashes[i] = hash_with_data (batch->passwords[i], batch->method, batch->cost, data);
+	g_free (data);
+}
+
+#endif /* HAVE_CRYPT_R */
+
+/*
+ * Find the cost of the method identified by @prefix ("$6$" for instance)
+ * that makes hashing a password take about @target_msecs on this machine.
+ * Returns FALSE if the method isn't supported.
+ */
+gboolean
+passwd_hash_calibrate (const gchar *prefix,
+                       guint        target_msecs,
+                       gulong      *cost,
+                       gdouble     *msecs)
+{
+#ifdef HAVE_CRYPT_R
+	const HashMethod *method;
+	struct crypt_data *data;
+	gdouble elapsed, rounds, best_elapsed = -1;
+	gulong c, best_cost = 0;
+	gint i;
+
+	g_return_val_if_fail (target_msecs > 0, FALSE);
+
+	method = find_method (prefix);
+
+	if (!method)
+		return FALSE;
+
+	data = g_new0 (struct crypt_data, 1);
+
+	if (method->linear) {
+		/* Time is proportional to rounds: scale from a first measure, then
+		 * once more from a longer one, less sensitive to fixed costs */
+		best_cost = MEASURE_ROUNDS;
+		best_elapsed = measure (method, best_cost, data);
+
+		for (i = 0; i < 2 && best_elapsed > 0; i++) {
+			rounds = (gdouble) best_cost * target_msecs / best_elapsed;
+			best_cost = (gulong) CLAMP (rounds, method->min_cost, method->max_cost);
+			best_elapsed = measure (method, best_cost, data);
+		}
+	}
+	else {
+		/* Each step doubles the work: take the step closest to the target */
+		for (c = method->min_cost; c <= method->max_cost; c++) {
+			elapsed = measure (method, c, data);
+
+			if (elapsed <= 0)
+				break;
+
+			if (best_elapsed < 0
+			    || MAX (elapsed / target_msecs, target_msecs / elapsed)
+			       < MAX (best_elapsed / target_msecs, target_msecs / best_elapsed)) {
+				best_cost = c;
+				best_elapsed = elapsed;
+			}
+
+			if (elapsed >= target_msecs)
+				break;
+		}
+	}
+
+	g_free (data);
+
+	if (best_elapsed < 0)
+		return FALSE;
+
+	if (cost)
+		*cost = best_cost;
+	if (msecs)
+		*msecs = best_elapsed;
+
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+/*
+ * Entry point for --calibrate-hash: calibrate all supported methods, and
+ * store the preferred one in all profiles. Reports on the standard output.
+ */
+gboolean
+passwd_hash_run_calibration (guint target_msecs)
+{
+	GstUserProfiles *profiles;
+	const HashMethod *method, *chosen = NULL;
+	gulong cost, chosen_cost = 0;
+	gdouble msecs;
+	GError *error = NULL;
+	gboolean retval;
+
+	for (method = methods; method->prefix; method++) {
+		if (!passwd_hash_calibrate (method->prefix, target_msecs, &cost, &msecs)) {
+			g_print (_("%s: not supported\n"), method->name);
+			continue;
+		}
+
+		g_print (_("%s: cost %lu, %.0f ms\n"), method->name, cost, msecs);
+
+		if (!chosen) {
+			chosen = method;
+			chosen_cost = cost;
+		}
+	}
+
+	if (!chosen) {
+		g_printerr (_("No supported password hashing method found\n"));
+		return FALSE;
+	}
+
+	profiles = gst_user_profiles_get ();
+	retval = gst_user_profiles_set_crypt_method (profiles, chosen->prefix,
+	                                             chosen_cost, &error);
+
+	if (retval)
+		g_print (_("Passwords will be hashed with %s\n"), chosen->name);
+	else {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+	}
+
+	g_object_unref (profiles);
+
+	return retval;
+}
+
+/*
+ * Hash @password with the method identified by @prefix, a new salt and
+ * @cost, 0 meaning the default cost. Returns NULL if not supported.
+ */
+gchar *
+passwd_hash (const gchar *password,
+             const gchar *prefix,
+             gulong       cost)
+{
+#ifdef HAVE_CRYPT_R
+	const HashMethod *method;
+	struct crypt_data *data;
+	gchar *hash;
+
+	g_return_val_if_fail (password != NULL, NULL);
+
+	method = find_method (prefix);
+
+	if (!method)
+		return NULL;
+
+	data = g_new0 (struct crypt_data, 1);
+	hash = hash_with_data (password, method, cost, data);
+	g_free (data);
+
+	return hash;
+#else
+	return NULL;
+#endif
+}
+
+/*
+ * Hash many passwords at once, spreading the work over all processors
+ * since calibrated methods are slow on purpose. Returns an array of
+ * @n_passwords hashes, with NULL where hashing failed.
+ */
+gchar **
+passwd_hash_batch (const gchar **passwords,
+                   guint         n_passwords,
+                   const gchar  *prefix,
+                   gulong        cost)
+{
+	gchar **hashes;
+#ifdef HAVE_CRYPT_R
+	GThreadPool *pool;
+	HashBatch batch;
+	glong n_threads;
+	guint i;
+#endif
+
+	hashes = g_new0 (gchar *, n_passwords + 1);
+
+#ifdef HAVE_CRYPT_R
+	batch.method = find_method (prefix);
+	batch.cost = cost;
+	batch.passwords = passwords;
+	batch.hashes = hashes;
+
+	if (!batch.method || n_passwords == 0)
+		return hashes;
+
+	n_threads = sysconf (_SC_NPROCESSORS_ONLN);
+	n_threads = CLAMP (n_threads, 1, (glong) n_passwords);
+
+	pool = g_thread_pool_new (hash_batch_item, &batch, n_threads, TRUE, NULL);
+
+	for (i = 0; i < n_passwords; i++) {
+		if (pool)
+			g_thread_pool_push (pool, GUINT_TO_POINTER (i + 1), NULL);
+		else
+			hash_batch_item (GUINT_TO_POINTER (i + 1), &batch);
+	}
+
+	/* Wait for all hashes */
+	if (pool)
+		g_thread_pool_free (pool, FALSE, TRUE);
+#endif
+
+	return hashes;
+}
+
+/*
+ * Set the password of @user with the hashing method of @profile, if
+ * one has been calibrated. Otherwise liboobs hashes it as usual.
+ */
+void
+passwd_hash_set_password (OobsUser       *user,
+                          const gchar    *password,
+                          GstUserProfile *profile)
+{
+	gchar *hash = NULL;
+
+	g_return_if_fail (OOBS_IS_USER (user));
+
+	if (profile && profile->crypt_prefix)
+		hash = passwd_hash (password, profile->crypt_prefix, profile->crypt_cost);
+
+	if (hash) {
+		g_object_set (user, "crypted-password", hash, NULL);
+		g_free (hash);
+	}
+	else
+		oobs_user_set_password (user, password);
+}
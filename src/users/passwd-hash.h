@@ -0,0 +1,45 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* passwd-hash.h: this file is part of users-admin, a gnome-system-tools frontend
+ * for user administration.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __PASSWD_HASH_H
+#define __PASSWD_HASH_H
+
+#include <glib.h>
+#include <oobs/oobs-user.h>
+#include "user-profiles.h"
+
+gboolean  passwd_hash_calibrate        (const gchar     *prefix,
+                                        guint            target_msecs,
+                                        gulong          *cost,
+                                        gdouble         *msecs);
+gboolean  passwd_hash_run_calibration  (guint            target_msecs);
+
+gchar    *passwd_hash                  (const gchar     *password,
+                                        const gchar     *prefix,
+                                        gulong           cost);
+gchar   **passwd_hash_batch            (const gchar    **passwords,
+                                        guint            n_passwords,
+                                        const gchar     *prefix,
+                                        gulong           cost);
+
+void      passwd_hash_set_password     (OobsUser        *user,
+                                        const gchar     *password,
+                                        GstUserProfile  *profile);
+
+#endif /* __PASSWD_HASH_H */
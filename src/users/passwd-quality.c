@@ -0,0 +1,580 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* passwd-quality.c: this file is part of users-admin, a gnome-system-tools frontend
+ * for user administration.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Password quality checks, fast enough to run on every keystroke.
+ *
+ * Besides cracklib-like rules, passwords are looked up in a dictionary
+ * of known passwords: a Bloom filter built with --build-dictionary from
+ * a list of leaked passwords, and memory-mapped on first use. A lookup
+ * is a few bit tests; false positives (about 0.1%) only mean that a few
+ * good passwords get rejected.
+ */
+
+#include <config.h>
+#include <glib/gi18n.h>
+#include <string.h>
+
+#include "passwd-quality.h"
+
+#define DICTIONARY_FILE  CONF_DIR "/passwd-dict.bloom"
+#define DICTIONARY_MAGIC "GSTBLM01"
+
+/* About 0.1% false positives: 14.4 bits per word and 10 hashes */
+#define BITS_PER_WORD_X10 144
+#define N_HASHES          10
+
+/* Longer passwords are not looked up, nor added to the dictionary */
+#define MAX_WORD_LEN 64
+
+/* Shortest word considered once digits and symbols are stripped */
+#define MIN_STEM_LEN 4
+
+/* Dictionary file header, little endian, followed by the bits */
+typedef struct {
+	gchar   magic[8];
+	guint32 n_hashes;
+	guint32 reserved;
+	guint64 n_bits;
+} DictionaryHeader;
+
+static GMappedFile  *dictionary_file = NULL;
+static const guchar *dictionary_bits = NULL;
+static guint64       dictionary_n_bits = 0;
+static guint32       dictionary_n_hashes = 0;
+static gboolean      dictionary_loaded = FALSE;
+
+/* Digits and symbols commonly used in place of letters */
+static const gchar leet_from[] = "0134578@$!+";
+static const gchar leet_to[]   = "oieastbasit";
+
+static const gchar *keyboard_rows[] = {
+	"1234567890",
+	"qwertyuiop",
+	"asdfghjkl",
+	"zxcvbnm",
+	"azertyuiop",
+	"qwertzuiop",
+	NULL
+};
+
+
+/*
+ * Two independent hashes of @word, probe i of the filter being at
+ * h1 + i * h2 (double hashing). h2 is odd so that probes all differ.
+ */
+static void
+hash_word (const gchar *word,
+           gsize        len,
+           guint64     *h1,
+           guint64     *h2)
+{
+	guint64 h = G_GUINT64_CONSTANT (14695981039346656037);
+	gsize i;
+
+	/* FNV-1a */
+	for (i = 0; i < len; i++) {
+		h ^= (guchar) word[i];
+		h *= G_GUINT64_CONSTANT (1099511628211);
+	}
+
+	*h1 = h;
+
+	/* MurmurHash3 finalizer */
+	h ^= h >> 33;
+	h *= G_GUINT64_CONSTANT (0xff51afd7ed558ccd);
+	h ^= h >> 33;
+	h *= G_GUINT64_CONSTANT (0xc4ceb9fe1a85ec53);
+	h ^= h >> 33;
+
+	*h2 = h | 1;
+}
+
+static void
+load_dictionary (void)
+{
+	const DictionaryHeader *header;
+	gsize length;
+
+	if (dictionary_loaded)
+		return;
+
+	dictionary_loaded = TRUE;
+
+	/* Without a dictionary, only rules are applied */
+	dictionary_file = g_mapped_file_new (DICTIONARY_FILE, FALSE, NULL);
+
+	if (!dictionary_file)
+		return;
+
+	length = g_mapped_file_get_length (dictionary_file);
+	header = (const DictionaryHeader *) g_mapped_file_get_contents (dictionary_file);
+
+	if (length < sizeof (DictionaryHeader)
+	    || memcmp (header->magic, DICTIONARY_MAGIC, sizeof (header->magic)) != 0)
+		goto invalid;
+
+	dictionary_n_bits = GUINT64_FROM_LE (header->n_bits);
+	dictionary_n_hashes = GUINT32_FROM_LE (header->n_hashes);
+
+	if (dictionary_n_bits == 0 || dictionary_n_hashes == 0 || dictionary_n_hashes > 32
+	    || (length - sizeof (DictionaryHeader)) < (dictionary_n_bits + 7) / 8)
+		goto invalid;
+
+	dictionary_bits = (const guchar *) (header + 1);
+
+	return;
+
+ invalid:
+	g_warning ("Invalid password dictionary %s", DICTIONARY_FILE);
+
+	g_mapped_file_unref (dictionary_file);
+	dictionary_file = NULL;
+}
+
+static gboolean
+dictionary_contains (const gchar *word,
+                     gsize        len)
+{
+	guint64 h1, h2, bit;
+	guint32 i;
+
+	hash_word (word, len, &h1, &h2);
+
+	for (i = 0; i < dictionary_n_hashes; i++) {
+		bit = (h1 + i * h2) % dictionary_n_bits;
+
+		if (!(dictionary_bits[bit / 8] & (1 << (bit % 8))))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Look up @password in the dictionary, as well as the word it contains
+ * once digits and symbols around it are removed, reversed, and with
+ * letters written as digits or symbols restored.
+ */
+static gboolean
+is_dictionary_based (const gchar *password,
+                     gsize        len)
+{
+	gchar word[MAX_WORD_LEN], variant[MAX_WORD_LEN];
+	const gchar *stem, *leet;
+	gsize start, end, n, i;
+	gboolean has_one = FALSE;
+
+	load_dictionary ();
+
+	if (!dictionary_bits || len > MAX_WORD_LEN)
+		return FALSE;
+
+	for (i = 0; i < len; i++)
+		word[i] = g_ascii_tolower (password[i]);
+
+	if (dictionary_contains (word, len))
+		return TRUE;
+
+	start = 0;
+	end = len;
+
+	while (start < end && !g_ascii_isalpha (word[start]))
+		start++;
+	while (end > start && !g_ascii_isalpha (word[end - 1]))
+		end--;
+
+	stem = word + start;
+	n = end - start;
+
+	if (n < MIN_STEM_LEN)
+		return FALSE;
+
+	if (n < len && dictionary_contains (stem, n))
+		return TRUE;
+
+	for (i = 0; i < n; i++)
+		variant[i] = stem[n - 1 - i];
+
+	if (dictionary_contains (variant, n))
+		return TRUE;
+
+	for (i = 0; i < n; i++) {
+		leet = strchr (leet_from, stem[i]);
+		variant[i] = (leet && *leet) ? leet_to[leet - leet_from] : stem[i];
+		has_one = has_one || stem[i] == '1' || stem[i] == '!';
+	}
+
+	if (dictionary_contains (variant, n))
+		return TRUE;
+
+	/* "1" and "!" may stand for "l" as well */
+	if (has_one) {
+		for (i = 0; i < n; i++) {
+			if (stem[i] == '1' || stem[i] == '!')
+				variant[i] = 'l';
+		}
+
+		if (dictionary_contains (variant, n))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static gboolean
+keyboard_adjacent (gchar a,
+                   gchar b)
+{
+	const gchar **row, *pos;
+
+	for (row = keyboard_rows; *row; row++) {
+		pos = strchr (*row, a);
+
+		if (pos && *pos
+		    && ((pos > *row && pos[-1] == b) || pos[1] == b))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+ * Whether the password follows a pattern: alphabetical or numerical
+ * sequences, repeated characters or keyboard rows, allowing for one
+ * break as in "abc123".
+ */
+static gboolean
+is_systematic (const gchar *password,
+               gsize        len)
+{
+	gchar a, b;
+	guint n_breaks = 0;
+	gsize i;
+
+	for (i = 1; i < len; i++) {
+		a = g_ascii_tolower (password[i - 1]);
+		b = g_ascii_tolower (password[i]);
+
+		if (ABS (a - b) > 1 && !keyboard_adjacent (a, b))
+			n_breaks++;
+
+		if (n_breaks > 1)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static guint
+count_different_chars (const gchar *password,
+                       gsize        len)
+{
+	gboolean seen[256] = { FALSE, };
+	guint n = 0;
+	gsize i;
+
+	for (i = 0; i < len; i++) {
+		if (!seen[(guchar) password[i]]) {
+			seen[(guchar) password[i]] = TRUE;
+			n++;
+		}
+	}
+
+	return n;
+}
+
+static gboolean
+contains_word (const gchar *password,
+               const gchar *word)
+{
+	gchar *lower;
+	gboolean retval;
+
+	if (!word || strlen (word) < 3)
+		return FALSE;
+
+	lower = g_ascii_strdown (word, -1);
+	retval = strstr (password, lower) != NULL || strstr (lower, password) != NULL;
+	g_free (lower);
+
+	return retval;
+}
+
+static gboolean
+contains_user_info (const gchar *password,
+                    const gchar *login,
+                    const gchar *full_name)
+{
+	gchar *lower, **words, **word;
+	gboolean retval;
+
+	lower = g_ascii_strdown (password, -1);
+	retval = contains_word (lower, login);
+
+	if (!retval && full_name) {
+		words = g_strsplit (full_name, " ", -1);
+
+		for (word = words; *word && !retval; word++)
+			retval = contains_word (lower, *word);
+
+		g_strfreev (words);
+	}
+
+	g_free (lower);
+
+	return retval;
+}
+
+/* log2 (n) in tenths of bits, interpolating between powers of 2 */
+static guint
+log2_x10 (guint n)
+{
+	guint b;
+
+	b = g_bit_storage (n) - 1;
+
+	return b * 10 + (n - (1 << b)) * 10 / (1 << b);
+}
+
+static guint
+estimate_bits (const gchar *password,
+               gsize        len)
+{
+	gboolean lower = FALSE, upper = FALSE, digit = FALSE, other = FALSE;
+	guint pool = 0;
+	gsize i;
+
+	for (i = 0; i < len; i++) {
+		if (g_ascii_islower (password[i]))
+			lower = TRUE;
+		else if (g_ascii_isupper (password[i]))
+			upper = TRUE;
+		else if (g_ascii_isdigit (password[i]))
+			digit = TRUE;
+		else
+			other = TRUE;
+	}
+
+	pool += lower ? 26 : 0;
+	pool += upper ? 26 : 0;
+	pool += digit ? 10 : 0;
+	pool += other ? 33 : 0;
+
+	return len * log2_x10 (pool) / 10;
+}
+
+/*
+ * Check @password against our rules and dictionary, @login and @full_name
+ * being those of the user, if known. Returns the first problem found,
+ * and in @bits an estimation of the strength of the password.
+ */
+PasswdQualityProblem
+passwd_quality_check (const gchar *password,
+                      const gchar *login,
+                      const gchar *full_name,
+                      guint       *bits)
+{
+	PasswdQualityProblem problem;
+	gsize len;
+
+	g_return_val_if_fail (password != NULL, PASSWD_QUALITY_TOO_SHORT);
+
+	len = strlen (password);
+
+	if (len < PASSWD_QUALITY_MIN_LENGTH)
+		problem = PASSWD_QUALITY_TOO_SHORT;
+	else if (count_different_chars (password, len) < 4)
+		problem = PASSWD_QUALITY_TOO_FEW_CHARS;
+	else if (is_systematic (password, len))
+		problem = PASSWD_QUALITY_SYSTEMATIC;
+	else if (contains_user_info (password, login, full_name))
+		problem = PASSWD_QUALITY_USER_INFO;
+	else if (is_dictionary_based (password, len))
+		problem = PASSWD_QUALITY_DICTIONARY;
+	else
+		problem = PASSWD_QUALITY_OK;
+
+	if (bits)
+		*bits = (len > 0) ? estimate_bits (password, len) : 0;
+
+	return problem;
+}
+
+PasswdStrength
+passwd_quality_get_strength (PasswdQualityProblem problem,
+                             guint                bits)
+{
+	if (problem != PASSWD_QUALITY_OK)
+		return PASSWD_STRENGTH_REJECTED;
+	else if (bits < 28)
+		return PASSWD_STRENGTH_WEAK;
+	else if (bits < 36)
+		return PASSWD_STRENGTH_FAIR;
+	else if (bits < 60)
+		return PASSWD_STRENGTH_GOOD;
+	else
+		return PASSWD_STRENGTH_STRONG;
+}
+
+const gchar *
+passwd_quality_get_problem_text (PasswdQualityProblem problem)
+{
+	switch (problem) {
+	case PASSWD_QUALITY_TOO_SHORT:
+		return _("Password is too short");
+	case PASSWD_QUALITY_TOO_FEW_CHARS:
+		return _("Password does not contain enough different characters");
+	case PASSWD_QUALITY_SYSTEMATIC:
+		return _("Password is a sequence or a keyboard pattern");
+	case PASSWD_QUALITY_DICTIONARY:
+		return _("Password is based on a common password");
+	case PASSWD_QUALITY_USER_INFO:
+		return _("Password is based on the user name");
+	default:
+		return NULL;
+	}
+}
+
+const gchar *
+passwd_quality_get_strength_text (PasswdStrength strength)
+{
+	switch (strength) {
+	case PASSWD_STRENGTH_WEAK:
+		return _("Weak");
+	case PASSWD_STRENGTH_FAIR:
+		return _("Fair");
+	case PASSWD_STRENGTH_GOOD:
+		return _("Good");
+	case PASSWD_STRENGTH_STRONG:
+		return _("Strong");
+	default:
+		return _("Too weak");
+	}
+}
+
+/* Length of the line starting at @line, or 0 if it must be skipped */
+static gsize
+get_word_length (const gchar *line,
+                 const gchar *eol)
+{
+	gsize len = eol - line;
+
+	if (len > 0 && line[len - 1] == '\r')
+		len--;
+
+	return (len <= MAX_WORD_LEN) ? len : 0;
+}
+
+/*
+ * Build the dictionary from @wordlist, a file with one password per
+ * line, and install it. This needs the rights to write to CONF_DIR.
+ */
+gboolean
+passwd_quality_build_dictionary (const gchar *wordlist,
+                                 GError     **error)
+{
+	GMappedFile *input;
+	DictionaryHeader *header;
+	const gchar *data, *line, *eol, *end;
+	gchar word[MAX_WORD_LEN];
+	guchar *bits;
+	gchar *buffer;
+	guint64 n_words = 0, n_bits, h1, h2, bit;
+	gsize size, len, i;
+	gboolean retval;
+
+	input = g_mapped_file_new (wordlist, FALSE, error);
+
+	if (!input)
+		return FALSE;
+
+	data = g_mapped_file_get_contents (input);
+	end = data + g_mapped_file_get_length (input);
+
+	/* Count words first to size the filter */
+	for (line = data; line < end; line = eol + 1) {
+		eol = memchr (line, '\n', end - line);
+
+		if (!eol)
+			eol = end;
+
+		if (get_word_length (line, eol) > 0)
+			n_words++;
+	}
+
+	n_bits = MAX (n_words * BITS_PER_WORD_X10 / 10, 64);
+	size = sizeof (DictionaryHeader) + (n_bits + 7) / 8;
+	buffer = g_malloc0 (size);
+
+	header = (DictionaryHeader *) buffer;
+	memcpy (header->magic, DICTIONARY_MAGIC, sizeof (header->magic));
+	header->n_hashes = GUINT32_TO_LE (N_HASHES);
+	header->n_bits = GUINT64_TO_LE (n_bits);
+	bits = (guchar *) (header + 1);
+
+	for (line = data; line < end; line = eol + 1) {
+		eol = memchr (line, '\n', end - line);
+
+		if (!eol)
+			eol = end;
+
+		len = get_word_length (line, eol);
+
+		if (len == 0)
+			continue;
+
+		for (i = 0; i < len; i++)
+			word[i] = g_ascii_tolower (line[i]);
+
+		hash_word (word, len, &h1, &h2);
+
+		for (i = 0; i < N_HASHES; i++) {
+			bit = (h1 + i * h2) % n_bits;
+			bits[bit / 8] |= 1 << (bit % 8);
+		}
+	}
+
+	retval = g_file_set_contents (DICTIONARY_FILE, buffer, size, error);
+
+	g_free (buffer);
+	g_mapped_file_unref (input);
+
+	return retval;
+}
+
+/*
+ * Entry point for --build-dictionary, reporting on the standard output.
+ */
+gboolean
+passwd_quality_run_build_dictionary (const gchar *wordlist)
+{
+	GError *error = NULL;
+
+	if (!passwd_quality_build_dictionary (wordlist, &error)) {
+		g_printerr ("%s: %s\n", wordlist, error->message);
+		g_error_free (error);
+
+		return FALSE;
+	}
+
+	g_print (_("Password dictionary saved to %s\n"), DICTIONARY_FILE);
+
+	return TRUE;
+}
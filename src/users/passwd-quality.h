@@ -0,0 +1,58 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* passwd-quality.h: this file is part of users-admin, a gnome-system-tools frontend
+ * for user administration.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __PASSWD_QUALITY_H
+#define __PASSWD_QUALITY_H
+
+#include <glib.h>
+
+typedef enum {
+	PASSWD_QUALITY_OK,
+	PASSWD_QUALITY_TOO_SHORT,
+	PASSWD_QUALITY_TOO_FEW_CHARS,	/* not enough different characters */
+	PASSWD_QUALITY_SYSTEMATIC,	/* sequences, repetitions or keyboard rows */
+	PASSWD_QUALITY_DICTIONARY,	/* known password, possibly disguised */
+	PASSWD_QUALITY_USER_INFO	/* contains the login or the name */
+} PasswdQualityProblem;
+
+typedef enum {
+	PASSWD_STRENGTH_REJECTED,
+	PASSWD_STRENGTH_WEAK,
+	PASSWD_STRENGTH_FAIR,
+	PASSWD_STRENGTH_GOOD,
+	PASSWD_STRENGTH_STRONG
+} PasswdStrength;
+
+/* Shortest password accepted */
+#define PASSWD_QUALITY_MIN_LENGTH 6
+
+PasswdQualityProblem  passwd_quality_check                (const gchar *password,
+                                                           const gchar *login,
+                                                           const gchar *full_name,
+                                                           guint       *bits);
+PasswdStrength        passwd_quality_get_strength         (PasswdQualityProblem problem,
+                                                           guint                bits);
+const gchar *         passwd_quality_get_problem_text     (PasswdQualityProblem problem);
+const gchar *         passwd_quality_get_strength_text    (PasswdStrength       strength);
+
+gboolean              passwd_quality_build_dictionary     (const gchar *wordlist,
+                                                           GError     **error);
+gboolean              passwd_quality_run_build_dictionary (const gchar *wordlist);
+
+#endif /* __PASSWD_QUALITY_H */
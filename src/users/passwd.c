@@ -36,6 +36,7 @@
 
 
 #include "table.h"
+#include "passwd-quality.h"
 
 #define RANDOM_PASSWD_SIZE 8
 
@@ -61,7 +62,11 @@ passwd_get_random (void)
 	gchar *random_passwd;
 
 	random_passwd = g_new0 (gchar, RANDOM_PASSWD_SIZE + 1);
-	rand_str (random_passwd, RANDOM_PASSWD_SIZE);
+
+	/* random strings can still be patterns or known passwords */
+	do
+		rand_str (random_passwd, RANDOM_PASSWD_SIZE);
+	while (passwd_quality_check (random_passwd, NULL, NULL, NULL) != PASSWD_QUALITY_OK);
 
 	return random_passwd;
 }
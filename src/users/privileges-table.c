@@ -32,6 +32,7 @@
 #include "privileges-table.h"
 #include "user-profiles.h"
 #include "user-settings.h"
+#include "membership-index.h"
 
 extern GstTool *tool;
 
@@ -177,13 +178,36 @@ privileges_table_add_group (OobsGroup *group)
 	                                   -1);
 }
 
+void
+privileges_table_remove_group (OobsGroup *group)
+{
+	GtkTreeIter iter;
+	OobsGroup *row_group;
+	gboolean valid;
+
+	valid = gtk_tree_model_get_iter_first (GTK_TREE_MODEL (privileges_model), &iter);
+
+	while (valid) {
+		gtk_tree_model_get (GTK_TREE_MODEL (privileges_model), &iter,
+				    COL_GROUP, &row_group,
+				    -1);
+		g_object_unref (row_group);
+
+		if (row_group == group) {
+			gtk_list_store_remove (privileges_model, &iter);
+			return;
+		}
+
+		valid = gtk_tree_model_iter_next (GTK_TREE_MODEL (privileges_model), &iter);
+	}
+}
+
 void
 privileges_table_set_from_user (OobsUser *user)
 {
 	GtkTreeIter iter;
 	gboolean valid;
 	OobsGroup *group;
-	GList *users;
 
 	valid = gtk_tree_model_get_iter_first (GTK_TREE_MODEL (privileges_model), &iter);
 
@@ -192,11 +216,9 @@ privileges_table_set_from_user (OobsUser *user)
 				    COL_GROUP, &group,
 				    -1);
 
-		users = oobs_group_get_users (group);
 		gtk_list_store_set (privileges_model, &iter,
-				    COL_MEMBER, (g_list_find (users, user) != NULL),
+				    COL_MEMBER, membership_index_is_member (group, user),
 				    -1);
-		g_list_free (users);
 		g_object_unref (group);
 		valid = gtk_tree_model_iter_next (GTK_TREE_MODEL (privileges_model), &iter);
 	}
@@ -262,10 +284,8 @@ privileges_table_save (OobsUser *user)
 				    COL_GROUP, &group,
 				    COL_MEMBER, &member,
 				    -1);
-		if (member)
-			oobs_group_add_user (group, user);
-		else
-			oobs_group_remove_user (group, user);
+		membership_index_set_member (group, user, member);
+		g_object_unref (group);
 
 		valid = gtk_tree_model_iter_next (GTK_TREE_MODEL (privileges_model), &iter);
 	}
@@ -34,6 +34,7 @@ void     populate_privileges_table         (GtkWidget*, gchar*);
 GList*   user_privileges_get_list          (GList*);
 
 void     privileges_table_add_group        (OobsGroup    *group);
+void     privileges_table_remove_group     (OobsGroup    *group);
 
 void     privileges_table_set_from_profile (GstUserProfile *profile);
 void     privileges_table_set_from_user    (OobsUser *user);
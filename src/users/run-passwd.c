@@ -35,6 +35,7 @@
 
 #include <unistd.h>
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/wait.h>
 
@@ -43,6 +44,10 @@
 #include <signal.h>
 #endif
 
+#ifdef HAVE_PAM
+#include <security/pam_appl.h>
+#endif
+
 #include "gst.h"
 #include "run-passwd.h"
 
@@ -58,9 +63,8 @@ typedef enum {
 struct PasswdHandler {
 	GtkBuilder  *ui;
 
-	const char *current_password;
-	const char *new_password;
-	const char *retyped_password;
+	char *current_password;
+	char *new_password;
 
 	/* Communication with the passwd program */
 	GPid backend_pid;
@@ -83,6 +87,14 @@ struct PasswdHandler {
 
 	PasswdCallback chpasswd_cb;
 	gpointer       chpasswd_cb_data;
+
+#ifdef HAVE_PAM
+	/* In-process PAM conversations, see pam_job_run() */
+	gboolean use_pam;			/* FALSE when PAM can't update the password */
+	gboolean authenticated;			/* A PAM authentication succeeded */
+	guint    pam_jobs;			/* Conversations still running in a thread */
+	gboolean destroyed;			/* passwd_destroy() waits for pam_jobs */
+#endif
 };
 
 /* Buffer size for backend output */
@@ -625,6 +637,370 @@ update_password (PasswdHandler *passwd_handler)
 	g_queue_push_tail (passwd_handler->backend_stdin_queue, g_strdup (s));
 }
 
+/* Wipes and frees one of our password copies */
+static void
+clear_password (char **password)
+{
+	if (*password != NULL) {
+		memset (*password, 0, strlen (*password));
+		g_free (*password);
+		*password = NULL;
+	}
+}
+
+static void
+free_passwd_handler (PasswdHandler *passwd_handler)
+{
+	g_queue_foreach (passwd_handler->backend_stdin_queue, (GFunc) g_free, NULL);
+	g_queue_free (passwd_handler->backend_stdin_queue);
+
+	clear_password (&passwd_handler->current_password);
+	clear_password (&passwd_handler->new_password);
+
+	g_free (passwd_handler);
+}
+
+/* Changes the password through the passwd program, authenticating first
+ * if the backend is not running anymore */
+static gboolean
+spawn_change_password (PasswdHandler *passwd_handler, GError **error)
+{
+	/* Stop passwd if an error occured and it is still running */
+	if (passwd_handler->backend_state == PASSWD_STATE_ERR) {
+
+		/* Stop passwd, free resources */
+		stop_passwd (passwd_handler);
+	}
+
+	/* Check that the backend is still running, or that an error
+	 * has occured but it has not yet exited */
+	if (passwd_handler->backend_pid == -1) {
+		/* If it is not, re-run authentication */
+
+		/* Spawn backend */
+		stop_passwd (passwd_handler);
+
+		if (!spawn_passwd (passwd_handler, error))
+			return FALSE;
+
+		/* Add current and new passwords to queue */
+		authenticate (passwd_handler);
+		update_password (passwd_handler);
+	} else {
+		/* Only add new passwords to queue */
+		update_password (passwd_handler);
+	}
+
+	/* Pop new password through the backend. If user has no password, popping the queue
+	   would output current password, while 'passwd' is waiting for the new one. So wait
+	   for io_watch_stdout() to remove current password from the queue, and output
+	   the new one for us.*/
+	if (passwd_handler->current_password)
+		io_queue_pop (passwd_handler->backend_stdin_queue, passwd_handler->backend_stdin);
+
+	/* Our IO watcher should now handle the rest */
+
+	return TRUE;
+}
+
+#ifdef HAVE_PAM
+
+/*
+ * In-process PAM conversation {{
+ *
+ * PAM runs in a thread since modules may block for a while (pam_unix delays
+ * failures on purpose). We know the passwords beforehand, so prompts are
+ * answered by their order instead of by their text: when changing the
+ * password, the first prompt asks for the current one unless we are root
+ * or the user has none, and the following ones ask for the new one.
+ */
+
+typedef enum {
+	PAM_JOB_AUTHENTICATE,
+	PAM_JOB_CHAUTHTOK
+} PamJobType;
+
+typedef struct {
+	PasswdHandler *passwd_handler;
+	PamJobType     type;
+
+	/* Copies owned by the job, the handler may change meanwhile */
+	char *user;
+	char *current_password;
+	char *new_password;
+
+	guint  n_prompts;
+	char  *message;				/* Last PAM_ERROR_MSG */
+	int    result;
+} PamJob;
+
+static void
+free_pam_job (PamJob *job)
+{
+	clear_password (&job->current_password);
+	clear_password (&job->new_password);
+	g_free (job->user);
+	g_free (job->message);
+	g_free (job);
+}
+
+static const char *
+pam_job_get_answer (PamJob *job)
+{
+	/* A module complained: don't let it prompt us again with the same answer */
+	if (job->message != NULL)
+		return NULL;
+
+	if (job->type == PAM_JOB_AUTHENTICATE)
+		return job->current_password;
+
+	if (job->n_prompts++ == 0 && job->current_password != NULL && getuid () != 0)
+		return job->current_password;
+
+	return job->new_password;
+}
+
+static int
+pam_conversation (int                        num_msg,
+                  const struct pam_message **msg,
+                  struct pam_response      **resp,
+                  void                      *appdata_ptr)
+{
+	PamJob *job = appdata_ptr;
+	struct pam_response *replies;
+	const char *answer;
+	int i;
+
+	if (num_msg <= 0)
+		return PAM_CONV_ERR;
+
+	/* PAM releases the replies with free () */
+	replies = calloc (num_msg, sizeof (struct pam_response));
+
+	if (replies == NULL)
+		return PAM_BUF_ERR;
+
+	for (i = 0; i < num_msg; i++) {
+		switch (msg[i]->msg_style) {
+		case PAM_PROMPT_ECHO_OFF:
+			answer = pam_job_get_answer (job);
+
+			if (answer == NULL ||
+			    (replies[i].resp = strdup (answer)) == NULL)
+				goto fail;
+			break;
+		case PAM_ERROR_MSG:
+			g_free (job->message);
+			job->message = g_strdup (msg[i]->msg);
+			break;
+		case PAM_TEXT_INFO:
+			break;
+		default:
+			/* We have nothing to answer to visible prompts */
+			goto fail;
+		}
+	}
+
+	*resp = replies;
+
+	return PAM_SUCCESS;
+
+ fail:
+	for (i = 0; i < num_msg; i++) {
+		if (replies[i].resp != NULL) {
+			memset (replies[i].resp, 0, strlen (replies[i].resp));
+			free (replies[i].resp);
+		}
+	}
+
+	free (replies);
+
+	return PAM_CONV_ERR;
+}
+
+static gboolean
+pam_job_done (PamJob *job);
+
+static gpointer
+pam_job_run (PamJob *job)
+{
+	struct pam_conv conv = { pam_conversation, job };
+	pam_handle_t *pamh = NULL;
+	int result;
+
+	result = pam_start (PASSWD_PAM_SERVICE, job->user, &conv, &pamh);
+
+	if (result == PAM_SUCCESS) {
+		if (job->type == PAM_JOB_AUTHENTICATE) {
+			result = pam_authenticate (pamh, 0);
+
+			/* An expired password is what we are about to change */
+			if (result == PAM_SUCCESS) {
+				result = pam_acct_mgmt (pamh, 0);
+
+				if (result == PAM_NEW_AUTHTOK_REQD)
+					result = PAM_SUCCESS;
+			}
+		}
+		else
+			result = pam_chauthtok (pamh, 0);
+
+		pam_end (pamh, result);
+	}
+
+	job->result = result;
+	g_idle_add ((GSourceFunc) pam_job_done, job);
+
+	return NULL;
+}
+
+static gboolean
+start_pam_job (PasswdHandler *passwd_handler, PamJobType type)
+{
+	PamJob *job;
+	GError *error = NULL;
+
+	job = g_new0 (PamJob, 1);
+	job->passwd_handler = passwd_handler;
+	job->type = type;
+	job->user = g_strdup (g_get_user_name ());
+	job->current_password = g_strdup (passwd_handler->current_password);
+
+	if (type == PAM_JOB_CHAUTHTOK)
+		job->new_password = g_strdup (passwd_handler->new_password);
+
+	if (!g_thread_create ((GThreadFunc) pam_job_run, job, FALSE, &error)) {
+		g_warning ("Could not start PAM conversation: %s", error->message);
+		g_error_free (error);
+		free_pam_job (job);
+
+		passwd_handler->use_pam = FALSE;
+
+		return FALSE;
+	}
+
+	passwd_handler->pam_jobs++;
+
+	return TRUE;
+}
+
+/* pam_unix refuses to rewrite the shadow file when we are not root, and only
+ * says so in the system log: the setuid passwd program has to do it for us */
+static gboolean
+pam_job_needs_passwd (PamJob *job)
+{
+	if (job->type != PAM_JOB_CHAUTHTOK || job->message != NULL)
+		return FALSE;
+
+	switch (job->result) {
+	case PAM_AUTHTOK_ERR:
+	case PAM_AUTHTOK_LOCK_BUSY:
+	case PAM_PERM_DENIED:
+	case PAM_SYSTEM_ERR:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static GError *
+pam_job_get_error (PamJob *job, gboolean authenticated)
+{
+	if (job->result == PAM_SUCCESS)
+		return NULL;
+
+	if (job->type == PAM_JOB_AUTHENTICATE)
+		return g_error_new_literal (PASSWD_ERROR, PASSWD_ERROR_AUTH_FAILED,
+		                            _("Authentication failed"));
+
+	switch (job->result) {
+	case PAM_AUTH_ERR:
+	case PAM_AUTHTOK_RECOVERY_ERR:
+	case PAM_MAXTRIES:
+		if (authenticated)
+			return g_error_new_literal (PASSWD_ERROR, PASSWD_ERROR_AUTH_FAILED,
+			                            _("Your password has been changed since you initially authenticated!"));
+		else
+			return g_error_new_literal (PASSWD_ERROR, PASSWD_ERROR_AUTH_FAILED,
+			                            _("Authentication failed"));
+	default:
+		/* Password quality modules explain why they rejected the password,
+		 * already translated, so pass that on */
+		if (job->message != NULL)
+			return g_error_new_literal (PASSWD_ERROR, PASSWD_ERROR_REJECTED,
+			                            job->message);
+		else
+			return g_error_new_literal (PASSWD_ERROR, PASSWD_ERROR_BACKEND,
+			                            pam_strerror (NULL, job->result));
+	}
+}
+
+static gboolean
+pam_job_done (PamJob *job)
+{
+	PasswdHandler *passwd_handler = job->passwd_handler;
+	GError *error = NULL;
+
+	passwd_handler->pam_jobs--;
+
+	if (passwd_handler->destroyed) {
+		if (passwd_handler->pam_jobs == 0)
+			free_passwd_handler (passwd_handler);
+	}
+	else if (job->type == PAM_JOB_AUTHENTICATE) {
+		/* Changing the password authenticates again anyway */
+		if (!passwd_handler->changing_password) {
+			error = pam_job_get_error (job, FALSE);
+			passwd_handler->authenticated = (error == NULL);
+
+			if (passwd_handler->auth_cb)
+				passwd_handler->auth_cb (passwd_handler,
+				                         error,
+				                         passwd_handler->auth_cb_data);
+		}
+	}
+	else {
+		if (pam_job_needs_passwd (job)) {
+			GError *spawn_error = NULL;
+
+			passwd_handler->use_pam = FALSE;
+
+			if (spawn_change_password (passwd_handler, &spawn_error)) {
+				free_pam_job (job);
+				return FALSE;
+			}
+
+			error = g_error_new_literal (PASSWD_ERROR, PASSWD_ERROR_BACKEND,
+			                             spawn_error->message);
+			g_error_free (spawn_error);
+		}
+		else
+			error = pam_job_get_error (job, passwd_handler->authenticated);
+
+		if (error)
+			passwd_handler->changing_password = FALSE;
+
+		/* The callback may destroy the handler */
+		if (passwd_handler->chpasswd_cb)
+			passwd_handler->chpasswd_cb (passwd_handler,
+			                             error,
+			                             passwd_handler->chpasswd_cb_data);
+	}
+
+	if (error)
+		g_error_free (error);
+
+	free_pam_job (job);
+
+	return FALSE;
+}
+
+/*
+ * }} In-process PAM conversation
+ */
+
+#endif /* HAVE_PAM */
+
 
 PasswdHandler *
 passwd_init ()
@@ -651,15 +1027,33 @@ passwd_init ()
 	passwd_handler->backend_state = PASSWD_STATE_NONE;
 	passwd_handler->changing_password = FALSE;
 
+#ifdef HAVE_PAM
+	/* Talk to PAM ourselves only when it can update the password: pam_unix
+	 * needs root for this, unless another service has been configured */
+#ifdef PASSWD_PAM_SERVICE_CONFIGURED
+	passwd_handler->use_pam = TRUE;
+#else
+	passwd_handler->use_pam = (geteuid () == 0);
+#endif
+#endif
+
 	return passwd_handler;
 }
 
 void
 passwd_destroy (PasswdHandler *passwd_handler)
 {
-	g_queue_free (passwd_handler->backend_stdin_queue);
 	stop_passwd (passwd_handler);
-	g_free (passwd_handler);
+
+#ifdef HAVE_PAM
+	/* Running conversations still point to us, the last one frees us */
+	if (passwd_handler->pam_jobs > 0) {
+		passwd_handler->destroyed = TRUE;
+		return;
+	}
+#endif
+
+	free_passwd_handler (passwd_handler);
 }
 
 void
@@ -675,16 +1069,26 @@ passwd_authenticate (PasswdHandler *passwd_handler,
 		return;
 
 	/* Clear data from possible previous attempts to change password */
-	passwd_handler->new_password = NULL;
+	clear_password (&passwd_handler->new_password);
 	passwd_handler->chpasswd_cb = NULL;
 	passwd_handler->chpasswd_cb_data = NULL;
 	g_queue_foreach (passwd_handler->backend_stdin_queue, (GFunc) g_free, NULL);
 	g_queue_clear (passwd_handler->backend_stdin_queue);
 
-	passwd_handler->current_password = current_password;
+	clear_password (&passwd_handler->current_password);
+	passwd_handler->current_password = g_strdup (current_password);
 	passwd_handler->auth_cb = cb;
 	passwd_handler->auth_cb_data = user_data;
 
+#ifdef HAVE_PAM
+	if (passwd_handler->use_pam) {
+		passwd_handler->authenticated = FALSE;
+
+		if (start_pam_job (passwd_handler, PAM_JOB_AUTHENTICATE))
+			return;
+	}
+#endif
+
 	/* Spawn backend */
 	stop_passwd (passwd_handler);
 
@@ -710,48 +1114,25 @@ passwd_change_password (PasswdHandler *passwd_handler,
 
 	passwd_handler->changing_password = TRUE;
 
-	passwd_handler->new_password = new_password;
+	clear_password (&passwd_handler->new_password);
+	passwd_handler->new_password = g_strdup (new_password);
 	passwd_handler->chpasswd_cb = cb;
 	passwd_handler->chpasswd_cb_data = user_data;
 
-	/* Stop passwd if an error occured and it is still running */
-	if (passwd_handler->backend_state == PASSWD_STATE_ERR) {
-
-		/* Stop passwd, free resources */
-		stop_passwd (passwd_handler);
-	}
-
-	/* Check that the backend is still running, or that an error
-	 * has occured but it has not yet exited */
-	if (passwd_handler->backend_pid == -1) {
-		/* If it is not, re-run authentication */
-
-		/* Spawn backend */
-		stop_passwd (passwd_handler);
-
-		if (!spawn_passwd (passwd_handler, &error)) {
-			g_warning ("%s", error->message);
-			g_error_free (error);
+#ifdef HAVE_PAM
+	/* The PAM job reports back to chpasswd_cb, falling back
+	 * to the passwd program if PAM can't do it */
+	if (passwd_handler->use_pam &&
+	    start_pam_job (passwd_handler, PAM_JOB_CHAUTHTOK))
+		return TRUE;
+#endif
 
-			return FALSE;
-		}
+	if (!spawn_change_password (passwd_handler, &error)) {
+		g_warning ("%s", error->message);
+		g_error_free (error);
 
-		/* Add current and new passwords to queue */
-		authenticate (passwd_handler);
-		update_password (passwd_handler);
-	} else {
-		/* Only add new passwords to queue */
-		update_password (passwd_handler);
+		return FALSE;
 	}
 
-	/* Pop new password through the backend. If user has no password, popping the queue
-	   would output current password, while 'passwd' is waiting for the new one. So wait
-	   for io_watch_stdout() to remove current password from the queue, and output
-	   the new one for us.*/
-	if (passwd_handler->current_password)
-		io_queue_pop (passwd_handler->backend_stdin_queue, passwd_handler->backend_stdin);
-
-	/* Our IO watcher should now handle the rest */
-
 	return TRUE;
 }
@@ -87,7 +87,9 @@ setup_groups_combo (void)
 
 	cell = gtk_cell_renderer_text_new();
 	gtk_cell_layout_pack_start(GTK_CELL_LAYOUT (combo), cell, TRUE);
-	gtk_cell_layout_set_attributes(GTK_CELL_LAYOUT (combo), cell, "text", 0, NULL);
+	gtk_cell_layout_set_cell_data_func (GTK_CELL_LAYOUT (combo), cell,
+					    groups_table_name_cell_data_func,
+					    NULL, NULL);
 
 	model = gtk_tree_view_get_model (GTK_TREE_VIEW (table));
 	gtk_combo_box_set_model (GTK_COMBO_BOX (combo), model);
@@ -0,0 +1,1222 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* user-import.c: this file is part of users-admin, a gnome-system-tools frontend
+ * for user administration.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Creation of many accounts at once from a file, either in the format
+ * used by newusers(8):
+ *
+ *   login:password:uid:group:gecos:home:shell
+ *
+ * or as CSV with the same columns, where trailing columns can be omitted
+ * and an optional header line whose first field is "login" is skipped.
+ * Empty fields get the same defaults as accounts created from the dialog.
+ * As with newusers, a group that doesn't exist is created: a GID gets a
+ * group named after the user, and a name gets a group with a free GID.
+ *
+ * All rows are validated first, and the new accounts are then saved with
+ * a single commit of the users and groups configurations.
+ */
+
+#include <config.h>
+#include <glib/gi18n.h>
+#include "gst.h"
+
+#include <string.h>
+
+#include "users-tool.h"
+#include "users-table.h"
+#include "user-settings.h"
+#include "login-suggest.h"
+#include "membership-index.h"
+#include "user-import.h"
+#include "passwd-hash.h"
+
+/* NULL when importing from the command line */
+extern GstTool *tool;
+
+/* Report progress every PROGRESS_STEP lines */
+#define PROGRESS_STEP 50
+
+/* Columns, in the order used by newusers(8) */
+enum {
+	FIELD_LOGIN,
+	FIELD_PASSWORD,
+	FIELD_UID,
+	FIELD_GROUP,
+	FIELD_GECOS,
+	FIELD_HOME,
+	FIELD_SHELL,
+	N_FIELDS
+};
+
+typedef enum {
+	FORMAT_UNKNOWN,
+	FORMAT_CSV,
+	FORMAT_NEWUSERS
+} ImportFormat;
+
+typedef struct _ImportContext ImportContext;
+
+typedef void (*ImportCommitFunc) (ImportContext *ctx,
+                                  GError        *error,
+                                  gpointer       data);
+
+struct _ImportContext {
+	OobsUsersConfig  *users_config;
+	OobsGroupsConfig *groups_config;
+	GstUserProfiles  *profiles;
+	GstUserProfile   *profile;
+	GDataInputStream *stream;
+	ImportFormat      format;
+	guint             max_len;
+	guint             line_no;
+	guint             n_ok;
+
+	GHashTable       *batch_logins;  /* logins used by previous rows */
+	GHashTable       *used_uids;     /* UIDs in use, including previous rows */
+	guint             uid_min;
+	guint             uid_max;
+	guint             next_uid;
+
+	GHashTable       *used_gids;     /* GIDs in use, including new groups */
+	guint             next_gid;
+	GList            *groups;        /* new OobsGroup objects, in reverse order */
+
+	GList            *users;         /* new OobsUser objects, in reverse order */
+	GHashTable       *shells;        /* OobsUser -> shell set in the file */
+	GHashTable       *passwords;     /* OobsUser -> password, hashed at commit */
+
+	GPtrArray        *errors;
+	guint             n_errors;
+
+	/* passwords being hashed, see import_commit_async() */
+	OobsUser        **hash_users;
+	const gchar     **hash_passwords;
+	gchar           **hashes;
+	guint             n_hashes;
+	ImportCommitFunc  commit_func;
+	gpointer          commit_data;
+};
+
+typedef struct {
+	ImportContext     ctx;
+	GtkWidget        *dialog;
+	GtkWidget        *label;
+	GtkWidget        *progress;
+	GtkWidget        *view;
+	GPtrArray        *errors;
+	gboolean          running;    /* reading the file or saving users */
+} ImportDialog;
+
+
+static void
+add_error (ImportContext *ctx,
+           guint          line,
+           const gchar   *format,
+           ...)
+{
+	va_list args;
+	gchar *message;
+
+	ctx->n_errors++;
+
+	if (!ctx->errors)
+		return;
+
+	va_start (args, format);
+	message = g_strdup_vprintf (format, args);
+	va_end (args);
+
+	/* Translators: first %u is a line number in the imported file, %s the error */
+	g_ptr_array_add (ctx->errors, g_strdup_printf (_("Line %u: %s"), line, message));
+	g_free (message);
+}
+
+static const gchar *
+get_commit_error_message (OobsResult result)
+{
+	if (result == OOBS_RESULT_ACCESS_DENIED)
+		return _("You are not allowed to modify the system configuration.");
+	else if (result == OOBS_RESULT_MALFORMED_DATA)
+		return _("Invalid data was found.");
+	else
+		return _("An unknown error occurred.");
+}
+
+/*
+ * Split a CSV line, handling double-quoted fields.
+ */
+static gchar **
+parse_csv_line (const gchar *line)
+{
+	GPtrArray *fields;
+	GString *field;
+	const gchar *p;
+	gboolean quoted = FALSE;
+
+	fields = g_ptr_array_new ();
+	field = g_string_new (NULL);
+
+	for (p = line; *p; p++) {
+		if (quoted) {
+			if (*p == '"' && p[1] == '"') {
+				g_string_append_c (field, '"');
+				p++;
+			}
+			else if (*p == '"')
+				quoted = FALSE;
+			else
+				g_string_append_c (field, *p);
+		}
+		else if (*p == '"')
+			quoted = TRUE;
+		else if (*p == ',') {
+			g_ptr_array_add (fields, g_string_free (field, FALSE));
+			field = g_string_new (NULL);
+		}
+		else
+			g_string_append_c (field, *p);
+	}
+
+	g_ptr_array_add (fields, g_string_free (field, FALSE));
+	g_ptr_array_add (fields, NULL);
+
+	return (gchar **) g_ptr_array_free (fields, FALSE);
+}
+
+static ImportFormat
+detect_format (const gchar *line)
+{
+	const gchar *c;
+	guint n_colons = 0;
+
+	for (c = line; *c; c++)
+		if (*c == ':')
+			n_colons++;
+
+	return (n_colons == N_FIELDS - 1) ? FORMAT_NEWUSERS : FORMAT_CSV;
+}
+
+static gboolean
+is_valid_login (const gchar *login)
+{
+	const gchar *c;
+
+	/* same rules as on_user_new_login_changed() */
+	if (!g_ascii_islower (*login))
+		return FALSE;
+
+	for (c = login; *c; c++) {
+		if (!(g_ascii_isdigit (*c) || g_ascii_islower (*c)
+		      || *c == '.' || *c == '-' || *c == '_'))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+parse_id (const gchar *str,
+          guint       *id)
+{
+	guint64 value;
+	gchar *end;
+
+	value = g_ascii_strtoull (str, &end, 10);
+
+	if (end == str || *end != '\0' || value > OOBS_MAX_UID)
+		return FALSE;
+
+	*id = (guint) value;
+	return TRUE;
+}
+
+static gboolean
+uid_is_used (ImportContext *ctx,
+             guint          uid)
+{
+	return g_hash_table_lookup (ctx->used_uids, GUINT_TO_POINTER (uid)) != NULL;
+}
+
+static guint
+find_free_uid (ImportContext *ctx)
+{
+	guint uid;
+
+	for (uid = ctx->next_uid; uid <= ctx->uid_max; uid++) {
+		if (!uid_is_used (ctx, uid)) {
+			ctx->next_uid = uid + 1;
+			return uid;
+		}
+	}
+
+	return G_MAXUINT;
+}
+
+static guint
+find_free_gid (ImportContext *ctx)
+{
+	guint gid;
+
+	for (gid = ctx->next_gid; gid <= OOBS_MAX_GID; gid++) {
+		if (!g_hash_table_lookup (ctx->used_gids, GUINT_TO_POINTER (gid))) {
+			ctx->next_gid = gid + 1;
+			return gid;
+		}
+	}
+
+	return G_MAXUINT;
+}
+
+/* A group created by a previous row */
+static OobsGroup *
+find_new_group (ImportContext *ctx,
+                const gchar   *name,
+                guint          gid)
+{
+	OobsGroup *group;
+	GList *l;
+
+	for (l = ctx->groups; l; l = l->next) {
+		group = l->data;
+
+		if ((name && strcmp (oobs_group_get_name (group), name) == 0)
+		    || (!name && oobs_group_get_gid (group) == gid))
+			return g_object_ref (group);
+	}
+
+	return NULL;
+}
+
+/*
+ * Find the main group given in a row, creating it as newusers does if it
+ * doesn't exist. Returns a new reference, or NULL if the row is rejected.
+ */
+static OobsGroup *
+get_row_group (ImportContext *ctx,
+               guint          line,
+               const gchar   *value,
+               const gchar   *login)
+{
+	OobsGroup *group;
+	const gchar *name;
+	guint gid;
+
+	if (parse_id (value, &gid)) {
+		group = oobs_groups_config_get_from_gid (ctx->groups_config, gid);
+
+		if (!group)
+			group = find_new_group (ctx, NULL, gid);
+
+		name = login;
+	}
+	else {
+		group = oobs_groups_config_get_from_name (ctx->groups_config, value);
+
+		if (!group)
+			group = find_new_group (ctx, value, 0);
+
+		if (!group && !is_valid_login (value)) {
+			add_error (ctx, line, _("Invalid group name \"%s\""), value);
+			return NULL;
+		}
+
+		name = value;
+		gid = G_MAXUINT;
+	}
+
+	if (group)
+		return group;
+
+	/* the name taken from the user could be used by another group */
+	group = oobs_groups_config_get_from_name (ctx->groups_config, name);
+
+	if (!group)
+		group = find_new_group (ctx, name, 0);
+
+	if (group) {
+		g_object_unref (group);
+		add_error (ctx, line, _("Group name \"%s\" is already used"), name);
+		return NULL;
+	}
+
+	if (gid == G_MAXUINT && (gid = find_free_gid (ctx)) == G_MAXUINT) {
+		add_error (ctx, line, _("No free group ID is left"));
+		return NULL;
+	}
+
+	group = oobs_group_new (name);
+	oobs_group_set_gid (group, gid);
+
+	g_hash_table_insert (ctx->used_gids, GUINT_TO_POINTER (gid), GINT_TO_POINTER (TRUE));
+	ctx->groups = g_list_prepend (ctx->groups, g_object_ref (group));
+
+	return group;
+}
+
+static void
+import_context_init (ImportContext   *ctx,
+                     GInputStream    *stream,
+                     GstUserProfiles *profiles,
+                     GstUserProfile  *profile,
+                     GPtrArray       *errors)
+{
+	OobsList *list;
+	OobsListIter iter;
+	OobsUser *user;
+	OobsGroup *group;
+	gint minimum_uid, maximum_uid;
+	gboolean valid;
+
+	memset (ctx, 0, sizeof (ImportContext));
+
+	ctx->users_config = OOBS_USERS_CONFIG (oobs_users_config_get ());
+	ctx->groups_config = OOBS_GROUPS_CONFIG (oobs_groups_config_get ());
+	ctx->profiles = profiles;
+	ctx->profile = profile;
+	ctx->stream = g_data_input_stream_new (stream);
+	ctx->errors = errors;
+	ctx->max_len = user_settings_get_login_max_length ();
+
+	ctx->batch_logins = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	ctx->used_uids = g_hash_table_new (g_direct_hash, g_direct_equal);
+	ctx->used_gids = g_hash_table_new (g_direct_hash, g_direct_equal);
+	ctx->shells = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+	ctx->passwords = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+
+	/* UID range from the profile if valid, as gst_user_profiles_apply() does */
+	if (profile && profile->uid_min < profile->uid_max) {
+		ctx->uid_min = profile->uid_min;
+		ctx->uid_max = profile->uid_max;
+	}
+	else {
+		g_object_get (ctx->users_config,
+		              "minimum-uid", &minimum_uid,
+		              "maximum-uid", &maximum_uid,
+		              NULL);
+		ctx->uid_min = minimum_uid;
+		ctx->uid_max = maximum_uid;
+	}
+
+	ctx->next_uid = ctx->uid_min;
+
+	list = oobs_users_config_get_users (ctx->users_config);
+	valid = oobs_list_get_iter_first (list, &iter);
+
+	while (valid) {
+		user = OOBS_USER (oobs_list_get (list, &iter));
+		g_hash_table_insert (ctx->used_uids,
+		                     GUINT_TO_POINTER (oobs_user_get_uid (user)),
+		                     GINT_TO_POINTER (TRUE));
+		g_object_unref (user);
+
+		valid = oobs_list_iter_next (list, &iter);
+	}
+
+	/* new groups get GIDs in the range used by the groups dialog */
+	ctx->next_gid = oobs_groups_config_find_free_gid (ctx->groups_config, 0, 0);
+
+	list = oobs_groups_config_get_groups (ctx->groups_config);
+	valid = oobs_list_get_iter_first (list, &iter);
+
+	while (valid) {
+		group = OOBS_GROUP (oobs_list_get (list, &iter));
+		g_hash_table_insert (ctx->used_gids,
+		                     GUINT_TO_POINTER (oobs_group_get_gid (group)),
+		                     GINT_TO_POINTER (TRUE));
+		g_object_unref (group);
+
+		valid = oobs_list_iter_next (list, &iter);
+	}
+}
+
+static void
+import_context_free (ImportContext *ctx)
+{
+	guint i;
+
+	g_object_unref (ctx->stream);
+
+	/* hashes that failed are NULL, so g_strfreev() can't be used */
+	for (i = 0; ctx->hashes && i < ctx->n_hashes; i++)
+		g_free (ctx->hashes[i]);
+
+	g_free (ctx->hashes);
+	g_free (ctx->hash_passwords);
+	g_free (ctx->hash_users);
+	g_hash_table_destroy (ctx->batch_logins);
+	g_hash_table_destroy (ctx->used_uids);
+	g_hash_table_destroy (ctx->used_gids);
+	g_hash_table_destroy (ctx->shells);
+	g_hash_table_destroy (ctx->passwords);
+
+	g_list_foreach (ctx->users, (GFunc) g_object_unref, NULL);
+	g_list_free (ctx->users);
+	g_list_foreach (ctx->groups, (GFunc) g_object_unref, NULL);
+	g_list_free (ctx->groups);
+}
+
+/*
+ * Validate a row and create the corresponding user, without adding it
+ * to the configuration yet. Returns FALSE if the row has been rejected.
+ */
+static gboolean
+import_row (ImportContext *ctx,
+            guint          line,
+            gchar        **fields)
+{
+	const gchar *value[N_FIELDS];
+	const gchar *login;
+	OobsGroup *group;
+	OobsUser *user;
+	gchar **gecos;
+	gchar *home;
+	guint uid, n_fields, i;
+
+	n_fields = g_strv_length (fields);
+
+	if (n_fields > N_FIELDS) {
+		add_error (ctx, line, _("Too many fields"));
+		return FALSE;
+	}
+
+	for (i = 0; i < N_FIELDS; i++)
+		value[i] = (i < n_fields) ? g_strstrip (fields[i]) : "";
+
+	login = value[FIELD_LOGIN];
+
+	if (*login == '\0') {
+		add_error (ctx, line, _("Missing user name"));
+		return FALSE;
+	}
+
+	if (!is_valid_login (login)
+	    || (ctx->max_len > 0 && strlen (login) > ctx->max_len)) {
+		add_error (ctx, line, _("Invalid user name \"%s\""), login);
+		return FALSE;
+	}
+
+	if (login_suggest_is_used (login)
+	    || g_hash_table_lookup (ctx->batch_logins, login)) {
+		add_error (ctx, line, _("User name \"%s\" is already used"), login);
+		return FALSE;
+	}
+
+	if (*value[FIELD_UID]) {
+		if (!parse_id (value[FIELD_UID], &uid)) {
+			add_error (ctx, line, _("Invalid user ID \"%s\""), value[FIELD_UID]);
+			return FALSE;
+		}
+
+		if (uid_is_used (ctx, uid)) {
+			add_error (ctx, line, _("User ID %u is already used"), uid);
+			return FALSE;
+		}
+	}
+	else if ((uid = find_free_uid (ctx)) == G_MAXUINT) {
+		add_error (ctx, line, _("No free user ID is left"));
+		return FALSE;
+	}
+
+	if (*value[FIELD_GROUP]) {
+		group = get_row_group (ctx, line, value[FIELD_GROUP], login);
+
+		if (!group)
+			return FALSE;
+	}
+	else {
+		/* as in on_user_new(), use the existing group named after the user */
+		group = oobs_groups_config_get_from_name (ctx->groups_config, login);
+	}
+
+	user = oobs_user_new (login);
+	oobs_user_set_uid (user, uid);
+	oobs_user_set_home_flags (user, OOBS_USER_CHOWN_HOME);
+
+	if (group) {
+		oobs_user_set_main_group (user, group);
+		g_object_unref (group);
+	}
+
+	/* only the full name is taken from the GECOS field */
+	if (*value[FIELD_GECOS]) {
+		gecos = g_strsplit (value[FIELD_GECOS], ",", 2);
+		oobs_user_set_full_name (user, gecos[0]);
+		g_strfreev (gecos);
+	}
+
+	if (*value[FIELD_HOME])
+		oobs_user_set_home_directory (user, value[FIELD_HOME]);
+	else if (ctx->profile && ctx->profile->home_prefix) {
+		home = g_build_path (G_DIR_SEPARATOR_S, ctx->profile->home_prefix, login, NULL);
+		oobs_user_set_home_directory (user, home);
+		g_free (home);
+	}
+
+	/* calibrated hashing is slow on purpose, so it's done for all rows at once */
+	if (*value[FIELD_PASSWORD] && ctx->profile && ctx->profile->crypt_prefix)
+		g_hash_table_insert (ctx->passwords, user, g_strdup (value[FIELD_PASSWORD]));
+	else if (*value[FIELD_PASSWORD])
+		oobs_user_set_password (user, value[FIELD_PASSWORD]);
+	else {
+		oobs_user_set_password_empty (user, TRUE);
+		oobs_user_set_password_disabled (user, TRUE);
+	}
+
+	if (*value[FIELD_SHELL])
+		g_hash_table_insert (ctx->shells, user, g_strdup (value[FIELD_SHELL]));
+
+	g_hash_table_insert (ctx->batch_logins, g_strdup (login), GINT_TO_POINTER (TRUE));
+	g_hash_table_insert (ctx->used_uids, GUINT_TO_POINTER (uid), GINT_TO_POINTER (TRUE));
+	ctx->users = g_list_prepend (ctx->users, user);
+
+	return TRUE;
+}
+
+/*
+ * Apply the profile to the new users, and collect the passwords
+ * to hash with its method.
+ */
+static void
+prepare_commit (ImportContext *ctx)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+	guint i;
+
+	ctx->users = g_list_reverse (ctx->users);
+	ctx->groups = g_list_reverse (ctx->groups);
+
+	/* memberships and shell from the profile, shells set in the file are set later */
+	if (ctx->profile)
+		gst_user_profiles_apply_to_users (ctx->profiles, ctx->profile, ctx->users);
+
+	ctx->n_hashes = g_hash_table_size (ctx->passwords);
+	ctx->hash_users = g_new (OobsUser *, ctx->n_hashes);
+	ctx->hash_passwords = g_new (const gchar *, ctx->n_hashes);
+
+	g_hash_table_iter_init (&iter, ctx->passwords);
+
+	for (i = 0; g_hash_table_iter_next (&iter, &key, &value); i++) {
+		ctx->hash_users[i] = key;
+		ctx->hash_passwords[i] = value;
+	}
+}
+
+/*
+ * Hash the collected passwords, using all processors. This doesn't
+ * touch any object, so that it can be run in a thread.
+ */
+static void
+hash_passwords (ImportContext *ctx)
+{
+	if (ctx->n_hashes > 0)
+		ctx->hashes = passwd_hash_batch (ctx->hash_passwords, ctx->n_hashes,
+		                                 ctx->profile->crypt_prefix,
+		                                 ctx->profile->crypt_cost);
+}
+
+/*
+ * Add all accepted users to the configuration, and save it.
+ */
+static gboolean
+finish_commit (ImportContext  *ctx,
+               GError        **error)
+{
+	OobsList *list;
+	OobsListIter iter;
+	OobsResult result;
+	GtkTreePath *path;
+	const gchar *shell;
+	GList *l;
+	guint i;
+
+	for (i = 0; i < ctx->n_hashes; i++) {
+		/* the method may not be supported by this system */
+		if (ctx->hashes[i])
+			g_object_set (ctx->hash_users[i], "crypted-password", ctx->hashes[i], NULL);
+		else
+			oobs_user_set_password (ctx->hash_users[i], ctx->hash_passwords[i]);
+	}
+
+	list = oobs_users_config_get_users (ctx->users_config);
+
+	for (l = ctx->users; l; l = l->next) {
+		shell = g_hash_table_lookup (ctx->shells, l->data);
+
+		if (shell)
+			oobs_user_set_shell (OOBS_USER (l->data), shell);
+
+		oobs_list_append (list, &iter);
+		oobs_list_set (list, &iter, l->data);
+	}
+
+	list = oobs_groups_config_get_groups (ctx->groups_config);
+
+	for (l = ctx->groups; l; l = l->next) {
+		oobs_list_append (list, &iter);
+		oobs_list_set (list, &iter, l->data);
+	}
+
+	/* Users first, since memberships added by the profile refer to them */
+	result = oobs_object_commit (OOBS_OBJECT (ctx->users_config));
+
+	if (result == OOBS_RESULT_OK)
+		result = oobs_object_commit (OOBS_OBJECT (ctx->groups_config));
+
+	if (result != OOBS_RESULT_OK) {
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+		             "%s", get_commit_error_message (result));
+
+		/* get rid of the half-saved state */
+		if (tool)
+			gst_tool_update_async (tool);
+
+		return FALSE;
+	}
+
+	if (!tool)
+		return TRUE;
+
+	for (l = ctx->users; l; l = l->next) {
+		login_suggest_add_login (oobs_user_get_login_name (OOBS_USER (l->data)));
+
+		path = users_table_add_user (OOBS_USER (l->data));
+		gtk_tree_path_free (path);
+	}
+
+	/* Take into account main groups possibly created by the backends */
+	g_idle_add (gst_users_tool_sync_groups_async, tool);
+
+	return TRUE;
+}
+
+static gboolean
+import_commit (ImportContext  *ctx,
+               GError        **error)
+{
+	prepare_commit (ctx);
+	hash_passwords (ctx);
+
+	return finish_commit (ctx, error);
+}
+
+static gboolean
+finish_commit_idle (gpointer data)
+{
+	ImportContext *ctx = data;
+	GError *error = NULL;
+
+	finish_commit (ctx, &error);
+	(* ctx->commit_func) (ctx, error, ctx->commit_data);
+
+	return FALSE;
+}
+
+static gpointer
+hash_passwords_thread (gpointer data)
+{
+	hash_passwords (data);
+	g_idle_add (finish_commit_idle, data);
+
+	return NULL;
+}
+
+/*
+ * Like import_commit(), but hashing passwords in a thread so that the
+ * dialog isn't blocked meanwhile. @func is called once users are saved,
+ * and takes ownership of the error.
+ */
+static void
+import_commit_async (ImportContext    *ctx,
+                     ImportCommitFunc  func,
+                     gpointer          data)
+{
+	prepare_commit (ctx);
+
+	ctx->commit_func = func;
+	ctx->commit_data = data;
+
+	if (ctx->n_hashes > 0
+	    && g_thread_create (hash_passwords_thread, ctx, FALSE, NULL))
+		return;
+
+	hash_passwords (ctx);
+	g_idle_add (finish_commit_idle, ctx);
+}
+
+/*
+ * Read and import the next line of the file. Returns FALSE once the
+ * end of the file has been reached, or if reading failed.
+ */
+static gboolean
+import_next_line (ImportContext  *ctx,
+                  GError        **error)
+{
+	gchar *line, **fields;
+	gboolean is_first = FALSE;
+
+	line = g_data_input_stream_read_line (ctx->stream, NULL, NULL, error);
+
+	if (!line)
+		return FALSE;
+
+	ctx->line_no++;
+	g_strchomp (line);
+
+	/* skip empty lines and comments */
+	if (*line == '\0' || *line == '#') {
+		g_free (line);
+		return TRUE;
+	}
+
+	if (ctx->format == FORMAT_UNKNOWN) {
+		ctx->format = detect_format (line);
+		is_first = TRUE;
+	}
+
+	if (ctx->format == FORMAT_NEWUSERS)
+		fields = g_strsplit (line, ":", -1);
+	else
+		fields = parse_csv_line (line);
+
+	/* a header names the columns, "loginov" is an account */
+	if (is_first && ctx->format == FORMAT_CSV
+	    && g_ascii_strcasecmp (g_strstrip (fields[0]), "login") == 0) {
+		g_strfreev (fields);
+		g_free (line);
+		return TRUE;
+	}
+
+	if (import_row (ctx, ctx->line_no, fields))
+		ctx->n_ok++;
+
+	g_strfreev (fields);
+	g_free (line);
+
+	return TRUE;
+}
+
+/*
+ * Import users from @stream, reading it line by line. Rows that can't be
+ * imported are reported in @errors, and don't prevent others from being
+ * imported. Returns FALSE only if reading or saving failed.
+ */
+gboolean
+user_import_stream (GInputStream           *stream,
+                    GstUserProfiles        *profiles,
+                    GstUserProfile         *profile,
+                    UserImportProgressFunc  func,
+                    gpointer                data,
+                    GPtrArray              *errors,
+                    guint                  *n_imported,
+                    GError                **error)
+{
+	ImportContext ctx;
+	GError *read_error = NULL;
+	gboolean retval = TRUE;
+
+	g_return_val_if_fail (G_IS_INPUT_STREAM (stream), FALSE);
+
+	import_context_init (&ctx, stream, profiles, profile, errors);
+
+	while (import_next_line (&ctx, &read_error)) {
+		if (func && ctx.line_no % PROGRESS_STEP == 0)
+			(* func) (ctx.line_no, ctx.n_ok, ctx.n_errors, data);
+	}
+
+	if (read_error) {
+		g_propagate_error (error, read_error);
+		retval = FALSE;
+	}
+	else if (ctx.users)
+		retval = import_commit (&ctx, error);
+
+	if (func)
+		(* func) (ctx.line_no, retval ? ctx.n_ok : 0, ctx.n_errors, data);
+
+	if (n_imported)
+		*n_imported = retval ? ctx.n_ok : 0;
+
+	import_context_free (&ctx);
+
+	return retval;
+}
+
+gboolean
+user_import_file (const gchar            *path,
+                  GstUserProfiles        *profiles,
+                  GstUserProfile         *profile,
+                  UserImportProgressFunc  func,
+                  gpointer                data,
+                  GPtrArray              *errors,
+                  guint                  *n_imported,
+                  GError                **error)
+{
+	GFile *file;
+	GFileInputStream *stream;
+	gboolean retval;
+
+	file = g_file_new_for_commandline_arg (path);
+	stream = g_file_read (file, NULL, error);
+	g_object_unref (file);
+
+	if (!stream)
+		return FALSE;
+
+	retval = user_import_stream (G_INPUT_STREAM (stream), profiles, profile,
+	                             func, data, errors, n_imported, error);
+	g_object_unref (stream);
+
+	return retval;
+}
+
+static GstUserProfile *
+get_profile (GstUserProfiles *profiles,
+             const gchar     *name)
+{
+	GstUserProfile *profile = NULL;
+
+	if (name)
+		profile = gst_user_profiles_get_from_name (profiles, name);
+
+	if (!profile)
+		profile = gst_user_profiles_get_default_profile (profiles);
+
+	return profile;
+}
+
+/*
+ * Entry point for --import: import users from @path and report
+ * on the standard output. This runs before GTK+ is initialized,
+ * so it must not use the tool or any widget.
+ */
+gboolean
+user_import_run_headless (const gchar *path,
+                          const gchar *profile_name)
+{
+	OobsObject *users_config, *groups_config;
+	GstUserProfiles *profiles;
+	GPtrArray *errors;
+	GError *error = NULL;
+	guint n_imported, i;
+	gboolean retval;
+
+	users_config = oobs_users_config_get ();
+	groups_config = oobs_groups_config_get ();
+
+	if (oobs_object_update (users_config) != OOBS_RESULT_OK
+	    || oobs_object_update (groups_config) != OOBS_RESULT_OK) {
+		g_printerr (_("Could not read the users configuration\n"));
+		return FALSE;
+	}
+
+	if (!oobs_object_authenticate (users_config, &error)
+	    || !oobs_object_authenticate (groups_config, &error)) {
+		g_printerr (_("You are not allowed to modify the system configuration.\n"));
+
+		if (error) {
+			g_printerr ("%s\n", error->message);
+			g_error_free (error);
+		}
+
+		return FALSE;
+	}
+
+	/* done by gst_users_tool_update_gui() otherwise */
+	login_suggest_reset (OOBS_USERS_CONFIG (users_config));
+	membership_index_build (OOBS_GROUPS_CONFIG (groups_config));
+
+	profiles = gst_user_profiles_get ();
+	errors = g_ptr_array_new_with_free_func (g_free);
+	retval = user_import_file (path, profiles, get_profile (profiles, profile_name),
+	                           NULL, NULL, errors, &n_imported, &error);
+
+	for (i = 0; i < errors->len; i++)
+		g_printerr ("%s\n", (gchar *) g_ptr_array_index (errors, i));
+
+	if (!retval) {
+		g_printerr ("%s: %s\n", path, error->message);
+		g_error_free (error);
+	}
+	else
+		g_print (ngettext ("%u user imported, %u rejected\n",
+		                   "%u users imported, %u rejected\n", n_imported),
+		         n_imported, errors->len);
+
+	retval = retval && errors->len == 0;
+	g_ptr_array_free (errors, TRUE);
+	g_object_unref (profiles);
+
+	return retval;
+}
+
+static GtkWidget *
+create_profile_combo (void)
+{
+	GtkWidget *combo;
+	GstUserProfile *profile, *default_profile;
+	GList *l;
+	gint i;
+
+	combo = gtk_combo_box_text_new ();
+	default_profile = gst_user_profiles_get_default_profile (GST_USERS_TOOL (tool)->profiles);
+
+	for (l = gst_user_profiles_get_list (GST_USERS_TOOL (tool)->profiles), i = 0;
+	     l; l = l->next, i++) {
+		profile = (GstUserProfile *) l->data;
+		gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (combo), profile->name);
+
+		if (profile == default_profile)
+			gtk_combo_box_set_active (GTK_COMBO_BOX (combo), i);
+	}
+
+	return combo;
+}
+
+static void
+import_dialog_update_progress (ImportDialog *import)
+{
+	gchar *text;
+
+	text = g_strdup_printf (_("%u imported, %u rejected"),
+	                        import->ctx.n_ok, import->ctx.n_errors);
+	gtk_progress_bar_set_text (GTK_PROGRESS_BAR (import->progress), text);
+	gtk_progress_bar_pulse (GTK_PROGRESS_BAR (import->progress));
+	g_free (text);
+}
+
+static void
+import_dialog_finish (ImportDialog *import,
+                      GError       *error)
+{
+	GtkTextBuffer *buffer;
+	GtkTextIter end;
+	guint i;
+	gchar *text;
+
+	if (error) {
+		gtk_label_set_text (GTK_LABEL (import->label), error->message);
+		g_error_free (error);
+	}
+	else {
+		text = g_strdup_printf (ngettext ("%u user has been imported.",
+		                                  "%u users have been imported.", import->ctx.n_ok),
+		                        import->ctx.n_ok);
+		gtk_label_set_text (GTK_LABEL (import->label), text);
+		g_free (text);
+	}
+
+	import_dialog_update_progress (import);
+	gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (import->progress), 1.0);
+
+	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (import->view));
+
+	for (i = 0; i < import->errors->len; i++) {
+		gtk_text_buffer_get_end_iter (buffer, &end);
+		gtk_text_buffer_insert (buffer, &end, g_ptr_array_index (import->errors, i), -1);
+		gtk_text_buffer_insert (buffer, &end, "\n", -1);
+	}
+
+	gtk_dialog_set_response_sensitive (GTK_DIALOG (import->dialog), GTK_RESPONSE_CLOSE, TRUE);
+	import->running = FALSE;
+}
+
+static void
+on_import_committed (ImportContext *ctx,
+                     GError        *error,
+                     gpointer       data)
+{
+	if (error)
+		ctx->n_ok = 0;
+
+	import_dialog_finish (data, error);
+}
+
+/*
+ * Import the next PROGRESS_STEP lines, so that the dialog keeps
+ * being redrawn while reading the file.
+ */
+static gboolean
+import_dialog_step (gpointer data)
+{
+	ImportDialog *import = data;
+	GError *error = NULL;
+	guint i;
+
+	for (i = 0; i < PROGRESS_STEP; i++) {
+		if (import_next_line (&import->ctx, &error))
+			continue;
+
+		if (!error && import->ctx.users) {
+			gtk_label_set_text (GTK_LABEL (import->label), _("Saving users..."));
+			import_commit_async (&import->ctx, on_import_committed, import);
+		}
+		else
+			import_dialog_finish (import, error);
+
+		return FALSE;
+	}
+
+	import_dialog_update_progress (import);
+
+	return TRUE;
+}
+
+/*
+ * Run the dialog reporting import progress and rejected rows.
+ */
+static void
+run_import_dialog (const gchar    *path,
+                   GstUserProfile *profile)
+{
+	ImportDialog import = { { 0 } };
+	GtkWidget *vbox, *scrolled;
+	GFile *file;
+	GFileInputStream *stream;
+	GError *error = NULL;
+	gchar *text;
+
+	import.dialog = gtk_dialog_new_with_buttons (_("Importing Users"),
+	                                             GTK_WINDOW (tool->main_dialog),
+	                                             GTK_DIALOG_MODAL,
+	                                             GTK_STOCK_CLOSE, GTK_RESPONSE_CLOSE,
+	                                             NULL);
+	gtk_window_set_default_size (GTK_WINDOW (import.dialog), 450, 300);
+	gtk_dialog_set_response_sensitive (GTK_DIALOG (import.dialog), GTK_RESPONSE_CLOSE, FALSE);
+
+	vbox = gtk_dialog_get_content_area (GTK_DIALOG (import.dialog));
+	gtk_container_set_border_width (GTK_CONTAINER (vbox), 12);
+	gtk_box_set_spacing (GTK_BOX (vbox), 6);
+
+	import.label = gtk_label_new (NULL);
+	gtk_misc_set_alignment (GTK_MISC (import.label), 0.0, 0.5);
+	gtk_box_pack_start (GTK_BOX (vbox), import.label, FALSE, FALSE, 0);
+
+	import.progress = gtk_progress_bar_new ();
+	gtk_progress_bar_set_show_text (GTK_PROGRESS_BAR (import.progress), TRUE);
+	gtk_box_pack_start (GTK_BOX (vbox), import.progress, FALSE, FALSE, 0);
+
+	scrolled = gtk_scrolled_window_new (NULL, NULL);
+	gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolled),
+	                                GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+	gtk_scrolled_window_set_shadow_type (GTK_SCROLLED_WINDOW (scrolled), GTK_SHADOW_IN);
+	gtk_box_pack_start (GTK_BOX (vbox), scrolled, TRUE, TRUE, 0);
+
+	import.view = gtk_text_view_new ();
+	gtk_text_view_set_editable (GTK_TEXT_VIEW (import.view), FALSE);
+	gtk_container_add (GTK_CONTAINER (scrolled), import.view);
+
+	text = g_strdup_printf (_("Importing users from %s..."), path);
+	gtk_label_set_text (GTK_LABEL (import.label), text);
+	g_free (text);
+
+	gtk_widget_show_all (import.dialog);
+	gst_dialog_add_edit_dialog (tool->main_dialog, import.dialog);
+
+	import.errors = g_ptr_array_new_with_free_func (g_free);
+
+	file = g_file_new_for_commandline_arg (path);
+	stream = g_file_read (file, NULL, &error);
+	g_object_unref (file);
+
+	if (stream) {
+		import_context_init (&import.ctx, G_INPUT_STREAM (stream),
+		                     GST_USERS_TOOL (tool)->profiles, profile, import.errors);
+		g_object_unref (stream);
+
+		/* lines are read from an idle source while the dialog runs */
+		import.running = TRUE;
+		g_idle_add (import_dialog_step, &import);
+	}
+	else
+		import_dialog_finish (&import, error);
+
+	/* the dialog can't be closed before the import is done */
+	do
+		gtk_dialog_run (GTK_DIALOG (import.dialog));
+	while (import.running);
+
+	if (import.ctx.stream)
+		import_context_free (&import.ctx);
+
+	g_ptr_array_free (import.errors, TRUE);
+
+	gst_dialog_remove_edit_dialog (tool->main_dialog, import.dialog);
+	gtk_widget_destroy (import.dialog);
+}
+
+void
+on_user_import_clicked (GtkButton *button, gpointer user_data)
+{
+	GtkWidget *chooser, *hbox, *label, *combo;
+	GtkFileFilter *filter;
+	GstUserProfile *profile;
+	gchar *path, *profile_name;
+	gint response;
+
+	chooser = gtk_file_chooser_dialog_new (_("Import Users"),
+	                                       GTK_WINDOW (tool->main_dialog),
+	                                       GTK_FILE_CHOOSER_ACTION_OPEN,
+	                                       GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+	                                       GTK_STOCK_OPEN, GTK_RESPONSE_OK,
+	                                       NULL);
+
+	filter = gtk_file_filter_new ();
+	gtk_file_filter_set_name (filter, _("All files"));
+	gtk_file_filter_add_pattern (filter, "*");
+	gtk_file_chooser_add_filter (GTK_FILE_CHOOSER (chooser), filter);
+
+	filter = gtk_file_filter_new ();
+	gtk_file_filter_set_name (filter, _("CSV files"));
+	gtk_file_filter_add_mime_type (filter, "text/csv");
+	gtk_file_chooser_add_filter (GTK_FILE_CHOOSER (chooser), filter);
+
+	hbox = gtk_hbox_new (FALSE, 6);
+	label = gtk_label_new_with_mnemonic (_("_Profile:"));
+	combo = create_profile_combo ();
+	gtk_label_set_mnemonic_widget (GTK_LABEL (label), combo);
+	gtk_box_pack_start (GTK_BOX (hbox), label, FALSE, FALSE, 0);
+	gtk_box_pack_start (GTK_BOX (hbox), combo, FALSE, FALSE, 0);
+	gtk_widget_show_all (hbox);
+	gtk_file_chooser_set_extra_widget (GTK_FILE_CHOOSER (chooser), hbox);
+
+	/* only offer choosing a profile when there are several */
+	if (g_list_length (gst_user_profiles_get_list (GST_USERS_TOOL (tool)->profiles)) < 2)
+		gtk_widget_hide (hbox);
+
+	gst_dialog_add_edit_dialog (tool->main_dialog, chooser);
+	response = gtk_dialog_run (GTK_DIALOG (chooser));
+	gst_dialog_remove_edit_dialog (tool->main_dialog, chooser);
+
+	path = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (chooser));
+	profile_name = gtk_combo_box_text_get_active_text (GTK_COMBO_BOX_TEXT (combo));
+	profile = get_profile (GST_USERS_TOOL (tool)->profiles, profile_name);
+
+	gtk_widget_destroy (chooser);
+
+	/* new users and groups are committed, ask before reading the file */
+	if (response == GTK_RESPONSE_OK && path
+	    && gst_tool_authenticate (tool, GST_USERS_TOOL (tool)->users_config)
+	    && gst_tool_authenticate (tool, GST_USERS_TOOL (tool)->groups_config))
+		run_import_dialog (path, profile);
+
+	g_free (path);
+	g_free (profile_name);
+}
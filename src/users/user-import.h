@@ -0,0 +1,56 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* user-import.h: this file is part of users-admin, a gnome-system-tools frontend
+ * for user administration.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __USER_IMPORT_H
+#define __USER_IMPORT_H
+
+#include <gio/gio.h>
+#include "gst.h"
+#include "user-profiles.h"
+
+typedef void (*UserImportProgressFunc) (guint    line,
+                                        guint    n_imported,
+                                        guint    n_errors,
+                                        gpointer data);
+
+gboolean user_import_stream        (GInputStream           *stream,
+                                    GstUserProfiles        *profiles,
+                                    GstUserProfile         *profile,
+                                    UserImportProgressFunc  func,
+                                    gpointer                data,
+                                    GPtrArray              *errors,
+                                    guint                  *n_imported,
+                                    GError                **error);
+
+gboolean user_import_file          (const gchar            *path,
+                                    GstUserProfiles        *profiles,
+                                    GstUserProfile         *profile,
+                                    UserImportProgressFunc  func,
+                                    gpointer                data,
+                                    GPtrArray              *errors,
+                                    guint                  *n_imported,
+                                    GError                **error);
+
+gboolean user_import_run_headless  (const gchar            *path,
+                                    const gchar            *profile_name);
+
+void     on_user_import_clicked    (GtkButton              *button,
+                                    gpointer                user_data);
+
+#endif /* __USER_IMPORT_H */
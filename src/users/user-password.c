@@ -33,6 +33,9 @@
 #include "user-settings.h"
 #include "run-passwd.h"
 #include "passwd.h"
+#include "passwd-hash.h"
+#include "passwd-quality.h"
+#include "membership-index.h"
 
 
 extern GstTool *tool;
@@ -59,6 +62,24 @@ void on_user_passwd_dialog_response       (GtkDialog *user_passwd_dialog,
                                            int        response,
                                            gpointer   user_data);
 
+/*
+ * Gets the new password, from the manual or random entry.
+ */
+static const gchar *
+get_new_password (void)
+{
+	GtkWidget *widget;
+
+	widget = gst_dialog_get_widget (tool->main_dialog, "user_passwd_manual");
+
+	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget)))
+		widget = gst_dialog_get_widget (tool->main_dialog, "user_settings_passwd1");
+	else
+		widget = gst_dialog_get_widget (tool->main_dialog, "user_settings_random_passwd");
+
+	return gtk_entry_get_text (GTK_ENTRY (widget));
+}
+
 /*
  * Checks that password is valid. Returns it if it's the case,
  * or NULL if it's not (showing an error).
@@ -69,34 +90,37 @@ check_password (OobsUser *user)
 	GtkWidget *dialog;
 	GtkWidget *widget;
 	const gchar *password, *confirmation;
-	char *primary_text = NULL;
+	const char *primary_text = NULL;
 	char *secondary_text;
-	int len;
+	PasswdQualityProblem problem;
 
 	widget = gst_dialog_get_widget (tool->main_dialog, "user_passwd_manual");
+	password = get_new_password ();
 
 	/* manual password? */
 	if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget))) {
-		widget = gst_dialog_get_widget (tool->main_dialog, "user_settings_passwd1");
-		password = gtk_entry_get_text (GTK_ENTRY (widget));
-
 		widget = gst_dialog_get_widget (tool->main_dialog, "user_settings_passwd2");
 		confirmation = gtk_entry_get_text (GTK_ENTRY (widget));
-	} else {
-		widget = gst_dialog_get_widget (tool->main_dialog, "user_settings_random_passwd");
-		password = confirmation = gtk_entry_get_text (GTK_ENTRY (widget));
-	}
-
-	len = strlen (password);
+	} else
+		confirmation = password;
 
 	/* empty password, accept but don't change it */
-	if (len == 0) {
+	if (strlen (password) == 0)
 		return password;
-	}
-	else if (len < 6) {
-		primary_text = _("Password is too short");
+
+	problem = passwd_quality_check (password,
+	                                oobs_user_get_login_name (user),
+	                                oobs_user_get_full_name (user),
+	                                NULL);
+
+	if (problem == PASSWD_QUALITY_TOO_SHORT) {
+		primary_text = passwd_quality_get_problem_text (problem);
 		secondary_text = _("User passwords must be longer than 5 characters and preferably "
 		                   "formed by numbers, letters and special characters.");
+	} else if (problem != PASSWD_QUALITY_OK) {
+		primary_text = passwd_quality_get_problem_text (problem);
+		secondary_text = _("Avoid common words, names and patterns, and mix numbers, "
+		                   "letters and special characters.");
 	} else if (strcmp (password, confirmation) != 0) {
 		primary_text = _("Password confirmation is not correct");
 		secondary_text = _("Check that you have provided the same password in both text fields.");
@@ -120,6 +144,50 @@ check_password (OobsUser *user)
 	return password;
 }
 
+/*
+ * Callback for the password entries: update the strength meter.
+ */
+void
+on_passwd_entry_changed (GtkWidget *entry,
+                         gpointer   user_data)
+{
+	GtkWidget *meter;
+	OobsUser *user;
+	PasswdQualityProblem problem;
+	PasswdStrength strength;
+	const gchar *password;
+	guint bits;
+
+	meter = gst_dialog_get_widget (tool->main_dialog, "user_passwd_strength");
+	password = get_new_password ();
+
+	if (*password == '\0') {
+		gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (meter), 0.0);
+		gtk_progress_bar_set_text (GTK_PROGRESS_BAR (meter), "");
+		return;
+	}
+
+	user = users_table_get_current ();
+	problem = passwd_quality_check (password,
+	                                user ? oobs_user_get_login_name (user) : NULL,
+	                                user ? oobs_user_get_full_name (user) : NULL,
+	                                &bits);
+	strength = passwd_quality_get_strength (problem, bits);
+
+	if (user)
+		g_object_unref (user);
+
+	gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (meter),
+	                               (gdouble) strength / PASSWD_STRENGTH_STRONG);
+
+	if (problem != PASSWD_QUALITY_OK)
+		gtk_progress_bar_set_text (GTK_PROGRESS_BAR (meter),
+		                           passwd_quality_get_problem_text (problem));
+	else
+		gtk_progress_bar_set_text (GTK_PROGRESS_BAR (meter),
+		                           passwd_quality_get_strength_text (strength));
+}
+
 void
 on_user_settings_passwd_random_new (GtkButton *button,
                                     gpointer   data)
@@ -354,20 +422,18 @@ finish_password_change (gboolean passwd_provided)
 	  {
 		  /* Force removing user from this group, since results are unexpected */
 		  if (no_passwd_login_group)
-			  oobs_group_remove_user (no_passwd_login_group, user);
+			  membership_index_set_member (no_passwd_login_group, user, FALSE);
 	  }
 	else
 	  {
 		  /* check whether user is allowed to login without password */
 		  no_passwd_login_changed =
 			  gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (nocheck_toggle))
-			  != oobs_user_is_in_group (user, no_passwd_login_group);
+			  != membership_index_is_member (no_passwd_login_group, user);
 
 		  if (no_passwd_login_changed) {
-			  if (gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (nocheck_toggle)))
-				  oobs_group_add_user (no_passwd_login_group, user);
-			  else
-				  oobs_group_remove_user (no_passwd_login_group, user);
+			  membership_index_set_member (no_passwd_login_group, user,
+			                               gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (nocheck_toggle)));
 		  }
 
 		  /* Unlock account, this may not be what is wanted, but that's the only solution
@@ -507,6 +573,7 @@ on_user_passwd_dialog_response (GtkDialog *user_passwd_dialog,
 	OobsUser *user;
 	const char *passwd;
 	PasswdHandler *passwd_handler = NULL;
+	GstUserProfile *profile;
 	gboolean is_self;
 
 	nocheck_toggle = gst_dialog_get_widget (tool->main_dialog, "user_passwd_no_check");
@@ -561,7 +628,13 @@ on_user_passwd_dialog_response (GtkDialog *user_passwd_dialog,
 	}
 	/* For other users, set password via the backends */
 	else {
-		oobs_user_set_password (user, passwd);
+		profile = gst_user_profiles_get_for_user (GST_USERS_TOOL (tool)->profiles,
+		                                          user, FALSE);
+
+		if (!profile)
+			profile = gst_user_profiles_get_default_profile (GST_USERS_TOOL (tool)->profiles);
+
+		passwd_hash_set_password (user, passwd, profile);
 		finish_password_change (TRUE);
 	}
 
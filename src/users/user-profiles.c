@@ -25,12 +25,18 @@
 #include "user-profiles.h"
 #include "user-settings.h"
 #include "group-settings.h"
+#include "membership-index.h"
 
 extern GstTool *tool;
 
 #define PROFILES_FILE CONF_DIR "/user-profiles.conf"
 #define GST_USER_PROFILES_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), GST_TYPE_USER_PROFILES, GstUserProfilesPrivate))
 
+/* Group masks are arrays of 64 bits words, one bit per group of all_groups */
+#define MASK_WORDS(n_groups) (MAX (((n_groups) + 63) / 64, 1))
+#define MASK_TEST(mask, bit) (((mask)[(bit) / 64] >> ((bit) % 64)) & 1)
+#define MASK_SET(mask, bit)  ((mask)[(bit) / 64] |= G_GUINT64_CONSTANT (1) << ((bit) % 64))
+
 typedef struct _GstUserProfilesPrivate GstUserProfilesPrivate;
 
 struct _GstUserProfilesPrivate
@@ -39,6 +45,16 @@ struct _GstUserProfilesPrivate
 	GstUserProfile *current_profile;
 	GList          *profiles;
 	GList          *all_groups;
+
+	/* Masks over all_groups, so that matching profiles is a mask compare */
+	guint           n_groups;
+	guint           n_words;
+	GHashTable     *profile_masks;      /* GstUserProfile -> guint64 * */
+	GHashTable     *user_masks;         /* login name -> guint64 *, cached */
+	OobsGroup     **group_objects;      /* group for each bit, NULL if it doesn't exist */
+	guint64        *existing_mask;      /* bits of groups that exist on the system */
+	guint           groups_generation;  /* from the membership index, see update_group_objects() */
+	guint           members_generation;
 };
 
 static void   gst_user_profiles_class_init (GstUserProfilesClass *class);
@@ -75,10 +91,186 @@ create_profile (GKeyFile    *key_file,
 	profile->groups = g_key_file_get_string_list (key_file, group, "Groups", NULL, NULL);
 	profile->uid_min = g_key_file_get_integer (key_file, group, "MinUID", NULL);
 	profile->uid_max = g_key_file_get_integer (key_file, group, "MaxUID", NULL);
+	profile->crypt_prefix = g_key_file_get_string (key_file, group, "CryptPrefix", NULL);
+	profile->crypt_cost = MAX (g_key_file_get_integer (key_file, group, "CryptCost", NULL), 0);
 
 	return profile;
 }
 
+/*
+ * Assign a bit to each group defining a profile, and compute the mask of each profile.
+ */
+static void
+build_profile_masks (GstUserProfilesPrivate *priv)
+{
+	GHashTable *group_bits;
+	GstUserProfile *profile;
+	gchar **group_name;
+	guint64 *mask;
+	GList *l;
+	guint bit;
+
+	priv->n_groups = g_list_length (priv->all_groups);
+	priv->n_words = MASK_WORDS (priv->n_groups);
+
+	group_bits = g_hash_table_new (g_str_hash, g_str_equal);
+
+	for (l = priv->all_groups, bit = 0; l; l = l->next, bit++)
+		g_hash_table_insert (group_bits, l->data, GUINT_TO_POINTER (bit));
+
+	for (l = priv->profiles; l; l = l->next) {
+		profile = (GstUserProfile *) l->data;
+		mask = g_new0 (guint64, priv->n_words);
+
+		for (group_name = profile->groups; group_name && *group_name; group_name++)
+			MASK_SET (mask, GPOINTER_TO_UINT (g_hash_table_lookup (group_bits, *group_name)));
+
+		g_hash_table_insert (priv->profile_masks, profile, mask);
+	}
+
+	g_hash_table_destroy (group_bits);
+
+	priv->group_objects = g_new0 (OobsGroup *, priv->n_groups);
+	priv->existing_mask = g_new0 (guint64, priv->n_words);
+}
+
+/*
+ * Resolve groups defining profiles to actual groups, when groups
+ * have been added or removed since the last call.
+ */
+static void
+update_group_objects (GstUserProfilesPrivate *priv)
+{
+	OobsGroupsConfig *groups_config;
+	guint generation;
+	GList *l;
+	guint bit;
+
+	generation = membership_index_get_groups_generation ();
+
+	if (generation == priv->groups_generation)
+		return;
+
+	/* not taken from the tool, which doesn't exist when importing from the command line */
+	groups_config = OOBS_GROUPS_CONFIG (oobs_groups_config_get ());
+	memset (priv->existing_mask, 0, priv->n_words * sizeof (guint64));
+
+	for (l = priv->all_groups, bit = 0; l; l = l->next, bit++) {
+		if (priv->group_objects[bit])
+			g_object_unref (priv->group_objects[bit]);
+
+		priv->group_objects[bit] = oobs_groups_config_get_from_name (groups_config,
+		                                                             (char *) l->data);
+
+		/* Non-existent groups are not considered as breaking match */
+		if (priv->group_objects[bit])
+			MASK_SET (priv->existing_mask, bit);
+	}
+
+	priv->groups_generation = generation;
+	g_hash_table_remove_all (priv->user_masks);
+}
+
+/*
+ * Get the mask of profile groups @user is a member of. Masks are cached
+ * until memberships change, by login name since reloading the users list
+ * replaces the user objects.
+ */
+static const guint64 *
+get_user_mask (GstUserProfilesPrivate *priv,
+               OobsUser               *user)
+{
+	GHashTable *groups;
+	const gchar *login;
+	guint64 *mask;
+	guint generation;
+	guint bit;
+
+	update_group_objects (priv);
+
+	generation = membership_index_get_generation ();
+
+	if (generation != priv->members_generation) {
+		g_hash_table_remove_all (priv->user_masks);
+		priv->members_generation = generation;
+	}
+
+	login = oobs_user_get_login_name (user);
+	mask = (login) ? g_hash_table_lookup (priv->user_masks, login) : NULL;
+
+	if (mask)
+		return mask;
+
+	mask = g_new0 (guint64, priv->n_words);
+	groups = membership_index_get_groups (user);
+
+	for (bit = 0; groups && bit < priv->n_groups; bit++) {
+		if (priv->group_objects[bit]
+		    && g_hash_table_lookup (groups, priv->group_objects[bit]))
+			MASK_SET (mask, bit);
+	}
+
+	/* users being created may have no login yet: they are never looked
+	 * up, the slot only keeps the returned mask alive */
+	g_hash_table_insert (priv->user_masks, g_strdup ((login) ? login : ""), mask);
+
+	return mask;
+}
+
+/*
+ * Check that user is member of all existing groups of the profile,
+ * and not member of any existing group defining another profile.
+ */
+static gboolean
+match_profile_groups (GstUserProfilesPrivate *priv,
+                      GstUserProfile         *profile,
+                      const guint64          *user_mask)
+{
+	const guint64 *profile_mask;
+	guint i;
+
+	profile_mask = g_hash_table_lookup (priv->profile_masks, profile);
+
+	for (i = 0; i < priv->n_words; i++) {
+		if ((user_mask[i] ^ profile_mask[i]) & priv->existing_mask[i])
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Add user to the groups of @profile, and remove it from groups of other
+ * profiles, only touching memberships that actually need to change.
+ */
+static void
+apply_profile_groups (GstUserProfilesPrivate *priv,
+                      GstUserProfile         *profile,
+                      OobsUser               *user)
+{
+	const guint64 *profile_mask;
+	const guint64 *user_mask;
+	guint64 *diff;
+	guint i, bit;
+
+	profile_mask = g_hash_table_lookup (priv->profile_masks, profile);
+	user_mask = get_user_mask (priv, user);
+
+	/* editing memberships invalidates the cached user mask, so keep a copy */
+	diff = g_new (guint64, priv->n_words);
+
+	for (i = 0; i < priv->n_words; i++)
+		diff[i] = (user_mask[i] ^ profile_mask[i]) & priv->existing_mask[i];
+
+	for (bit = 0; bit < priv->n_groups; bit++) {
+		if (MASK_TEST (diff, bit))
+			membership_index_set_member (priv->group_objects[bit], user,
+			                             MASK_TEST (profile_mask, bit));
+	}
+
+	g_free (diff);
+}
+
 static void
 load_profiles (GstUserProfiles *profiles)
 {
@@ -86,6 +278,7 @@ load_profiles (GstUserProfiles *profiles)
 	GKeyFile *key_file;
 	gchar **groups, **group, **group_name;
 	GstUserProfile *profile;
+	GHashTable *seen_groups;
 
 	priv = GST_USER_PROFILES_GET_PRIVATE (profiles);
 	key_file = g_key_file_new ();
@@ -101,6 +294,8 @@ load_profiles (GstUserProfiles *profiles)
 	if (!groups)
 		return;
 
+	seen_groups = g_hash_table_new (g_str_hash, g_str_equal);
+
 	while (*group) {
 		profile = create_profile (key_file, *group);
 		priv->profiles = g_list_prepend (priv->profiles, profile);
@@ -111,11 +306,11 @@ load_profiles (GstUserProfiles *profiles)
 		/* Add the groups to global list */
 		group_name = profile->groups;
 		while (group_name && *group_name) {
-			if (!g_list_find_custom (priv->all_groups,
-			                         *group_name,
-			                         (GCompareFunc) strcmp))
-				priv->all_groups = g_list_append (priv->all_groups,
-				                                  *group_name);
+			if (!g_hash_table_lookup (seen_groups, *group_name)) {
+				g_hash_table_insert (seen_groups, *group_name, *group_name);
+				priv->all_groups = g_list_prepend (priv->all_groups,
+				                                   *group_name);
+			}
 
 			group_name++;
 		}
@@ -123,6 +318,9 @@ load_profiles (GstUserProfiles *profiles)
 		group++;
 	}
 
+	priv->all_groups = g_list_reverse (priv->all_groups);
+
+	g_hash_table_destroy (seen_groups);
 	g_strfreev (groups);
 	g_key_file_free (key_file);
 }
@@ -139,6 +337,7 @@ free_profile (GstUserProfile *profile)
 		g_free (profile->home_prefix);
 	if (profile->groups)
 		g_strfreev (profile->groups);
+	g_free (profile->crypt_prefix);
 	g_free (profile);
 }
 
@@ -150,7 +349,12 @@ gst_user_profiles_init (GstUserProfiles *profiles)
 	priv = GST_USER_PROFILES_GET_PRIVATE (profiles);
 
 	priv->profiles = NULL;
+	priv->profile_masks = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+	                                             NULL, g_free);
+	priv->user_masks = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                          g_free, g_free);
 	load_profiles (profiles);
+	build_profile_masks (priv);
 }
 
 static void
@@ -158,9 +362,21 @@ gst_user_profiles_finalize (GObject *object)
 {
 	GstUserProfilesPrivate *priv;
 	GList *l;
+	guint bit;
 
 	priv = GST_USER_PROFILES_GET_PRIVATE (object);
 
+	g_hash_table_destroy (priv->profile_masks);
+	g_hash_table_destroy (priv->user_masks);
+
+	for (bit = 0; priv->group_objects && bit < priv->n_groups; bit++) {
+		if (priv->group_objects[bit])
+			g_object_unref (priv->group_objects[bit]);
+	}
+
+	g_free (priv->group_objects);
+	g_free (priv->existing_mask);
+
 	if (priv->profiles) {
 		for (l = priv->profiles; l; l = l->next)
 			free_profile ((GstUserProfile *) l->data);
@@ -246,14 +462,11 @@ gst_user_profiles_get_for_user (GstUserProfiles *profiles,
 	GstUserProfilesPrivate *priv;
 	GstUserProfile *profile;
 	GstUserProfile *matched;
-	OobsGroupsConfig *groups_config;
 	GFile *file_home, *file_prefix;
 	const gchar *shell, *home;
+	const guint64 *user_mask;
 	uid_t uid;
-	gchar **group_name;
-	OobsGroup *group;
-	GList *l, *m;
-	gboolean matched_groups, in_profile, in_group;
+	GList *l;
 
 	g_return_val_if_fail (GST_IS_USER_PROFILES (profiles), NULL);
 	g_return_val_if_fail (OOBS_IS_USER (user), NULL);
@@ -263,7 +476,7 @@ gst_user_profiles_get_for_user (GstUserProfiles *profiles,
 	uid = oobs_user_get_uid (user);
 
 	priv = GST_USER_PROFILES_GET_PRIVATE (profiles);
-	groups_config = OOBS_GROUPS_CONFIG (GST_USERS_TOOL (tool)->groups_config);
+	user_mask = get_user_mask (priv, user);
 
 	matched = NULL;
 	for (l = priv->profiles; l; l = l->next) {
@@ -297,38 +510,9 @@ gst_user_profiles_get_for_user (GstUserProfiles *profiles,
 		if (profile->shell && strcmp (shell, profile->shell) != 0)
 			continue;
 
-		/* check user's membership to all groups of the profile,
-		 * also check that user is not member of any group
-		 * that defines another profile vs the current one */
-		matched_groups = TRUE;
-		for (m = priv->all_groups; m && matched_groups; m = m->next) {
-			in_profile = FALSE;
-			group_name = profile->groups;
-			while (group_name && *group_name) {
-				if (strcmp ((char *) m->data, *group_name) == 0)
-					in_profile = TRUE;
-
-				group_name++;
-			}
-
-			group = oobs_groups_config_get_from_name (groups_config, (char *) m->data);
-
-			/* Non-existent groups are not considered as breaking match */
-			if (!group)
-				continue;
-
-			in_group = oobs_user_is_in_group (user, group);
-			if ((in_profile && !in_group) || (!in_profile && in_group)) {
-				matched_groups = FALSE;
-				break;
-			}
-
-			g_object_unref (group);
-		}
-
 		/* stop at first match, since the list has been reverted on loading,
 		 * most privileged profiles must be at the end of the config file */
-		if (matched_groups) {
+		if (match_profile_groups (priv, profile, user_mask)) {
 			matched = profile;
 			break;
 		}
@@ -339,9 +523,10 @@ gst_user_profiles_get_for_user (GstUserProfiles *profiles,
 
 /*
  * Change user settings to fit a given profile. User will be added to groups of
- * the passed profile, and removed from groups defining other profiles. If user_new
- * is TRUE, only shell and groups will be changed: forcing other settings would
- * break the account.
+ * the passed profile, and removed from groups defining other profiles. If new_user
+ * is FALSE, only shell and groups will be changed: forcing other settings would
+ * break the account. If it is TRUE, groups are left alone, since the user doesn't
+ * exist yet: use gst_user_profiles_apply_groups() once it has been created.
  */
 void
 gst_user_profiles_apply (GstUserProfiles *profiles,
@@ -351,13 +536,8 @@ gst_user_profiles_apply (GstUserProfiles *profiles,
 {
 	GstUserProfilesPrivate *priv;
 	OobsUsersConfig *users_config;
-	OobsGroupsConfig *groups_config;
 	gint uid;
 	char *home;
-	char **group_name;
-	OobsGroup *group;
-	GList *l;
-	gboolean in_profile;
 
 	g_return_if_fail (GST_IS_USER_PROFILES (profiles));
 	g_return_if_fail (profile != NULL);
@@ -366,32 +546,10 @@ gst_user_profiles_apply (GstUserProfiles *profiles,
 	g_return_if_fail (oobs_user_get_login_name (user) != NULL);
 
 	priv = GST_USER_PROFILES_GET_PRIVATE (profiles);
-	groups_config = OOBS_GROUPS_CONFIG (GST_USERS_TOOL (tool)->groups_config);
 
 	/* add user to groups from the profile, remove it from groups of other profiles */
-	for (l = priv->all_groups; l; l = l->next) {
-		in_profile = FALSE;
-		group_name = profile->groups;
-		while (group_name && *group_name) {
-			if (strcmp ((char *) l->data, *group_name) == 0)
-				in_profile = TRUE;
-
-			group_name++;
-		}
-
-		group = oobs_groups_config_get_from_name (groups_config, (char *) l->data);
-
-		/* Non-existent groups are simply skipped */
-		if (!group)
-			continue;
-
-		if (in_profile)
-			oobs_group_add_user (group, user);
-		else
-			oobs_group_remove_user (group, user);
-
-		g_object_unref (group);
-	}
+	if (!new_user)
+		apply_profile_groups (priv, profile, user);
 
 	/* default shell */
 	if (profile->shell)
@@ -417,3 +575,115 @@ gst_user_profiles_apply (GstUserProfiles *profiles,
 		g_free (home);
 	}
 }
+
+/*
+ * Add a newly created user to the groups of @profile, see gst_user_profiles_apply().
+ */
+void
+gst_user_profiles_apply_groups (GstUserProfiles *profiles,
+                                GstUserProfile  *profile,
+                                OobsUser        *user)
+{
+	g_return_if_fail (GST_IS_USER_PROFILES (profiles));
+	g_return_if_fail (profile != NULL);
+	g_return_if_fail (OOBS_IS_USER (user));
+
+	apply_profile_groups (GST_USER_PROFILES_GET_PRIVATE (profiles), profile, user);
+}
+
+/*
+ * Apply groups and shell of @profile to all users of @users, like
+ * gst_user_profiles_apply() does for existing users. Profile groups are
+ * only resolved once, and only memberships that differ are changed.
+ */
+void
+gst_user_profiles_apply_to_users (GstUserProfiles *profiles,
+                                  GstUserProfile  *profile,
+                                  GList           *users)
+{
+	GstUserProfilesPrivate *priv;
+	OobsUser *user;
+	GList *l;
+
+	g_return_if_fail (GST_IS_USER_PROFILES (profiles));
+	g_return_if_fail (profile != NULL);
+
+	priv = GST_USER_PROFILES_GET_PRIVATE (profiles);
+
+	for (l = users; l; l = l->next) {
+		user = OOBS_USER (l->data);
+
+		apply_profile_groups (priv, profile, user);
+
+		if (profile->shell)
+			oobs_user_set_shell (user, profile->shell);
+	}
+}
+
+/*
+ * Make all profiles hash passwords with the method identified by @prefix
+ * and @cost, as chosen by passwd_hash_run_calibration(). This rewrites
+ * the profiles file, and thus needs the rights to do so.
+ */
+gboolean
+gst_user_profiles_set_crypt_method (GstUserProfiles *profiles,
+                                    const gchar     *prefix,
+                                    gulong           cost,
+                                    GError         **error)
+{
+	GstUserProfilesPrivate *priv;
+	GstUserProfile *profile;
+	GKeyFile *key_file;
+	GFile *file;
+	gchar **groups, **group;
+	gchar *data;
+	gsize length;
+	gboolean retval;
+	GList *l;
+
+	g_return_val_if_fail (GST_IS_USER_PROFILES (profiles), FALSE);
+	g_return_val_if_fail (prefix != NULL, FALSE);
+
+	priv = GST_USER_PROFILES_GET_PRIVATE (profiles);
+	key_file = g_key_file_new ();
+	g_key_file_set_list_separator (key_file, ',');
+
+	/* Translated names and descriptions must be written back too */
+	if (!g_key_file_load_from_file (key_file, PROFILES_FILE,
+	                                G_KEY_FILE_KEEP_COMMENTS | G_KEY_FILE_KEEP_TRANSLATIONS,
+	                                error)) {
+		g_key_file_free (key_file);
+		return FALSE;
+	}
+
+	groups = g_key_file_get_groups (key_file, NULL);
+
+	for (group = groups; group && *group; group++) {
+		g_key_file_set_string (key_file, *group, "CryptPrefix", prefix);
+		g_key_file_set_integer (key_file, *group, "CryptCost", cost);
+	}
+
+	data = g_key_file_to_data (key_file, &length, NULL);
+
+	/* unlike g_file_set_contents(), this keeps the mode and owner of the file */
+	file = g_file_new_for_path (PROFILES_FILE);
+	retval = g_file_replace_contents (file, data, length, NULL, FALSE,
+	                                  G_FILE_CREATE_NONE, NULL, NULL, error);
+	g_object_unref (file);
+
+	if (retval) {
+		for (l = priv->profiles; l; l = l->next) {
+			profile = l->data;
+
+			g_free (profile->crypt_prefix);
+			profile->crypt_prefix = g_strdup (prefix);
+			profile->crypt_cost = cost;
+		}
+	}
+
+	g_free (data);
+	g_strfreev (groups);
+	g_key_file_free (key_file);
+
+	return retval;
+}
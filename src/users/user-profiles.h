@@ -61,6 +61,10 @@ struct _GstUserProfile
 	uid_t   uid_min;
 	uid_t   uid_max;
 	gchar **groups;
+
+	/* password hashing, see passwd-hash.c */
+	gchar  *crypt_prefix;
+	gulong  crypt_cost;
 };
 
 GType            gst_user_profiles_get_type            (void);
@@ -77,6 +81,16 @@ void             gst_user_profiles_apply               (GstUserProfiles *profile
                                                         GstUserProfile  *profile,
                                                         OobsUser        *user,
                                                         gboolean         new_user);
+void             gst_user_profiles_apply_groups        (GstUserProfiles *profiles,
+                                                        GstUserProfile  *profile,
+                                                        OobsUser        *user);
+void             gst_user_profiles_apply_to_users      (GstUserProfiles *profiles,
+                                                        GstUserProfile  *profile,
+                                                        GList           *users);
+gboolean         gst_user_profiles_set_crypt_method    (GstUserProfiles *profiles,
+                                                        const gchar     *prefix,
+                                                        gulong           cost,
+                                                        GError         **error);
 
 
 G_END_DECLS
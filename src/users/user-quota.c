@@ -0,0 +1,590 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* user-quota.c: this file is part of users-admin, a gnome-system-tools frontend
+ * for user administration.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Disk usage and limits of users, read with quotactl(2).
+ *
+ * Refreshing runs in a thread: homes are mapped to the block devices they
+ * live on, and all the records of each device are read in one pass with
+ * Q_GETNEXTQUOTA, falling back to one Q_GETQUOTA per user when the kernel
+ * doesn't support it (before Linux 4.6) or we aren't allowed to list
+ * records. Results replace the cache from the main loop, and are refreshed
+ * periodically since usage changes behind our back.
+ *
+ * The backends don't handle quotas, so reading the records of other users
+ * and changing limits need the tool to run as root. Otherwise, only the
+ * quota of the current user is read, and limits can't be edited.
+ */
+
+#include <config.h>
+#include "gst.h"
+#include <glib/gi18n.h>
+
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <mntent.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/quota.h>
+
+#include "user-quota.h"
+
+/* Seconds between two refreshes */
+#define REFRESH_INTERVAL 300
+
+/* Unit of block limits in quota records */
+#define QUOTA_BLOCK_SIZE 1024
+
+/* Linux 4.6, not always in the C library headers */
+#ifndef Q_GETNEXTQUOTA
+#define Q_GETNEXTQUOTA 0x800009
+#endif
+
+/* Layout of struct if_nextdqblk from <linux/quota.h> */
+typedef struct {
+	guint64 dqb_bhardlimit;
+	guint64 dqb_bsoftlimit;
+	guint64 dqb_curspace;
+	guint64 dqb_ihardlimit;
+	guint64 dqb_isoftlimit;
+	guint64 dqb_curinodes;
+	guint64 dqb_btime;
+	guint64 dqb_itime;
+	guint32 dqb_valid;
+	guint32 dqb_id;
+} NextDqblk;
+
+typedef struct {
+	dev_t  dev;
+	gchar *device;
+} QuotaMount;
+
+typedef struct {
+	uid_t  uid;
+	gchar *home;
+} QuotaRequest;
+
+typedef struct {
+	guint       generation;
+	GArray     *requests;   /* QuotaRequest, copied from the main thread */
+	GHashTable *quotas;     /* uid -> UserQuota, filled by the thread */
+	gboolean    available;
+	gboolean    privileged; /* whether records of all users can be read */
+} QuotaJob;
+
+static OobsUsersConfig *users_config = NULL;
+static UserQuotaChangedFunc changed_func = NULL;
+static gpointer changed_data = NULL;
+
+static GHashTable *quota_cache = NULL;   /* uid -> UserQuota */
+static gboolean quota_available = FALSE;
+
+static guint refresh_id = 0;
+static guint generation = 0;
+static gboolean job_running = FALSE;
+static gboolean job_pending = FALSE;
+
+static GHashTable *
+quota_table_new (void)
+{
+	return g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+}
+
+/* Block devices of mounted filesystems, in mount order */
+static GArray *
+read_mounts (void)
+{
+	GArray *mounts;
+	QuotaMount mount;
+	struct mntent ent;
+	struct stat st;
+	gchar buf[1024];
+	FILE *file;
+
+	mounts = g_array_new (FALSE, FALSE, sizeof (QuotaMount));
+	file = setmntent ("/proc/mounts", "r");
+
+	if (!file)
+		return mounts;
+
+	while (getmntent_r (file, &ent, buf, sizeof (buf))) {
+		/* quotactl() wants a block device, skip virtual and network filesystems
+		 * before stat(), which could hang on the latter */
+		if (ent.mnt_fsname[0] != '/' || stat (ent.mnt_dir, &st) != 0)
+			continue;
+
+		mount.dev = st.st_dev;
+		mount.device = g_strdup (ent.mnt_fsname);
+		g_array_append_val (mounts, mount);
+	}
+
+	endmntent (file);
+
+	return mounts;
+}
+
+static void
+free_mounts (GArray *mounts)
+{
+	guint i;
+
+	for (i = 0; i < mounts->len; i++)
+		g_free (g_array_index (mounts, QuotaMount, i).device);
+
+	g_array_free (mounts, TRUE);
+}
+
+/* Later mounts hide earlier ones on the same directory */
+static const gchar *
+find_mount_device (GArray *mounts,
+                   dev_t   dev)
+{
+	QuotaMount *mount;
+	guint i;
+
+	for (i = mounts->len; i > 0; i--) {
+		mount = &g_array_index (mounts, QuotaMount, i - 1);
+
+		if (mount->dev == dev)
+			return mount->device;
+	}
+
+	return NULL;
+}
+
+/*
+ * Read all the records of @device into @records. Returns FALSE
+ * if the kernel can't enumerate them, or we are not allowed to.
+ */
+static gboolean
+read_device_quotas (const gchar *device,
+                    GHashTable  *records)
+{
+	NextDqblk next;
+	UserQuota *quota;
+	guint32 id = 0;
+
+	while (quotactl (QCMD (Q_GETNEXTQUOTA, USRQUOTA), device, id, (caddr_t) &next) == 0) {
+		quota = g_new (UserQuota, 1);
+		quota->used = next.dqb_curspace;
+		quota->soft = next.dqb_bsoftlimit * QUOTA_BLOCK_SIZE;
+		quota->hard = next.dqb_bhardlimit * QUOTA_BLOCK_SIZE;
+		g_hash_table_insert (records, GUINT_TO_POINTER (next.dqb_id), quota);
+
+		if (next.dqb_id == G_MAXUINT32)
+			return TRUE;
+
+		id = next.dqb_id + 1;
+	}
+
+	/* set once past the last record */
+	return (errno == ENOENT);
+}
+
+static UserQuota *
+read_user_quota (const gchar *device,
+                 uid_t        uid)
+{
+	struct dqblk dq;
+	UserQuota *quota;
+
+	if (quotactl (QCMD (Q_GETQUOTA, USRQUOTA), device, uid, (caddr_t) &dq) != 0)
+		return NULL;
+
+	quota = g_new (UserQuota, 1);
+	quota->used = dq.dqb_curspace;
+	quota->soft = dq.dqb_bsoftlimit * QUOTA_BLOCK_SIZE;
+	quota->hard = dq.dqb_bhardlimit * QUOTA_BLOCK_SIZE;
+
+	return quota;
+}
+
+static void
+read_device_users (QuotaJob    *job,
+                   const gchar *device,
+                   GArray      *indexes)
+{
+	struct dqinfo info;
+	QuotaRequest *request;
+	GHashTable *records;
+	UserQuota *record, *quota;
+	gboolean listed;
+	guint i;
+
+	/* quotas are off on this filesystem */
+	if (quotactl (QCMD (Q_GETINFO, USRQUOTA), device, 0, (caddr_t) &info) != 0)
+		return;
+
+	job->available = TRUE;
+	records = quota_table_new ();
+	listed = job->privileged && read_device_quotas (device, records);
+
+	for (i = 0; i < indexes->len; i++) {
+		request = &g_array_index (job->requests, QuotaRequest,
+		                          g_array_index (indexes, guint, i));
+		record = g_hash_table_lookup (records, GUINT_TO_POINTER (request->uid));
+
+		if (record) {
+			quota = g_new (UserQuota, 1);
+			*quota = *record;
+		}
+		else if (listed) {
+			/* users without a record use no space and have no limits */
+			quota = g_new0 (UserQuota, 1);
+		}
+		else
+			quota = read_user_quota (device, request->uid);
+
+		if (quota)
+			g_hash_table_insert (job->quotas, GUINT_TO_POINTER (request->uid), quota);
+	}
+
+	g_hash_table_destroy (records);
+}
+
+static void
+free_job (QuotaJob *job)
+{
+	guint i;
+
+	for (i = 0; i < job->requests->len; i++)
+		g_free (g_array_index (job->requests, QuotaRequest, i).home);
+
+	g_array_free (job->requests, TRUE);
+
+	if (job->quotas)
+		g_hash_table_destroy (job->quotas);
+
+	g_slice_free (QuotaJob, job);
+}
+
+static gboolean
+refresh_done (gpointer data)
+{
+	QuotaJob *job = data;
+
+	job_running = FALSE;
+
+	/* discard results arriving after user_quota_shutdown() */
+	if (job->generation == generation) {
+		if (quota_cache)
+			g_hash_table_destroy (quota_cache);
+
+		quota_cache = job->quotas;
+		job->quotas = NULL;
+		quota_available = job->available;
+
+		if (changed_func)
+			changed_func (changed_data);
+
+		if (job_pending) {
+			job_pending = FALSE;
+			user_quota_refresh ();
+		}
+	}
+
+	free_job (job);
+
+	return FALSE;
+}
+
+static gpointer
+refresh_thread (gpointer data)
+{
+	QuotaJob *job = data;
+	QuotaRequest *request;
+	GHashTable *devices;   /* device -> GArray of request indexes */
+	GHashTableIter iter;
+	gpointer device, indexes;
+	GArray *mounts;
+	struct stat st;
+	const gchar *dev;
+	guint i;
+
+	mounts = read_mounts ();
+	devices = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                 NULL, (GDestroyNotify) g_array_unref);
+
+	/* group users by filesystem, so that each one is read once */
+	for (i = 0; i < job->requests->len; i++) {
+		request = &g_array_index (job->requests, QuotaRequest, i);
+
+		if (stat (request->home, &st) != 0)
+			continue;
+
+		dev = find_mount_device (mounts, st.st_dev);
+
+		if (!dev)
+			continue;
+
+		indexes = g_hash_table_lookup (devices, dev);
+
+		if (!indexes) {
+			indexes = g_array_new (FALSE, FALSE, sizeof (guint));
+			g_hash_table_insert (devices, (gpointer) dev, indexes);
+		}
+
+		g_array_append_val ((GArray *) indexes, i);
+	}
+
+	g_hash_table_iter_init (&iter, devices);
+
+	while (g_hash_table_iter_next (&iter, &device, &indexes))
+		read_device_users (job, device, indexes);
+
+	g_hash_table_destroy (devices);
+	free_mounts (mounts);
+
+	g_idle_add (refresh_done, job);
+
+	return NULL;
+}
+
+static gboolean
+refresh_timeout (gpointer data)
+{
+	user_quota_refresh ();
+
+	return TRUE;
+}
+
+/*
+ * Start watching quotas of the users of @config, @func is called
+ * from the main loop each time the cache has been refreshed.
+ */
+void
+user_quota_init (OobsUsersConfig      *config,
+                 UserQuotaChangedFunc  func,
+                 gpointer              data)
+{
+	users_config = config;
+	changed_func = func;
+	changed_data = data;
+
+	if (!refresh_id)
+		refresh_id = g_timeout_add_seconds (REFRESH_INTERVAL, refresh_timeout, NULL);
+}
+
+void
+user_quota_shutdown (void)
+{
+	if (refresh_id) {
+		g_source_remove (refresh_id);
+		refresh_id = 0;
+	}
+
+	/* a running thread is left to finish, its results are dropped */
+	generation++;
+	job_pending = FALSE;
+
+	users_config = NULL;
+	changed_func = NULL;
+	changed_data = NULL;
+
+	if (quota_cache) {
+		g_hash_table_destroy (quota_cache);
+		quota_cache = NULL;
+	}
+
+	quota_available = FALSE;
+}
+
+/*
+ * Read quotas again in the background. Homes are copied from the
+ * configuration here, since OobsUsers can't be used from the thread.
+ */
+void
+user_quota_refresh (void)
+{
+	OobsList *list;
+	OobsListIter iter;
+	OobsUser *user;
+	QuotaJob *job;
+	QuotaRequest request;
+	const gchar *home;
+	gboolean valid;
+
+	if (!users_config)
+		return;
+
+	if (job_running) {
+		job_pending = TRUE;
+		return;
+	}
+
+	job = g_slice_new0 (QuotaJob);
+	job->generation = generation;
+	job->privileged = user_quota_can_edit ();
+	job->requests = g_array_new (FALSE, FALSE, sizeof (QuotaRequest));
+	job->quotas = quota_table_new ();
+
+	list = oobs_users_config_get_users (users_config);
+	valid = oobs_list_get_iter_first (list, &iter);
+
+	while (valid) {
+		user = OOBS_USER (oobs_list_get (list, &iter));
+		home = oobs_user_get_home_directory (user);
+
+		/* the kernel would refuse to give quotas of other users anyway */
+		if (!job->privileged && oobs_user_get_uid (user) != getuid ()) {
+			g_object_unref (user);
+			valid = oobs_list_iter_next (list, &iter);
+			continue;
+		}
+
+		if (home && *home) {
+			request.uid = oobs_user_get_uid (user);
+			request.home = g_strdup (home);
+			g_array_append_val (job->requests, request);
+		}
+
+		g_object_unref (user);
+		valid = oobs_list_iter_next (list, &iter);
+	}
+
+	if (!g_thread_create (refresh_thread, job, FALSE, NULL)) {
+		free_job (job);
+		return;
+	}
+
+	job_running = TRUE;
+}
+
+/* Whether quotas are enabled on a filesystem holding homes */
+gboolean
+user_quota_is_available (void)
+{
+	return quota_available;
+}
+
+/*
+ * Whether limits can be changed. Q_SETQUOTA needs CAP_SYS_ADMIN, and
+ * isn't available through the backends.
+ */
+gboolean
+user_quota_can_edit (void)
+{
+	return geteuid () == 0;
+}
+
+gboolean
+user_quota_lookup (OobsUser  *user,
+                   UserQuota *quota)
+{
+	UserQuota *cached;
+
+	if (!quota_cache)
+		return FALSE;
+
+	cached = g_hash_table_lookup (quota_cache, GUINT_TO_POINTER (oobs_user_get_uid (user)));
+
+	if (!cached)
+		return FALSE;
+
+	*quota = *cached;
+
+	return TRUE;
+}
+
+/*
+ * Set block limits of @user on the filesystem holding its home,
+ * in bytes, 0 meaning no limit. Inode limits are left untouched.
+ */
+gboolean
+user_quota_set_limits (OobsUser  *user,
+                       guint64    soft,
+                       guint64    hard,
+                       GError   **error)
+{
+	struct dqblk dq;
+	struct stat st;
+	GArray *mounts;
+	UserQuota *cached;
+	const gchar *home;
+	const gchar *device;
+	uid_t uid;
+	gint saved_errno;
+	gboolean retval = FALSE;
+
+	if (!user_quota_can_edit ()) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_PERM,
+		             _("Only the administrator can change disk quotas."));
+		return FALSE;
+	}
+
+	uid = oobs_user_get_uid (user);
+	home = oobs_user_get_home_directory (user);
+
+	if (!home || !*home) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NOENT,
+		             _("This user has no home directory."));
+		return FALSE;
+	}
+
+	if (stat (home, &st) != 0) {
+		saved_errno = errno;
+		g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+		             _("Could not read home directory %s: %s"),
+		             home, g_strerror (saved_errno));
+		return FALSE;
+	}
+
+	mounts = read_mounts ();
+	device = find_mount_device (mounts, st.st_dev);
+
+	if (!device) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_NODEV,
+		             _("Disk quotas are not supported on the file system holding %s."),
+		             home);
+		goto out;
+	}
+
+	memset (&dq, 0, sizeof (dq));
+	dq.dqb_bsoftlimit = (soft + QUOTA_BLOCK_SIZE - 1) / QUOTA_BLOCK_SIZE;
+	dq.dqb_bhardlimit = (hard + QUOTA_BLOCK_SIZE - 1) / QUOTA_BLOCK_SIZE;
+	dq.dqb_valid = QIF_BLIMITS;
+
+	if (quotactl (QCMD (Q_SETQUOTA, USRQUOTA), device, uid, (caddr_t) &dq) != 0) {
+		saved_errno = errno;
+		g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+		             _("Could not set disk quota on %s: %s"),
+		             device, g_strerror (saved_errno));
+		goto out;
+	}
+
+	/* keep the cache in sync until the next refresh */
+	cached = (quota_cache) ? g_hash_table_lookup (quota_cache, GUINT_TO_POINTER (uid)) : NULL;
+
+	if (cached) {
+		cached->soft = dq.dqb_bsoftlimit * QUOTA_BLOCK_SIZE;
+		cached->hard = dq.dqb_bhardlimit * QUOTA_BLOCK_SIZE;
+
+		if (changed_func)
+			changed_func (changed_data);
+	}
+
+	retval = TRUE;
+
+ out:
+	free_mounts (mounts);
+
+	return retval;
+}
@@ -0,0 +1,50 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* user-quota.h: this file is part of users-admin, a gnome-system-tools frontend
+ * for user administration.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __USER_QUOTA_H
+#define __USER_QUOTA_H
+
+#include "gst.h"
+
+/* Sizes are in bytes, limits are 0 when unset */
+typedef struct {
+	guint64 used;
+	guint64 soft;
+	guint64 hard;
+} UserQuota;
+
+typedef void (* UserQuotaChangedFunc) (gpointer data);
+
+void      user_quota_init          (OobsUsersConfig      *config,
+                                    UserQuotaChangedFunc  func,
+                                    gpointer              data);
+void      user_quota_shutdown      (void);
+
+void      user_quota_refresh       (void);
+
+gboolean  user_quota_is_available  (void);
+gboolean  user_quota_can_edit      (void);
+gboolean  user_quota_lookup        (OobsUser  *user,
+                                    UserQuota *quota);
+gboolean  user_quota_set_limits    (OobsUser  *user,
+                                    guint64    soft,
+                                    guint64    hard,
+                                    GError   **error);
+
+#endif /* __USER_QUOTA_H */
@@ -33,6 +33,8 @@
 #include <stdlib.h>
 #include <utmp.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <pwd.h>
 
 #include "users-table.h"
 #include "table.h"
@@ -44,6 +46,14 @@
 #include "group-settings.h"
 #include "test-battery.h"
 #include "user-profiles.h"
+#include "login-suggest.h"
+#include "membership-index.h"
+#include "users-search.h"
+#include "user-quota.h"
+#include "home-relocation.h"
+
+/* Quota limits are edited in MB */
+#define QUOTA_UNIT (1024 * 1024)
 
 extern GstTool *tool;
 
@@ -70,12 +80,10 @@ check_user_delete (OobsUser *user)
 	GtkWidget *dialog;
 	OobsGroupsConfig *config;
 	OobsGroup *admin_group;
-	GList *admin_users;
 	gint response;
 
 	config = OOBS_GROUPS_CONFIG (GST_USERS_TOOL (tool)->groups_config);
 	admin_group = oobs_groups_config_get_from_name (config, ADMIN_GROUP);
-	admin_users = oobs_group_get_users (admin_group);
 
 	if (oobs_user_get_uid (user) == 0) {
 		dialog = gtk_message_dialog_new (GTK_WINDOW (tool->main_dialog),
@@ -99,8 +107,8 @@ check_user_delete (OobsUser *user)
 						  _("Please ensure the user has logged out before deleting this account."));
 	}
 	/* don't allow deleting the last admin */
-	else if (oobs_user_is_in_group (user, admin_group)
-	         && g_list_length (admin_users) < 2)
+	else if (membership_index_is_member (admin_group, user)
+	         && membership_index_count_members (admin_group) < 2)
 	{
 		dialog = gtk_message_dialog_new (GTK_WINDOW (tool->main_dialog),
 		                                 GTK_DIALOG_MODAL,
@@ -142,7 +150,6 @@ check_user_delete (OobsUser *user)
 
 	gtk_widget_destroy (dialog);
 	g_object_unref (admin_group);
-	g_list_free (admin_users);
 
 	/* Home flag is used to remove home when deleting a user */
 	if (response == GTK_RESPONSE_YES)
@@ -173,10 +180,14 @@ user_delete (GtkTreeModel *model, GtkTreePath *path)
 		config = OOBS_USERS_CONFIG (GST_USERS_TOOL (tool)->users_config);
 		result = oobs_users_config_delete_user (config, user);
 		if (result == OOBS_RESULT_OK) {
+			login_suggest_remove_login (oobs_user_get_login_name (user));
+			users_search_remove_user (user);
+			membership_index_remove_user (user);
+
 			/* Take into account the possible deletion of user's main group.
 			 * If we update groups here, the 'changed' signal will be blocked, and
 			 * if it happens after 2 seconds, it will trigger a confirmation dialog. */
-			g_idle_add (gst_users_tool_update_groups_async, tool);
+			g_idle_add (gst_users_tool_sync_groups_async, tool);
 			gtk_list_store_remove (GTK_LIST_STORE (model), &iter);
 			retval = TRUE;
 		}
@@ -191,28 +202,229 @@ user_delete (GtkTreeModel *model, GtkTreePath *path)
 	return retval;
 }
 
+/*
+ * Same checks as check_user_delete(), without any dialog. @n_admins is the
+ * number of administrators that would be left, updated if @user is one.
+ */
+static gboolean
+can_delete_user (OobsUser  *user,
+                 OobsGroup *admin_group,
+                 guint     *n_admins)
+{
+	if (oobs_user_get_uid (user) == 0 || oobs_user_get_active (user))
+		return FALSE;
+
+	if (membership_index_is_member (admin_group, user)) {
+		/* don't allow deleting the last admin */
+		if (*n_admins < 2)
+			return FALSE;
+
+		(*n_admins)--;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Ask a single confirmation for deleting several users, telling which
+ * ones can't be deleted. Returns the response, GTK_RESPONSE_YES meaning
+ * that home folders must be removed too.
+ */
+static gint
+confirm_users_delete (GList *users, GList *kept)
+{
+	GtkWidget *dialog;
+	GString *secondary;
+	GList *l;
+	guint n_users;
+	gint response;
+
+	n_users = g_list_length (users);
+	secondary = g_string_new (_("Files owned by these users in their home folders can be "
+	                            "completely removed if you don't need them anymore. You may "
+	                            "want to back them up before deleting the accounts."));
+
+	if (kept) {
+		g_string_append (secondary, "\n\n");
+		g_string_append (secondary, _("The following accounts can't be deleted and will be kept:"));
+
+		for (l = kept; l; l = l->next) {
+			g_string_append (secondary, (l == kept) ? " " : ", ");
+			g_string_append (secondary, oobs_user_get_login_name (OOBS_USER (l->data)));
+		}
+	}
+
+	dialog = gtk_message_dialog_new (GTK_WINDOW (tool->main_dialog),
+	                                 GTK_DIALOG_MODAL,
+	                                 GTK_MESSAGE_QUESTION,
+	                                 GTK_BUTTONS_NONE,
+	                                 ngettext ("Delete %u user account?",
+	                                           "Delete %u user accounts?", n_users),
+	                                 n_users);
+	gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog),
+	                                          "%s", secondary->str);
+	gtk_dialog_add_buttons (GTK_DIALOG (dialog),
+	                        _("Keep Files"), GTK_RESPONSE_NO,
+	                        _("Don't Remove Accounts"), GTK_RESPONSE_CANCEL,
+	                        _("Delete Files"), GTK_RESPONSE_YES,
+	                        NULL);
+	gtk_dialog_set_default_response (GTK_DIALOG (dialog), GTK_RESPONSE_CANCEL);
+
+	gst_dialog_add_edit_dialog (tool->main_dialog, dialog);
+	response = gtk_dialog_run (GTK_DIALOG (dialog));
+	gst_dialog_remove_edit_dialog (tool->main_dialog, dialog);
+
+	gtk_widget_destroy (dialog);
+	g_string_free (secondary, TRUE);
+
+	return response;
+}
+
+/*
+ * Delete all users pointed by @references after one confirmation,
+ * removing them from the users list and committing it only once.
+ */
+static void
+users_delete_batch (GtkTreeModel *model, GList *references)
+{
+	OobsUsersConfig *config;
+	OobsGroupsConfig *groups_config;
+	OobsGroup *admin_group;
+	OobsList *list;
+	OobsListIter list_iter;
+	OobsResult result;
+	GtkTreePath *path;
+	GtkTreeIter iter;
+	GHashTable *deleted;
+	GList *users = NULL, *kept = NULL, *rows = NULL, *l;
+	OobsUser *user;
+	GObject *object;
+	guint n_admins;
+	gboolean valid;
+	gint response;
+
+	config = OOBS_USERS_CONFIG (GST_USERS_TOOL (tool)->users_config);
+	groups_config = OOBS_GROUPS_CONFIG (GST_USERS_TOOL (tool)->groups_config);
+	admin_group = oobs_groups_config_get_from_name (groups_config, ADMIN_GROUP);
+	n_admins = membership_index_count_members (admin_group);
+
+	for (l = references; l; l = l->next) {
+		path = gtk_tree_row_reference_get_path (l->data);
+
+		if (gtk_tree_model_get_iter (model, &iter, path)) {
+			gtk_tree_model_get (model, &iter, COL_USER_OBJECT, &user, -1);
+
+			if (can_delete_user (user, admin_group, &n_admins)) {
+				users = g_list_prepend (users, user);
+				rows = g_list_prepend (rows, l->data);
+			}
+			else
+				kept = g_list_prepend (kept, user);
+		}
+
+		gtk_tree_path_free (path);
+	}
+
+	if (admin_group)
+		g_object_unref (admin_group);
+
+	users = g_list_reverse (users);
+	kept = g_list_reverse (kept);
+
+	if (!users) {
+		/* nothing left, the usual dialog explains why */
+		if (kept)
+			check_user_delete (OOBS_USER (kept->data));
+
+		goto out;
+	}
+
+	response = confirm_users_delete (users, kept);
+
+	if (response != GTK_RESPONSE_YES && response != GTK_RESPONSE_NO)
+		goto out;
+
+	/* Home flag is used to remove home when deleting a user */
+	deleted = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	for (l = users; l; l = l->next) {
+		oobs_user_set_home_flags (OOBS_USER (l->data),
+		                          (response == GTK_RESPONSE_YES) ? OOBS_USER_REMOVE_HOME : 0);
+		g_hash_table_insert (deleted, l->data, l->data);
+	}
+
+	/* remove all users in one pass over the list, then commit once */
+	list = oobs_users_config_get_users (config);
+	valid = oobs_list_get_iter_first (list, &list_iter);
+
+	while (valid) {
+		object = oobs_list_get (list, &list_iter);
+
+		if (g_hash_table_lookup (deleted, object))
+			valid = oobs_list_remove (list, &list_iter);
+		else
+			valid = oobs_list_iter_next (list, &list_iter);
+
+		g_object_unref (object);
+	}
+
+	g_hash_table_destroy (deleted);
+
+	result = gst_tool_commit (tool, OOBS_OBJECT (config));
+
+	if (result != OOBS_RESULT_OK) {
+		/* get back to the real state of the system */
+		gst_tool_update_async (tool);
+		goto out;
+	}
+
+	for (l = users; l; l = l->next) {
+		login_suggest_remove_login (oobs_user_get_login_name (OOBS_USER (l->data)));
+		users_search_remove_user (OOBS_USER (l->data));
+		membership_index_remove_user (OOBS_USER (l->data));
+	}
+
+	for (l = rows; l; l = l->next) {
+		path = gtk_tree_row_reference_get_path (l->data);
+
+		if (path && gtk_tree_model_get_iter (model, &iter, path))
+			gtk_list_store_remove (GTK_LIST_STORE (model), &iter);
+
+		gtk_tree_path_free (path);
+	}
+
+	/* Take into account the possible deletion of users' main groups, only once */
+	g_idle_add (gst_users_tool_sync_groups_async, tool);
+
+ out:
+	g_list_foreach (users, (GFunc) g_object_unref, NULL);
+	g_list_foreach (kept, (GFunc) g_object_unref, NULL);
+	g_list_free (users);
+	g_list_free (kept);
+	g_list_free (rows);
+}
+
 void
 on_user_delete_clicked (GtkButton *button, gpointer user_data)
 {
 	GtkTreeModel *model;
 	GtkTreePath *path;
-	GList *list, *elem;
+	GList *list;
 
 	/* No need to prompt if not allowed */
 	if (!gst_tool_authenticate (tool, GST_USERS_TOOL (tool)->users_config))
 		return;
 
-	list = elem = users_table_get_row_references ();
+	list = users_table_get_row_references ();
 	model = users_table_get_model ();
 
-	while (elem) {
-		path = gtk_tree_row_reference_get_path (elem->data);
-
+	if (list && !list->next) {
+		path = gtk_tree_row_reference_get_path (list->data);
 		user_delete (model, path);
-
 		gtk_tree_path_free (path);
-		elem = elem->next;
 	}
+	else if (list)
+		users_delete_batch (model, list);
 
 	users_table_select_first ();
 
@@ -267,19 +479,22 @@ select_main_group (OobsUser *user)
 		gtk_combo_box_set_active (GTK_COMBO_BOX (combo), -1);
 }
 
-static void
-set_login_length (GtkWidget *entry)
+gint
+user_settings_get_login_max_length (void)
 {
-	gint max_len;
 #ifdef __FreeBSD__
-	max_len = UT_NAMESIZE;
+	return UT_NAMESIZE;
 #else
 	struct utmp ut;
 
-	max_len = sizeof (ut.ut_user);
+	return sizeof (ut.ut_user);
 #endif
+}
 
-	gtk_entry_set_max_length (GTK_ENTRY (entry), max_len);
+static void
+set_login_length (GtkWidget *entry)
+{
+	gtk_entry_set_max_length (GTK_ENTRY (entry), user_settings_get_login_max_length ());
 }
 
 GdkPixbuf *
@@ -402,8 +617,12 @@ check_comments (gchar **primary_text, gchar **secondary_text, gpointer data)
 	g_free (comment);
 }
 
+/*
+ * Ask what to do with the old and new home directories when the home path
+ * changes, @flags are set to the OOBS_USER_*_HOME flags that were chosen.
+ */
 static gboolean
-check_home (OobsUser *user)
+check_home (OobsUser *user, gint *flags)
 {
 	GtkWidget *dialog;
 	GtkWidget *home_entry;
@@ -419,6 +638,7 @@ check_home (OobsUser *user)
 
 	/* Better be sure there's no remnant from aborted changes */
 	oobs_user_set_home_flags (user, 0);
+	*flags = 0;
 
 	home_entry = gst_dialog_get_widget (tool->main_dialog, "user_settings_home");
 	home = gtk_entry_get_text (GTK_ENTRY (home_entry));
@@ -566,15 +786,14 @@ check_home (OobsUser *user)
 			return TRUE;
 		}
 
-		if (chown_home && delete_old)
-			oobs_user_set_home_flags (user, home_flags | OOBS_USER_CHOWN_HOME
-			                                           | OOBS_USER_REMOVE_HOME);
-		else if (chown_home)
-			oobs_user_set_home_flags (user, home_flags | OOBS_USER_CHOWN_HOME);
-		else if (delete_old)
-			oobs_user_set_home_flags (user, home_flags | OOBS_USER_REMOVE_HOME);
-		else
-			oobs_user_set_home_flags (user, home_flags);
+		if (chown_home)
+			home_flags |= OOBS_USER_CHOWN_HOME;
+
+		if (delete_old)
+			home_flags |= OOBS_USER_REMOVE_HOME;
+
+		oobs_user_set_home_flags (user, home_flags);
+		*flags = home_flags;
 
 		return (response != GTK_RESPONSE_CANCEL);
 	}
@@ -648,7 +867,6 @@ user_settings_check_revoke_admin_rights ()
 	OobsSelfConfig *self_config;
 	OobsUser *user;
 	OobsGroup *admin_group;
-	GList *members;
 	GtkWidget *dialog;
 	int response;
 
@@ -657,10 +875,9 @@ user_settings_check_revoke_admin_rights ()
 
 	user = users_table_get_current ();
 	admin_group = oobs_groups_config_get_from_name (groups_config, ADMIN_GROUP);
-	members = oobs_group_get_users (admin_group);
 
 	/* check that user is no alone in the admin group */
-	if (g_list_length (members) < 2) {
+	if (membership_index_count_members (admin_group) < 2) {
 		dialog = gtk_message_dialog_new (GTK_WINDOW (tool->main_dialog),
 		                                 GTK_DIALOG_MODAL,
 		                                 GTK_MESSAGE_ERROR,
@@ -741,25 +958,15 @@ check_profile (OobsUser *user, GstUserProfile *profile)
 void
 on_user_new_name_changed (GtkEditable *user_name, gpointer user_data)
 {
-	OobsUsersConfig *config;
 	GtkWidget *validate_button;
 	GtkWidget *user_login;
 	GtkWidget *login_entry;
 	GtkTreeModel *model;
+	const GPtrArray *logins;
 	gboolean valid_login;
 	gboolean valid_name;
-	gboolean used_login;
 	const char *name;
-	char *lc_name, *ascii_name, *stripped_name;
-	char **words1;
-	char **words2 = NULL;
-	char **w1, **w2;
-	char *c;
-	char *unicode_fallback = "?";
-	GString *first_word, *last_word;
-	GString *item1, *item2, *item3, *item4;
-	int len;
-	int nwords1, nwords2, i;
+	guint i;
 
 	validate_button = gst_dialog_get_widget (tool->main_dialog,
 	                                         "user_new_validate_button");
@@ -786,165 +993,17 @@ on_user_new_name_changed (GtkEditable *user_name, gpointer user_data)
 		return;
 	}
 
+	/* candidates are already checked against used logins and max length */
+	logins = login_suggest_get_candidates (name, user_settings_get_login_max_length ());
 
-	ascii_name = g_convert_with_fallback (name, -1, "ASCII//TRANSLIT", "UTF-8",
-	                                      unicode_fallback, NULL, NULL, NULL);
-
-	lc_name = g_ascii_strdown (ascii_name, -1);
-
-	/* remove all non ASCII alphanumeric chars from the name,
-	 * apart from the few allowed symbols */
-	stripped_name = g_strnfill (strlen (lc_name) + 1, '\0');
-	i = 0;
-	for (c = lc_name; *c; c++) {
-		if ( !(g_ascii_isdigit (*c) || g_ascii_islower (*c)
-		       || *c == ' ' || *c == '-' || *c == '.' || *c == '_'
-		       /* used to track invalid words, removed below */
-		       || *c == '?') )
-			continue;
-
-		    stripped_name[i] = *c;
-		    i++;
-	}
-
-	if (strlen (stripped_name) <= 0) {
-		g_free (ascii_name);
-		g_free (lc_name);
-		g_free (stripped_name);
+	if (logins->len == 0)
 		return;
-	}
-
-	/* we split name on spaces, and then on dashes, so that we can treat words
-	 * linked with dashes the same way, i.e. both fully shown, or both abbreviated */
-	words1 = g_strsplit_set (stripped_name, " ", -1);
-	len = g_strv_length (words1);
-
-	g_free (ascii_name);
-	g_free (lc_name);
-	g_free (stripped_name);
-
-
-	/* Concatenate the whole first word with the first letter of each word (item1),
-	 * and the last word with the first letter of each word (item2). item3 and item4
-	 * are symmetrical respectively to item1 and item2.
-	 *
-	 * Constant 5 is the max reasonable number of words we may get when
-	 * splitting on dashes, since we can't guess it at this point,
-	 * and reallocating would be too bad. */
-	item1 = g_string_sized_new (strlen (words1[0]) + len - 1 + 5);
-	item3 = g_string_sized_new (strlen (words1[0]) + len - 1 + 5);
-
-	item2 = g_string_sized_new (strlen (words1[len - 1]) + len - 1 + 5);
-	item4 = g_string_sized_new (strlen (words1[len - 1]) + len - 1 + 5);
-
-	/* again, guess at the max size of names */
-	first_word = g_string_sized_new (20);
-	last_word = g_string_sized_new (20);
-
-	nwords1 = 0;
-	nwords2 = 0;
-	for (w1 = words1; *w1; w1++) {
-		if (strlen (*w1) == 0)
-			continue;
-
-		/* skip words with string '?', most likely resulting
-		 * from failed transliteration to ASCII */
-		if (strstr (*w1, unicode_fallback) != NULL)
-			continue;
-
-		nwords1++; /* count real words, excluding empty string */
-
-		words2 = g_strsplit_set (*w1, "-", -1);
-
-		/* reset last word if a new non-empty word has been found */
-		if (strlen (*words2) > 0)
-			last_word = g_string_set_size (last_word, 0);
-
-		for (w2 = words2; *w2; w2++) {
-			if (strlen (*w2) == 0)
-				continue;
-
-			nwords2++;
-
-			/* part of the first "toplevel" real word */
-			if (nwords1 == 1) {
-				item1 = g_string_append (item1, *w2);
-				first_word = g_string_append (first_word, *w2);
-			}
-			else {
-				item1 = g_string_append_unichar (item1,
-				                                 g_utf8_get_char (*w2));
-				item3 = g_string_append_unichar (item3,
-				                                 g_utf8_get_char (*w2));
-			}
-
-			/* not part of the last "toplevel" word */
-			if (w1 != words1 + len - 1) {
-				item2 = g_string_append_unichar (item2,
-				                                 g_utf8_get_char (*w2));
-				item4 = g_string_append_unichar (item4,
-				                                 g_utf8_get_char (*w2));
-			}
-
-			/* always save current word so that we have it if last one reveals empty */
-			last_word = g_string_append (last_word, *w2);
-		}
-
-		g_strfreev (words2);
-	}
 
-	item2 = g_string_append (item2, last_word->str);
-	item3 = g_string_append (item3, first_word->str);
-	item4 = g_string_prepend (item4, last_word->str);
-
-	config = OOBS_USERS_CONFIG (GST_USERS_TOOL (tool)->users_config);
-
-	used_login = oobs_users_config_is_login_used (config, item1->str);
-	if (nwords2 > 0 && !used_login && !isdigit(item1->str[0]))
+	for (i = 0; i < logins->len; i++)
 		gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (user_login),
-		                                item1->str);
-
-	/* if there's only one word, would be the same as item1 */
-	if (nwords2 > 1) {
-		/* add other items */
-		used_login = oobs_users_config_is_login_used (config, item2->str);
-		if (!used_login && !isdigit(item2->str[0]))
-			gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (user_login),
-			                                item2->str);
-
-		used_login = oobs_users_config_is_login_used (config, item3->str);
-		if (!used_login && !isdigit(item3->str[0]))
-			gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (user_login),
-			                                item3->str);
-
-		used_login = oobs_users_config_is_login_used (config, item4->str);
-		if (!used_login && !isdigit(item4->str[0]))
-			gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (user_login),
-			                                item4->str);
-
-		/* add the last word */
-		used_login = oobs_users_config_is_login_used (config, last_word->str);
-		if (!used_login && !isdigit(last_word->str[0]))
-			gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (user_login),
-			                                last_word->str);
-
-		/* ...and the first one */
-		used_login = oobs_users_config_is_login_used (config, first_word->str);
-		if (!used_login && !isdigit(first_word->str[0]))
-			gtk_combo_box_text_append_text (GTK_COMBO_BOX_TEXT (user_login),
-			                                first_word->str);
-	}
-
+		                                g_ptr_array_index (logins, i));
 
 	gtk_combo_box_set_active (GTK_COMBO_BOX (user_login), 0);
-
-	g_strfreev (words1);
-	g_string_free (first_word, TRUE);
-	g_string_free (last_word, TRUE);
-	g_string_free (item1, TRUE);
-	g_string_free (item2, TRUE);
-	g_string_free (item3, TRUE);
-	g_string_free (item4, TRUE);
 }
 
 /*
@@ -976,8 +1035,7 @@ on_user_new_login_changed (GtkComboBox *login_combo, gpointer user_data)
 	login_notice = gst_dialog_get_widget (tool->main_dialog, "user_new_login_notice");
 	letter_notice = gst_dialog_get_widget (tool->main_dialog, "user_new_login_letter_notice");
 
-	used_login = oobs_users_config_is_login_used (OOBS_USERS_CONFIG (GST_USERS_TOOL (tool)->users_config),
-	                                              login);
+	used_login = login_suggest_is_used (login);
 	empty_login = (strlen (login) <= 0);
 	valid_login = TRUE;
 
@@ -1021,6 +1079,281 @@ on_user_new_login_changed (GtkComboBox *login_combo, gpointer user_data)
 	                        (!used_login && valid_login) || empty_login ? NULL : &color);
 }
 
+/* Skeleton files copied by the backends into new home directories */
+#define SKEL_DIR "/etc/skel"
+
+/* How often the home directory of an account being created is looked at */
+#define CREATION_PROGRESS_INTERVAL 500
+
+/*
+ * Accounts are created one at a time in the background, since each creation
+ * commits the whole users list. Others wait in creation_queue, their rows
+ * being shown as pending meanwhile.
+ */
+typedef struct {
+	OobsUser       *user;
+	GstUserProfile *profile;    /* its groups are applied once the user exists */
+	gchar          *home;
+	guint           skel_files;
+	guint           progress_id;
+} UserCreation;
+
+static GQueue creation_queue = G_QUEUE_INIT;
+static UserCreation *current_creation = NULL;
+
+/* set after a failure, creations resume once the configuration has been reloaded */
+static gboolean creation_waiting_reload = FALSE;
+
+static void start_user_creation (UserCreation *creation);
+
+/*
+ * Count regular files and links below @path, stopping at @limit.
+ * Unreadable directories are skipped.
+ */
+static guint
+count_files (const gchar *path,
+             guint        limit)
+{
+	GDir *dir;
+	const gchar *name;
+	gchar *child;
+	guint count = 0;
+
+	dir = g_dir_open (path, 0, NULL);
+
+	if (!dir)
+		return 0;
+
+	while (count < limit && (name = g_dir_read_name (dir)) != NULL) {
+		child = g_build_filename (path, name, NULL);
+
+		if (g_file_test (child, G_FILE_TEST_IS_DIR)
+		    && !g_file_test (child, G_FILE_TEST_IS_SYMLINK))
+			count += count_files (child, limit - count);
+		else
+			count++;
+
+		g_free (child);
+	}
+
+	g_dir_close (dir);
+
+	return MIN (count, limit);
+}
+
+/*
+ * The backends don't report how far they are, so watch the skeleton files
+ * appear in the new home. Homes which can't be read by the tool, or which
+ * existed before, are only reported as being created. Watching stops once
+ * all skeleton files are there, the commit may take longer.
+ */
+static gboolean
+user_creation_progress (gpointer data)
+{
+	UserCreation *creation = data;
+	gchar *status;
+	guint copied;
+
+	if (!g_file_test (creation->home, G_FILE_TEST_IS_DIR))
+		return TRUE;
+
+	copied = count_files (creation->home, creation->skel_files);
+	status = g_strdup_printf (_("Copying files to home folder (%u of %u)"),
+	                          copied, creation->skel_files);
+	users_table_set_pending_status (creation->user, status);
+	g_free (status);
+
+	if (copied < creation->skel_files)
+		return TRUE;
+
+	creation->progress_id = 0;
+	return FALSE;
+}
+
+static void
+free_user_creation (UserCreation *creation)
+{
+	if (creation->progress_id)
+		g_source_remove (creation->progress_id);
+
+	g_object_unref (creation->user);
+	g_free (creation->home);
+	g_slice_free (UserCreation, creation);
+}
+
+/*
+ * The groups configuration has been read again, since the backends may
+ * have created a main group for the new user: set it, and apply the groups
+ * of the profile now that the user exists.
+ */
+static void
+on_created_user_groups_updated (OobsObject *object,
+                                OobsResult  result,
+                                gpointer    data)
+{
+	UserCreation *creation = data;
+	OobsUser *user = creation->user;
+	OobsGroup *main_group;
+	struct passwd *pw;
+
+	if (result != OOBS_RESULT_OK) {
+		free_user_creation (creation);
+		return;
+	}
+
+	/* all group objects have been replaced */
+	gst_users_tool_update_groups_async (tool);
+
+	/* the commit doesn't tell which GID the backends chose */
+	pw = getpwnam (oobs_user_get_login_name (user));
+	main_group = NULL;
+
+	if (pw)
+		main_group = oobs_groups_config_get_from_gid (OOBS_GROUPS_CONFIG (object), pw->pw_gid);
+
+	if (main_group) {
+		oobs_user_set_main_group (user, main_group);
+		g_object_unref (main_group);
+	}
+
+	if (creation->profile) {
+		gst_user_profiles_apply_groups (GST_USERS_TOOL (tool)->profiles,
+		                                creation->profile, user);
+		gst_tool_commit_async (tool, GST_USERS_TOOL (tool)->groups_config,
+		                       NULL, NULL, NULL);
+	}
+
+	free_user_creation (creation);
+}
+
+static void
+on_user_created (OobsObject *object,
+                 OobsResult  result,
+                 gpointer    data)
+{
+	UserCreation *creation = data;
+	OobsUser *user = creation->user;
+	GtkTreePath *user_path;
+
+	current_creation = NULL;
+
+	if (creation->progress_id) {
+		g_source_remove (creation->progress_id);
+		creation->progress_id = 0;
+	}
+
+	user_path = users_table_finish_pending_user (user, result == OOBS_RESULT_OK);
+
+	if (result == OOBS_RESULT_OK) {
+		/* frees the creation once done */
+		oobs_object_update_async (GST_USERS_TOOL (tool)->groups_config,
+		                          on_created_user_groups_updated, creation);
+
+		/* Unless the admin is busy with another dialog, run the password
+		 * edit dialog. User can hit cancel, leaving the account disabled */
+		if (user_path && !gst_dialog_get_editing (tool->main_dialog)) {
+			users_table_select_path (user_path);
+			on_edit_user_passwd (NULL, NULL);
+		}
+	}
+	else {
+		/* error has already been shown, get rid of the half-saved state */
+		login_suggest_remove_login (oobs_user_get_login_name (user));
+		membership_index_remove_user (user);
+
+		/* the next creation would commit the half-saved state again */
+		creation_waiting_reload = TRUE;
+		gst_tool_update_async (tool);
+	}
+
+	if (user_path)
+		gtk_tree_path_free (user_path);
+
+	if (result != OOBS_RESULT_OK)
+		free_user_creation (creation);
+
+	if (!creation_waiting_reload && !g_queue_is_empty (&creation_queue))
+		start_user_creation (g_queue_pop_head (&creation_queue));
+}
+
+/*
+ * Called once users have been reloaded, which cleared the rows and
+ * logins of queued accounts. Creations stopped by a failure go on.
+ */
+void
+user_settings_reload_creations (void)
+{
+	UserCreation *creation;
+	GList *l;
+
+	for (l = creation_queue.head; l; l = l->next) {
+		creation = l->data;
+
+		login_suggest_add_login (oobs_user_get_login_name (creation->user));
+		users_table_add_pending_user (creation->user, _("Waiting to be created..."));
+	}
+
+	if (!creation_waiting_reload)
+		return;
+
+	creation_waiting_reload = FALSE;
+
+	if (!current_creation && !g_queue_is_empty (&creation_queue))
+		start_user_creation (g_queue_pop_head (&creation_queue));
+}
+
+static void
+start_user_creation (UserCreation *creation)
+{
+	OobsList *list;
+	OobsListIter iter;
+
+	current_creation = creation;
+
+	/* home folders already present are reused, not filled from the skeleton */
+	if (creation->home && !g_file_test (creation->home, G_FILE_TEST_EXISTS))
+		creation->skel_files = count_files (SKEL_DIR, G_MAXUINT);
+
+	if (creation->skel_files > 0)
+		creation->progress_id = g_timeout_add (CREATION_PROGRESS_INTERVAL,
+		                                       user_creation_progress, creation);
+
+	users_table_set_pending_status (creation->user, _("Creating account..."));
+
+	list = oobs_users_config_get_users (OOBS_USERS_CONFIG (GST_USERS_TOOL (tool)->users_config));
+	oobs_list_append (list, &iter);
+	oobs_list_set (list, &iter, creation->user);
+
+	/* No report window, which would block other dialogs: progress is
+	 * shown in the row of the new user */
+	gst_tool_commit_async (tool, GST_USERS_TOOL (tool)->users_config,
+	                       NULL, on_user_created, creation);
+}
+
+/*
+ * Show @user as pending at once, and create it in the background.
+ */
+static void
+queue_user_creation (OobsUser       *user,
+                     GstUserProfile *profile)
+{
+	UserCreation *creation;
+
+	creation = g_slice_new0 (UserCreation);
+	creation->user = g_object_ref (user);
+	creation->profile = profile;
+	creation->home = g_strdup (oobs_user_get_home_directory (user));
+
+	/* Known as used, so that the login is not proposed again meanwhile */
+	login_suggest_add_login (oobs_user_get_login_name (user));
+	users_table_add_pending_user (user, _("Waiting to be created..."));
+
+	if (current_creation || creation_waiting_reload)
+		g_queue_push_tail (&creation_queue, creation);
+	else
+		start_user_creation (creation);
+}
+
 /*
  * Callback for user_new button: run the dialog to enter the user's
  * real name and login, and create the user with default settings.
@@ -1036,14 +1369,12 @@ on_user_new (GtkButton *button, gpointer user_data)
 	GtkWidget *notice_image;
 	GtkWidget *encrypted_home;
 	GtkTreeModel *model;
-	GtkTreePath *user_path;
 	OobsUser *user;
 	OobsGroup *main_group;
 	const char *fullname, *login;
 	GstUserProfile *profile;
 	OobsUsersConfig *users_config;
 	OobsGroupsConfig *groups_config;
-	OobsResult result;
 	gboolean encrypt;
 
 	/* Before going further, check for authorizations, authenticating if needed */
@@ -1114,37 +1445,13 @@ on_user_new (GtkButton *button, gpointer user_data)
 
 	g_return_if_fail (user != NULL);
 
-	/* fill settings with values from default profile */
+	/* fill settings with values from default profile, groups come once created */
 	profile = gst_user_profiles_get_default_profile (GST_USERS_TOOL (tool)->profiles);
 	gst_user_profiles_apply (GST_USERS_TOOL (tool)->profiles, profile, user, TRUE);
 
-	/* We need to know about this user before adding it, else we won't be aware
-	 * that we triggered the commit, and we will show a "Reload config?" dialog. */
-	gst_tool_add_configuration_object (GST_TOOL (tool), OOBS_OBJECT (user), FALSE);
-
-	/* Commit both user and groups config because of possible memberships
-	 * added by the profile. Avoid showing the new user or trying to commit
-	 * group changes if the user has not been created. */
-	result = oobs_users_config_add_user (users_config, user);
-	if (result == OOBS_RESULT_OK) {
-		gst_tool_commit (tool, GST_USERS_TOOL (tool)->groups_config);
-
-		user_path = users_table_add_user (user);
-		users_table_select_path (user_path);
-		gtk_tree_path_free (user_path);
-
-		/* Take into account possibly new main group for user.
-		 * If we update groups here, the 'changed' signal will be blocked,
-		 * and if it happens after 2 seconds, it will trigger a confirmation dialog. */
-		g_idle_add (gst_users_tool_update_groups_async, tool);
-
-		/* Finally, run the password edit dialog.
-		 * User can hit cancel, leaving the account disabled */
-		on_edit_user_passwd (NULL, NULL);
-	}
-	else {
-		gst_tool_commit_error (tool, result);
-	}
+	/* Groups of the profile are only applied and committed once
+	 * the user has been created, see on_user_created(). */
+	queue_user_creation (user, profile);
 
 	g_object_unref (user);
 }
@@ -1334,6 +1641,225 @@ on_edit_user_profile (GtkButton *button, gpointer user_data)
 	g_object_unref (user);
 }
 
+/*
+ * Fill the disk quota widgets of the advanced dialog, hiding them
+ * when quotas are not enabled on the filesystem holding the home.
+ * Limits are only shown read-only when we can't change them.
+ */
+static gboolean
+fill_user_quota (OobsUser *user, UserQuota *quota)
+{
+	GtkWidget *widget;
+	gboolean editable;
+	gchar *used;
+
+	widget = gst_dialog_get_widget (tool->main_dialog, "user_settings_quota");
+
+	if (!user_quota_lookup (user, quota)) {
+		gtk_widget_hide (widget);
+		return FALSE;
+	}
+
+	gtk_widget_show (widget);
+
+	widget = gst_dialog_get_widget (tool->main_dialog, "user_settings_quota_used");
+	used = g_format_size_for_display (quota->used);
+	gtk_label_set_text (GTK_LABEL (widget), used);
+	g_free (used);
+
+	editable = user_quota_can_edit ();
+
+	widget = gst_dialog_get_widget (tool->main_dialog, "user_settings_quota_soft");
+	gtk_spin_button_set_value (GTK_SPIN_BUTTON (widget), quota->soft / QUOTA_UNIT);
+	gtk_widget_set_sensitive (widget, editable);
+
+	widget = gst_dialog_get_widget (tool->main_dialog, "user_settings_quota_hard");
+	gtk_spin_button_set_value (GTK_SPIN_BUTTON (widget), quota->hard / QUOTA_UNIT);
+	gtk_widget_set_sensitive (widget, editable);
+
+	return TRUE;
+}
+
+/* Apply limits which have been changed, which doesn't go through the backends */
+static void
+save_user_quota (OobsUser *user, const UserQuota *quota)
+{
+	GtkWidget *widget;
+	GtkWidget *dialog;
+	GError *error = NULL;
+	guint64 soft, hard;
+
+	if (!user_quota_can_edit ())
+		return;
+
+	widget = gst_dialog_get_widget (tool->main_dialog, "user_settings_quota_soft");
+	soft = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (widget));
+
+	widget = gst_dialog_get_widget (tool->main_dialog, "user_settings_quota_hard");
+	hard = gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (widget));
+
+	if (soft == quota->soft / QUOTA_UNIT && hard == quota->hard / QUOTA_UNIT)
+		return;
+
+	if (user_quota_set_limits (user, soft * QUOTA_UNIT, hard * QUOTA_UNIT, &error))
+		return;
+
+	dialog = gtk_message_dialog_new (GTK_WINDOW (tool->main_dialog),
+	                                 GTK_DIALOG_MODAL,
+	                                 GTK_MESSAGE_ERROR,
+	                                 GTK_BUTTONS_CLOSE,
+	                                 _("Could not change disk quota of %s"),
+	                                 oobs_user_get_full_name_fallback (user));
+	gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog),
+	                                          "%s", error->message);
+	gtk_dialog_run (GTK_DIALOG (dialog));
+	gtk_widget_destroy (dialog);
+
+	g_error_free (error);
+}
+
+typedef struct {
+	GtkWidget *dialog;
+	GtkWidget *progress;
+	GError    *error;
+	gboolean   finished;
+} RelocationDialog;
+
+static void
+on_relocation_progress (HomeRelocation *relocation,
+                        guint64         bytes_done,
+                        guint64         bytes_total,
+                        guint           files_done,
+                        guint           files_total,
+                        gpointer        data)
+{
+	RelocationDialog *relocation_dialog = data;
+	gchar *done, *total, *text;
+
+	done = g_format_size_for_display (bytes_done);
+	total = g_format_size_for_display (bytes_total);
+	/* TRANSLATORS: progress of the copy of a home directory, e.g. "1.2 GB of 3.5 GB, 10 of 100 files" */
+	text = g_strdup_printf (_("%s of %s, %u of %u files"), done, total, files_done, files_total);
+
+	gtk_progress_bar_set_text (GTK_PROGRESS_BAR (relocation_dialog->progress), text);
+	gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (relocation_dialog->progress),
+	                               (bytes_total > 0) ? (gdouble) bytes_done / bytes_total : 0);
+
+	g_free (done);
+	g_free (total);
+	g_free (text);
+}
+
+static void
+on_relocation_done (HomeRelocation *relocation,
+                    const GError   *error,
+                    gpointer        data)
+{
+	RelocationDialog *relocation_dialog = data;
+
+	relocation_dialog->finished = TRUE;
+
+	if (error)
+		relocation_dialog->error = g_error_copy (error);
+
+	gtk_dialog_response (GTK_DIALOG (relocation_dialog->dialog), GTK_RESPONSE_OK);
+}
+
+/*
+ * Copy the old home of @user to its new location ourselves, showing
+ * progress, instead of letting the backends copy it while the commit
+ * blocks. Returns FALSE if the copy failed or has been cancelled, running
+ * it again skips files that have already been copied.
+ */
+static gboolean
+relocate_home (OobsUser *user, const gchar *old_home, gboolean chown_home)
+{
+	RelocationDialog relocation_dialog = { NULL, NULL, NULL, FALSE };
+	HomeRelocation *relocation;
+	OobsGroup *main_group;
+	GtkWidget *vbox;
+	GtkWidget *label;
+	GtkWidget *dialog;
+	const gchar *new_home;
+	gchar *markup;
+	gboolean cancelled;
+
+	new_home = oobs_user_get_home_directory (user);
+	main_group = oobs_user_get_main_group (user);
+
+	relocation_dialog.dialog = gtk_dialog_new_with_buttons (_("Copying Home Directory"),
+	                                                        GTK_WINDOW (tool->main_dialog),
+	                                                        GTK_DIALOG_MODAL,
+	                                                        GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+	                                                        NULL);
+
+	gtk_window_set_default_size (GTK_WINDOW (relocation_dialog.dialog), 450, -1);
+
+	vbox = gtk_dialog_get_content_area (GTK_DIALOG (relocation_dialog.dialog));
+	gtk_container_set_border_width (GTK_CONTAINER (vbox), 12);
+	gtk_box_set_spacing (GTK_BOX (vbox), 6);
+
+	label = gtk_label_new (NULL);
+	markup = g_markup_printf_escaped (_("Copying files from <tt>%s</tt> to <tt>%s</tt>..."),
+	                                  old_home, new_home);
+	gtk_label_set_markup (GTK_LABEL (label), markup);
+	gtk_misc_set_alignment (GTK_MISC (label), 0.0, 0.5);
+	gtk_box_pack_start (GTK_BOX (vbox), label, FALSE, FALSE, 0);
+	g_free (markup);
+
+	relocation_dialog.progress = gtk_progress_bar_new ();
+	gtk_progress_bar_set_show_text (GTK_PROGRESS_BAR (relocation_dialog.progress), TRUE);
+	gtk_box_pack_start (GTK_BOX (vbox), relocation_dialog.progress, FALSE, FALSE, 0);
+
+	gtk_widget_show_all (relocation_dialog.dialog);
+
+	relocation = home_relocation_new (old_home, new_home, chown_home,
+	                                  oobs_user_get_uid (user),
+	                                  (main_group) ? oobs_group_get_gid (main_group) : (gid_t) -1);
+	home_relocation_start (relocation, on_relocation_progress, on_relocation_done,
+	                       &relocation_dialog);
+
+	gst_dialog_add_edit_dialog (tool->main_dialog, relocation_dialog.dialog);
+	gtk_dialog_run (GTK_DIALOG (relocation_dialog.dialog));
+
+	/* cancelled, wait for threads to stop */
+	if (!relocation_dialog.finished) {
+		home_relocation_cancel (relocation);
+
+		while (!relocation_dialog.finished)
+			gtk_main_iteration ();
+	}
+
+	gst_dialog_remove_edit_dialog (tool->main_dialog, relocation_dialog.dialog);
+	gtk_widget_destroy (relocation_dialog.dialog);
+	home_relocation_free (relocation);
+
+	if (!relocation_dialog.error)
+		return TRUE;
+
+	cancelled = g_error_matches (relocation_dialog.error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+
+	if (!cancelled) {
+		dialog = gtk_message_dialog_new (GTK_WINDOW (tool->main_dialog),
+		                                 GTK_DIALOG_MODAL,
+		                                 GTK_MESSAGE_ERROR,
+		                                 GTK_BUTTONS_CLOSE,
+		                                 _("Could not copy the home directory of %s"),
+		                                 oobs_user_get_full_name_fallback (user));
+		gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog),
+		                                          _("%s\n\nThe home directory has not been changed. "
+		                                            "If you try again, files that have already "
+		                                            "been copied will be skipped."),
+		                                          relocation_dialog.error->message);
+		gtk_dialog_run (GTK_DIALOG (dialog));
+		gtk_widget_destroy (dialog);
+	}
+
+	g_error_free (relocation_dialog.error);
+
+	return FALSE;
+}
+
 static void
 on_commit_finish (OobsObject *object, OobsResult result, gpointer user)
 {
@@ -1361,6 +1887,10 @@ on_edit_user_advanced (GtkButton *button, gpointer user_data)
 	OobsGroup *main_group;
 	gboolean password_disabled;
 	OobsGroup *no_passwd_login_group;
+	UserQuota quota;
+	gboolean has_quota;
+	gchar *old_home;
+	gint home_flags;
 	int response;
 
 	TestBattery battery[] = {
@@ -1445,6 +1975,7 @@ on_edit_user_advanced (GtkButton *button, gpointer user_data)
 
 	privileges_table_set_from_user (user);
 	select_main_group (user);
+	has_quota = fill_user_quota (user, &quota);
 
 
 	/* run dialog */
@@ -1458,7 +1989,13 @@ on_edit_user_advanced (GtkButton *button, gpointer user_data)
 		}
 
 	} while (!test_battery_run (battery, GTK_WINDOW (user_advanced_dialog), user_advanced_dialog)
-	         || !check_home (user));
+	         || !check_home (user, &home_flags));
+
+	/* before the home directory changes, limits apply to the current one */
+	if (has_quota)
+		save_user_quota (user, &quota);
+
+	old_home = g_strdup (oobs_user_get_home_directory (user));
 
 
 	widget = gst_dialog_get_widget (tool->main_dialog, "user_settings_room_number");
@@ -1488,7 +2025,7 @@ on_edit_user_advanced (GtkButton *button, gpointer user_data)
 		oobs_groups_config_get_from_name (OOBS_GROUPS_CONFIG (GST_USERS_TOOL (tool)->groups_config),
 		                                  NO_PASSWD_LOGIN_GROUP);
 	if (password_disabled && no_passwd_login_group)
-		oobs_group_remove_user (no_passwd_login_group, user);
+		membership_index_set_member (no_passwd_login_group, user, FALSE);
 
 	privileges_table_save (user);
 
@@ -1506,6 +2043,19 @@ on_edit_user_advanced (GtkButton *button, gpointer user_data)
 	else
 		oobs_user_set_main_group (user, NULL);
 
+	/* Copy the home dir with progress when we are allowed to, once the new owner is known.
+	 * If it fails, other changes are still applied, keeping the old home dir. */
+	if ((home_flags & OOBS_USER_COPY_HOME) && geteuid () == 0) {
+		if (relocate_home (user, old_home, home_flags & OOBS_USER_CHOWN_HOME))
+			oobs_user_set_home_flags (user, home_flags & ~(OOBS_USER_COPY_HOME | OOBS_USER_CHOWN_HOME));
+		else {
+			oobs_user_set_home_directory (user, old_home);
+			oobs_user_set_home_flags (user, 0);
+		}
+	}
+
+	g_free (old_home);
+
 
 	/* Need to run async since copying home dir could be slow */
 	gst_tool_commit_async (tool, OOBS_OBJECT (user),
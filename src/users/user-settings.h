@@ -43,6 +43,8 @@ uid_t           user_settings_find_new_uid       (gint uid_min,
                                                   gint uid_max);
 gboolean        user_settings_is_user_in_group   (OobsUser  *user,
                                                   OobsGroup *group);
+gint            user_settings_get_login_max_length (void);
+void            user_settings_reload_creations   (void);
 
 gboolean        user_settings_check_revoke_admin_rights ();
 
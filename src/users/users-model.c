@@ -0,0 +1,1018 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* users-model.c: this file is part of users-admin, a gnome-system-tools frontend
+ * for user administration.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Filtered and sorted view of the users list store, replacing a
+ * GtkTreeModelFilter and GtkTreeModelSort stack.
+ *
+ * Rows are sorted by search rank, then by an optional sort key, then by the
+ * collation key of the login, computed once when the row changes. Visible rows are kept in display
+ * order in a gap buffer: converting between positions and rows is O(1),
+ * and a series of insertions or deletions in ascending or descending order,
+ * like refiltering does, costs a single pass over the rows.
+ */
+
+#include <config.h>
+#include <string.h>
+#include "gst.h"
+#include "users-model.h"
+#include "users-search.h"
+
+#define GST_USERS_MODEL_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), GST_TYPE_USERS_MODEL, GstUsersModelPrivate))
+
+#define N_VISIBLE(priv) ((priv)->size - ((priv)->gap_end - (priv)->gap_start))
+
+typedef struct _Row Row;
+typedef struct _GstUsersModelPrivate GstUsersModelPrivate;
+
+struct _Row
+{
+	GtkTreeIter  child_iter;
+	guint        child_index;
+	OobsUser    *user;      /* reference held by the child model */
+	gchar       *key;       /* collation key of the login */
+	gint         rank;
+	gint64       sort_key;
+	gint         index;     /* in the visible buffer, -1 if hidden */
+	gboolean     visible;   /* used while refiltering */
+};
+
+struct _GstUsersModelPrivate
+{
+	GtkTreeModel *child_model;
+	gint          user_column;
+	gint          stamp;
+
+	GPtrArray    *rows;     /* child position -> Row */
+
+	/* visible rows in display order, with a gap at gap_start */
+	Row         **visible;
+	guint         size;
+	guint         gap_start;
+	guint         gap_end;
+
+	GtkTreeModelFilterVisibleFunc visible_func;
+	gpointer      visible_data;
+
+	GstUsersModelSortKeyFunc sort_key_func;
+	gpointer      sort_key_data;
+
+	gboolean      search_ranked;
+
+	gulong        inserted_id;
+	gulong        changed_id;
+	gulong        deleted_id;
+	gulong        reordered_id;
+};
+
+static void gst_users_model_class_init      (GstUsersModelClass *class);
+static void gst_users_model_init            (GstUsersModel      *model);
+static void gst_users_model_finalize        (GObject            *object);
+static void gst_users_model_tree_model_init (GtkTreeModelIface  *iface);
+
+G_DEFINE_TYPE_WITH_CODE (GstUsersModel, gst_users_model, G_TYPE_OBJECT,
+			 G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL,
+						gst_users_model_tree_model_init));
+
+static void
+gst_users_model_class_init (GstUsersModelClass *class)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (class);
+
+	object_class->finalize = gst_users_model_finalize;
+
+	g_type_class_add_private (object_class,
+				  sizeof (GstUsersModelPrivate));
+}
+
+static void
+gst_users_model_init (GstUsersModel *model)
+{
+	GstUsersModelPrivate *priv = GST_USERS_MODEL_GET_PRIVATE (model);
+
+	priv->stamp = g_random_int ();
+	priv->rows = g_ptr_array_new ();
+	priv->search_ranked = TRUE;
+}
+
+static void
+free_row (Row *row)
+{
+	g_free (row->key);
+	g_slice_free (Row, row);
+}
+
+static void
+release_child_model (GstUsersModel *model)
+{
+	GstUsersModelPrivate *priv = GST_USERS_MODEL_GET_PRIVATE (model);
+
+	if (!priv->child_model)
+		return;
+
+	g_signal_handler_disconnect (priv->child_model, priv->inserted_id);
+	g_signal_handler_disconnect (priv->child_model, priv->changed_id);
+	g_signal_handler_disconnect (priv->child_model, priv->deleted_id);
+	g_signal_handler_disconnect (priv->child_model, priv->reordered_id);
+
+	g_ptr_array_foreach (priv->rows, (GFunc) free_row, NULL);
+	g_ptr_array_set_size (priv->rows, 0);
+
+	g_object_unref (priv->child_model);
+	priv->child_model = NULL;
+}
+
+static void
+gst_users_model_finalize (GObject *object)
+{
+	GstUsersModelPrivate *priv = GST_USERS_MODEL_GET_PRIVATE (object);
+
+	release_child_model (GST_USERS_MODEL (object));
+	g_ptr_array_free (priv->rows, TRUE);
+	g_free (priv->visible);
+
+	(* G_OBJECT_CLASS (gst_users_model_parent_class)->finalize) (object);
+}
+
+/* Visible buffer handling */
+
+static guint
+pos_to_index (GstUsersModelPrivate *priv,
+              guint                 pos)
+{
+	return (pos < priv->gap_start) ? pos : pos + (priv->gap_end - priv->gap_start);
+}
+
+static guint
+index_to_pos (GstUsersModelPrivate *priv,
+              guint                 index)
+{
+	return (index < priv->gap_start) ? index : index - (priv->gap_end - priv->gap_start);
+}
+
+static Row *
+get_row (GstUsersModelPrivate *priv,
+         guint                 pos)
+{
+	return priv->visible[pos_to_index (priv, pos)];
+}
+
+static void
+move_gap (GstUsersModelPrivate *priv,
+          guint                 pos)
+{
+	Row *row;
+
+	while (priv->gap_start > pos) {
+		row = priv->visible[--priv->gap_start];
+		priv->visible[--priv->gap_end] = row;
+		row->index = priv->gap_end;
+	}
+
+	while (priv->gap_start < pos) {
+		row = priv->visible[priv->gap_end++];
+		priv->visible[priv->gap_start] = row;
+		row->index = priv->gap_start++;
+	}
+}
+
+static void
+insert_row (GstUsersModelPrivate *priv,
+            guint                 pos,
+            Row                  *row)
+{
+	guint new_size, n_after, i;
+
+	if (priv->gap_start == priv->gap_end) {
+		new_size = MAX (priv->size * 2, 64);
+		n_after = priv->size - priv->gap_end;
+
+		priv->visible = g_renew (Row *, priv->visible, new_size);
+		memmove (priv->visible + new_size - n_after,
+			 priv->visible + priv->gap_end,
+			 n_after * sizeof (Row *));
+
+		priv->gap_end = new_size - n_after;
+		priv->size = new_size;
+
+		for (i = priv->gap_end; i < new_size; i++)
+			priv->visible[i]->index = i;
+	}
+
+	move_gap (priv, pos);
+	priv->visible[priv->gap_start] = row;
+	row->index = priv->gap_start++;
+}
+
+static void
+remove_row (GstUsersModelPrivate *priv,
+            guint                 pos)
+{
+	Row *row;
+
+	move_gap (priv, pos);
+	row = priv->visible[priv->gap_end++];
+	row->index = -1;
+}
+
+/* Sorting */
+
+static gint
+compare_rows (const Row *a,
+              const Row *b)
+{
+	if (a->rank != b->rank)
+		return (a->rank < b->rank) ? -1 : 1;
+
+	if (a->sort_key != b->sort_key)
+		return (a->sort_key < b->sort_key) ? -1 : 1;
+
+	return strcmp ((a->key) ? a->key : "", (b->key) ? b->key : "");
+}
+
+static gint
+compare_rows_func (gconstpointer a,
+                   gconstpointer b)
+{
+	return compare_rows (* (Row **) a, * (Row **) b);
+}
+
+/* Position at which @row should be inserted, it must be hidden */
+static guint
+find_position (GstUsersModelPrivate *priv,
+               Row                  *row)
+{
+	guint low, high, mid;
+
+	low = 0;
+	high = N_VISIBLE (priv);
+
+	while (low < high) {
+		mid = (low + high) / 2;
+
+		if (compare_rows (get_row (priv, mid), row) <= 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+/* Signal emission, always done after the row has been moved */
+
+static void
+emit_row_inserted (GstUsersModel *model,
+                   Row           *row)
+{
+	GstUsersModelPrivate *priv = GST_USERS_MODEL_GET_PRIVATE (model);
+	GtkTreePath *path;
+	GtkTreeIter iter;
+
+	path = gtk_tree_path_new_from_indices (index_to_pos (priv, row->index), -1);
+	iter.stamp = priv->stamp;
+	iter.user_data = row;
+
+	gtk_tree_model_row_inserted (GTK_TREE_MODEL (model), path, &iter);
+	gtk_tree_path_free (path);
+}
+
+static void
+emit_row_changed (GstUsersModel *model,
+                  Row           *row)
+{
+	GstUsersModelPrivate *priv = GST_USERS_MODEL_GET_PRIVATE (model);
+	GtkTreePath *path;
+	GtkTreeIter iter;
+
+	path = gtk_tree_path_new_from_indices (index_to_pos (priv, row->index), -1);
+	iter.stamp = priv->stamp;
+	iter.user_data = row;
+
+	gtk_tree_model_row_changed (GTK_TREE_MODEL (model), path, &iter);
+	gtk_tree_path_free (path);
+}
+
+static void
+emit_row_deleted (GstUsersModel *model,
+                  guint          pos)
+{
+	GtkTreePath *path;
+
+	path = gtk_tree_path_new_from_indices (pos, -1);
+	gtk_tree_model_row_deleted (GTK_TREE_MODEL (model), path);
+	gtk_tree_path_free (path);
+}
+
+/* Rows */
+
+static gboolean
+row_is_visible (GstUsersModel *model,
+                Row           *row)
+{
+	GstUsersModelPrivate *priv = GST_USERS_MODEL_GET_PRIVATE (model);
+
+	if (!row->user)
+		return FALSE;
+
+	if (priv->visible_func &&
+	    !(* priv->visible_func) (priv->child_model, &row->child_iter, priv->visible_data))
+		return FALSE;
+
+	row->rank = (priv->search_ranked) ? users_search_get_rank (row->user) : 0;
+	row->sort_key = (priv->sort_key_func) ? (* priv->sort_key_func) (row->user, priv->sort_key_data) : 0;
+
+	return TRUE;
+}
+
+/* Read the row user from the child model, returns whether it should be visible */
+static gboolean
+update_row (GstUsersModel *model,
+            Row           *row)
+{
+	GstUsersModelPrivate *priv = GST_USERS_MODEL_GET_PRIVATE (model);
+	const gchar *login = NULL;
+	OobsUser *user;
+
+	gtk_tree_model_get (priv->child_model, &row->child_iter,
+			    priv->user_column, &user,
+			    -1);
+
+	if (user)
+		login = oobs_user_get_login_name (user);
+
+	/* rows only change when users are edited, recomputing is cheap enough */
+	g_free (row->key);
+	row->key = (login) ? g_utf8_collate_key (login, -1) : NULL;
+	row->user = user;
+
+	if (user)
+		g_object_unref (user);
+
+	return row_is_visible (model, row);
+}
+
+static void
+update_row_position (GstUsersModel *model,
+                     Row           *row,
+                     gboolean       visible)
+{
+	GstUsersModelPrivate *priv = GST_USERS_MODEL_GET_PRIVATE (model);
+	GtkTreePath *path;
+	guint pos, new_pos, n, i;
+	gint *new_order;
+
+	if (row->index < 0) {
+		if (visible) {
+			insert_row (priv, find_position (priv, row), row);
+			emit_row_inserted (model, row);
+		}
+
+		return;
+	}
+
+	pos = index_to_pos (priv, row->index);
+
+	if (!visible) {
+		remove_row (priv, pos);
+		emit_row_deleted (model, pos);
+		return;
+	}
+
+	n = N_VISIBLE (priv);
+
+	if ((pos == 0 || compare_rows (get_row (priv, pos - 1), row) <= 0) &&
+	    (pos == n - 1 || compare_rows (row, get_row (priv, pos + 1)) <= 0)) {
+		emit_row_changed (model, row);
+		return;
+	}
+
+	/* move it, keeping the row selected in views */
+	remove_row (priv, pos);
+	new_pos = find_position (priv, row);
+	insert_row (priv, new_pos, row);
+
+	new_order = g_new (gint, n);
+
+	for (i = 0; i < n; i++)
+		new_order[i] = i;
+
+	if (new_pos < pos) {
+		for (i = new_pos + 1; i <= pos; i++)
+			new_order[i] = i - 1;
+	}
+	else {
+		for (i = pos; i < new_pos; i++)
+			new_order[i] = i + 1;
+	}
+
+	new_order[new_pos] = pos;
+
+	path = gtk_tree_path_new ();
+	gtk_tree_model_rows_reordered (GTK_TREE_MODEL (model), path, NULL, new_order);
+	gtk_tree_path_free (path);
+	g_free (new_order);
+
+	emit_row_changed (model, row);
+}
+
+static void
+renumber_rows (GstUsersModelPrivate *priv,
+               guint                 from)
+{
+	guint i;
+
+	for (i = from; i < priv->rows->len; i++)
+		((Row *) g_ptr_array_index (priv->rows, i))->child_index = i;
+}
+
+/* Child model signals */
+
+static void
+on_child_row_inserted (GtkTreeModel  *child_model,
+                       GtkTreePath   *child_path,
+                       GtkTreeIter   *child_iter,
+                       GstUsersModel *model)
+{
+	GstUsersModelPrivate *priv = GST_USERS_MODEL_GET_PRIVATE (model);
+	guint child_index;
+	Row *row;
+
+	child_index = gtk_tree_path_get_indices (child_path)[0];
+
+	row = g_slice_new0 (Row);
+	row->child_iter = *child_iter;
+	row->index = -1;
+
+	g_ptr_array_add (priv->rows, row);
+
+	if (child_index < priv->rows->len - 1) {
+		memmove (priv->rows->pdata + child_index + 1,
+			 priv->rows->pdata + child_index,
+			 (priv->rows->len - child_index - 1) * sizeof (gpointer));
+		priv->rows->pdata[child_index] = row;
+	}
+
+	renumber_rows (priv, child_index);
+	update_row_position (model, row, update_row (model, row));
+}
+
+static void
+on_child_row_changed (GtkTreeModel  *child_model,
+                      GtkTreePath   *child_path,
+                      GtkTreeIter   *child_iter,
+                      GstUsersModel *model)
+{
+	GstUsersModelPrivate *priv = GST_USERS_MODEL_GET_PRIVATE (model);
+	Row *row;
+
+	row = g_ptr_array_index (priv->rows, gtk_tree_path_get_indices (child_path)[0]);
+	update_row_position (model, row, update_row (model, row));
+}
+
+static void
+on_child_row_deleted (GtkTreeModel  *child_model,
+                      GtkTreePath   *child_path,
+                      GstUsersModel *model)
+{
+	GstUsersModelPrivate *priv = GST_USERS_MODEL_GET_PRIVATE (model);
+	guint child_index, pos;
+	Row *row;
+
+	child_index = gtk_tree_path_get_indices (child_path)[0];
+	row = g_ptr_array_index (priv->rows, child_index);
+
+	g_ptr_array_remove_index (priv->rows, child_index);
+	renumber_rows (priv, child_index);
+
+	if (row->index >= 0) {
+		pos = index_to_pos (priv, row->index);
+		remove_row (priv, pos);
+		emit_row_deleted (model, pos);
+	}
+
+	free_row (row);
+}
+
+static void
+on_child_rows_reordered (GtkTreeModel  *child_model,
+                         GtkTreePath   *child_path,
+                         GtkTreeIter   *child_iter,
+                         gint          *new_order,
+                         GstUsersModel *model)
+{
+	GstUsersModelPrivate *priv = GST_USERS_MODEL_GET_PRIVATE (model);
+	gpointer *rows;
+	guint i;
+
+	/* display order doesn't depend on the child order */
+	rows = g_memdup (priv->rows->pdata, priv->rows->len * sizeof (gpointer));
+
+	for (i = 0; i < priv->rows->len; i++)
+		priv->rows->pdata[i] = rows[new_order[i]];
+
+	renumber_rows (priv, 0);
+	g_free (rows);
+}
+
+/* GtkTreeModel implementation */
+
+static GtkTreeModelFlags
+gst_users_model_get_flags (GtkTreeModel *tree_model)
+{
+	return GTK_TREE_MODEL_ITERS_PERSIST | GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint
+gst_users_model_get_n_columns (GtkTreeModel *tree_model)
+{
+	GstUsersModelPrivate *priv = GST_USERS_MODEL_GET_PRIVATE (tree_model);
+
+	return (priv->child_model) ? gtk_tree_model_get_n_columns (priv->child_model) : 0;
+}
+
+static GType
+gst_users_model_get_column_type (GtkTreeModel *tree_model,
+                                 gint          index)
+{
+	GstUsersModelPrivate *priv = GST_USERS_MODEL_GET_PRIVATE (tree_model);
+
+	g_return_val_if_fail (priv->child_model != NULL, G_TYPE_INVALID);
+
+	return gtk_tree_model_get_column_type (priv->child_model, index);
+}
+
+static gboolean
+set_iter (GstUsersModelPrivate *priv,
+          GtkTreeIter          *iter,
+          gint                  pos)
+{
+	if (pos < 0 || pos >= (gint) N_VISIBLE (priv)) {
+		iter->stamp = 0;
+		return FALSE;
+	}
+
+	iter->stamp = priv->stamp;
+	iter->user_data = get_row (priv, pos);
+
+	return TRUE;
+}
+
+static gboolean
+gst_users_model_get_iter (GtkTreeModel *tree_model,
+                          GtkTreeIter  *iter,
+                          GtkTreePath  *path)
+{
+	GstUsersModelPrivate *priv = GST_USERS_MODEL_GET_PRIVATE (tree_model);
+
+	if (gtk_tree_path_get_depth (path) != 1) {
+		iter->stamp = 0;
+		return FALSE;
+	}
+
+	return set_iter (priv, iter, gtk_tree_path_get_indices (path)[0]);
+}
+
+static GtkTreePath *
+gst_users_model_get_path (GtkTreeModel *tree_model,
+                          GtkTreeIter  *iter)
+{
+	GstUsersModelPrivate *priv = GST_USERS_MODEL_GET_PRIVATE (tree_model);
+	Row *row;
+
+	g_return_val_if_fail (iter->stamp == priv->stamp, NULL);
+
+	row = iter->user_data;
+
+	if (row->index < 0)
+		return NULL;
+
+	return gtk_tree_path_new_from_indices (index_to_pos (priv, row->index), -1);
+}
+
+static void
+gst_users_model_get_value (GtkTreeModel *tree_model,
+                           GtkTreeIter  *iter,
+                           gint          column,
+                           GValue       *value)
+{
+	GstUsersModelPrivate *priv = GST_USERS_MODEL_GET_PRIVATE (tree_model);
+	Row *row;
+
+	g_return_if_fail (iter->stamp == priv->stamp);
+
+	row = iter->user_data;
+	gtk_tree_model_get_value (priv->child_model, &row->child_iter, column, value);
+}
+
+static gboolean
+gst_users_model_iter_next (GtkTreeModel *tree_model,
+                           GtkTreeIter  *iter)
+{
+	GstUsersModelPrivate *priv = GST_USERS_MODEL_GET_PRIVATE (tree_model);
+	Row *row;
+
+	g_return_val_if_fail (iter->stamp == priv->stamp, FALSE);
+
+	row = iter->user_data;
+
+	if (row->index < 0) {
+		iter->stamp = 0;
+		return FALSE;
+	}
+
+	return set_iter (priv, iter, index_to_pos (priv, row->index) + 1);
+}
+
+static gboolean
+gst_users_model_iter_previous (GtkTreeModel *tree_model,
+                               GtkTreeIter  *iter)
+{
+	GstUsersModelPrivate *priv = GST_USERS_MODEL_GET_PRIVATE (tree_model);
+	Row *row;
+
+	g_return_val_if_fail (iter->stamp == priv->stamp, FALSE);
+
+	row = iter->user_data;
+
+	if (row->index < 0) {
+		iter->stamp = 0;
+		return FALSE;
+	}
+
+	return set_iter (priv, iter, (gint) index_to_pos (priv, row->index) - 1);
+}
+
+static gboolean
+gst_users_model_iter_children (GtkTreeModel *tree_model,
+                               GtkTreeIter  *iter,
+                               GtkTreeIter  *parent)
+{
+	GstUsersModelPrivate *priv = GST_USERS_MODEL_GET_PRIVATE (tree_model);
+
+	if (parent) {
+		iter->stamp = 0;
+		return FALSE;
+	}
+
+	return set_iter (priv, iter, 0);
+}
+
+static gboolean
+gst_users_model_iter_has_child (GtkTreeModel *tree_model,
+                                GtkTreeIter  *iter)
+{
+	return FALSE;
+}
+
+static gint
+gst_users_model_iter_n_children (GtkTreeModel *tree_model,
+                                 GtkTreeIter  *iter)
+{
+	GstUsersModelPrivate *priv = GST_USERS_MODEL_GET_PRIVATE (tree_model);
+
+	return (iter) ? 0 : N_VISIBLE (priv);
+}
+
+static gboolean
+gst_users_model_iter_nth_child (GtkTreeModel *tree_model,
+                                GtkTreeIter  *iter,
+                                GtkTreeIter  *parent,
+                                gint          n)
+{
+	GstUsersModelPrivate *priv = GST_USERS_MODEL_GET_PRIVATE (tree_model);
+
+	if (parent) {
+		iter->stamp = 0;
+		return FALSE;
+	}
+
+	return set_iter (priv, iter, n);
+}
+
+static gboolean
+gst_users_model_iter_parent (GtkTreeModel *tree_model,
+                             GtkTreeIter  *iter,
+                             GtkTreeIter  *child)
+{
+	iter->stamp = 0;
+	return FALSE;
+}
+
+static void
+gst_users_model_tree_model_init (GtkTreeModelIface *iface)
+{
+	iface->get_flags = gst_users_model_get_flags;
+	iface->get_n_columns = gst_users_model_get_n_columns;
+	iface->get_column_type = gst_users_model_get_column_type;
+	iface->get_iter = gst_users_model_get_iter;
+	iface->get_path = gst_users_model_get_path;
+	iface->get_value = gst_users_model_get_value;
+	iface->iter_next = gst_users_model_iter_next;
+	iface->iter_previous = gst_users_model_iter_previous;
+	iface->iter_children = gst_users_model_iter_children;
+	iface->iter_has_child = gst_users_model_iter_has_child;
+	iface->iter_n_children = gst_users_model_iter_n_children;
+	iface->iter_nth_child = gst_users_model_iter_nth_child;
+	iface->iter_parent = gst_users_model_iter_parent;
+}
+
+/* Public API */
+
+/*
+ * Create a view of @child_model, which must have persistent iters (like
+ * GtkListStore), sorted by login. @user_column holds the OobsUser of each
+ * row, rows without one are hidden.
+ */
+GtkTreeModel *
+gst_users_model_new (GtkTreeModel *child_model,
+                     gint          user_column)
+{
+	GstUsersModel *model;
+	GstUsersModelPrivate *priv;
+
+	model = g_object_new (GST_TYPE_USERS_MODEL, NULL);
+	priv = GST_USERS_MODEL_GET_PRIVATE (model);
+
+	priv->user_column = user_column;
+
+	gst_users_model_set_model (model, child_model);
+
+	return GTK_TREE_MODEL (model);
+}
+
+GtkTreeModel *
+gst_users_model_get_model (GstUsersModel *model)
+{
+	g_return_val_if_fail (GST_IS_USERS_MODEL (model), NULL);
+
+	return GST_USERS_MODEL_GET_PRIVATE (model)->child_model;
+}
+
+/*
+ * Replace the child model. Dropping a big list store this way is much
+ * cheaper than clearing it, which removes rows one by one from the start.
+ */
+void
+gst_users_model_set_model (GstUsersModel *model,
+                           GtkTreeModel  *child_model)
+{
+	GstUsersModelPrivate *priv;
+	GtkTreeIter iter;
+	gboolean valid;
+	Row *row;
+	guint pos;
+
+	g_return_if_fail (GST_IS_USERS_MODEL (model));
+	g_return_if_fail (!child_model ||
+			  gtk_tree_model_get_flags (child_model) & GTK_TREE_MODEL_ITERS_PERSIST);
+
+	priv = GST_USERS_MODEL_GET_PRIVATE (model);
+
+	/* from the end, so that the gap doesn't move */
+	for (pos = N_VISIBLE (priv); pos > 0; pos--) {
+		remove_row (priv, pos - 1);
+		emit_row_deleted (model, pos - 1);
+	}
+
+	release_child_model (model);
+
+	if (!child_model)
+		return;
+
+	priv->child_model = g_object_ref (child_model);
+
+	priv->inserted_id = g_signal_connect (child_model, "row-inserted",
+					      G_CALLBACK (on_child_row_inserted), model);
+	priv->changed_id = g_signal_connect (child_model, "row-changed",
+					     G_CALLBACK (on_child_row_changed), model);
+	priv->deleted_id = g_signal_connect (child_model, "row-deleted",
+					     G_CALLBACK (on_child_row_deleted), model);
+	priv->reordered_id = g_signal_connect (child_model, "rows-reordered",
+					       G_CALLBACK (on_child_rows_reordered), model);
+
+	valid = gtk_tree_model_get_iter_first (child_model, &iter);
+
+	while (valid) {
+		row = g_slice_new0 (Row);
+		row->child_iter = iter;
+		row->child_index = priv->rows->len;
+		row->index = -1;
+
+		g_ptr_array_add (priv->rows, row);
+		update_row (model, row);
+		valid = gtk_tree_model_iter_next (child_model, &iter);
+	}
+
+	gst_users_model_refilter (model);
+}
+
+/*
+ * Set the function deciding which rows of the child model are visible,
+ * gst_users_model_refilter() must be called when its result changes.
+ */
+void
+gst_users_model_set_visible_func (GstUsersModel                 *model,
+                                  GtkTreeModelFilterVisibleFunc  func,
+                                  gpointer                       data)
+{
+	GstUsersModelPrivate *priv;
+
+	g_return_if_fail (GST_IS_USERS_MODEL (model));
+
+	priv = GST_USERS_MODEL_GET_PRIVATE (model);
+	priv->visible_func = func;
+	priv->visible_data = data;
+}
+
+/*
+ * Set the function giving the key rows are sorted by before their logins,
+ * gst_users_model_refilter() must be called when keys change.
+ */
+void
+gst_users_model_set_sort_key_func (GstUsersModel            *model,
+                                   GstUsersModelSortKeyFunc  func,
+                                   gpointer                  data)
+{
+	GstUsersModelPrivate *priv;
+
+	g_return_if_fail (GST_IS_USERS_MODEL (model));
+
+	priv = GST_USERS_MODEL_GET_PRIVATE (model);
+	priv->sort_key_func = func;
+	priv->sort_key_data = data;
+}
+
+/*
+ * Whether rows matching the users search come first, TRUE by default.
+ * Views with their own filtering don't want the order of the users table.
+ * gst_users_model_refilter() must be called after changing it.
+ */
+void
+gst_users_model_set_search_ranked (GstUsersModel *model,
+                                   gboolean       ranked)
+{
+	g_return_if_fail (GST_IS_USERS_MODEL (model));
+
+	GST_USERS_MODEL_GET_PRIVATE (model)->search_ranked = ranked;
+}
+
+/*
+ * Update visibility and order of all rows, after the visible function,
+ * the sort keys or the search query changed. Rows that stay visible are reordered in
+ * place, so views keep their selection.
+ */
+void
+gst_users_model_refilter (GstUsersModel *model)
+{
+	GstUsersModelPrivate *priv;
+	GPtrArray *sorted;
+	GtkTreePath *path;
+	gint *new_order;
+	gboolean reordered = FALSE;
+	guint i, pos, n_kept;
+	Row *row;
+
+	g_return_if_fail (GST_IS_USERS_MODEL (model));
+
+	priv = GST_USERS_MODEL_GET_PRIVATE (model);
+	sorted = g_ptr_array_sized_new (priv->rows->len);
+
+	for (i = 0; i < priv->rows->len; i++) {
+		row = g_ptr_array_index (priv->rows, i);
+		row->visible = row_is_visible (model, row);
+
+		if (row->visible)
+			g_ptr_array_add (sorted, row);
+	}
+
+	g_ptr_array_sort (sorted, compare_rows_func);
+
+	/* remove hidden rows, from the end so that the gap only moves backwards */
+	for (pos = N_VISIBLE (priv); pos > 0; pos--) {
+		row = get_row (priv, pos - 1);
+
+		if (!row->visible) {
+			remove_row (priv, pos - 1);
+			emit_row_deleted (model, pos - 1);
+		}
+	}
+
+	/* sort rows that stayed visible */
+	n_kept = N_VISIBLE (priv);
+
+	if (n_kept > 0) {
+		new_order = g_new (gint, n_kept);
+
+		for (i = 0, pos = 0; i < sorted->len; i++) {
+			row = g_ptr_array_index (sorted, i);
+
+			if (row->index < 0)
+				continue;
+
+			new_order[pos] = index_to_pos (priv, row->index);
+			reordered |= (new_order[pos] != (gint) pos);
+			pos++;
+		}
+
+		if (reordered) {
+			move_gap (priv, n_kept);
+
+			for (i = 0, pos = 0; i < sorted->len; i++) {
+				row = g_ptr_array_index (sorted, i);
+
+				if (row->index < 0)
+					continue;
+
+				priv->visible[pos] = row;
+				row->index = pos++;
+			}
+
+			path = gtk_tree_path_new ();
+			gtk_tree_model_rows_reordered (GTK_TREE_MODEL (model), path, NULL, new_order);
+			gtk_tree_path_free (path);
+		}
+
+		g_free (new_order);
+	}
+
+	/* insert new rows, in ascending order so that the gap only moves forward */
+	for (i = 0; i < sorted->len; i++) {
+		row = g_ptr_array_index (sorted, i);
+
+		if (row->index < 0) {
+			insert_row (priv, i, row);
+			emit_row_inserted (model, row);
+		}
+	}
+
+	g_ptr_array_free (sorted, TRUE);
+}
+
+void
+gst_users_model_convert_iter_to_child_iter (GstUsersModel *model,
+                                            GtkTreeIter   *child_iter,
+                                            GtkTreeIter   *iter)
+{
+	g_return_if_fail (GST_IS_USERS_MODEL (model));
+	g_return_if_fail (iter->stamp == GST_USERS_MODEL_GET_PRIVATE (model)->stamp);
+
+	*child_iter = ((Row *) iter->user_data)->child_iter;
+}
+
+GtkTreePath *
+gst_users_model_convert_path_to_child_path (GstUsersModel *model,
+                                            GtkTreePath   *path)
+{
+	GtkTreeIter iter;
+
+	g_return_val_if_fail (GST_IS_USERS_MODEL (model), NULL);
+
+	if (!gst_users_model_get_iter (GTK_TREE_MODEL (model), &iter, path))
+		return NULL;
+
+	return gtk_tree_path_new_from_indices (((Row *) iter.user_data)->child_index, -1);
+}
+
+/*
+ * Returns: the path of the row in @model, or NULL if it is hidden.
+ */
+GtkTreePath *
+gst_users_model_convert_child_path_to_path (GstUsersModel *model,
+                                            GtkTreePath   *child_path)
+{
+	GstUsersModelPrivate *priv;
+	guint child_index;
+	Row *row;
+
+	g_return_val_if_fail (GST_IS_USERS_MODEL (model), NULL);
+
+	priv = GST_USERS_MODEL_GET_PRIVATE (model);
+	child_index = gtk_tree_path_get_indices (child_path)[0];
+
+	if (child_index >= priv->rows->len)
+		return NULL;
+
+	row = g_ptr_array_index (priv->rows, child_index);
+
+	if (row->index < 0)
+		return NULL;
+
+	return gtk_tree_path_new_from_indices (index_to_pos (priv, row->index), -1);
+}
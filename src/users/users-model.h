@@ -0,0 +1,80 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* users-model.h: this file is part of users-admin, a gnome-system-tools frontend
+ * for user administration.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __USERS_MODEL_H__
+#define __USERS_MODEL_H__
+
+#include <gtk/gtk.h>
+#include <oobs/oobs-user.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_USERS_MODEL           (gst_users_model_get_type ())
+#define GST_USERS_MODEL(obj)           (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_USERS_MODEL, GstUsersModel))
+#define GST_USERS_MODEL_CLASS(obj)     (G_TYPE_CHECK_CLASS_CAST ((obj),    GST_TYPE_USERS_MODEL, GstUsersModelClass))
+#define GST_IS_USERS_MODEL(obj)        (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_USERS_MODEL))
+#define GST_IS_USERS_MODEL_CLASS(obj)  (G_TYPE_CHECK_CLASS_TYPE ((obj),    GST_TYPE_USERS_MODEL))
+#define GST_USERS_MODEL_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj),  GST_TYPE_USERS_MODEL, GstUsersModelClass))
+
+typedef struct _GstUsersModel      GstUsersModel;
+typedef struct _GstUsersModelClass GstUsersModelClass;
+
+typedef gint64 (* GstUsersModelSortKeyFunc) (OobsUser *user,
+                                             gpointer  data);
+
+struct _GstUsersModel
+{
+	GObject parent;
+};
+
+struct _GstUsersModelClass
+{
+	GObjectClass parent_class;
+};
+
+GType          gst_users_model_get_type             (void);
+
+GtkTreeModel * gst_users_model_new                  (GtkTreeModel *child_model,
+                                                     gint          user_column);
+
+GtkTreeModel * gst_users_model_get_model            (GstUsersModel *model);
+void           gst_users_model_set_model            (GstUsersModel *model,
+                                                     GtkTreeModel  *child_model);
+
+void           gst_users_model_set_visible_func     (GstUsersModel                 *model,
+                                                     GtkTreeModelFilterVisibleFunc  func,
+                                                     gpointer                       data);
+void           gst_users_model_set_sort_key_func    (GstUsersModel            *model,
+                                                     GstUsersModelSortKeyFunc  func,
+                                                     gpointer                  data);
+void           gst_users_model_set_search_ranked    (GstUsersModel *model,
+                                                     gboolean       ranked);
+void           gst_users_model_refilter             (GstUsersModel *model);
+
+void           gst_users_model_convert_iter_to_child_iter (GstUsersModel *model,
+                                                           GtkTreeIter   *child_iter,
+                                                           GtkTreeIter   *iter);
+GtkTreePath *  gst_users_model_convert_path_to_child_path (GstUsersModel *model,
+                                                           GtkTreePath   *path);
+GtkTreePath *  gst_users_model_convert_child_path_to_path (GstUsersModel *model,
+                                                           GtkTreePath   *child_path);
+
+G_END_DECLS
+
+#endif /* __USERS_MODEL_H__ */
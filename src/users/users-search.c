@@ -0,0 +1,477 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* users-search.c: this file is part of users-admin, a gnome-system-tools frontend
+ * for user administration.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Search index over login, full name, home directory and UID of users.
+ *
+ * Each user is given a dense id, and the index maps "grams" to arrays of
+ * ids: every trigram of every field, plus the one and two characters
+ * prefixes of each word. Queries of three characters or more look up the
+ * shortest trigram posting and check candidates for substring matches;
+ * shorter queries only match word prefixes. Removed users leave stale ids
+ * behind, which are skipped since candidates are always checked, and
+ * postings are rebuilt once stale ids become too numerous.
+ */
+
+#include <config.h>
+#include "gst.h"
+
+#include <string.h>
+
+#include "users-search.h"
+
+/* Queries shorter than this only match word prefixes */
+#define TRIGRAM 3
+
+/* Rebuild postings when stale ids are more than this and half of all ids */
+#define MIN_STALE 1024
+
+#define WORD_SEPARATORS " /._-,"
+
+enum {
+	FIELD_LOGIN,
+	FIELD_NAME,
+	FIELD_HOME,
+	FIELD_UID,
+	N_FIELDS
+};
+
+typedef struct {
+	OobsUser *user;
+	gchar    *fields[N_FIELDS];  /* case folded */
+} SearchEntry;
+
+static GPtrArray  *entries = NULL;    /* id -> SearchEntry, NULL for free ids */
+static GArray     *free_ids = NULL;
+static GHashTable *user_ids = NULL;   /* OobsUser -> id + 1 */
+static GHashTable *postings = NULL;   /* gram -> GArray of ids */
+static guint       n_postings = 0;
+static guint       n_stale = 0;
+
+static gchar      *query = NULL;      /* case folded */
+static GHashTable *results = NULL;    /* OobsUser -> rank + 1 */
+
+
+static void
+ensure_index (void)
+{
+	if (entries)
+		return;
+
+	entries = g_ptr_array_new ();
+	free_ids = g_array_new (FALSE, FALSE, sizeof (guint));
+	user_ids = g_hash_table_new (g_direct_hash, g_direct_equal);
+	postings = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+	                                  NULL, (GDestroyNotify) g_array_unref);
+	results = g_hash_table_new (g_direct_hash, g_direct_equal);
+}
+
+/* Pack up to 3 bytes and the length in a non-zero integer */
+static guint
+gram_key (const gchar *str,
+          guint        len)
+{
+	guint key = len;
+	guint i;
+
+	for (i = 0; i < len; i++)
+		key = (key << 8) | (guchar) str[i];
+
+	return key;
+}
+
+static gboolean
+is_word_start (const gchar *str,
+               const gchar *p)
+{
+	return (p == str || strchr (WORD_SEPARATORS, p[-1]) != NULL);
+}
+
+/*
+ * Call @func on each gram of @entry, possibly several times for a gram.
+ */
+static void
+entry_foreach_gram (SearchEntry *entry,
+                    void (*func) (guint key, gpointer data),
+                    gpointer     data)
+{
+	const gchar *str, *p;
+	guint i, len;
+
+	for (i = 0; i < N_FIELDS; i++) {
+		str = entry->fields[i];
+		len = strlen (str);
+
+		for (p = str; *p; p++) {
+			if (p + TRIGRAM <= str + len)
+				(* func) (gram_key (p, TRIGRAM), data);
+
+			if (is_word_start (str, p)) {
+				(* func) (gram_key (p, 1), data);
+
+				if (p[1] != '\0')
+					(* func) (gram_key (p, 2), data);
+			}
+		}
+	}
+}
+
+static void
+collect_gram (guint key, gpointer data)
+{
+	g_hash_table_insert ((GHashTable *) data, GUINT_TO_POINTER (key), NULL);
+}
+
+static void
+index_entry (guint id)
+{
+	SearchEntry *entry = g_ptr_array_index (entries, id);
+	GHashTable *keys;
+	GHashTableIter iter;
+	gpointer key;
+	GArray *posting;
+
+	keys = g_hash_table_new (g_direct_hash, g_direct_equal);
+	entry_foreach_gram (entry, collect_gram, keys);
+
+	g_hash_table_iter_init (&iter, keys);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		posting = g_hash_table_lookup (postings, key);
+
+		if (!posting) {
+			posting = g_array_new (FALSE, FALSE, sizeof (guint));
+			g_hash_table_insert (postings, key, posting);
+		}
+
+		g_array_append_val (posting, id);
+		n_postings++;
+	}
+
+	g_hash_table_destroy (keys);
+}
+
+static void
+rebuild_postings (void)
+{
+	guint id;
+
+	g_hash_table_remove_all (postings);
+	n_postings = 0;
+	n_stale = 0;
+
+	for (id = 0; id < entries->len; id++) {
+		if (g_ptr_array_index (entries, id))
+			index_entry (id);
+	}
+}
+
+static gboolean
+has_word_prefix (const gchar *str,
+                 const gchar *prefix,
+                 guint        len)
+{
+	const gchar *p;
+
+	for (p = str; *p; p++) {
+		if (is_word_start (str, p) && strncmp (p, prefix, len) == 0)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+ * Rank of @entry for the current query, lower is better,
+ * or -1 if the entry doesn't match.
+ */
+static gint
+get_rank (SearchEntry *entry)
+{
+	const gchar **fields = (const gchar **) entry->fields;
+	guint len = strlen (query);
+	gboolean substring = (len >= TRIGRAM);
+
+	if (strcmp (fields[FIELD_LOGIN], query) == 0
+	    || strcmp (fields[FIELD_UID], query) == 0)
+		return 0;
+	if (g_str_has_prefix (fields[FIELD_LOGIN], query))
+		return 1;
+	if (has_word_prefix (fields[FIELD_NAME], query, len))
+		return 2;
+	if (substring && strstr (fields[FIELD_LOGIN], query))
+		return 3;
+	if (substring && strstr (fields[FIELD_NAME], query))
+		return 4;
+	if (has_word_prefix (fields[FIELD_HOME], query, len))
+		return 5;
+	if (substring && strstr (fields[FIELD_HOME], query))
+		return 6;
+	if (g_str_has_prefix (fields[FIELD_UID], query))
+		return 7;
+
+	return -1;
+}
+
+static void
+update_result (SearchEntry *entry)
+{
+	gint rank;
+
+	if (!query)
+		return;
+
+	rank = get_rank (entry);
+
+	if (rank >= 0)
+		g_hash_table_insert (results, entry->user, GINT_TO_POINTER (rank + 1));
+	else
+		g_hash_table_remove (results, entry->user);
+}
+
+static void
+free_entry (SearchEntry *entry)
+{
+	guint i;
+
+	for (i = 0; i < N_FIELDS; i++)
+		g_free (entry->fields[i]);
+
+	g_object_unref (entry->user);
+	g_slice_free (SearchEntry, entry);
+}
+
+void
+users_search_clear (void)
+{
+	guint id;
+
+	ensure_index ();
+
+	for (id = 0; id < entries->len; id++) {
+		if (g_ptr_array_index (entries, id))
+			free_entry (g_ptr_array_index (entries, id));
+	}
+
+	g_ptr_array_set_size (entries, 0);
+	g_array_set_size (free_ids, 0);
+	g_hash_table_remove_all (user_ids);
+	g_hash_table_remove_all (postings);
+	g_hash_table_remove_all (results);
+	n_postings = 0;
+	n_stale = 0;
+}
+
+static void
+count_gram (guint key, gpointer data)
+{
+	(* (guint *) data)++;
+}
+
+void
+users_search_remove_user (OobsUser *user)
+{
+	SearchEntry *entry;
+	guint id;
+
+	ensure_index ();
+
+	id = GPOINTER_TO_UINT (g_hash_table_lookup (user_ids, user));
+
+	if (id == 0)
+		return;
+
+	id--;
+	entry = g_ptr_array_index (entries, id);
+
+	/* postings are left as is, just account for them */
+	entry_foreach_gram (entry, count_gram, &n_stale);
+
+	g_hash_table_remove (results, user);
+	g_hash_table_remove (user_ids, user);
+	g_ptr_array_index (entries, id) = NULL;
+	g_array_append_val (free_ids, id);
+	free_entry (entry);
+
+	if (n_stale > MIN_STALE && n_stale > n_postings / 2)
+		rebuild_postings ();
+}
+
+/*
+ * Add @user to the index, or update it if it is already there.
+ */
+void
+users_search_update_user (OobsUser *user)
+{
+	SearchEntry *entry;
+	const gchar *name, *home;
+	guint id;
+
+	ensure_index ();
+	users_search_remove_user (user);
+
+	entry = g_slice_new (SearchEntry);
+	entry->user = g_object_ref (user);
+
+	name = oobs_user_get_full_name (user);
+	home = oobs_user_get_home_directory (user);
+
+	entry->fields[FIELD_LOGIN] = g_utf8_casefold (oobs_user_get_login_name (user), -1);
+	entry->fields[FIELD_NAME] = g_utf8_casefold (name ? name : "", -1);
+	entry->fields[FIELD_HOME] = g_utf8_casefold (home ? home : "", -1);
+	entry->fields[FIELD_UID] = g_strdup_printf ("%d", oobs_user_get_uid (user));
+
+	if (free_ids->len > 0) {
+		id = g_array_index (free_ids, guint, free_ids->len - 1);
+		g_array_set_size (free_ids, free_ids->len - 1);
+		g_ptr_array_index (entries, id) = entry;
+	}
+	else {
+		id = entries->len;
+		g_ptr_array_add (entries, entry);
+	}
+
+	g_hash_table_insert (user_ids, user, GUINT_TO_POINTER (id + 1));
+	index_entry (id);
+	update_result (entry);
+}
+
+/*
+ * Get the ids of users that may match the current query.
+ */
+static GArray *
+get_candidates (void)
+{
+	GArray *posting, *best = NULL;
+	guint len, i;
+
+	len = strlen (query);
+
+	if (len < TRIGRAM)
+		return g_hash_table_lookup (postings, GUINT_TO_POINTER (gram_key (query, len)));
+
+	/* all trigrams of the query must be present, use the rarest one */
+	for (i = 0; i + TRIGRAM <= len; i++) {
+		posting = g_hash_table_lookup (postings,
+		                               GUINT_TO_POINTER (gram_key (query + i, TRIGRAM)));
+		if (!posting)
+			return NULL;
+
+		if (!best || posting->len < best->len)
+			best = posting;
+	}
+
+	return best;
+}
+
+/*
+ * Set the text typed in the search entry, updating results.
+ */
+void
+users_search_set_query (const gchar *text)
+{
+	GHashTableIter iter;
+	GHashTable *previous;
+	gpointer user;
+	SearchEntry *entry;
+	GArray *candidates;
+	gchar *folded = NULL;
+	gboolean refine;
+	guint i, id;
+
+	ensure_index ();
+
+	if (text) {
+		folded = g_utf8_casefold (text, -1);
+		g_strstrip (folded);
+
+		if (*folded == '\0') {
+			g_free (folded);
+			folded = NULL;
+		}
+	}
+
+	/* When typing, new results are a subset of previous ones, unless we
+	 * switch from prefix matching to substring matching */
+	refine = (query && folded
+	          && g_str_has_prefix (folded, query)
+	          && (strlen (query) >= TRIGRAM || strlen (folded) < TRIGRAM));
+
+	g_free (query);
+	query = folded;
+
+	if (!query) {
+		g_hash_table_remove_all (results);
+		return;
+	}
+
+	if (refine) {
+		previous = results;
+		results = g_hash_table_new (g_direct_hash, g_direct_equal);
+		g_hash_table_iter_init (&iter, previous);
+
+		while (g_hash_table_iter_next (&iter, &user, NULL)) {
+			id = GPOINTER_TO_UINT (g_hash_table_lookup (user_ids, user)) - 1;
+			update_result (g_ptr_array_index (entries, id));
+		}
+
+		g_hash_table_destroy (previous);
+
+		return;
+	}
+
+	g_hash_table_remove_all (results);
+	candidates = get_candidates ();
+
+	for (i = 0; candidates && i < candidates->len; i++) {
+		id = g_array_index (candidates, guint, i);
+		entry = g_ptr_array_index (entries, id);
+
+		/* stale id from a removed user */
+		if (entry)
+			update_result (entry);
+	}
+}
+
+gboolean
+users_search_has_query (void)
+{
+	return (query != NULL);
+}
+
+gboolean
+users_search_match (OobsUser *user)
+{
+	if (!query)
+		return TRUE;
+
+	return (g_hash_table_lookup (results, user) != NULL);
+}
+
+gint
+users_search_get_rank (OobsUser *user)
+{
+	gpointer rank;
+
+	if (!query)
+		return 0;
+
+	rank = g_hash_table_lookup (results, user);
+
+	return (rank) ? GPOINTER_TO_INT (rank) - 1 : G_MAXINT;
+}
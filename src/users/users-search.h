@@ -0,0 +1,34 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*- */
+/* users-search.h: this file is part of users-admin, a gnome-system-tools frontend
+ * for user administration.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __USERS_SEARCH_H
+#define __USERS_SEARCH_H
+
+#include "gst.h"
+
+void      users_search_clear         (void);
+void      users_search_update_user   (OobsUser    *user);
+void      users_search_remove_user   (OobsUser    *user);
+
+void      users_search_set_query     (const gchar *query);
+gboolean  users_search_has_query     (void);
+gboolean  users_search_match         (OobsUser    *user);
+gint      users_search_get_rank      (OobsUser    *user);
+
+#endif /* __USERS_SEARCH_H */
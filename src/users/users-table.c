@@ -24,15 +24,250 @@
 #include <config.h>
 #include "gst.h"
 #include <glib/gi18n.h>
+#include <string.h>
 
 #include "table.h"
 #include "users-table.h"
 #include "user-settings.h"
 #include "callbacks.h"
+#include "users-search.h"
+#include "users-model.h"
+#include "user-quota.h"
+#include "last-login.h"
 
 extern GstTool *tool;
 
+/* Number of rendered faces and labels kept, see get_rendered_user() */
+#define RENDER_CACHE_SIZE 256
+
+typedef struct {
+	OobsUser  *user;
+	GdkPixbuf *face;
+	gchar     *label;
+	GList     *link;
+} RenderedUser;
+
 static GtkListStore *users_model = NULL;
+static GstUsersModel *users_view_model = NULL;
+static GtkTreeViewColumn *last_login_column = NULL;
+static GtkTreeViewColumn *quota_column = NULL;
+
+/* Faces and labels are only rendered for rows being displayed,
+ * the most recently used ones are kept around */
+static GHashTable *render_cache = NULL;   /* OobsUser -> RenderedUser */
+static GQueue render_cache_lru = G_QUEUE_INIT;
+
+/* Accounts still being created by the backends, shown greyed out
+ * with a status line until users_table_finish_pending_user() */
+typedef struct {
+	GtkTreeRowReference *row;
+	gchar               *status;
+} PendingUser;
+
+static GHashTable *pending_users = NULL;  /* OobsUser -> PendingUser */
+
+static void
+free_pending_user (PendingUser *pending)
+{
+	gtk_tree_row_reference_free (pending->row);
+	g_free (pending->status);
+	g_slice_free (PendingUser, pending);
+}
+
+static PendingUser *
+lookup_pending_user (OobsUser *user)
+{
+	if (!pending_users || !user)
+		return NULL;
+
+	return g_hash_table_lookup (pending_users, user);
+}
+
+static void
+free_rendered_user (RenderedUser *rendered)
+{
+	g_queue_delete_link (&render_cache_lru, rendered->link);
+
+	if (rendered->face)
+		g_object_unref (rendered->face);
+
+	g_object_unref (rendered->user);
+	g_free (rendered->label);
+	g_slice_free (RenderedUser, rendered);
+}
+
+static RenderedUser *
+get_rendered_user (OobsUser *user)
+{
+	RenderedUser *rendered;
+
+	if (!render_cache)
+		render_cache = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+		                                      NULL, (GDestroyNotify) free_rendered_user);
+
+	rendered = g_hash_table_lookup (render_cache, user);
+
+	if (rendered) {
+		g_queue_unlink (&render_cache_lru, rendered->link);
+		g_queue_push_head_link (&render_cache_lru, rendered->link);
+		return rendered;
+	}
+
+	rendered = g_slice_new (RenderedUser);
+	rendered->user = g_object_ref (user);
+	rendered->face = user_settings_get_user_face (user, 48);
+	rendered->label = g_markup_printf_escaped ("<big><b>%s</b>\n<span color=\'dark grey\'><i>%s</i></span></big>",
+	                                           oobs_user_get_full_name_fallback (user),
+	                                           oobs_user_get_login_name (user));
+
+	g_queue_push_head (&render_cache_lru, rendered);
+	rendered->link = render_cache_lru.head;
+	g_hash_table_insert (render_cache, user, rendered);
+
+	if (render_cache_lru.length > RENDER_CACHE_SIZE) {
+		rendered = g_queue_peek_tail (&render_cache_lru);
+		g_hash_table_remove (render_cache, rendered->user);
+	}
+
+	return g_hash_table_lookup (render_cache, user);
+}
+
+static void
+user_face_cell_data_func (GtkTreeViewColumn *column,
+			  GtkCellRenderer   *renderer,
+			  GtkTreeModel      *model,
+			  GtkTreeIter       *iter,
+			  gpointer           data)
+{
+	OobsUser *user;
+
+	gtk_tree_model_get (model, iter,
+			    COL_USER_OBJECT, &user,
+			    -1);
+
+	g_object_set (renderer,
+		      "pixbuf", (user) ? get_rendered_user (user)->face : NULL,
+		      "sensitive", lookup_pending_user (user) == NULL,
+		      NULL);
+
+	if (user)
+		g_object_unref (user);
+}
+
+static void
+user_label_cell_data_func (GtkTreeViewColumn *column,
+			   GtkCellRenderer   *renderer,
+			   GtkTreeModel      *model,
+			   GtkTreeIter       *iter,
+			   gpointer           data)
+{
+	OobsUser *user;
+	PendingUser *pending;
+	gchar *markup;
+
+	gtk_tree_model_get (model, iter,
+			    COL_USER_OBJECT, &user,
+			    -1);
+
+	pending = lookup_pending_user (user);
+
+	if (pending) {
+		/* status instead of the login, not cached since it changes often */
+		markup = g_markup_printf_escaped ("<big><b>%s</b>\n<span color=\'dark grey\'><i>%s</i></span></big>",
+		                                  oobs_user_get_full_name_fallback (user),
+		                                  pending->status);
+		g_object_set (renderer, "markup", markup, "sensitive", FALSE, NULL);
+		g_free (markup);
+	}
+	else
+		g_object_set (renderer,
+			      "markup", (user) ? get_rendered_user (user)->label : NULL,
+			      "sensitive", TRUE,
+			      NULL);
+
+	if (user)
+		g_object_unref (user);
+}
+
+static void
+user_last_login_cell_data_func (GtkTreeViewColumn *column,
+				GtkCellRenderer   *renderer,
+				GtkTreeModel      *model,
+				GtkTreeIter       *iter,
+				gpointer           data)
+{
+	OobsUser *user;
+	GDate date;
+	gint64 time;
+	gchar text[64];
+
+	gtk_tree_model_get (model, iter,
+			    COL_USER_OBJECT, &user,
+			    -1);
+
+	/* empty until logins have been read */
+	text[0] = '\0';
+
+	if (user && last_login_lookup (user, &time)) {
+		if (time == 0)
+			g_strlcpy (text, _("Never"), sizeof (text));
+		else {
+			g_date_clear (&date, 1);
+			g_date_set_time_t (&date, (time_t) time);
+			g_date_strftime (text, sizeof (text), "%x", &date);
+		}
+	}
+
+	g_object_set (renderer, "text", text, NULL);
+
+	if (user)
+		g_object_unref (user);
+}
+
+/* Disk usage, with the quota limit below it, in red when exceeded */
+static void
+user_quota_cell_data_func (GtkTreeViewColumn *column,
+			   GtkCellRenderer   *renderer,
+			   GtkTreeModel      *model,
+			   GtkTreeIter       *iter,
+			   gpointer           data)
+{
+	OobsUser *user;
+	UserQuota quota;
+	guint64 limit;
+	gchar *used, *size, *max, *markup = NULL;
+
+	gtk_tree_model_get (model, iter,
+			    COL_USER_OBJECT, &user,
+			    -1);
+
+	if (user && user_quota_lookup (user, &quota)) {
+		limit = (quota.soft) ? quota.soft : quota.hard;
+		used = g_format_size_for_display (quota.used);
+
+		if (limit) {
+			size = g_format_size_for_display (limit);
+			/* TRANSLATORS: quota limit, below the disk usage of the user */
+			max = g_strdup_printf (_("of %s"), size);
+			markup = g_markup_printf_escaped ((quota.used > limit)
+			                                  ? "<span color='red'>%s</span>\n<span color='dark grey'><small>%s</small></span>"
+			                                  : "%s\n<span color='dark grey'><small>%s</small></span>",
+			                                  used, max);
+			g_free (size);
+			g_free (max);
+		}
+		else
+			markup = g_markup_escape_text (used, -1);
+
+		g_free (used);
+	}
+
+	g_object_set (renderer, "markup", markup, NULL);
+	g_free (markup);
+
+	if (user)
+		g_object_unref (user);
+}
 
 static void
 add_user_columns (GtkTreeView *treeview)
@@ -42,21 +277,25 @@ add_user_columns (GtkTreeView *treeview)
 
 	column = gtk_tree_view_column_new ();
 
+	/* all rows have the same height, so that only visible ones are rendered */
+	gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+	gtk_tree_view_column_set_expand (column, TRUE);
+
 	/* Face */
 	renderer = gtk_cell_renderer_pixbuf_new ();
 	gtk_tree_view_column_pack_start (column, renderer, FALSE);
-	gtk_tree_view_column_set_attributes (column, renderer,
-					     "pixbuf", COL_USER_FACE,
-					     NULL);
+	gtk_tree_view_column_set_cell_data_func (column, renderer,
+						 user_face_cell_data_func,
+						 NULL, NULL);
 	g_object_set (G_OBJECT (renderer),
 		      "ypad", 3,
 		      NULL);
 	/* User full name and login, on two lines */
 	renderer = gtk_cell_renderer_text_new ();
 	gtk_tree_view_column_pack_start (column, renderer, TRUE);
-	gtk_tree_view_column_set_attributes (column, renderer,
-					     "markup", COL_USER_LABEL,
-					     NULL);
+	gtk_tree_view_column_set_cell_data_func (column, renderer,
+						 user_label_cell_data_func,
+						 NULL, NULL);
 	g_object_set (G_OBJECT (renderer),
 		      "ypad", 3,
 	              "ellipsize", PANGO_ELLIPSIZE_END,
@@ -64,6 +303,105 @@ add_user_columns (GtkTreeView *treeview)
 		      NULL);
 
 	gtk_tree_view_insert_column (treeview, column, -1);
+
+	/* Last login, shown once lastlog or wtmp has been read */
+	renderer = gtk_cell_renderer_text_new ();
+	last_login_column = gtk_tree_view_column_new_with_attributes (_("Last Login"), renderer, NULL);
+	gtk_tree_view_column_set_sizing (last_login_column, GTK_TREE_VIEW_COLUMN_FIXED);
+	gtk_tree_view_column_set_fixed_width (last_login_column, 100);
+	gtk_tree_view_column_set_visible (last_login_column, FALSE);
+	gtk_tree_view_column_set_cell_data_func (last_login_column, renderer,
+						 user_last_login_cell_data_func,
+						 NULL, NULL);
+	g_object_set (G_OBJECT (renderer),
+		      "ypad", 3,
+		      "xalign", 1.0,
+		      NULL);
+
+	gtk_tree_view_insert_column (treeview, last_login_column, -1);
+
+	/* Disk usage, shown once quotas have been found, see on_user_quota_changed() */
+	renderer = gtk_cell_renderer_text_new ();
+	quota_column = gtk_tree_view_column_new_with_attributes (_("Disk Usage"), renderer, NULL);
+	gtk_tree_view_column_set_sizing (quota_column, GTK_TREE_VIEW_COLUMN_FIXED);
+	gtk_tree_view_column_set_fixed_width (quota_column, 100);
+	gtk_tree_view_column_set_visible (quota_column, FALSE);
+	gtk_tree_view_column_set_cell_data_func (quota_column, renderer,
+						 user_quota_cell_data_func,
+						 NULL, NULL);
+	g_object_set (G_OBJECT (renderer),
+		      "ypad", 3,
+		      "xalign", 1.0,
+		      NULL);
+
+	gtk_tree_view_insert_column (treeview, quota_column, -1);
+	gtk_tree_view_set_fixed_height_mode (treeview, TRUE);
+}
+
+/* Oldest logins first when asked to, so that stale accounts stand out */
+static gint64
+users_model_sort_key (OobsUser *user, gpointer data)
+{
+	GstUsersTool *tool = (GstUsersTool *) data;
+	gint64 time;
+
+	if (!tool->sortlastlogin)
+		return 0;
+
+	/* not read yet */
+	if (!last_login_lookup (user, &time))
+		return G_MAXINT64;
+
+	return time;
+}
+
+static void
+on_last_login_changed (gpointer data)
+{
+	GtkWidget *users_table = GTK_WIDGET (data);
+	GstUsersTool *users_tool = GST_USERS_TOOL (tool);
+
+	gtk_tree_view_column_set_visible (last_login_column, last_login_is_available ());
+
+	if (users_tool->sortlastlogin)
+		gst_users_model_refilter (users_view_model);
+
+	gtk_widget_queue_draw (users_table);
+}
+
+static void
+on_user_quota_changed (gpointer data)
+{
+	GtkWidget *users_table = GTK_WIDGET (data);
+
+	gtk_tree_view_column_set_visible (quota_column, user_quota_is_available ());
+	gtk_widget_queue_draw (users_table);
+}
+
+/* Type-ahead find on logins, returns FALSE when the row matches */
+static gboolean
+users_table_search_equal (GtkTreeModel *model,
+                          gint          column,
+                          const gchar  *key,
+                          GtkTreeIter  *iter,
+                          gpointer      data)
+{
+	OobsUser *user;
+	const gchar *login;
+	gboolean match;
+
+	gtk_tree_model_get (model, iter,
+			    COL_USER_OBJECT, &user,
+			    -1);
+
+	if (!user)
+		return TRUE;
+
+	login = oobs_user_get_login_name (user);
+	match = (login && g_ascii_strncasecmp (login, key, strlen (key)) == 0);
+	g_object_unref (user);
+
+	return !match;
 }
 
 static gboolean
@@ -75,64 +413,118 @@ users_model_filter (GtkTreeModel *model, GtkTreeIter *iter, gpointer data)
 	gboolean show;
 
 	gtk_tree_model_get (model, iter,
-			    COL_USER_ID, &uid,
 	                    COL_USER_OBJECT, &user,
 			    -1);
 
 	if (user == NULL)
 		return FALSE;
 
+	uid = oobs_user_get_uid (user);
+
 	show = (tool->showall
 	        || (oobs_user_is_root (user) && tool->showroot)
 	        || (uid >= tool->minimum_uid && uid <= tool->maximum_uid)
 	        || oobs_self_config_is_user_self (OOBS_SELF_CONFIG (tool->self_config), user));
+	show = show && users_search_match (user);
 
 	g_object_unref (user);
 
 	return show;
 }
 
+static void
+on_users_search_changed (GtkEntry *entry,
+                         gpointer  data)
+{
+	GtkTreeView *users_table = GTK_TREE_VIEW (data);
+
+	users_search_set_query (gtk_entry_get_text (entry));
+	gst_users_model_refilter (users_view_model);
+
+	if (gtk_tree_selection_count_selected_rows (gtk_tree_view_get_selection (users_table)) == 0)
+		users_table_select_first ();
+}
+
+static void
+on_users_search_icon_press (GtkEntry             *entry,
+                            GtkEntryIconPosition  icon_pos,
+                            GdkEvent             *event,
+                            gpointer              data)
+{
+	gtk_entry_set_text (entry, "");
+}
+
+/* Accounts being created can't be edited or deleted yet */
+static gboolean
+users_table_select_func (GtkTreeSelection *selection,
+                         GtkTreeModel     *model,
+                         GtkTreePath      *path,
+                         gboolean          path_currently_selected,
+                         gpointer          data)
+{
+	GtkTreeIter iter;
+	OobsUser *user;
+	gboolean pending;
+
+	if (path_currently_selected || !pending_users)
+		return TRUE;
+
+	if (!gtk_tree_model_get_iter (model, &iter, path))
+		return TRUE;
+
+	gtk_tree_model_get (model, &iter,
+			    COL_USER_OBJECT, &user,
+			    -1);
+
+	pending = (lookup_pending_user (user) != NULL);
+
+	if (user)
+		g_object_unref (user);
+
+	return !pending;
+}
+
+static GtkListStore *
+create_users_store (void)
+{
+	return gtk_list_store_new (COL_USER_LAST,
+				   G_TYPE_OBJECT);
+}
+
 void
 create_users_table (GstUsersTool *tool)
 {
 	GtkWidget *users_table;
 	GtkTreeSelection *selection;
-	GtkTreeModel *filter_model;
-	GtkTreeModel *sort_model;
+	GtkTreeModel *model;
 	GtkWidget *popup;
+	GtkWidget *search_entry;
 
 	users_table = gst_dialog_get_widget (GST_TOOL (tool)->main_dialog, "users_table");
+	search_entry = gst_dialog_get_widget (GST_TOOL (tool)->main_dialog, "users_search_entry");
 
-	users_model = gtk_list_store_new (COL_USER_LAST,
-				    GDK_TYPE_PIXBUF,
-	                            G_TYPE_STRING,
-	                            G_TYPE_STRING,
-	                            G_TYPE_STRING,
-	                            G_TYPE_STRING,
-				    G_TYPE_INT,
-	                            G_TYPE_BOOLEAN,
-				    G_TYPE_OBJECT,
-				    OOBS_TYPE_LIST_ITER);
-
-	/* Filter model */
-	filter_model = gtk_tree_model_filter_new (GTK_TREE_MODEL (users_model), NULL);
-	gtk_tree_model_filter_set_visible_func (GTK_TREE_MODEL_FILTER (filter_model),
-						users_model_filter, tool, NULL);
-
-	/* Sort model */
-	sort_model = gtk_tree_model_sort_new_with_model (filter_model);
-	gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (sort_model),
-	                                      COL_USER_LOGIN, GTK_SORT_ASCENDING);
-
-	gtk_tree_view_set_model (GTK_TREE_VIEW (users_table), sort_model);
+	users_model = create_users_store ();
+
+	/* Filtered and sorted view */
+	model = gst_users_model_new (GTK_TREE_MODEL (users_model), COL_USER_OBJECT);
+	users_view_model = GST_USERS_MODEL (model);
+	gst_users_model_set_visible_func (users_view_model, users_model_filter, tool);
+	gst_users_model_set_sort_key_func (users_view_model, users_model_sort_key, tool);
+
+	gtk_tree_view_set_model (GTK_TREE_VIEW (users_table), model);
 	g_object_unref (users_model);
 
 	add_user_columns (GTK_TREE_VIEW (users_table));
 	
 	selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (users_table));
 	gtk_tree_selection_set_mode (selection, GTK_SELECTION_MULTIPLE);
+	gtk_tree_selection_set_select_function (selection, users_table_select_func,
+						NULL, NULL);
 
-	gtk_tree_view_set_search_column (GTK_TREE_VIEW (users_table), COL_USER_LOGIN);
+	gtk_tree_view_set_search_column (GTK_TREE_VIEW (users_table), COL_USER_OBJECT);
+	gtk_tree_view_set_search_equal_func (GTK_TREE_VIEW (users_table),
+					     users_table_search_equal,
+					     NULL, NULL);
 
 	popup = popup_menu_create (users_table, TABLE_USERS);
 	g_object_set_data_full (G_OBJECT (users_table),
@@ -147,6 +539,17 @@ create_users_table (GstUsersTool *tool)
 			  GINT_TO_POINTER (TABLE_USERS));
 	g_signal_connect (G_OBJECT (users_table), "popup-menu",
 			  G_CALLBACK (on_table_popup_menu), NULL);
+
+	g_signal_connect (G_OBJECT (search_entry), "changed",
+			  G_CALLBACK (on_users_search_changed), users_table);
+	g_signal_connect (G_OBJECT (search_entry), "icon-press",
+			  G_CALLBACK (on_users_search_icon_press), NULL);
+
+	/* filled by last_login_refresh() and user_quota_refresh(), called when users are loaded */
+	last_login_init (OOBS_USERS_CONFIG (tool->users_config),
+			 on_last_login_changed, users_table);
+	user_quota_init (OOBS_USERS_CONFIG (tool->users_config),
+			 on_user_quota_changed, users_table);
 }
 
 GtkTreeModel *
@@ -158,30 +561,15 @@ users_table_get_model ()
 void
 users_table_set_user (OobsUser *user, GtkTreeIter *iter)
 {
-	GdkPixbuf *face;
-	const char *name;
-	const char *login;
-	char *label;
-
-	face = user_settings_get_user_face (user, 48);
-	name = oobs_user_get_full_name_fallback (user);
-	login = oobs_user_get_login_name (user);
+	/* before the row changes, so that filtering and rendering see the new data */
+	users_search_update_user (user);
 
-	label = g_markup_printf_escaped ("<big><b>%s</b>\n<span color=\'dark grey\'><i>%s</i></span></big>",
-	                                 name, login);
+	if (render_cache)
+		g_hash_table_remove (render_cache, user);
 
 	gtk_list_store_set (users_model, iter,
-			    COL_USER_FACE, face,
-			    COL_USER_NAME, name,
-			    COL_USER_LOGIN, login,
-			    COL_USER_LABEL, label,
-			    COL_USER_HOME, oobs_user_get_home_directory (user),
-			    COL_USER_ID, oobs_user_get_uid (user),
 			    COL_USER_OBJECT, user,
 			    -1);
-	g_free (label);
-	if (face)
-		g_object_unref (face);
 }
 
 /*
@@ -201,10 +589,119 @@ users_table_add_user (OobsUser *user)
 	return gtk_tree_model_get_path (GTK_TREE_MODEL (users_model), &iter);
 }
 
+/*
+ * Add a row for an account which the backends are still creating. It can't
+ * be selected, and shows @status until users_table_finish_pending_user().
+ */
+void
+users_table_add_pending_user (OobsUser    *user,
+                              const gchar *status)
+{
+	PendingUser *pending;
+	GtkTreePath *path;
+
+	if (!pending_users)
+		pending_users = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+		                                       NULL, (GDestroyNotify) free_pending_user);
+
+	/* known before the row is added, so that it is never selectable */
+	pending = g_slice_new0 (PendingUser);
+	pending->status = g_strdup (status);
+	g_hash_table_insert (pending_users, user, pending);
+
+	path = users_table_add_user (user);
+	pending->row = gtk_tree_row_reference_new (GTK_TREE_MODEL (users_model), path);
+	gtk_tree_path_free (path);
+}
+
+void
+users_table_set_pending_status (OobsUser    *user,
+                                const gchar *status)
+{
+	PendingUser *pending;
+	GtkTreePath *path;
+	GtkTreeIter iter;
+
+	pending = lookup_pending_user (user);
+
+	if (!pending || g_strcmp0 (pending->status, status) == 0)
+		return;
+
+	g_free (pending->status);
+	pending->status = g_strdup (status);
+
+	path = gtk_tree_row_reference_get_path (pending->row);
+
+	if (path && gtk_tree_model_get_iter (GTK_TREE_MODEL (users_model), &iter, path))
+		gtk_tree_model_row_changed (GTK_TREE_MODEL (users_model), path, &iter);
+
+	gtk_tree_path_free (path);
+}
+
+/*
+ * Turn the pending row of @user into a normal one if @created is TRUE,
+ * else remove it.
+ *
+ * Returns: the path to the row if kept, or NULL
+ */
+GtkTreePath *
+users_table_finish_pending_user (OobsUser *user,
+                                 gboolean  created)
+{
+	PendingUser *pending;
+	GtkTreePath *path;
+	GtkTreeIter iter;
+
+	pending = lookup_pending_user (user);
+
+	/* the table has been reloaded meanwhile */
+	if (!pending)
+		return NULL;
+
+	path = gtk_tree_row_reference_get_path (pending->row);
+	g_hash_table_remove (pending_users, user);
+
+	if (!path)
+		return NULL;
+
+	if (!gtk_tree_model_get_iter (GTK_TREE_MODEL (users_model), &iter, path)) {
+		gtk_tree_path_free (path);
+		return NULL;
+	}
+
+	if (created) {
+		users_table_set_user (user, &iter);
+		return path;
+	}
+
+	if (render_cache)
+		g_hash_table_remove (render_cache, user);
+
+	users_search_remove_user (user);
+	gtk_list_store_remove (users_model, &iter);
+	gtk_tree_path_free (path);
+
+	return NULL;
+}
+
+/*
+ * Replace the list store rather than clearing it, which would remove
+ * rows one by one.
+ */
 void
 users_table_clear (void)
 {
-        gtk_list_store_clear (users_model);
+	users_model = create_users_store ();
+	gst_users_model_set_model (users_view_model, GTK_TREE_MODEL (users_model));
+	g_object_unref (users_model);
+
+	if (render_cache)
+		g_hash_table_remove_all (render_cache);
+
+	if (pending_users)
+		g_hash_table_remove_all (pending_users);
+
+	users_search_clear ();
 }
 
 /*
@@ -215,17 +712,10 @@ users_table_get_row_references ()
 {
 	GtkWidget *users_table;
 	GtkTreeSelection *selection;
-	GtkTreeModel *model;
-	GtkTreeModel *sort_model;
-	GtkTreeModel *filter_model;
-	GtkTreePath *path, *filter_path;
+	GtkTreePath *path;
 	GList *paths, *elem, *list = NULL;
 
 	users_table = gst_dialog_get_widget (GST_TOOL (tool)->main_dialog, "users_table");
-	sort_model = gtk_tree_view_get_model (GTK_TREE_VIEW (users_table));
-	filter_model = gtk_tree_model_sort_get_model (GTK_TREE_MODEL_SORT (sort_model));
-	model = gtk_tree_model_filter_get_model (GTK_TREE_MODEL_FILTER (filter_model));
-
 	selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (users_table));
 	paths = elem = gtk_tree_selection_get_selected_rows (selection, NULL);
 
@@ -233,16 +723,10 @@ users_table_get_row_references ()
 		return NULL;
 
 	while (elem) {
-		filter_path = gtk_tree_model_sort_convert_path_to_child_path (GTK_TREE_MODEL_SORT (sort_model),
-		                                                              elem->data);
-
-		path = gtk_tree_model_filter_convert_path_to_child_path (GTK_TREE_MODEL_FILTER (filter_model),
-		                                                         filter_path);
-
-		list = g_list_prepend (list, gtk_tree_row_reference_new (model, path));
+		path = gst_users_model_convert_path_to_child_path (users_view_model, elem->data);
+		list = g_list_prepend (list, gtk_tree_row_reference_new (GTK_TREE_MODEL (users_model), path));
 
 		gtk_tree_path_free (path);
-		gtk_tree_path_free (filter_path);
 		elem = elem->next;
 	}
 
@@ -261,25 +745,19 @@ void
 users_table_select_path (GtkTreePath *path)
 {
 	GtkWidget *users_table = gst_dialog_get_widget (GST_TOOL (tool)->main_dialog, "users_table");
-	GtkTreeModel *filter_model;
-	GtkTreeModel *sort_model;
 	GtkTreeSelection *selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (users_table));
-	GtkTreePath *filter_path;
-	GtkTreePath *sort_path;
+	GtkTreePath *view_path;
 
-	sort_model = gtk_tree_view_get_model (GTK_TREE_VIEW (users_table));
-	filter_model = gtk_tree_model_sort_get_model (GTK_TREE_MODEL_SORT (sort_model));
+	view_path = gst_users_model_convert_child_path_to_path (users_view_model, path);
 
-	filter_path = gtk_tree_model_filter_convert_child_path_to_path
-		(GTK_TREE_MODEL_FILTER (filter_model), path);
-	sort_path = gtk_tree_model_sort_convert_child_path_to_path
-		(GTK_TREE_MODEL_SORT (sort_model), filter_path);
+	/* hidden by the search */
+	if (!view_path)
+		return;
 
 	gtk_tree_selection_unselect_all (selection);
-	gtk_tree_selection_select_path (selection, sort_path);
+	gtk_tree_selection_select_path (selection, view_path);
 
-	gtk_tree_path_free (filter_path);
-	gtk_tree_path_free (sort_path);
+	gtk_tree_path_free (view_path);
 }
 
 void
@@ -297,31 +775,24 @@ users_table_update_current ()
 {
 	GtkWidget *users_table = gst_dialog_get_widget (GST_TOOL (tool)->main_dialog, "users_table");
 	GtkTreeSelection *selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (users_table));
-	GtkTreeModel *sort_model;
-	GtkTreeModel *filter_model;
+	GtkTreeModel *model;
 	GList *selected;
 	GtkTreePath *path;
 	GtkTreeIter iter;
-	GtkTreeIter sort_iter;
-	GtkTreeIter filter_iter;
+	GtkTreeIter view_iter;
 	OobsUser *user;
 
-	selected = gtk_tree_selection_get_selected_rows (selection, &sort_model);
+	selected = gtk_tree_selection_get_selected_rows (selection, &model);
 	g_assert (selected != NULL);
 
 	/* Only choose the first selected user */
 	path = (GtkTreePath *) selected->data;
 
-	gtk_tree_model_get_iter (sort_model, &sort_iter, path);
+	gtk_tree_model_get_iter (model, &view_iter, path);
 	g_list_foreach (selected, (GFunc) gtk_tree_path_free, NULL);
 	g_list_free (selected);
 
-	gtk_tree_model_sort_convert_iter_to_child_iter (GTK_TREE_MODEL_SORT (sort_model),
-	                                                &filter_iter, &sort_iter);
-
-	filter_model = gtk_tree_model_sort_get_model (GTK_TREE_MODEL_SORT (sort_model));
-	gtk_tree_model_filter_convert_iter_to_child_iter (GTK_TREE_MODEL_FILTER (filter_model),
-	                                                  &iter, &filter_iter);
+	gst_users_model_convert_iter_to_child_iter (users_view_model, &iter, &view_iter);
 
 	user = users_table_get_current ();
 	users_table_set_user (user, &iter);
@@ -26,14 +26,8 @@
 
 #include "users-tool.h"
 
+/* Everything else is read from the OobsUser when rendering */
 enum {
-	COL_USER_FACE,
-	COL_USER_NAME,
-	COL_USER_LOGIN,
-	COL_USER_LABEL,
-	COL_USER_HOME,
-	COL_USER_ID,
-	COL_USER_MEMBER, /* used in group members dialog */
 	COL_USER_OBJECT,
 	COL_USER_LAST
 };
@@ -49,6 +43,13 @@ void          users_table_set_user              (OobsUser     *user,
 
 GtkTreePath  *users_table_add_user              (OobsUser     *user);
 
+void          users_table_add_pending_user      (OobsUser     *user,
+                                                const gchar  *status);
+void          users_table_set_pending_status    (OobsUser     *user,
+                                                const gchar  *status);
+GtkTreePath  *users_table_finish_pending_user   (OobsUser     *user,
+                                                gboolean      created);
+
 GList        *users_table_get_row_references    ();
 
 void          users_table_select_path           (GtkTreePath *path);
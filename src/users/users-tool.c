@@ -20,20 +20,28 @@
  */
 
 #include <glib.h>
+#include <stdlib.h>
+#include <string.h>
 #include <glib/gi18n.h>
 #include "callbacks.h"
 #include "user-profiles.h"
+#include "user-settings.h"
 #include "users-table.h"
 #include "groups-table.h"
 #include "privileges-table.h"
 #include "table.h"
 #include "users-tool.h"
+#include "login-suggest.h"
+#include "membership-index.h"
+#include "user-quota.h"
+#include "last-login.h"
 #include "gst.h"
 
 static void  gst_users_tool_class_init     (GstUsersToolClass *class);
 static void  gst_users_tool_init           (GstUsersTool      *tool);
 static void  gst_users_tool_finalize       (GObject           *object);
 static void  gst_users_tool_update_config  (GstTool *tool);
+static void  stop_loading_users            (GstUsersTool *tool);
 
 static GObject* gst_users_tool_constructor (GType                  type,
 					    guint                  n_construct_properties,
@@ -41,6 +49,12 @@ static GObject* gst_users_tool_constructor (GType                  type,
 
 G_DEFINE_TYPE (GstUsersTool, gst_users_tool, GST_TYPE_TOOL);
 
+/* Users added synchronously, enough to fill the visible part of the table */
+#define USERS_FIRST_CHUNK 64
+
+/* Time spent adding users in each idle iteration, in microseconds */
+#define USERS_CHUNK_TIME 10000
+
 static void
 gst_users_tool_class_init (GstUsersToolClass *class)
 {
@@ -62,6 +76,7 @@ on_option_changed (GSettings  *settings,
 
 	GST_USERS_TOOL (tool)->showall = g_settings_get_boolean (settings, "showall");
 	GST_USERS_TOOL (tool)->showroot = g_settings_get_boolean (settings, "showroot");
+	GST_USERS_TOOL (tool)->sortlastlogin = g_settings_get_boolean (settings, "sortlastlogin");
 
 	/* We need to reload the users table since unshown users aren't added */
 	gst_tool_update_gui (tool);
@@ -72,6 +87,7 @@ gst_users_tool_init (GstUsersTool *tool)
 {
 	tool->users_config = oobs_users_config_get ();
 	gst_tool_add_configuration_object (GST_TOOL (tool), tool->users_config, TRUE);
+	gst_tool_add_configuration_children (GST_TOOL (tool), tool->users_config, OOBS_TYPE_USER);
 
 	tool->groups_config = oobs_groups_config_get ();
 	gst_tool_add_configuration_object (GST_TOOL (tool), tool->groups_config, TRUE);
@@ -102,9 +118,12 @@ gst_users_tool_constructor (GType                  type,
 	                  (GCallback) on_option_changed, tool);
 	g_signal_connect (tool->settings, "changed::showroot",
 	                  (GCallback) on_option_changed, tool);
+	g_signal_connect (tool->settings, "changed::sortlastlogin",
+	                  (GCallback) on_option_changed, tool);
 
 	tool->showall = g_settings_get_boolean (tool->settings, "showall");
 	tool->showroot = g_settings_get_boolean (tool->settings, "showroot");
+	tool->sortlastlogin = g_settings_get_boolean (tool->settings, "sortlastlogin");
 
 	return object;
 }
@@ -114,6 +133,10 @@ gst_users_tool_finalize (GObject *object)
 {
 	GstUsersTool *tool = GST_USERS_TOOL (object);
 
+	stop_loading_users (tool);
+	last_login_shutdown ();
+	user_quota_shutdown ();
+
 	g_object_unref (tool->users_config);
 	g_object_unref (tool->self_config);
 	g_object_unref (tool->groups_config);
@@ -128,6 +151,183 @@ gst_users_tool_finalize (GObject *object)
 	(* G_OBJECT_CLASS (gst_users_tool_parent_class)->finalize) (object);
 }
 
+static void
+stop_loading_users (GstUsersTool *tool)
+{
+	if (tool->users_load_id) {
+		g_source_remove (tool->users_load_id);
+		tool->users_load_id = 0;
+	}
+
+	if (tool->users_load_queue) {
+		g_ptr_array_free (tool->users_load_queue, TRUE);
+		tool->users_load_queue = NULL;
+	}
+}
+
+typedef struct {
+	gchar    *key;
+	OobsUser *user;
+} UserSortItem;
+
+static UserSortItem *
+user_sort_item_new (OobsUser *user)
+{
+	UserSortItem *item;
+	const gchar *login;
+
+	login = oobs_user_get_login_name (user);
+
+	item = g_slice_new (UserSortItem);
+	item->key = g_utf8_collate_key ((login) ? login : "", -1);
+	item->user = user;
+
+	return item;
+}
+
+static void
+user_sort_item_free (gpointer data)
+{
+	UserSortItem *item = data;
+
+	g_object_unref (item->user);
+	g_free (item->key);
+	g_slice_free (UserSortItem, item);
+}
+
+static gint
+compare_user_sort_items (gconstpointer a,
+                         gconstpointer b)
+{
+	return strcmp ((* (UserSortItem **) a)->key, (* (UserSortItem **) b)->key);
+}
+
+/* g_get_monotonic_time() needs GLib 2.28 */
+static gint64
+get_time (void)
+{
+	GTimeVal now;
+
+	g_get_current_time (&now);
+
+	return (gint64) now.tv_sec * G_USEC_PER_SEC + now.tv_usec;
+}
+
+/*
+ * Add the next @max_users users of the loading queue to the table,
+ * stopping earlier if @end_time is reached. Returns FALSE when done.
+ */
+static gboolean
+load_users_chunk (GstUsersTool *tool,
+                  guint         max_users,
+                  gint64        end_time)
+{
+	GPtrArray *queue = tool->users_load_queue;
+	UserSortItem *item;
+	guint i;
+
+	for (i = 0; i < max_users && tool->users_load_pos < queue->len; i++) {
+		item = g_ptr_array_index (queue, tool->users_load_pos++);
+		gtk_tree_path_free (users_table_add_user (item->user));
+
+		if (end_time && (i % 16) == 15 && get_time () >= end_time)
+			break;
+	}
+
+	if (tool->users_load_pos < queue->len)
+		return TRUE;
+
+	g_ptr_array_free (queue, TRUE);
+	tool->users_load_queue = NULL;
+
+	return FALSE;
+}
+
+static gboolean
+load_users_idle (gpointer data)
+{
+	GstUsersTool *tool = GST_USERS_TOOL (data);
+
+	if (load_users_chunk (tool, G_MAXUINT, get_time () + USERS_CHUNK_TIME))
+		return TRUE;
+
+	tool->users_load_id = 0;
+
+	return FALSE;
+}
+
+/*
+ * Sort the users not loaded yet, once the first chunk has been shown.
+ */
+static gboolean
+sort_users_idle (gpointer data)
+{
+	GstUsersTool *tool = GST_USERS_TOOL (data);
+	GPtrArray *queue = tool->users_load_queue;
+
+	qsort (queue->pdata + tool->users_load_pos, queue->len - tool->users_load_pos,
+	       sizeof (gpointer), compare_user_sort_items);
+
+	tool->users_load_id = g_idle_add (load_users_idle, tool);
+
+	return FALSE;
+}
+
+/*
+ * Move the first @n users in table order to the start of @queue, sorted,
+ * so that rows are appended at the end of the table and the first chunk
+ * contains the first screenful. The rest is left unsorted.
+ */
+static void
+select_first_users (GPtrArray *queue,
+                    guint      n)
+{
+	gpointer *items = queue->pdata;
+	gpointer tmp;
+	guint left, right, store, i;
+
+	if (queue->len <= n) {
+		qsort (items, queue->len, sizeof (gpointer), compare_user_sort_items);
+		return;
+	}
+
+	left = 0;
+	right = queue->len - 1;
+
+	/* quickselect, until the n first items are the smallest ones */
+	while (left < right) {
+		tmp = items[(left + right) / 2];
+		items[(left + right) / 2] = items[right];
+		items[right] = tmp;
+
+		for (i = store = left; i < right; i++) {
+			if (compare_user_sort_items (&items[i], &items[right]) < 0) {
+				tmp = items[i];
+				items[i] = items[store];
+				items[store++] = tmp;
+			}
+		}
+
+		tmp = items[store];
+		items[store] = items[right];
+		items[right] = tmp;
+
+		if (store == n)
+			break;
+		else if (store < n)
+			left = store + 1;
+		else
+			right = store - 1;
+	}
+
+	qsort (items, n, sizeof (gpointer), compare_user_sort_items);
+}
+
+/*
+ * Fill the users table: the current user and the first ones are added at once,
+ * and the rest from an idle source so that large directories don't block the
+ * dialog. The list is copied, since it may change while we are loading.
+ */
 static void
 update_users (GstUsersTool *tool)
 {
@@ -135,29 +335,54 @@ update_users (GstUsersTool *tool)
 	OobsListIter iter;
 	OobsUser *user;
 	OobsUser *self;
+	GPtrArray *queue;
 	GtkTreePath *path;
 	gboolean valid;
 
+	stop_loading_users (tool);
 	users_table_clear ();
+	login_suggest_reset (OOBS_USERS_CONFIG (tool->users_config));
+
+	/* reloading users replaces the objects the index is keyed on */
+	membership_index_build (OOBS_GROUPS_CONFIG (tool->groups_config));
+
 	list = oobs_users_config_get_users (OOBS_USERS_CONFIG (tool->users_config));
 	self = oobs_self_config_get_user (OOBS_SELF_CONFIG (tool->self_config));
 
+	queue = g_ptr_array_new_with_free_func (user_sort_item_free);
 	valid = oobs_list_get_iter_first (list, &iter);
 
 	while (valid) {
 		user = OOBS_USER (oobs_list_get (list, &iter));
-		path = users_table_add_user (user);
-		gst_tool_add_configuration_object (GST_TOOL (tool), OOBS_OBJECT (user), FALSE);
 
-		if (self == user)
+		if (self == user) {
+			path = users_table_add_user (user);
 			users_table_select_path (path);
+			gtk_tree_path_free (path);
+			g_object_unref (user);
+		}
+		else
+			g_ptr_array_add (queue, user_sort_item_new (user));
 
-		g_object_unref (user);
-		gtk_tree_path_free (path);
 		valid = oobs_list_iter_next (list, &iter);
 	}
+
+	/* sorting all users would delay the first chunk */
+	select_first_users (queue, USERS_FIRST_CHUNK);
+	tool->users_load_queue = queue;
+	tool->users_load_pos = 0;
+
+	if (load_users_chunk (tool, USERS_FIRST_CHUNK, 0))
+		tool->users_load_id = g_idle_add (sort_users_idle, tool);
+
+	last_login_refresh ();
+	user_quota_refresh ();
 }
 
+/*
+ * Fill the groups and privileges tables. The membership index must have
+ * been rebuilt already, update_users() does it on a full reload.
+ */
 static void
 update_groups (GstUsersTool *tool)
 {
@@ -261,6 +486,9 @@ gst_users_tool_update_gui (GstTool *tool)
 	update_groups (GST_USERS_TOOL (tool));
 	update_profiles (GST_USERS_TOOL (tool));
 	update_shells (GST_USERS_TOOL (tool));
+
+	/* rows of accounts waiting to be created have been cleared */
+	user_settings_reload_creations ();
 }
 
 /*
@@ -270,7 +498,44 @@ gst_users_tool_update_gui (GstTool *tool)
 gboolean
 gst_users_tool_update_groups_async (gpointer data)
 {
-	update_groups (GST_USERS_TOOL (data));
+	GstUsersTool *tool = GST_USERS_TOOL (data);
+
+	membership_index_build (OOBS_GROUPS_CONFIG (tool->groups_config));
+	update_groups (tool);
+
+	return FALSE;
+}
+
+/*
+ * Like gst_users_tool_update_groups_async(), but only handling groups
+ * that have been added or removed instead of rebuilding all tables.
+ */
+gboolean
+gst_users_tool_sync_groups_async (gpointer data)
+{
+	GstUsersTool *tool = GST_USERS_TOOL (data);
+	GList *added = NULL, *removed = NULL, *l;
+	OobsList *list;
+
+	list = oobs_groups_config_get_groups (OOBS_GROUPS_CONFIG (tool->groups_config));
+	groups_table_sync (list, &added, &removed);
+
+	for (l = removed; l; l = l->next) {
+		gst_tool_remove_configuration_object (GST_TOOL (tool), OOBS_OBJECT (l->data));
+		membership_index_remove_group (OOBS_GROUP (l->data));
+		privileges_table_remove_group (OOBS_GROUP (l->data));
+	}
+
+	for (l = added; l; l = l->next) {
+		gst_tool_add_configuration_object (GST_TOOL (tool), OOBS_OBJECT (l->data), FALSE);
+		membership_index_add_group (OOBS_GROUP (l->data));
+		privileges_table_add_group (OOBS_GROUP (l->data));
+	}
+
+	g_list_foreach (added, (GFunc) g_object_unref, NULL);
+	g_list_foreach (removed, (GFunc) g_object_unref, NULL);
+	g_list_free (added);
+	g_list_free (removed);
 
 	return FALSE;
 }
@@ -55,6 +55,12 @@ struct _GstUsersTool {
 	GSettings *settings;
 	gboolean   showall;
 	gboolean   showroot;
+	gboolean   sortlastlogin;
+
+	/* users still to be added to the table, see update_users() */
+	GPtrArray *users_load_queue;
+	guint      users_load_pos;
+	guint      users_load_id;
 };
 
 struct _GstUsersToolClass {
@@ -68,6 +74,7 @@ GstTool *gst_users_tool_new                 (void);
 void     gst_users_tool_update_gui          (GstTool *tool);
 
 gboolean gst_users_tool_update_groups_async (gpointer data);
+gboolean gst_users_tool_sync_groups_async   (gpointer data);
 
 G_END_DECLS
 